@@ -1,15 +1,17 @@
 #pragma once
 
-extern void _mm_pause(void);
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include<intrin.h>
+#endif
 
 inline void asm_volatile_pause() {
 #if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
 	::_mm_pause();
-#elif defined(__i386__) || FOLLY_X64
+#elif defined(__i386__) || defined(__x86_64__)
 	asm volatile("pause");
-#elif FOLLY_AARCH64 || defined(__arm__)
+#elif defined(__aarch64__) || defined(__arm__)
 	asm volatile("yield");
-#elif FOLLY_PPC64
+#elif defined(__powerpc64__)
 	asm volatile("or 27,27,27");
 #endif
-}
\ No newline at end of file
+}
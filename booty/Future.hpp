@@ -0,0 +1,448 @@
+/*
+ * Future.hpp provides a lightweight one-shot Promise/Future pair, the result
+ * channel of booty::ThreadPool tasks.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_FUTURE_HPP
+#define BOOTY_FUTURE_HPP
+
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<exception>
+#include<future>
+#include<mutex>
+#include<new>
+#include<optional>
+#include<stdexcept>
+#include<type_traits>
+#include<utility>
+
+#include"Unit.h"
+
+namespace booty {
+
+	/// Thrown by Future::get() when its Promise is destroyed unfulfilled,
+	/// e.g. the task was dropped by a closing pool.
+	class BrokenPromise :public std::logic_error {
+	public:
+		BrokenPromise()
+			:std::logic_error("Promise is destroyed before being fulfilled.") {}
+	};
+
+	/// Thrown when a moved-from or already consumed Future/Promise is used.
+	class NoState :public std::logic_error {
+	public:
+		NoState()
+			:std::logic_error("Future/Promise has no shared state.") {}
+	};
+
+	namespace detail {
+
+		/// Something useful a thread can do instead of sleeping in
+		/// Future::wait(): ThreadPool installs one on each of its workers so
+		/// a task waiting for another task's result runs queued tasks in the
+		/// meantime. runOne() returns false when there was nothing to run.
+		struct WaitHelper {
+			bool(*runOne)(void* context);
+			void* context;
+		};
+
+		inline WaitHelper*& currentWaitHelper() noexcept {
+			static thread_local WaitHelper* helper = nullptr;
+			return helper;
+		}
+
+		/// Installs `helper` on the calling thread for its lifetime.
+		class ScopedWaitHelper {
+		public:
+			explicit ScopedWaitHelper(WaitHelper* helper) noexcept
+				:previous_(std::exchange(currentWaitHelper(), helper)) {}
+
+			ScopedWaitHelper(const ScopedWaitHelper&) = delete;
+			ScopedWaitHelper& operator=(const ScopedWaitHelper&) = delete;
+
+			~ScopedWaitHelper() {
+				currentWaitHelper() = previous_;
+			}
+
+		private:
+			WaitHelper* previous_;
+		};
+
+		/// BlockCache recycles fixed-size blocks through a per-thread free list,
+		/// so a thread that keeps creating and destroying objects of one size
+		/// stops hitting malloc after warm-up. Blocks freed on a thread go to
+		/// that thread's list; at most kMaxCached blocks are kept per thread
+		/// and the rest go back to the system allocator.
+		template<size_t Size, size_t Align>
+		class BlockCache {
+			static constexpr size_t kMaxCached = 1024;
+
+			struct Node {
+				Node* next;
+			};
+
+			// trivially destructible, so it is still usable while other
+			// thread_local objects are being destroyed.
+			struct FreeList {
+				Node* head;
+				size_t count;
+				bool closed;
+			};
+
+			// frees cached blocks at thread exit and stops further caching.
+			struct Reaper {
+				~Reaper() {
+					FreeList& l = list();
+					while (l.head) {
+						Node* node = l.head;
+						l.head = node->next;
+						release(node);
+					}
+					l.count = 0;
+					l.closed = true;
+				}
+			};
+
+			static FreeList& list() noexcept {
+				static thread_local FreeList l{ nullptr, 0, false };
+				return l;
+			}
+
+			static void release(void* p) noexcept {
+				if constexpr (Align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+					::operator delete(p, std::align_val_t(Align));
+				else
+					::operator delete(p);
+			}
+
+		public:
+			static_assert(Size >= sizeof(Node), "block is too small to be cached.");
+
+			static void* allocate() {
+				FreeList& l = list();
+				if (l.head) {
+					Node* node = l.head;
+					l.head = node->next;
+					--l.count;
+					return node;
+				}
+				if constexpr (Align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+					return ::operator new(Size, std::align_val_t(Align));
+				else
+					return ::operator new(Size);
+			}
+
+			static void deallocate(void* p) noexcept {
+				FreeList& l = list();
+				if (l.closed || l.count >= kMaxCached) {
+					release(p);
+					return;
+				}
+				static thread_local Reaper reaper;
+				(void)reaper;
+				l.head = new (p) Node{ l.head };
+				++l.count;
+			}
+		};
+
+		/// Shared state of one Promise/Future pair: a single pooled block
+		/// holding the value (or exception), the ready flag and the parking
+		/// spot of a blocked waiter. The waiter mutex is only touched when
+		/// somebody actually blocks.
+		template<typename T>
+		class FutureState {
+			using Value = Unit::LiftT<T>;
+
+		public:
+			static FutureState* create() {
+				return new (BlockCache<sizeof(FutureState), alignof(FutureState)>::allocate()) FutureState();
+			}
+
+			// promise and future each hold one reference.
+			void release() noexcept {
+				if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					this->~FutureState();
+					BlockCache<sizeof(FutureState), alignof(FutureState)>::deallocate(this);
+				}
+			}
+
+			template<typename... Args>
+			void setValue(Args&&... args) {
+				value_.emplace(std::forward<Args>(args)...);
+				publish();
+			}
+
+			void setException(std::exception_ptr error) {
+				error_ = std::move(error);
+				publish();
+			}
+
+			bool ready() const noexcept {
+				return ready_.load(std::memory_order_acquire);
+			}
+
+			void wait() {
+				if (ready())
+					return;
+				if (WaitHelper* helper = currentWaitHelper()) {
+					helpUntil(*helper, std::chrono::steady_clock::time_point::max());
+					return;
+				}
+				waiting_.store(true, std::memory_order_seq_cst);
+				std::unique_lock<std::mutex> lock(mtx_);
+				cond_.wait(lock, [this] { return ready(); });
+			}
+
+			template<typename Clock, typename Duration>
+			bool waitUntil(const std::chrono::time_point<Clock, Duration>& deadline) {
+				if (ready())
+					return true;
+				if (WaitHelper* helper = currentWaitHelper())
+					return helpUntil(*helper, deadline);
+				waiting_.store(true, std::memory_order_seq_cst);
+				std::unique_lock<std::mutex> lock(mtx_);
+				return cond_.wait_until(lock, deadline, [this] { return ready(); });
+			}
+
+			/* move the result out, rethrow the stored exception if any. */
+			Value takeValue() {
+				if (error_)
+					std::rethrow_exception(error_);
+				return std::move(*value_);
+			}
+
+		private:
+			FutureState() = default;
+
+			/// Run whatever `helper` offers until ready or `deadline`. When it
+			/// has nothing, sleep on our own condition for a short, growing
+			/// while: new work may show up before the result does.
+			template<typename Clock, typename Duration>
+			bool helpUntil(WaitHelper& helper, const std::chrono::time_point<Clock, Duration>& deadline) {
+				constexpr std::chrono::microseconds kMinNap{ 50 };
+				constexpr std::chrono::microseconds kMaxNap{ 1000 };
+				auto nap = kMinNap;
+				while (!ready()) {
+					if (helper.runOne(helper.context)) {
+						nap = kMinNap;
+						continue;
+					}
+					auto now = Clock::now();
+					if (now >= deadline)
+						return false;
+					waiting_.store(true, std::memory_order_seq_cst);
+					std::unique_lock<std::mutex> lock(mtx_);
+					if (deadline - now > nap)
+						cond_.wait_for(lock, nap, [this] { return ready(); });
+					else
+						cond_.wait_until(lock, deadline, [this] { return ready(); });
+					nap = std::min(nap * 2, kMaxNap);
+				}
+				return true;
+			}
+
+			void publish() {
+				// seq_cst store/load pairs with `waiting_` store/`ready_` load
+				// in wait(): either the waiter sees ready_, or we see waiting_.
+				ready_.store(true, std::memory_order_seq_cst);
+				if (waiting_.load(std::memory_order_seq_cst)) {
+					{ std::lock_guard<std::mutex> lock(mtx_); }
+					cond_.notify_all();
+				}
+			}
+
+			std::atomic<uint32_t> refs_{ 2 };
+			std::atomic<bool> ready_{ false };
+			std::atomic<bool> waiting_{ false };
+			std::exception_ptr error_;
+			std::optional<Value> value_;
+			std::mutex mtx_;
+			std::condition_variable cond_;
+		};
+
+	} // namespace detail
+
+	template<typename T>
+	class Promise;
+
+	/// Future is the consumer end: wait for and take the result once.
+	/// It is move-only and its get() consumes it, like std::future.
+	template<typename T>
+	class Future {
+		friend class Promise<T>;
+		using State = detail::FutureState<T>;
+
+	public:
+		Future() noexcept = default;
+
+		Future(Future&& other) noexcept
+			:state_(std::exchange(other.state_, nullptr)) {}
+
+		Future& operator=(Future&& other) noexcept {
+			if (this != &other) {
+				reset();
+				state_ = std::exchange(other.state_, nullptr);
+			}
+			return *this;
+		}
+
+		Future(const Future&) = delete;
+		Future& operator=(const Future&) = delete;
+
+		~Future() {
+			reset();
+		}
+
+		bool valid() const noexcept {
+			return state_ != nullptr;
+		}
+
+		/* true once the result (value or exception) is available. */
+		bool isReady() const {
+			return checkedState()->ready();
+		}
+
+		void wait() const {
+			checkedState()->wait();
+		}
+
+		template<typename Rep, typename Period>
+		std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout) const {
+			return wait_until(std::chrono::steady_clock::now() + timeout);
+		}
+
+		template<typename Clock, typename Duration>
+		std::future_status wait_until(const std::chrono::time_point<Clock, Duration>& deadline) const {
+			return checkedState()->waitUntil(deadline)
+				? std::future_status::ready : std::future_status::timeout;
+		}
+
+		/* block until ready, then take the value or rethrow the exception. */
+		T get() {
+			wait();
+			State* state = std::exchange(state_, nullptr);
+			struct Releaser {
+				State* state;
+				~Releaser() { state->release(); }
+			} releaser{ state };
+			if constexpr (std::is_void_v<T>)
+				state->takeValue();
+			else
+				return state->takeValue();
+		}
+
+	private:
+		explicit Future(State* state) noexcept
+			:state_(state) {}
+
+		State* checkedState() const {
+			if (!state_)
+				throw NoState();
+			return state_;
+		}
+
+		void reset() noexcept {
+			if (state_)
+				std::exchange(state_, nullptr)->release();
+		}
+
+		State* state_ = nullptr;
+	};
+
+	/// Promise is the producer end: fulfill it exactly once. Destroying an
+	/// unfulfilled Promise stores BrokenPromise into its Future.
+	template<typename T>
+	class Promise {
+		using State = detail::FutureState<T>;
+
+	public:
+		Promise() noexcept = default;
+
+		Promise(Promise&& other) noexcept
+			:state_(std::exchange(other.state_, nullptr)),
+			fulfilled_(other.fulfilled_) {}
+
+		Promise& operator=(Promise&& other) noexcept {
+			if (this != &other) {
+				reset();
+				state_ = std::exchange(other.state_, nullptr);
+				fulfilled_ = other.fulfilled_;
+			}
+			return *this;
+		}
+
+		Promise(const Promise&) = delete;
+		Promise& operator=(const Promise&) = delete;
+
+		~Promise() {
+			reset();
+		}
+
+		/* create a connected Promise/Future pair, one allocation at most. */
+		static std::pair<Promise, Future<T>> makeContract() {
+			State* state = State::create();
+			return { Promise(state), Future<T>(state) };
+		}
+
+		bool valid() const noexcept {
+			return state_ != nullptr;
+		}
+
+		template<typename... Args>
+		void setValue(Args&&... args) {
+			checkedState()->setValue(std::forward<Args>(args)...);
+			fulfilled_ = true;
+		}
+
+		void setException(std::exception_ptr error) {
+			checkedState()->setException(std::move(error));
+			fulfilled_ = true;
+		}
+
+		/* fulfill with the result of func(), or with whatever it throws. */
+		template<typename F>
+		void setWith(F&& func) {
+			try {
+				if constexpr (std::is_void_v<T>) {
+					std::forward<F>(func)();
+					setValue();
+				}
+				else {
+					setValue(std::forward<F>(func)());
+				}
+			}
+			catch (...) {
+				setException(std::current_exception());
+			}
+		}
+
+	private:
+		explicit Promise(State* state) noexcept
+			:state_(state) {}
+
+		State* checkedState() const {
+			if (!state_)
+				throw NoState();
+			if (fulfilled_)
+				throw std::future_error(std::future_errc::promise_already_satisfied);
+			return state_;
+		}
+
+		void reset() noexcept {
+			if (!state_)
+				return;
+			if (!fulfilled_)
+				state_->setException(std::make_exception_ptr(BrokenPromise()));
+			std::exchange(state_, nullptr)->release();
+		}
+
+		State* state_ = nullptr;
+		bool fulfilled_ = false;
+	};
+
+} // namespace booty
+
+#endif // !BOOTY_FUTURE_HPP
@@ -0,0 +1,279 @@
+/*
+ * Parallel.hpp provides data-parallel loops on top of booty::ThreadPool:
+ * parallel_for, parallel_reduce and parallel_transform.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_PARALLEL_HPP
+#define BOOTY_PARALLEL_HPP
+
+#include<algorithm>
+#include<atomic>
+#include<condition_variable>
+#include<exception>
+#include<iterator>
+#include<mutex>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"ThreadPool.hpp"
+#include"Unit.h"
+
+namespace booty {
+
+	/// All algorithms here use lazy binary splitting: a range is not cut into
+	/// chunks up front. The thread running a range works through it `grain`
+	/// elements at a time, and before every step checks whether the work it
+	/// shared earlier has been taken (ThreadPool::wantsWork()). Only then does
+	/// it give away the upper half of what is left. So ranges are split on
+	/// demand of idle workers, and a busy pool doesn't pay for splitting.
+	///
+	/// The calling thread runs the whole range itself (minus what is stolen),
+	/// then helps with queued tasks until every split-off part is finished.
+	/// It is safe to call them from inside a pool task.
+	///
+	/// `begin`/`end` are either integers, in which case the body receives the
+	/// index, or random-access iterators, in which case it receives `*it`.
+	/// The first exception thrown by a body cancels the remaining steps and
+	/// is rethrown to the caller.
+	///
+	/// `pool` is a ThreadPool or any other BasicThreadPool<QueuePolicy,
+	/// WaitPolicy>: the algorithms only use its public interface.
+
+	namespace detail {
+
+		template<typename Index>
+		inline decltype(auto) elementAt(Index begin, size_t offset) {
+			if constexpr (std::is_integral_v<Index>)
+				return static_cast<Index>(begin + offset);
+			else
+				return *(begin + offset);
+		}
+
+		template<typename Index>
+		inline size_t distanceOf(Index begin, Index end) {
+			return end > begin ? static_cast<size_t>(end - begin) : 0;
+		}
+
+		// default step: ~64 steps per worker, bounded to keep checks cheap.
+		template<class Pool>
+		inline size_t defaultGrain(const Pool& pool, size_t count) {
+			return std::clamp<size_t>(count / (pool.maxThreadCount() * 64), 1, 2048);
+		}
+
+		/// Join point of one algorithm call: counts split-off parts in flight,
+		/// records the first failure and lets the caller wait for the rest.
+		class ParallelGroup {
+		public:
+			explicit ParallelGroup(size_t grain)
+				:grain_(grain) {}
+
+			size_t grain() const noexcept {
+				return grain_;
+			}
+
+			void add() noexcept {
+				pending_.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			// under mtx_ so join() cannot return while we still touch cond_.
+			void done() {
+				std::lock_guard<std::mutex> lock(mtx_);
+				if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					cond_.notify_all();
+			}
+
+			void fail(std::exception_ptr error) {
+				std::lock_guard<std::mutex> lock(mtx_);
+				if (!error_)
+					error_ = std::move(error);
+				cancelled_.store(true, std::memory_order_relaxed);
+			}
+
+			bool cancelled() const noexcept {
+				return cancelled_.load(std::memory_order_relaxed);
+			}
+
+			/* help the pool until every part is done, then rethrow any failure. */
+			template<class Pool>
+			void join(Pool& pool) {
+				while (pending_.load(std::memory_order_acquire) > 0) {
+					if (!pool.tryRunTask()) {
+						std::unique_lock<std::mutex> lock(mtx_);
+						cond_.wait(lock, [this] {
+							return pending_.load(std::memory_order_acquire) == 0;
+						});
+					}
+				}
+				std::lock_guard<std::mutex> lock(mtx_);
+				if (error_)
+					std::rethrow_exception(error_);
+			}
+
+		private:
+			const size_t grain_;
+			std::atomic<size_t> pending_{ 0 };
+			std::atomic<bool> cancelled_{ false };
+			std::exception_ptr error_;
+			std::mutex mtx_;
+			std::condition_variable cond_;
+		};
+
+		/// Run [lo, hi) of `job`, splitting off the upper half whenever the
+		/// pool asks for work. Job provides init()/leaf()/finish().
+		template<class Pool, class Job>
+		void runRange(Pool& pool, Job& job, size_t lo, size_t hi) {
+			try {
+				const size_t start = lo;
+				const size_t grain = job.grain();
+				auto acc = job.init();
+				while (hi - lo > grain && !job.cancelled()) {
+					if (pool.wantsWork()) {
+						size_t mid = lo + (hi - lo) / 2;
+						job.add();
+						try {
+							pool.executeContinuation([&pool, &job, mid, hi] {
+								runRange(pool, job, mid, hi);
+								job.done();
+							});
+						}
+						catch (...) {
+							job.done();
+							throw;
+						}
+						hi = mid;
+					}
+					else {
+						job.leaf(acc, lo, lo + grain);
+						lo += grain;
+					}
+				}
+				if (!job.cancelled())
+					job.leaf(acc, lo, hi);
+				job.finish(start, std::move(acc));
+			}
+			catch (...) {
+				job.fail(std::current_exception());
+			}
+		}
+
+		template<typename Index, class Body>
+		class ForJob :public ParallelGroup {
+		public:
+			ForJob(Index begin, Body& body, size_t grain)
+				:ParallelGroup(grain), begin_(begin), body_(body) {}
+
+			Unit init() const noexcept {
+				return {};
+			}
+
+			void leaf(Unit&, size_t lo, size_t hi) {
+				for (size_t i = lo; i < hi; ++i)
+					body_(elementAt(begin_, i));
+			}
+
+			void finish(size_t, Unit&&) noexcept {}
+
+		private:
+			Index begin_;
+			Body& body_;
+		};
+
+		template<typename Index, typename T, class Map, class Reduce>
+		class ReduceJob :public ParallelGroup {
+		public:
+			ReduceJob(Index begin, const T& identity, Map& map, Reduce& reduce, size_t grain)
+				:ParallelGroup(grain), begin_(begin), identity_(identity), map_(map), reduce_(reduce) {}
+
+			T init() const {
+				return identity_;
+			}
+
+			void leaf(T& acc, size_t lo, size_t hi) {
+				for (size_t i = lo; i < hi; ++i)
+					acc = reduce_(std::move(acc), map_(elementAt(begin_, i)));
+			}
+
+			void finish(size_t start, T&& acc) {
+				std::lock_guard<std::mutex> lock(partials_mtx_);
+				partials_.emplace_back(start, std::move(acc));
+			}
+
+			/* fold partial results in range order, reduce needs only be associative. */
+			T result() {
+				std::sort(partials_.begin(), partials_.end(),
+					[](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+				T acc = identity_;
+				for (auto& partial : partials_)
+					acc = reduce_(std::move(acc), std::move(partial.second));
+				return acc;
+			}
+
+		private:
+			Index begin_;
+			const T& identity_;
+			Map& map_;
+			Reduce& reduce_;
+			std::mutex partials_mtx_;
+			std::vector<std::pair<size_t, T>> partials_;
+		};
+
+		struct IdentityMap {
+			template<typename U>
+			U&& operator()(U&& value) const noexcept {
+				return std::forward<U>(value);
+			}
+		};
+
+	} // namespace detail
+
+	/// body(i) (or body(*it)) for every element of [begin, end).
+	template<class Pool, typename Index, class Body>
+	void parallel_for(Pool& pool, Index begin, Index end, Body&& body, size_t grain = 0) {
+		size_t count = detail::distanceOf(begin, end);
+		if (count == 0)
+			return;
+		detail::ForJob<Index, std::remove_reference_t<Body>> job(
+			begin, body, grain ? grain : detail::defaultGrain(pool, count));
+		detail::runRange(pool, job, 0, count);
+		job.join(pool);
+	}
+
+	/// reduce(...reduce(reduce(identity, map(e0)), map(e1))..., map(eN)) where
+	/// partial results are combined in range order; `reduce` must be
+	/// associative and `identity` its neutral element.
+	template<class Pool, typename Index, typename T, class Map, class Reduce>
+	T parallel_reduce(Pool& pool, Index begin, Index end, T identity,
+		Map&& map, Reduce&& reduce, size_t grain = 0) {
+		size_t count = detail::distanceOf(begin, end);
+		if (count == 0)
+			return identity;
+		detail::ReduceJob<Index, T, std::remove_reference_t<Map>, std::remove_reference_t<Reduce>> job(
+			begin, identity, map, reduce, grain ? grain : detail::defaultGrain(pool, count));
+		detail::runRange(pool, job, 0, count);
+		job.join(pool);
+		return job.result();
+	}
+
+	/// parallel_reduce() over the elements (or indices) themselves.
+	template<class Pool, typename Index, typename T, class Reduce>
+	T parallel_reduce(Pool& pool, Index begin, Index end, T identity, Reduce&& reduce) {
+		return parallel_reduce(pool, begin, end, std::move(identity),
+			detail::IdentityMap(), std::forward<Reduce>(reduce));
+	}
+
+	/// d_first[i] = op(first[i]) for every element, both ranges random-access.
+	/// Returns the end of the written output range.
+	template<class Pool, class InputIt, class OutputIt, class UnaryOp>
+	OutputIt parallel_transform(Pool& pool, InputIt first, InputIt last,
+		OutputIt d_first, UnaryOp&& op, size_t grain = 0) {
+		size_t count = detail::distanceOf(first, last);
+		parallel_for(pool, size_t(0), count, [&](size_t i) {
+			*(d_first + i) = op(*(first + i));
+		}, grain);
+		return d_first + count;
+	}
+
+} // namespace booty
+
+#endif // !BOOTY_PARALLEL_HPP
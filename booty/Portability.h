@@ -9,6 +9,15 @@
  */
 #pragma once
 
+#include<cstddef>
+
+// C++20 coroutine support, booty/coro and ThreadPool::schedule() need it.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+#define BOOTY_HAS_COROUTINES 1
+#else
+#define BOOTY_HAS_COROUTINES 0
+#endif
+
 namespace booty {
 #ifdef NDEBUG
 	constexpr bool kIsDebug = false;
@@ -16,4 +25,8 @@ namespace booty {
 	constexpr bool kIsDebug = true;
 #endif // NDEBUG
 
+	/// Cache line size used to pad hot atomics and per-thread slots apart,
+	/// keep it a compile-time constant so it is usable in `alignas`.
+	constexpr size_t kCacheLineSize = 64;
+
 } // namespace booty
@@ -0,0 +1,310 @@
+/*
+ * SerialExecutor.hpp provides strands on top of booty::ThreadPool: items
+ * of one strand run one at a time in submission order, different strands
+ * run in parallel.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_SERIAL_EXECUTOR_HPP
+#define BOOTY_SERIAL_EXECUTOR_HPP
+
+#include<algorithm>
+#include<atomic>
+#include<cstdint>
+#include<functional>
+#include<memory>
+#include<thread>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"Asm.h"
+#include"Future.hpp"
+#include"ThreadPool.hpp"
+#include"base/Base.h"
+#include"detail/InlineTask.hpp"
+
+namespace booty {
+
+	/// SerialExecutor (a strand) runs the items submitted to it one at a time,
+	/// in submission order, on the threads of a ThreadPool (of any other
+	/// BasicThreadPool with BasicSerialExecutor). Where a job would otherwise
+	/// hold a mutex for its whole run, and park a pool thread on it, it
+	/// submits to the strand of its key instead.
+	///
+	/// Items go to a lock-free MPSC queue (Vyukov's intrusive list). Whoever
+	/// submits into an empty strand schedules a drain task on the pool; a
+	/// drain runs up to `batch` items, then re-queues itself at the back of
+	/// the pool's shared queue if more are left. So there is at most one
+	/// drain per strand, a busy strand pays one pool dispatch per batch
+	/// rather than per item, and it still yields the worker to other strands
+	/// between batches. Drains are pool continuations: a bounded pool never
+	/// refuses nor drops them, the strand's items are already accepted.
+	///
+	/// The drain hands the nodes it consumed back to the submitters through
+	/// a per-strand free list, so a strand whose backlog stays under
+	/// kMaxCachedNodes items allocates nothing in a steady state.
+	///
+	/// Exceptions escaping an execute() item are swallowed, like in
+	/// ThreadPool::execute(). If the pool rejects the drain (it is closed or
+	/// paused) the exception reaches the submitter, the items stay queued and
+	/// are drained by a later submission or by the destructor.
+	template<class Pool>
+	class BasicSerialExecutor :public NonCopyable {
+	public:
+		static constexpr size_t kDefaultBatch = 64;
+		/* consumed nodes the drain keeps for reuse, beyond those the submitters hold. */
+		static constexpr size_t kMaxCachedNodes = 256;
+
+		explicit BasicSerialExecutor(Pool& pool, size_t batch = kDefaultBatch)
+			:pool_(pool), batch_(std::max<size_t>(1, batch)), head_(&stub_), tail_(&stub_) {}
+
+		/// Wait for every queued item to run, helping the pool meanwhile.
+		~BasicSerialExecutor() {
+			while (size_.load(std::memory_order_acquire) > 0) {
+				if (stalled_.exchange(false, std::memory_order_acquire))
+					drain(SIZE_MAX);
+				else if (!pool_.tryRunTask())
+					std::this_thread::yield();
+			}
+			if (head_ != &stub_)
+				delete head_;
+			deleteChain(cache_);
+			deleteChain(free_.load(std::memory_order_acquire));
+			deleteChain(spare_);
+		}
+
+		/// run func(args...) after every item submitted before it.
+		template<class CondFunc, typename... Args>
+		void execute(CondFunc&& func, Args&&... args) {
+			push(bindTask(std::forward<CondFunc>(func), std::forward<Args>(args)...));
+		}
+
+		/// execute() with a Future of the result.
+		template<class CondFunc, typename... Args>
+		auto submitTask(CondFunc&& func, Args&&... args) {
+			using return_type = typename std::invoke_result_t<CondFunc, Args...>;
+			auto[promise, fut] = Promise<return_type>::makeContract();
+			push([promise = std::move(promise),
+				func = std::forward<CondFunc>(func),
+				args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+				promise.setWith([&]()->return_type {
+					return std::apply(func, std::move(args));
+				});
+			});
+			return std::move(fut);
+		}
+
+		/* items queued or running. */
+		size_t pending() const noexcept {
+			return size_.load(std::memory_order_relaxed);
+		}
+
+		Pool& pool() const noexcept {
+			return pool_;
+		}
+
+	private:
+		using Task = detail::InlineTask;
+
+		struct Node {
+			std::atomic<Node*> next{ nullptr };
+			Task task;
+		};
+
+		template<class CondFunc, typename... Args>
+		static Task bindTask(CondFunc&& func, Args&&... args) {
+			if constexpr (sizeof...(Args) == 0) {
+				return Task(std::forward<CondFunc>(func));
+			}
+			else {
+				return [func = std::forward<CondFunc>(func),
+					args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+					std::apply(func, std::move(args));
+				};
+			}
+		}
+
+		static void deleteChain(Node* node) noexcept {
+			while (node) {
+				Node* next = node->next.load(std::memory_order_relaxed);
+				delete node;
+				node = next;
+			}
+		}
+
+		/// A consumed node if the strand has one to spare, a new one
+		/// otherwise. A submitter that finds another one taking a node
+		/// allocates rather than waits.
+		Node* allocate() {
+			Node* node = nullptr;
+			if (!spareLocked_.load(std::memory_order_relaxed) &&
+				!spareLocked_.exchange(true, std::memory_order_acquire)) {
+				if (!spare_ && free_.load(std::memory_order_relaxed))
+					spare_ = free_.exchange(nullptr, std::memory_order_acquire);
+				node = spare_;
+				if (node)
+					spare_ = node->next.load(std::memory_order_relaxed);
+				spareLocked_.store(false, std::memory_order_release);
+			}
+			if (!node)
+				return new Node;
+			node->next.store(nullptr, std::memory_order_relaxed);
+			return node;
+		}
+
+		/// Keep a consumed node for the submitters, only called by the drain.
+		/// Nodes gather in a chain of the drain's own, handed over whole
+		/// once the submitters took the previous one; past kMaxCachedNodes
+		/// they are freed.
+		void recycle(Node* node) noexcept {
+			node->next.store(cache_, std::memory_order_relaxed);
+			if (!free_.load(std::memory_order_relaxed)) {
+				// only the drain stores a non-null free_, submitters take it whole.
+				free_.store(node, std::memory_order_release);
+				cache_ = nullptr;
+				cached_ = 0;
+			}
+			else if (cached_ < kMaxCachedNodes) {
+				cache_ = node;
+				++cached_;
+			}
+			else {
+				delete node;
+			}
+		}
+
+		void push(Task&& task) {
+			Node* node = allocate();
+			node->task = std::move(task);
+			Node* prev = tail_.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+			// the submitter that finds the strand empty owns the drain.
+			if (size_.fetch_add(1, std::memory_order_acq_rel) == 0)
+				schedule();
+			else if (stalled_.load(std::memory_order_relaxed) &&
+				stalled_.exchange(false, std::memory_order_acquire))
+				schedule();
+		}
+
+		void schedule() {
+			try {
+				pool_.executeContinuation([this] { drain(batch_); });
+			}
+			catch (...) {
+				stalled_.store(true, std::memory_order_release);
+				throw;
+			}
+		}
+
+		/// Run up to `limit` items, then reschedule if more are queued. The
+		/// last access to `this` is the size_ decrement that may let the
+		/// destructor proceed.
+		void drain(size_t limit) {
+			size_t count = std::min(limit, size_.load(std::memory_order_acquire));
+			for (size_t i = 0; i < count; ++i) {
+				Task task = pop();
+				try {
+					task();
+				}
+				catch (...) {}
+			}
+			if (size_.fetch_sub(count, std::memory_order_acq_rel) == count)
+				return;
+			// not executeContinuation(): from a worker that would land on
+			// top of its own deque and run again before anything else.
+			try {
+				pool_.executeShared([this] { drain(batch_); });
+			}
+			catch (...) {
+				stalled_.store(true, std::memory_order_release);
+			}
+		}
+
+		/// Take the oldest item, only called by the drain. An item counted in
+		/// size_ may be linked a moment later than a producer ahead of it
+		/// in the list, so wait for the link (yielding, in case that
+		/// producer was preempted in between).
+		Task pop() {
+			Node* next = head_->next.load(std::memory_order_acquire);
+			for (size_t spins = 0; !next; ++spins) {
+				if (spins < 64)
+					asm_volatile_pause();
+				else
+					std::this_thread::yield();
+				next = head_->next.load(std::memory_order_acquire);
+			}
+			if (head_ != &stub_)
+				recycle(head_);  // the last producer link into it is done, as next is set.
+			head_ = next;  // `next` is the new dummy once its task is moved out.
+			return std::move(next->task);
+		}
+
+		Pool& pool_;
+		const size_t batch_;
+		// consumer side: the dummy node before the oldest item.
+		Node* head_;
+		Node stub_;
+		// consumed nodes not handed to the submitters yet.
+		Node* cache_ = nullptr;
+		size_t cached_ = 0;
+		alignas(kCacheLineSize) std::atomic<Node*> tail_;
+		std::atomic<size_t> size_{ 0 };
+		// items are queued but the pool refused their drain.
+		std::atomic<bool> stalled_{ false };
+		// consumed nodes published by the drain, taken whole into spare_.
+		std::atomic<Node*> free_{ nullptr };
+		// submitter side: nodes to reuse, under spareLocked_.
+		std::atomic<bool> spareLocked_{ false };
+		Node* spare_ = nullptr;
+	};
+
+	using SerialExecutor = BasicSerialExecutor<ThreadPool>;
+
+	/// KeyedSerialExecutor hashes keys onto a fixed set of strands: items of
+	/// one key run in order, items of different keys usually in parallel.
+	/// Keys sharing a strand are serialized with each other, so use several
+	/// times more strands than pool threads.
+	template<typename Key, typename Hash = std::hash<Key>, class Pool = ThreadPool>
+	class KeyedSerialExecutor :public NonCopyable {
+	public:
+		using Strand = BasicSerialExecutor<Pool>;
+
+		/// `strands` == 0 means 4 per pool thread.
+		explicit KeyedSerialExecutor(Pool& pool, size_t strands = 0,
+			size_t batch = Strand::kDefaultBatch, Hash hash = Hash())
+			:hash_(std::move(hash)) {
+			if (strands == 0)
+				strands = 4 * pool.maxThreadCount();
+			strands_.reserve(strands);
+			for (size_t i = 0; i < strands; ++i)
+				strands_.emplace_back(std::make_unique<Strand>(pool, batch));
+		}
+
+		template<class CondFunc, typename... Args>
+		void execute(const Key& key, CondFunc&& func, Args&&... args) {
+			strandFor(key).execute(std::forward<CondFunc>(func), std::forward<Args>(args)...);
+		}
+
+		template<class CondFunc, typename... Args>
+		auto submitTask(const Key& key, CondFunc&& func, Args&&... args) {
+			return strandFor(key).submitTask(std::forward<CondFunc>(func), std::forward<Args>(args)...);
+		}
+
+		Strand& strandFor(const Key& key) {
+			// std::hash of integers is often the identity, mix before reducing.
+			uint64_t hash = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+			return *strands_[(hash >> 32) % strands_.size()];
+		}
+
+		size_t strandCount() const noexcept {
+			return strands_.size();
+		}
+
+	private:
+		Hash hash_;
+		std::vector<std::unique_ptr<Strand>> strands_;
+	};
+
+} // namespace booty
+
+#endif // !BOOTY_SERIAL_EXECUTOR_HPP
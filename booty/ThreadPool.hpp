@@ -1,169 +1,1185 @@
 #ifndef BOOTY_THREAD_POOL_H
 #define BOOTY_THREAD_POOL_H
 
+#include"Portability.h"
+
 #include<thread>
-#include<future>
-#include<condition_variable>
+#include<mutex>
 #include<vector>
 #include<tuple>
-#include<functional>
 #include<utility>
 #include<memory>
-#include<deque>
-//#include"concurrency/UnboundedLockQueue.hpp"
+#include<atomic>
+#include<chrono>
+#include<stdexcept>
+#include<algorithm>
+#include<iterator>
+#include<type_traits>
+#include<functional>
+#include<limits>
+#include<optional>
+#if BOOTY_HAS_COROUTINES
+#include<coroutine>
+#endif
+
+#include"Asm.h"
+#include"Future.hpp"
+#include"ThreadPoolStats.hpp"
+#include"ThreadPoolPolicies.hpp"
+#include"base/Topology.h"
+#include"detail/InlineTask.hpp"
+#include"detail/TaskLanes.hpp"
+#include"sync/Futex.h"
+#include"sync/Spin.h"
+#include"concurrency/WorkStealingDeque.hpp"
 
 namespace booty {
 
 	using AtomicBool = std::atomic<bool>;
 
-	class ThreadPool {
+	/// Scheduling class of a submission. HIGH tasks are taken before anything
+	/// else, LOW tasks only when nothing else is queued; plain submissions are
+	/// NORMAL.
+	enum class Priority {
+		HIGH,
+		NORMAL,
+		LOW
+	};
+
+	/// What a submission from outside the pool does when the queue is at
+	/// ThreadPoolOptions::capacity.
+	enum class OverflowPolicy {
+		BLOCK,           // wait for room, at most block_timeout, then throw QueueFull
+		REJECT,          // throw QueueFull
+		CALLER_RUNS,     // run the task on the submitting thread
+		DISCARD_OLDEST   // drop the oldest NORMAL/LOW task (never a continuation) to make room
+	};
+
+	/// Thrown by submissions refused for lack of room in a bounded pool.
+	class QueueFull :public std::runtime_error {
+	public:
+		QueueFull()
+			:std::runtime_error("ThreadPool queue is full.") {}
+	};
+
+	/// Sizing knobs of ThreadPool. The pool grows on submissions only, never
+	/// by polling, and shrinks back when workers stay idle for `keep_alive`.
+	struct ThreadPoolOptions {
+		// 0 means the pool's core threshold, larger values are capped to it.
+		size_t max_threads = 0;
+		// workers launched up front and never retired.
+		size_t min_threads = 1;
+		// a worker idle for this long retires, as long as min_threads survive.
+		std::chrono::milliseconds keep_alive{ 30000 };
+		// grow when queued tasks exceed live workers * launch_queue_depth...
+		size_t launch_queue_depth = 3;
+		// ...or when tasks have been waiting with every worker busy this long.
+		std::chrono::microseconds launch_queue_wait{ 1000 };
+		// pin worker slot i to the i-th usable cpu (see CpuTopology::cpus()),
+		// so consecutive workers fill one cache domain before the next.
+		bool pin_workers = false;
+		// with pin_workers: steal from workers of the same L3 domain first,
+		// then of the same NUMA node, and only then from anyone.
+		bool local_steal = false;
+		// a worker blocked in Future::wait()/get() runs queued tasks of this
+		// pool until the result is ready, instead of sleeping. Off by default:
+		// the tasks run on the waiter's stack, under any lock it holds.
+		// waitFor() helps either way.
+		bool cooperative_wait = false;
+		// an idle worker spins this long for new work before it parks, so
+		// a steady stream of submissions is picked up without syscalls
+		// (used by policy::FutexWait and policy::SpinWait).
+		sync::WaitOptions spin = sync::WaitOptions().setSpinMax(std::chrono::microseconds(20));
+		// queued tasks allowed before submissions from outside the pool hit
+		// `overflow`, 0 means unbounded. Tasks submitted by the pool's own
+		// workers, and continuations (see executeContinuation()), are always
+		// admitted: they are how admitted work finishes, blocking or
+		// refusing them could deadlock the pool.
+		size_t capacity = 0;
+		OverflowPolicy overflow = OverflowPolicy::BLOCK;
+		// with BLOCK: give up after this long, 0 waits as long as it takes.
+		// DISCARD_OLDEST waits as long when nothing can be dropped, 100ms
+		// if 0.
+		std::chrono::milliseconds block_timeout{ 0 };
+	};
+
+	/// BasicThreadPool is a work-stealing pool whose shared queue and idle
+	/// strategy are chosen at compile time, see ThreadPoolPolicies.hpp:
+	/// QueuePolicy takes the submissions of threads outside the pool,
+	/// WaitPolicy decides how idle workers wait for them (futex parking,
+	/// a condition variable, or spinning). Both are plain members, so the
+	/// hot paths are inlined and pay nothing for the choice. Most code uses
+	/// the ThreadPool alias with the default policies.
+	template<class QueuePolicy = policy::DequeQueue, class WaitPolicy = policy::FutexWait>
+	class BasicThreadPool {
 	private:
-		static size_t core_threshold;
+		using Task = detail::InlineTask;
+		using TaskDeque = concurrency::WorkStealingDeque<Task>;
+		using Clock = std::chrono::steady_clock;
+
 		// threshold of maximum working threads == kThresholdFactor * hardware-threads
 		static constexpr float kThresholdFactor = 1.5;
-		// when num of current working threads * 3 < size of tasks, then launch new thread.
-		static constexpr size_t kLaunchNewByTaskRate = 3;
+		/// To limit number of working threads, set threshold as (1.5 * usable cpus), where
+		/// usable cpus honours the affinity mask and the cgroup CPU quota.
+		/// Computed on first use: a static data member of a class template
+		/// is initialized in no particular order with other translation
+		/// units' statics, so a pool built during static init could read 0.
+		static size_t coreThreshold() {
+			static const size_t threshold = std::max<size_t>(1, static_cast<size_t>(
+				kThresholdFactor * CpuTopology::instance().usableCpus()));
+			return threshold;
+		}
+		// upper bound of shards per priority lane.
+		static constexpr size_t kMaxLaneShards = 8;
+		// every kAgingPeriod-th dispatch of a thread scans the lanes starting
+		// from a rotating lane, so LOW (and NORMAL) work cannot starve.
+		static constexpr uint32_t kAgingPeriod = 16;
+		// DISCARD_OLDEST with nothing to drop waits this long for room when
+		// block_timeout is 0, then throws QueueFull.
+		static constexpr std::chrono::milliseconds kDiscardWait{ 100 };
+
+		// lanes in the order they are normally scanned.
+		enum Lane :size_t {
+			HIGH_LANE = 0,
+			DEADLINE_LANE,
+			NORMAL_LANE,
+			LOW_LANE,
+			kLaneCount
+		};
+
+		enum SlotState :uint32_t {
+			FREE = 0,  // no thread, or its thread has retired and may be joined
+			RUNNING = 1
+		};
+
+		/// Worker is one slot of the pool: its own deque plus the thread
+		/// draining it. All slots are created up front so the slot array is
+		/// never resized while thieves are walking it; a retired thread leaves
+		/// its slot FREE for the next launch.
+		struct alignas(kCacheLineSize) Worker {
+			BasicThreadPool* pool;
+			size_t index;
+			// xorshift state for picking steal victims.
+			uint32_t seed;
+			// tasks looked up so far, drives the aging of lanes.
+			uint32_t dispatched = 0;
+			// cpu the thread is pinned to, -1 if not pinned.
+			int cpu = -1;
+			// with local_steal: other slots ordered nearest first, tier_ends
+			// marks where each locality tier (L3, NUMA node, rest) ends.
+			std::vector<size_t> victims;
+			std::vector<size_t> tier_ends;
+			std::atomic<uint32_t> state{ FREE };
+			TaskDeque tasks;
+#if BOOTY_THREADPOOL_STATS
+			// written by this worker only.
+			detail::PoolCounters<false> stats;
+#endif
+			// only touched under launch_mtx_ or after the pool is closed.
+			std::thread thread;
+
+			Worker(BasicThreadPool* p, size_t idx)
+				:pool(p), index(idx), seed(static_cast<uint32_t>(idx * 2654435761u + 1)) {}
+
+			uint32_t nextRandom() noexcept {
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+				return seed;
+			}
+		};
+
+		// the worker running on current thread, nullptr for external threads.
+		static inline thread_local Worker* current_worker_ = nullptr;
+
+		ThreadPoolOptions options_;
 		size_t max_thread_count_;
-		// threads-manager
-		std::vector<std::thread> threads_;
-		// tasks-queue
-		std::deque<std::function<void()>> tasks_;
+		// worker slots, each one holds at most one live thread.
+		std::vector<std::unique_ptr<Worker>> workers_;
+		// tasks submitted from outside of the pool.
+		QueuePolicy injection_;
+		// priority and deadline lanes, sharded so they add no shared hot spot.
+		detail::ShardedLane<Task> high_lane_;
+		detail::ShardedLane<Task> low_lane_;
+		detail::DeadlineLane<Task> deadline_lane_;
+		// set by the first non-NORMAL submission, until then only the NORMAL
+		// lane is scanned.
+		AtomicBool lanes_used_{ false };
+		// tasks queued in any deque but not picked up yet.
+		std::atomic<size_t> pending_{ 0 };
+		// with a capacity: queued tasks like pending_, but counted before
+		// the push, so that admission can reserve room with a CAS.
+		std::atomic<size_t> occupancy_{ 0 };
+		// bumped when room frees up or the pool closes, submitters blocked on
+		// a full queue sleep on it.
+		sync::Futex<> space_{ 0 };
+		std::atomic<uint32_t> space_waiters_{ 0 };
+		// puts idle workers to sleep and wakes them up.
+		WaitPolicy wait_;
+		// launched and not yet retired workers.
+		std::atomic<size_t> live_{ 0 };
+		// first moment (ns) a submission found no idle worker, 0 if not saturated.
+		std::atomic<int64_t> saturated_since_{ 0 };
 		// for synchronization
-		std::mutex pause_mtx_;
-		std::mutex queue_mtx_;
-		std::condition_variable cond_var_;
+		std::mutex launch_mtx_;
 		AtomicBool paused_;
 		AtomicBool closed_;
+#if BOOTY_THREADPOOL_STATS
+		// tasks run by threads outside of the pool, via tryRunTask().
+		detail::PoolCounters<true> external_stats_;
+		std::atomic<uint64_t> threads_launched_{ 0 };
+		std::atomic<uint64_t> threads_retired_{ 0 };
+#endif
 	public:
-		ThreadPool()
-			: max_thread_count_(core_threshold) {
+		BasicThreadPool()
+			: BasicThreadPool(ThreadPoolOptions()) {}
+
+		explicit BasicThreadPool(const size_t& max_threads)
+			: BasicThreadPool(optionsWithMax(max_threads)) {}
+
+		explicit BasicThreadPool(const ThreadPoolOptions& options)
+			:options_(normalized(options)),
+			max_thread_count_(options_.max_threads),
+			high_lane_(laneShards(max_thread_count_)),
+			low_lane_(laneShards(max_thread_count_)),
+			deadline_lane_(laneShards(max_thread_count_)),
+			wait_(max_thread_count_, options_.spin) {
 			paused_.store(false, std::memory_order_relaxed);
 			closed_.store(false, std::memory_order_relaxed);
 
-			// pre-launch some threads.
-			for (size_t i = 0; i < max_thread_count_ / 2; ++i) {
+			workers_.reserve(max_thread_count_);
+			for (size_t i = 0; i < max_thread_count_; ++i)
+				workers_.emplace_back(std::make_unique<Worker>(this, i));
+			if (options_.pin_workers)
+				placeWorkers();
+
+			// pre-launch core threads, the rest are launched on demand.
+			for (size_t i = 0; i < options_.min_threads; ++i) {
 				launchNew();
 			}
-			// lanuch sheduler and running background.
-			std::thread scheduler = std::thread(&ThreadPool::scheduler, this);
-			scheduler.detach();
 		}
 
-		explicit ThreadPool(const size_t& max_threads)
-			:max_thread_count_((max_threads > core_threshold ? core_threshold : max_threads)) {
-			paused_.store(false, std::memory_order_relaxed);
-			closed_.store(false, std::memory_order_relaxed);
+		/// Submit func(args...) and get a Future of its result. The task, its
+		/// captured arguments and the promise are stored inline in the queue
+		/// slot when they fit, and the shared state comes from a per-thread
+		/// block cache, so a small task costs no allocation once warmed up.
+		template<class CondFunc, typename... Args>
+		inline auto submitTask(CondFunc&& func, Args&&... args) {
+			using return_type = typename std::invoke_result_t<CondFunc, Args...>;
+			checkAccepting();
 
-			// pre-launch some threads.
-			for (size_t i = 0; i < max_thread_count_ / 2; ++i) {
-				launchNew();
-			}
-			// lanuch sheduler and running background.
-			std::thread scheduler = std::thread(&ThreadPool::scheduler, this);
-			scheduler.detach();
+			auto[promise, fut] = Promise<return_type>::makeContract();
+			enqueue(wrapPromise(std::move(promise), std::forward<CondFunc>(func), std::forward<Args>(args)...));
+			return std::move(fut);
+		}
+
+		/// submitTask() into the lane of `priority`. Workers drain HIGH first
+		/// and LOW last, but every few dispatches they look at a lower lane
+		/// first, so a saturated pool still makes progress on every lane.
+		template<class CondFunc, typename... Args>
+		inline auto submitTask(Priority priority, CondFunc&& func, Args&&... args) {
+			using return_type = typename std::invoke_result_t<CondFunc, Args...>;
+			checkAccepting();
+
+			auto[promise, fut] = Promise<return_type>::makeContract();
+			enqueue(wrapPromise(std::move(promise), std::forward<CondFunc>(func), std::forward<Args>(args)...),
+				priority);
+			return std::move(fut);
 		}
 
+		/// submitTask() with an absolute deadline. Deadline tasks rank below
+		/// HIGH and above NORMAL and run earliest-deadline-first; a missed
+		/// deadline does not cancel the task, it just makes it the most urgent.
 		template<class CondFunc, typename... Args>
-		inline decltype(auto) submitTask(CondFunc&& func, Args&&... args) {
+		inline auto submitTask(Clock::time_point deadline, CondFunc&& func, Args&&... args) {
 			using return_type = typename std::invoke_result_t<CondFunc, Args...>;
+			checkAccepting();
+
+			auto[promise, fut] = Promise<return_type>::makeContract();
+			enqueueAt(wrapPromise(std::move(promise), std::forward<CondFunc>(func), std::forward<Args>(args)...),
+				deadline);
+			return std::move(fut);
+		}
+
+		/// Fire-and-forget: run func(args...) without creating any Future.
+		/// Exceptions escaping the task are swallowed by the worker.
+		template<class CondFunc, typename... Args>
+		inline void execute(CondFunc&& func, Args&&... args) {
+			checkAccepting();
+			enqueue(bindTask(std::forward<CondFunc>(func), std::forward<Args>(args)...));
+		}
+
+		template<class CondFunc, typename... Args>
+		inline void execute(Priority priority, CondFunc&& func, Args&&... args) {
+			checkAccepting();
+			enqueue(bindTask(std::forward<CondFunc>(func), std::forward<Args>(args)...), priority);
+		}
+
+		template<class CondFunc, typename... Args>
+		inline void execute(Clock::time_point deadline, CondFunc&& func, Args&&... args) {
+			checkAccepting();
+			enqueueAt(bindTask(std::forward<CondFunc>(func), std::forward<Args>(args)...), deadline);
+		}
+
+		/// Queue a continuation of work this pool has already admitted: a
+		/// range split off a parallel loop, a graph node made ready, a
+		/// strand's drain. It goes where execute() would put it, but skips
+		/// the capacity check: it is never refused, blocked, run inline nor
+		/// dropped for lack of room, as its waiter would then hang or fail
+		/// halfway. It still throws if the pool is closed or paused.
+		template<class CondFunc, typename... Args>
+		inline void executeContinuation(CondFunc&& func, Args&&... args) {
+			checkAccepting();
+			Task task = bindTask(std::forward<CondFunc>(func), std::forward<Args>(args)...);
+			admitContinuation(task);
+			enqueueNormal(std::move(task));
+		}
+
+		/// executeContinuation() at the back of the shared injection queue,
+		/// also when called from a worker, whose own deque is LIFO. For
+		/// tasks that re-queue themselves to hand the worker over to older
+		/// work.
+		template<class CondFunc, typename... Args>
+		inline void executeShared(CondFunc&& func, Args&&... args) {
+			checkAccepting();
+			Task task = bindTask(std::forward<CondFunc>(func), std::forward<Args>(args)...);
+			admitContinuation(task);
+			stampTask(task);
+			injection_.push(std::move(task));
+			signalWork(1);
+		}
 
-			auto task = std::make_shared<std::packaged_task<return_type()>>(
-				[func = std::forward<CondFunc>(func),
-				args = std::make_tuple(std::forward<Args>(args)...)]()->return_type{
-				return std::apply(func, args);
+		/// Non-throwing submitTask(): an empty optional if the pool is closed,
+		/// paused or full. It never blocks nor runs the task inline, whatever
+		/// the overflow policy.
+		template<class CondFunc, typename... Args>
+		auto trySubmit(CondFunc&& func, Args&&... args) {
+			using return_type = typename std::invoke_result_t<CondFunc, Args...>;
+			auto[promise, fut] = Promise<return_type>::makeContract();
+			Task task = wrapPromise(std::move(promise), std::forward<CondFunc>(func), std::forward<Args>(args)...);
+			if (!tryAdmit())
+				return std::optional<Future<return_type>>();
+			enqueueNormal(std::move(task));
+			return std::optional<Future<return_type>>(std::move(fut));
+		}
+
+		/// Non-throwing execute(), false if the task was not queued.
+		template<class CondFunc, typename... Args>
+		bool tryExecute(CondFunc&& func, Args&&... args) {
+			Task task = bindTask(std::forward<CondFunc>(func), std::forward<Args>(args)...);
+			if (!tryAdmit())
+				return false;
+			enqueueNormal(std::move(task));
+			return true;
+		}
+
+		/// Submit every callable of [first, last) under a single queue lock and
+		/// wake at most as many idle workers as there are tasks. Returns the
+		/// futures in the same order.
+		template<class Iter>
+		auto submitBatch(Iter first, Iter last) {
+			using func_type = std::decay_t<decltype(*first)>;
+			using return_type = typename std::invoke_result_t<func_type&>;
+			checkAccepting();
+
+			std::vector<Future<return_type>> futures;
+			std::vector<Task> tasks;
+			if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+				typename std::iterator_traits<Iter>::iterator_category>) {
+				size_t count = static_cast<size_t>(std::distance(first, last));
+				futures.reserve(count);
+				tasks.reserve(count);
+			}
+			for (; first != last; ++first) {
+				auto[promise, fut] = Promise<return_type>::makeContract();
+				tasks.emplace_back(wrapPromise(std::move(promise), func_type(*first)));
+				futures.push_back(std::move(fut));
 			}
-			);
+			enqueueBulk(tasks);
+			return futures;
+		}
 
-			auto fut = task->get_future();
-			if (closed_.load(std::memory_order_relaxed) || paused_.load(std::memory_order_relaxed))
-				throw std::runtime_error("Do not allow executing tasks_ after closed_ or paused_.");
+		template<class Range>
+		auto submitBatch(Range&& range) {
+			return submitBatch(std::begin(range), std::end(range));
+		}
 
-			tasks_.emplace_back([task]() {  // `=` mode instead of `&` to avoid ref-dangle.
-				(*task)();
-			});
-			return fut;
+		/// Fire-and-forget version of submitBatch(), no Future is created.
+		template<class Iter>
+		void executeBatch(Iter first, Iter last) {
+			checkAccepting();
+			std::vector<Task> tasks;
+			if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+				typename std::iterator_traits<Iter>::iterator_category>) {
+				tasks.reserve(static_cast<size_t>(std::distance(first, last)));
+			}
+			for (; first != last; ++first)
+				tasks.emplace_back(*first);
+			enqueueBulk(tasks);
 		}
 
+		template<class Range>
+		void executeBatch(Range&& range) {
+			executeBatch(std::begin(range), std::end(range));
+		}
+
+#if BOOTY_HAS_COROUTINES
+		/// Awaitable which moves the awaiting coroutine onto this pool:
+		/// `co_await pool.schedule();` suspends it and queues its handle
+		/// as an ordinary (allocation-free) task, the worker picking it up
+		/// resumes the frame directly. Throws like execute() if the pool is
+		/// closed or paused. A frame still queued when the pool closes is
+		/// never resumed.
+		class ScheduleAwaiter {
+		public:
+			ScheduleAwaiter(BasicThreadPool& pool, Priority priority) noexcept
+				:pool_(pool), priority_(priority) {}
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			// the frame is a continuation: dropping it would never resume it.
+			void await_suspend(std::coroutine_handle<> awaiting) {
+				pool_.checkAccepting();
+				Task task([awaiting] { awaiting.resume(); });
+				pool_.admitContinuation(task);
+				pool_.pushLane(std::move(task), priority_);
+			}
+
+			void await_resume() const noexcept {}
+
+		private:
+			BasicThreadPool& pool_;
+			Priority priority_;
+		};
+
+		ScheduleAwaiter schedule(Priority priority = Priority::NORMAL) noexcept {
+			return ScheduleAwaiter(*this, priority);
+		}
+#endif // BOOTY_HAS_COROUTINES
+
 		void pause() {
 			paused_.store(true);
 		}
 
 		void unpause() {
 			paused_.store(false);
-			cond_var_.notify_all();
+			wait_.notifyAll();
 		}
 
 		void close() {
-			if (!closed_.load()) {
+			{
+				// no launch can start after closed_ is set under launch_mtx_.
+				std::lock_guard<std::mutex> launch_lock(launch_mtx_);
+				if (closed_.load())
+					return;
 				closed_.store(true);
-				cond_var_.notify_all();  // notify all threads to trigger `return`.
-				for (auto& thread : threads_)
-					thread.join();
 			}
+			wait_.notifyAll();  // wake all threads to trigger `return`.
+			if (options_.capacity != 0)
+				notifySpace(std::numeric_limits<int>::max());  // blocked submitters throw.
+			for (auto& worker : workers_)
+				if (worker->thread.joinable())
+					worker->thread.join();
 		}
 
 		bool isClosed() const {
 			return closed_.load();
 		}
 
-		~ThreadPool() {
+		/* number of live worker threads. */
+		size_t threadCount() const {
+			return live_.load(std::memory_order_relaxed);
+		}
+
+		/* tasks queued and not picked up yet. */
+		size_t pendingTasks() const {
+			return pending_.load(std::memory_order_relaxed);
+		}
+
+		/* upper bound of worker threads this pool may run. */
+		size_t maxThreadCount() const {
+			return max_thread_count_;
+		}
+
+		/// Run one queued task on the calling thread, false if none was found.
+		/// A thread waiting for work it has spawned calls this to lend a hand
+		/// instead of sleeping. Workers look at their own deque first.
+		bool tryRunTask() {
+			Task task;
+			Worker* self = current_worker_;
+			if (!findTask((self && self->pool == this) ? self : nullptr, task))
+				return false;
+			taskTaken();
+			runTask(task, (self && self->pool == this) ? self : nullptr);
+			return true;
+		}
+
+		/// Wait until every future is ready, running queued tasks of this pool
+		/// meanwhile (a worker's own deque first, then shared and stolen
+		/// work). Usable from workers and outside threads alike; the results
+		/// are then taken with get() as usual.
+		template<typename... Futures>
+		void waitFor(Futures&... futures) {
+			(helpUntilReady(futures), ...);
+		}
+
+		template<typename T>
+		void waitFor(std::vector<Future<T>>& futures) {
+			for (auto& future : futures)
+				helpUntilReady(future);
+		}
+
+		/// True when tasks pushed from the calling thread would sit in an empty
+		/// queue, i.e. thieves have drained what this thread shared before.
+		/// Lazy splitting algorithms use it to decide when to split work.
+		bool wantsWork() const {
+			Worker* self = current_worker_;
+			if (self && self->pool == this)
+				return self->tasks.empty();
+			return injection_.empty();
+		}
+
+		/// Aggregate the statistics counters into a snapshot. Cheap enough to
+		/// poll, but it reads every worker's counters, so not per task. With
+		/// BOOTY_THREADPOOL_STATS off it returns an empty, disabled snapshot.
+		ThreadPoolStats stats() const {
+			ThreadPoolStats snapshot;
+#if BOOTY_THREADPOOL_STATS
+			snapshot.enabled = true;
+			double ns = detail::nsPerCycle();
+			snapshot.workers.resize(workers_.size() + 1);
+			for (size_t i = 0; i < workers_.size(); ++i)
+				workers_[i]->stats.collect(snapshot, snapshot.workers[i], ns);
+			external_stats_.collect(snapshot, snapshot.workers.back(), ns);
+			snapshot.threads_launched = threads_launched_.load(std::memory_order_relaxed);
+			snapshot.threads_retired = threads_retired_.load(std::memory_order_relaxed);
+#endif
+			return snapshot;
+		}
+
+		~BasicThreadPool() {
 			close();
 		}
 
 	private:
-		void scheduler() {
-			// find new task and notify one free thread to execute.
-			while (!closed_.load(std::memory_order_relaxed)) {  // exit when close.
-				if (paused_.load(std::memory_order_relaxed)) {
-					std::unique_lock<std::mutex> pause_lock(pause_mtx_);
-					cond_var_.wait(pause_lock, [this] {
-						return !paused_.load(std::memory_order_relaxed);
-					});
+		static ThreadPoolOptions optionsWithMax(size_t max_threads) {
+			ThreadPoolOptions options;
+			options.max_threads = max_threads == 0 ? 1 : max_threads;
+			return options;
+		}
+
+		// clamp the sizing knobs, options.max_threads becomes the slot count.
+		static ThreadPoolOptions normalized(ThreadPoolOptions options) {
+			if (options.max_threads == 0 || options.max_threads > coreThreshold())
+				options.max_threads = coreThreshold();
+			if (options.min_threads > options.max_threads)
+				options.min_threads = options.max_threads;
+			if (options.launch_queue_depth == 0)
+				options.launch_queue_depth = 1;
+			// with a single cpu a spinning worker only delays whoever it waits for.
+			if (CpuTopology::instance().usableCpus() < 2)
+				options.spin.setSpinMax(std::chrono::nanoseconds::zero());
+			return options;
+		}
+
+		/// Assign slot i to cpus()[i % n] and, with local_steal, order its
+		/// steal victims by distance: same L3, same NUMA node, everyone else.
+		void placeWorkers() {
+			const auto& cpus = CpuTopology::instance().cpus();
+			auto cpuOf = [&](size_t slot) -> const CpuInfo& {
+				return cpus[slot % cpus.size()];
+			};
+			for (auto& worker : workers_) {
+				const CpuInfo& home = cpuOf(worker->index);
+				worker->cpu = home.id;
+				if (!options_.local_steal)
+					continue;
+				std::vector<size_t> tiers[3];
+				for (auto& other : workers_) {
+					if (other == worker)
+						continue;
+					const CpuInfo& cpu = cpuOf(other->index);
+					size_t tier = cpu.l3_domain == home.l3_domain ? 0
+						: cpu.numa_node == home.numa_node ? 1 : 2;
+					tiers[tier].push_back(other->index);
+				}
+				for (auto& tier : tiers) {
+					if (tier.empty())
+						continue;
+					worker->victims.insert(worker->victims.end(), tier.begin(), tier.end());
+					worker->tier_ends.push_back(worker->victims.size());
+				}
+			}
+		}
+
+		static size_t laneShards(size_t max_threads) {
+			return std::clamp<size_t>(max_threads, 1, kMaxLaneShards);
+		}
+
+		void checkAccepting() const {
+			if (closed_.load(std::memory_order_relaxed) || paused_.load(std::memory_order_relaxed))
+				throw std::runtime_error("Do not allow executing tasks_ after closed_ or paused_.");
+		}
+
+		// bind func(args...) to the promise which receives its result.
+		template<typename R, class CondFunc, typename... Args>
+		static Task wrapPromise(Promise<R>&& promise, CondFunc&& func, Args&&... args) {
+			return [promise = std::move(promise),
+				func = std::forward<CondFunc>(func),
+				args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+				promise.setWith([&]()->R {
+					return std::apply(func, std::move(args));
+				});
+			};
+		}
+
+		template<class CondFunc, typename... Args>
+		static Task bindTask(CondFunc&& func, Args&&... args) {
+			if constexpr (sizeof...(Args) == 0) {
+				return Task(std::forward<CondFunc>(func));
+			}
+			else {
+				return [func = std::forward<CondFunc>(func),
+					args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+					std::apply(func, std::move(args));
+				};
+			}
+		}
+
+		static int64_t nowNs() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				Clock::now().time_since_epoch()).count();
+		}
+
+		// lane shard of the calling thread: its worker index, or a hash of
+		// the thread id for external submitters.
+		static size_t shardHint(const Worker* self) {
+			if (self)
+				return self->index;
+			static thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+			return hint;
+		}
+
+		// remember when `task` was queued, for the queue wait histogram.
+		static void stampTask(Task& task) noexcept {
+#if BOOTY_THREADPOOL_STATS
+			task.setStamp(detail::cycleNow());
+#else
+			(void)task;
+#endif
+		}
+
+		/// Tasks submitted by a worker of this pool stay on that worker's own
+		/// deque (LIFO, cache-hot), everything else goes to the injection queue.
+		void enqueue(Task&& task) {
+			if (!admit(1)) {
+				runInline(task);
+				return;
+			}
+			enqueueNormal(std::move(task));
+		}
+
+		// push into the NORMAL lane, the task is already admitted.
+		void enqueueNormal(Task&& task) {
+			stampTask(task);
+			Worker* self = current_worker_;
+			if (self && self->pool == this)
+				self->tasks.push(std::move(task));
+			else
+				injection_.push(std::move(task));
+			signalWork(1);
+		}
+
+		void enqueue(Task&& task, Priority priority) {
+			if (!admit(1)) {
+				runInline(task);
+				return;
+			}
+			pushLane(std::move(task), priority);
+		}
+
+		// push into the lane of `priority`, the task is already admitted.
+		void pushLane(Task&& task, Priority priority) {
+			if (priority == Priority::NORMAL) {
+				enqueueNormal(std::move(task));
+				return;
+			}
+			stampTask(task);
+			Worker* self = current_worker_;
+			size_t hint = shardHint((self && self->pool == this) ? self : nullptr);
+			lanes_used_.store(true, std::memory_order_relaxed);
+			if (priority == Priority::HIGH)
+				high_lane_.push(hint, std::move(task));
+			else
+				low_lane_.push(hint, std::move(task));
+			signalWork(1);
+		}
+
+		void enqueueAt(Task&& task, Clock::time_point deadline) {
+			if (!admit(1)) {
+				runInline(task);
+				return;
+			}
+			stampTask(task);
+			Worker* self = current_worker_;
+			size_t hint = shardHint((self && self->pool == this) ? self : nullptr);
+			lanes_used_.store(true, std::memory_order_relaxed);
+			deadline_lane_.push(hint, std::chrono::duration_cast<std::chrono::nanoseconds>(
+				deadline.time_since_epoch()).count(), std::move(task));
+			signalWork(1);
+		}
+
+		// same as enqueue() for many tasks, the target deque is locked once.
+		void enqueueBulk(std::vector<Task>& tasks) {
+			if (tasks.empty())
+				return;
+			if (!admit(tasks.size())) {
+				for (auto& task : tasks)
+					runInline(task);
+				return;
+			}
+#if BOOTY_THREADPOOL_STATS
+			uint64_t now = detail::cycleNow();
+			for (auto& task : tasks)
+				task.setStamp(now);
+#endif
+			auto first = std::make_move_iterator(tasks.begin());
+			auto last = std::make_move_iterator(tasks.end());
+			Worker* self = current_worker_;
+			if (self && self->pool == this)
+				self->tasks.pushBulk(first, last);
+			else
+				injection_.pushBulk(first, last);
+			signalWork(tasks.size());
+		}
+
+		/// Make room for `count` tasks according to options_.overflow. False
+		/// means the caller runs them itself (CALLER_RUNS on a full queue).
+		bool admit(size_t count) {
+			if (options_.capacity == 0)
+				return true;
+			Worker* self = current_worker_;
+			if (self && self->pool == this) {
+				occupancy_.fetch_add(count, std::memory_order_relaxed);
+				return true;
+			}
+			if (tryReserve(count))
+				return true;
+			switch (options_.overflow) {
+			case OverflowPolicy::REJECT:
+				throw QueueFull();
+			case OverflowPolicy::CALLER_RUNS:
+				return false;
+			case OverflowPolicy::DISCARD_OLDEST:
+				discardUntilReserved(count);
+				return true;
+			default:
+				waitForSpace(count);
+				return true;
+			}
+		}
+
+		/// Continuations bypass admit() but take their room like any task,
+		/// so that taskTaken() gives it back; the mark keeps them out of
+		/// DISCARD_OLDEST's reach.
+		void admitContinuation(Task& task) noexcept {
+			task.markContinuation();
+			if (options_.capacity != 0)
+				occupancy_.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		/* admission of try*(): never waits, never runs inline. */
+		bool tryAdmit() {
+			if (closed_.load(std::memory_order_relaxed) || paused_.load(std::memory_order_relaxed))
+				return false;
+			if (options_.capacity == 0)
+				return true;
+			Worker* self = current_worker_;
+			if (self && self->pool == this) {
+				occupancy_.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			return tryReserve(1);
+		}
+
+		/// Reserve room for `count` tasks if it fits. A batch larger than the
+		/// whole capacity still gets into an empty queue, or it never could.
+		bool tryReserve(size_t count) {
+			size_t occupied = occupancy_.load(std::memory_order_relaxed);
+			do {
+				if (occupied != 0 && occupied + count > options_.capacity)
+					return false;
+			} while (!occupancy_.compare_exchange_weak(occupied, occupied + count,
+				std::memory_order_seq_cst, std::memory_order_relaxed));
+			return true;
+		}
+
+		/// BLOCK: sleep on space_ until `count` tasks fit. Throw QueueFull once
+		/// block_timeout has passed, and the usual error if the pool closes.
+		void waitForSpace(size_t count) {
+			auto deadline = options_.block_timeout.count() > 0
+				? Clock::now() + options_.block_timeout : Clock::time_point::max();
+			while (!tryReserve(count)) {
+				checkAccepting();
+				uint32_t epoch = space_.load(std::memory_order_acquire);
+				// seq_cst pairs with the occupancy_ decrement in taskTaken().
+				space_waiters_.fetch_add(1, std::memory_order_seq_cst);
+				sync::FutexResult result = sync::FutexResult::AWOKEN;
+				size_t occupied = occupancy_.load(std::memory_order_seq_cst);
+				if (occupied != 0 && occupied + count > options_.capacity)
+					result = space_.futexWaitUntil(epoch, deadline);
+				space_waiters_.fetch_sub(1, std::memory_order_seq_cst);
+				if (result == sync::FutexResult::TIMEDOUT) {
+					if (tryReserve(count))
+						break;
+					throw QueueFull();
 				}
+			}
+			// we were woken for one slot, pass the wakeup on if more are free.
+			if (space_waiters_.load(std::memory_order_seq_cst) > 0 &&
+				occupancy_.load(std::memory_order_relaxed) < options_.capacity) {
+				notifySpace(1);
+			}
+		}
 
-				if (threads_.size() * kLaunchNewByTaskRate < tasks_.size()) {
-					cond_var_.notify_one();
+		/// DISCARD_OLDEST: drop queued NORMAL/LOW tasks, oldest first, until
+		/// `count` fit. A dropped submitTask() leaves its future BrokenPromise.
+		/// With nothing to drop, wait for the workers to make room, at most
+		/// block_timeout (kDiscardWait if 0), then throw QueueFull; the usual
+		/// error if the pool closes or pauses meanwhile.
+		void discardUntilReserved(size_t count) {
+			Clock::time_point deadline{};
+			for (uint32_t spins = 0; !tryReserve(count);) {
+				Task victim;
+				if (takeOldest(victim)) {
+					pending_.fetch_sub(1, std::memory_order_relaxed);
+					occupancy_.fetch_sub(1, std::memory_order_seq_cst);
+					continue;
 				}
-				else {
+				// the queue is full of reservations not pushed yet, or of
+				// HIGH and deadline tasks, which are never dropped.
+				checkAccepting();
+				if (spins++ < 128) {
+					asm_volatile_pause();
+					continue;
+				}
+				auto now = Clock::now();
+				if (deadline == Clock::time_point{})
+					deadline = now + (options_.block_timeout.count() > 0 ? options_.block_timeout : kDiscardWait);
+				else if (now >= deadline)
+					throw QueueFull();
+				std::this_thread::yield();
+			}
+		}
+
+		/// Take the oldest queued NORMAL/LOW task that is not a continuation.
+		/// The continuations met on the way go back to the injection queue,
+		/// still counted as pending: they may run a little later, but run.
+		bool takeOldest(Task& task) {
+			std::vector<Task> kept;
+			auto droppable = [&kept](Task& taken) {
+				if (!taken.continuation())
+					return true;
+				kept.push_back(std::move(taken));
+				return false;
+			};
+			bool found = false;
+			while (!found && injection_.tryPop(task))
+				found = droppable(task);
+			while (!found && low_lane_.tryTake(0, task))
+				found = droppable(task);
+			for (size_t i = 0; !found && i < workers_.size(); ++i) {
+				while (!found && workers_[i]->tasks.steal(task))
+					found = droppable(task);
+			}
+			if (!kept.empty())
+				injection_.pushBulk(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()));
+			return found;
+		}
+
+		// CALLER_RUNS: the submitter runs the task, accounted as external.
+		void runInline(Task& task) {
+			stampTask(task);
+			runTask(task, nullptr);
+		}
+
+		// a queued task has been picked up, free its room.
+		void taskTaken() {
+			pending_.fetch_sub(1, std::memory_order_relaxed);
+			if (options_.capacity == 0)
+				return;
+			// seq_cst pairs with the space_waiters_ increment in waitForSpace().
+			occupancy_.fetch_sub(1, std::memory_order_seq_cst);
+			if (space_waiters_.load(std::memory_order_seq_cst) > 0)
+				notifySpace(1);
+		}
+
+		void notifySpace(int count) {
+			space_.fetch_add(1, std::memory_order_release);
+			space_.futexWake(count);
+		}
+
+		/// Publish `count` new tasks, let the wait policy wake idle workers,
+		/// and grow the pool if there are more tasks than workers to take them.
+		void signalWork(size_t count) {
+			// seq_cst pairs with the waiter registration of the wait policy,
+			// and `live_` decrement in tryRetire().
+			pending_.fetch_add(count, std::memory_order_seq_cst);
+			if (count > wait_.notify(count)) {
+				maybeGrow();
+			}
+		}
+
+		/// Every worker is busy: launch one more if the backlog is deep, or if
+		/// it has stayed saturated longer than launch_queue_wait.
+		void maybeGrow() {
+			size_t live = live_.load(std::memory_order_seq_cst);
+			if (live >= max_thread_count_)
+				return;
+			size_t pending = pending_.load(std::memory_order_relaxed);
+			if (live == 0 || pending > live * options_.launch_queue_depth) {
+				// a big batch may warrant several workers at once.
+				size_t wanted = std::max<size_t>(1, pending / options_.launch_queue_depth);
+				for (; live < wanted && live < max_thread_count_; ++live)
 					launchNew();
-					cond_var_.notify_one();
+				return;
+			}
+			int64_t now = nowNs();
+			int64_t since = saturated_since_.load(std::memory_order_relaxed);
+			if (since == 0) {
+				saturated_since_.compare_exchange_strong(since, now, std::memory_order_relaxed);
+			}
+			else if (now - since >= std::chrono::nanoseconds(options_.launch_queue_wait).count() &&
+				saturated_since_.compare_exchange_strong(since, now, std::memory_order_relaxed)) {
+				launchNew();
+			}
+		}
+
+		/// Scan the lanes HIGH, DEADLINE, NORMAL, LOW. Every kAgingPeriod-th
+		/// lookup of a thread starts from a rotating lane instead, which bounds
+		/// how long a lower lane can be starved by a stream of urgent work.
+		/// `self` is nullptr for threads outside of the pool.
+		bool findTask(Worker* self, Task& task) {
+			if (!lanes_used_.load(std::memory_order_relaxed))
+				return findNormalTask(self, task);
+			static thread_local uint32_t external_dispatched = 0;
+			uint32_t tick = self ? self->dispatched++ : external_dispatched++;
+			size_t first = (tick % kAgingPeriod == kAgingPeriod - 1)
+				? (tick / kAgingPeriod) % kLaneCount : HIGH_LANE;
+			for (size_t i = 0; i < kLaneCount; ++i) {
+				if (takeFromLane((first + i) % kLaneCount, self, task))
+					return true;
+			}
+			return false;
+		}
+
+		bool takeFromLane(size_t lane, Worker* self, Task& task) {
+			switch (lane) {
+			case HIGH_LANE:
+				return high_lane_.tryTake(shardHint(self), task);
+			case DEADLINE_LANE:
+				return deadline_lane_.tryTake(task);
+			case NORMAL_LANE:
+				return findNormalTask(self, task);
+			default:
+				return low_lane_.tryTake(shardHint(self), task);
+			}
+		}
+
+		/// own deque first (newest), then the injection queue (oldest),
+		/// finally steal the oldest task of a random victim.
+		bool findNormalTask(Worker* self, Task& task) {
+			if ((self && self->tasks.pop(task)) || injection_.tryPop(task))
+				return true;
+			if (self && !self->victims.empty())
+				return stealNearest(*self, task);
+			size_t count = workers_.size();
+			size_t start = (self ? self->nextRandom() : externalRandom()) % count;
+			for (size_t i = 0; i < count; ++i) {
+				Worker& victim = *workers_[(start + i) % count];
+				if (&victim != self && victim.tasks.steal(task)) {
+					countSteal(self);
+					return true;
 				}
 			}
+			return false;
 		}
 
-		void launchNew() {
-			if (threads_.size() < max_thread_count_) {
-				threads_.emplace_back([this] {
-					while (true) {
-						if (paused_.load(std::memory_order_relaxed)) {
-							std::unique_lock<std::mutex> pause_lock(pause_mtx_);
-							cond_var_.wait(pause_lock, [this] {
-								return !paused_.load(std::memory_order_relaxed);
-							});
-						}
-						std::function<void()> task;
-						{
-							std::unique_lock<std::mutex> lock(queue_mtx_);
-							cond_var_.wait(lock, [this] {
-								return !tasks_.empty() || closed_.load(std::memory_order_relaxed);
-							});
-							if (closed_.load(std::memory_order_relaxed)) {
-								lock.unlock();
-								return;
-							}
-							task = std::move(tasks_.front());
-							tasks_.pop_front();
-						}
-						task();  // execute task.
+		/* work to pick up, or a reason to leave the loop. */
+		bool readyToRun() const {
+			return closed_.load(std::memory_order_seq_cst) ||
+				(!paused_.load(std::memory_order_seq_cst) &&
+					pending_.load(std::memory_order_seq_cst) > 0);
+		}
+
+		/// Wait, as the wait policy does, until there is work to do.
+		/// Return false if keep_alive expired.
+		bool waitForTask(Worker& self) {
+#if BOOTY_THREADPOOL_STATS
+			uint64_t start = detail::cycleNow();
+#endif
+			saturated_since_.store(0, std::memory_order_relaxed);
+			bool woken = wait_.wait(self.index, options_.keep_alive, [this] { return readyToRun(); });
+#if BOOTY_THREADPOOL_STATS
+			self.stats.idled(detail::cyclesBetween(start, detail::cycleNow()));
+#endif
+			return woken;
+		}
+
+		// give up the slot if more than min_threads workers are alive.
+		bool tryRetire() {
+			size_t live = live_.load(std::memory_order_seq_cst);
+			while (live > options_.min_threads) {
+				if (live_.compare_exchange_weak(live, live - 1, std::memory_order_seq_cst)) {
+					// a submitter that saw the old live_ may not have launched anyone.
+					if (pending_.load(std::memory_order_seq_cst) > 0) {
+						live_.fetch_add(1, std::memory_order_seq_cst);
+						return false;
 					}
+					return true;
 				}
-				);
+			}
+			return false;
+		}
+
+		// walk the locality tiers of `self`, from a random victim within each.
+		bool stealNearest(Worker& self, Task& task) {
+			size_t begin = 0;
+			for (size_t end : self.tier_ends) {
+				size_t count = end - begin;
+				size_t start = self.nextRandom() % count;
+				for (size_t i = 0; i < count; ++i) {
+					if (workers_[self.victims[begin + (start + i) % count]]->tasks.steal(task)) {
+						countSteal(&self);
+						return true;
+					}
+				}
+				begin = end;
+			}
+			return false;
+		}
+
+		template<typename T>
+		void helpUntilReady(Future<T>& future) {
+			if (!future.valid() || future.isReady())
+				return;
+			detail::WaitHelper helper{ &BasicThreadPool::helpOnce, this };
+			detail::ScopedWaitHelper scope(&helper);
+			future.wait();
+		}
+
+		static bool helpOnce(void* pool) {
+			auto* self = static_cast<BasicThreadPool*>(pool);
+			// a task run by waitFor() waits for its own futures as it would
+			// on a worker.
+			detail::ScopedWaitHelper scope(self->options_.cooperative_wait ? detail::currentWaitHelper() : nullptr);
+			return self->tryRunTask();
+		}
+
+		// victim picking for helpers which have no Worker of their own.
+		static uint32_t externalRandom() noexcept {
+			static thread_local uint32_t seed = 0x9e3779b9u;
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			return seed;
+		}
+
+		void countSteal(Worker* self) noexcept {
+#if BOOTY_THREADPOOL_STATS
+			if (self)
+				self->stats.stolen();
+			else
+				external_stats_.stolen();
+#else
+			(void)self;
+#endif
+		}
+
+		// `self` is nullptr when a thread outside of the pool helps out.
+		void runTask(Task& task, Worker* self) {
+#if BOOTY_THREADPOOL_STATS
+			uint64_t start = detail::cycleNow();
+			uint64_t wait = detail::cyclesBetween(task.stamp(), start);
+			size_t depth = pending_.load(std::memory_order_relaxed);
+			if (self)
+				self->stats.taskStarted(wait, depth);
+			else
+				external_stats_.taskStarted(wait, depth);
+#else
+			(void)self;
+#endif
+			try {
+				task();  // execute task.
+			}
+			catch (...) {
+				// only execute()-ed tasks can throw here, they have no
+				// one to report to, and must not take the worker down.
+			}
+#if BOOTY_THREADPOOL_STATS
+			uint64_t run = detail::cyclesBetween(start, detail::cycleNow());
+			if (self)
+				self->stats.taskFinished(run);
+			else
+				external_stats_.taskFinished(run);
+#endif
+		}
+
+		void workerLoop(Worker& self) {
+			current_worker_ = &self;
+			if (self.cpu >= 0)
+				CpuTopology::pinCurrentThread(self.cpu);
+			detail::WaitHelper helper{ &BasicThreadPool::helpOnce, this };
+			detail::ScopedWaitHelper scope(options_.cooperative_wait ? &helper : detail::currentWaitHelper());
+			wait_.enter(self.index);
+			while (!closed_.load(std::memory_order_relaxed)) {
+				Task task;
+				bool found = !paused_.load(std::memory_order_relaxed) && findTask(&self, task);
+				if (found)
+					taskTaken();
+				wait_.lookedUp(self.index, found, [this] { return readyToRun(); });
+				if (found) {
+					runTask(task, &self);
+				}
+				else if (!waitForTask(self) && tryRetire()) {
+#if BOOTY_THREADPOOL_STATS
+					threads_retired_.fetch_add(1, std::memory_order_relaxed);
+#endif
+					break;
+				}
+			}
+			wait_.leave(self.index);
+			current_worker_ = nullptr;
+			self.state.store(FREE, std::memory_order_release);
+		}
+
+		// take a FREE slot and start a worker thread in it.
+		void launchNew() {
+			std::lock_guard<std::mutex> lock(launch_mtx_);
+			if (closed_.load() || live_.load() >= max_thread_count_)
+				return;
+			for (auto& slot : workers_) {
+				Worker& worker = *slot;
+				if (worker.state.load(std::memory_order_acquire) != FREE)
+					continue;
+				if (worker.thread.joinable())
+					worker.thread.join();  // retired, already on its way out.
+				worker.state.store(RUNNING, std::memory_order_relaxed);
+				live_.fetch_add(1, std::memory_order_seq_cst);
+				worker.thread = std::thread(&BasicThreadPool::workerLoop, this, std::ref(worker));
+#if BOOTY_THREADPOOL_STATS
+				threads_launched_.fetch_add(1, std::memory_order_relaxed);
+#endif
+				return;
 			}
 		}
 	};
 
-	/// To limit number of working threads, set threshold as (2 * hardware threads).
-	size_t ThreadPool::core_threshold = ThreadPool::kThresholdFactor * std::thread::hardware_concurrency();
+	/// The pool with the default policies: a work-stealing deque for external
+	/// submissions, spin-then-futex parking for idle workers.
+	using ThreadPool = BasicThreadPool<>;
 }
 
 #endif // !BOOTY_THREAD_POOL_H
@@ -0,0 +1,437 @@
+/*
+ * ThreadPoolPolicies.hpp holds the compile-time policies of
+ * booty::BasicThreadPool: the queue taking submissions from outside the
+ * pool, and the way idle workers wait for them.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_THREADPOOL_POLICIES_HPP
+#define BOOTY_THREADPOOL_POLICIES_HPP
+
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<cstdint>
+#include<iterator>
+#include<memory>
+#include<mutex>
+#include<utility>
+#include<vector>
+
+#include"Portability.h"
+#include"base/Base.h"
+#include"detail/InlineTask.hpp"
+#include"sync/Futex.h"
+#include"sync/Spin.h"
+#include"concurrency/ConcurrentQueue.hpp"
+#include"concurrency/UnboundedLockQueue.hpp"
+#include"concurrency/UnboundedQueue.hpp"
+#include"concurrency/WorkStealingDeque.hpp"
+
+namespace booty {
+
+	/// A queue policy is the queue external submissions of NORMAL priority go
+	/// to; tasks submitted by workers stay on their own work-stealing deques
+	/// whatever the policy. It provides:
+	///   void push(detail::InlineTask&&);
+	///   template<class Iter> void pushBulk(Iter first, Iter last);
+	///   bool tryPop(detail::InlineTask&);    // oldest first, never blocks
+	///   bool empty() const;                  // a hint, may be stale
+	///
+	/// A wait policy puts idle workers to sleep and wakes them up. It is
+	/// built with the number of worker slots and ThreadPoolOptions::spin,
+	/// and provides:
+	///   void enter(size_t slot);             // a worker thread starts
+	///   void leave(size_t slot);             // and exits
+	///   bool wait(size_t slot, keep_alive, ready);
+	///                                        // until ready() or keep_alive, false on timeout
+	///   void lookedUp(size_t slot, bool found, ready);
+	///                                        // after every lookup of a worker
+	///   size_t notify(size_t count);         // `count` tasks were published
+	///   void notifyAll();                    // the pool closes or unpauses
+	/// notify() returns how many workers were already waiting or about to
+	/// look for work, the pool grows when a submission exceeds them. The
+	/// pool publishes work with a seq_cst increment before notify(), and
+	/// ready() reads it seq_cst, so a policy registers a waiter (seq_cst)
+	/// before checking ready() one last time.
+	namespace policy {
+
+		/// The default queue: a WorkStealingDeque used from the front only, the
+		/// same container the workers steal from.
+		class DequeQueue :public NonCopyable {
+		public:
+			using Task = detail::InlineTask;
+
+			void push(Task&& task) {
+				deque_.push(std::move(task));
+			}
+
+			template<class Iter>
+			void pushBulk(Iter first, Iter last) {
+				deque_.pushBulk(first, last);
+			}
+
+			bool tryPop(Task& task) {
+				return deque_.steal(task);
+			}
+
+			bool empty() const noexcept {
+				return deque_.empty();
+			}
+
+		private:
+			concurrency::WorkStealingDeque<Task> deque_;
+		};
+
+		/// std::queue behind a mutex (concurrency::UnboundedLockQueue), what
+		/// the pool was originally built on.
+		class LockQueue :public NonCopyable {
+		public:
+			using Task = detail::InlineTask;
+
+			void push(Task&& task) {
+				queue_.enqueue(std::move(task));
+			}
+
+			template<class Iter>
+			void pushBulk(Iter first, Iter last) {
+				queue_.enqueueBulk(first, last);
+			}
+
+			bool tryPop(Task& task) {
+				return queue_.tryDequeue(task);
+			}
+
+			bool empty() const {
+				return queue_.empty();
+			}
+
+		private:
+			concurrency::UnboundedLockQueue<Task> queue_;
+		};
+
+		/// The lock-free MPMC concurrency::UnboundedQueue, spinning flavour
+		/// since workers only ever try_dequeue(). Link HazardPtr.cpp.
+		class LockFreeQueue :public NonCopyable {
+		public:
+			using Task = detail::InlineTask;
+
+			void push(Task&& task) {
+				queue_.enqueue(std::move(task));
+			}
+
+			template<class Iter>
+			void pushBulk(Iter first, Iter last) {
+				for (; first != last; ++first)
+					queue_.enqueue(*first);
+			}
+
+			bool tryPop(Task& task) {
+				return queue_.try_dequeue(task);
+			}
+
+			bool empty() const noexcept {
+				return queue_.empty();
+			}
+
+		private:
+			concurrency::UMPMCQueue<Task, false> queue_;
+		};
+
+		/// The sharded concurrency::ConcurrentQueue: submitting threads fill
+		/// their own implicit sub-queues, workers sweep them, and a bulk
+		/// submission goes in under one lock.
+		class ShardedQueue :public NonCopyable {
+		public:
+			using Task = detail::InlineTask;
+
+			void push(Task&& task) {
+				queue_.enqueue(std::move(task));
+			}
+
+			template<class Iter>
+			void pushBulk(Iter first, Iter last) {
+				queue_.enqueue_bulk(first, static_cast<size_t>(std::distance(first, last)));
+			}
+
+			bool tryPop(Task& task) {
+				return queue_.try_dequeue(task);
+			}
+
+			bool empty() const noexcept {
+				return queue_.empty();
+			}
+
+		private:
+			concurrency::ConcurrentQueue<Task> queue_;
+		};
+
+		/// The default wait: spin for ThreadPoolOptions::spin, then park on a
+		/// per-worker futex. Submitters wake the most recently parked (warmest)
+		/// workers, one futex wake each, and none at all while enough workers
+		/// are spinning; the common case of a busy pool takes no lock and
+		/// makes no syscall.
+		class FutexWait :public NonCopyable {
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			FutexWait(size_t slots, const sync::WaitOptions& spin)
+				:spin_(spin), slots_(new Slot[std::max<size_t>(1, slots)]) {
+				parked_.reserve(slots);
+			}
+
+			void enter(size_t) noexcept {
+				live_.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			void leave(size_t slot) {
+				if (slots_[slot].spinning)
+					stopSpinning(slots_[slot], false, [] { return false; });
+				live_.fetch_sub(1, std::memory_order_relaxed);
+			}
+
+			/// Spinning workers pick work up on their own, so only the surplus
+			/// over them costs a futex wake.
+			size_t notify(size_t count) {
+				// seq_cst pairs with the spinning_ decrement and the idle_
+				// increment of the waiters.
+				size_t spinning = spinning_.load(std::memory_order_seq_cst);
+				size_t idle = idle_.load(std::memory_order_seq_cst);
+				if (count > spinning && idle > 0)
+					unpark(count - spinning);
+				return spinning + idle;
+			}
+
+			void notifyAll() {
+				unpark(SIZE_MAX);
+			}
+
+			/// Spin, then park until there is work to do.
+			template<class Ready>
+			bool wait(size_t slot, Clock::duration keep_alive, Ready&& ready) {
+				Slot& self = slots_[slot];
+				return spin(self, ready) || park(self, slot, keep_alive, ready);
+			}
+
+			/// Leave the spinning state after a lookup. Submitters that saw us
+			/// spinning woke nobody, so the last spinner to find a task passes
+			/// the baton if more work is queued.
+			template<class Ready>
+			void lookedUp(size_t slot, bool found, Ready&& ready) {
+				if (slots_[slot].spinning)
+					stopSpinning(slots_[slot], found, ready);
+			}
+
+		private:
+			// value of Slot::parker.
+			enum ParkState :uint32_t {
+				AWAKE = 0,
+				PARKED,    // listed in parked_, sleeping or about to
+				NOTIFIED   // taken off parked_ by unpark()
+			};
+
+			struct alignas(kCacheLineSize) Slot {
+				// the thread sleeps on its own futex, so a wakeup is targeted.
+				sync::Futex<> parker{ AWAKE };
+				// counted in spinning_, owned by the worker thread.
+				bool spinning = false;
+			};
+
+			/// Busy-wait for work, if at most half of the live workers already
+			/// do. On success the worker stays counted as spinning until it has
+			/// looked for a task, see lookedUp().
+			template<class Ready>
+			bool spin(Slot& self, Ready&& ready) {
+				if (spin_.spin_max() <= std::chrono::nanoseconds::zero())
+					return false;
+				size_t spinning = spinning_.fetch_add(1, std::memory_order_seq_cst);
+				self.spinning = true;
+				if (spinning > 0 && 2 * spinning >= live_.load(std::memory_order_relaxed)) {
+					stopSpinning(self, false, ready);
+					return false;
+				}
+				if (sync::spin_pause_until(Clock::time_point::max(), spin_, ready) == sync::spin_result::success)
+					return true;
+				stopSpinning(self, false, ready);
+				return false;
+			}
+
+			template<class Ready>
+			void stopSpinning(Slot& self, bool found, Ready&& ready) {
+				self.spinning = false;
+				if (spinning_.fetch_sub(1, std::memory_order_seq_cst) == 1 && found && ready())
+					unpark(1);
+			}
+
+			/// List `self` in parked_ and sleep on its futex until unpark()
+			/// picks it. Return false if keep_alive expired first.
+			template<class Ready>
+			bool park(Slot& self, size_t slot, Clock::duration keep_alive, Ready&& ready) {
+				{
+					std::lock_guard<std::mutex> lock(mtx_);
+					self.parker.store(PARKED, std::memory_order_relaxed);
+					parked_.push_back(slot);
+					idle_.fetch_add(1, std::memory_order_seq_cst);
+				}
+				// a submitter that read idle_ before our increment (or saw us
+				// spinning) woke nobody; it published its work first, so we see it.
+				if (ready() && cancelPark(self, slot))
+					return true;
+				auto deadline = Clock::now() + keep_alive;
+				while (self.parker.load(std::memory_order_acquire) == PARKED) {
+					if (self.parker.futexWaitUntil(PARKED, deadline) == sync::FutexResult::TIMEDOUT &&
+						cancelPark(self, slot)) {
+						return false;
+					}
+				}
+				self.parker.store(AWAKE, std::memory_order_relaxed);
+				self.spinning = true;  // counted by unpark().
+				return true;
+			}
+
+			/// Take `slot` off parked_ again. False if a waker got there first,
+			/// it is then about to notify the futex.
+			bool cancelPark(Slot& self, size_t slot) {
+				std::lock_guard<std::mutex> lock(mtx_);
+				auto it = std::find(parked_.begin(), parked_.end(), slot);
+				if (it == parked_.end())
+					return false;
+				parked_.erase(it);
+				idle_.fetch_sub(1, std::memory_order_seq_cst);
+				self.parker.store(AWAKE, std::memory_order_relaxed);
+				return true;
+			}
+
+			/// Wake up to `count` parked workers, most recently parked first. Each
+			/// one is counted as spinning on its behalf, so submissions racing
+			/// with its wakeup do not wake yet another worker.
+			void unpark(size_t count) {
+				for (size_t i = 0; i < count; ++i) {
+					Slot* slot;
+					{
+						std::lock_guard<std::mutex> lock(mtx_);
+						if (parked_.empty())
+							return;
+						slot = &slots_[parked_.back()];
+						parked_.pop_back();
+						idle_.fetch_sub(1, std::memory_order_seq_cst);
+						spinning_.fetch_add(1, std::memory_order_seq_cst);
+					}
+					slot->parker.store(NOTIFIED, std::memory_order_release);
+					slot->parker.futexWake(1);
+				}
+			}
+
+			const sync::WaitOptions spin_;
+			std::unique_ptr<Slot[]> slots_;
+			// workers listed in parked_.
+			std::atomic<size_t> idle_{ 0 };
+			// workers looking for work without sleeping: spinning, or just
+			// unparked. A submission seen by one of them needs no wakeup.
+			std::atomic<size_t> spinning_{ 0 };
+			// entered and not yet left.
+			std::atomic<size_t> live_{ 0 };
+			// slots of parked workers, the most recently parked (warmest) last.
+			std::vector<size_t> parked_;
+			std::mutex mtx_;
+		};
+
+		/// One mutex and condition variable shared by all workers, no spinning:
+		/// the classic pool. Any worker may take the wakeup, and every
+		/// notification of a waiting pool goes through the mutex.
+		class CondVarWait :public NonCopyable {
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			CondVarWait(size_t, const sync::WaitOptions&) {}
+
+			void enter(size_t) noexcept {}
+
+			void leave(size_t) noexcept {}
+
+			size_t notify(size_t count) {
+				// seq_cst pairs with the waiting_ increment in wait().
+				size_t waiting = waiting_.load(std::memory_order_seq_cst);
+				if (waiting > 0) {
+					// a waiter holds the lock from its last check until it sleeps.
+					std::lock_guard<std::mutex> lock(mtx_);
+					if (count >= waiting) {
+						cond_.notify_all();
+					}
+					else {
+						for (size_t i = 0; i < count; ++i)
+							cond_.notify_one();
+					}
+				}
+				return waiting;
+			}
+
+			void notifyAll() {
+				std::lock_guard<std::mutex> lock(mtx_);
+				cond_.notify_all();
+			}
+
+			template<class Ready>
+			bool wait(size_t, Clock::duration keep_alive, Ready&& ready) {
+				std::unique_lock<std::mutex> lock(mtx_);
+				waiting_.fetch_add(1, std::memory_order_seq_cst);
+				bool woken = cond_.wait_until(lock, Clock::now() + keep_alive, ready);
+				waiting_.fetch_sub(1, std::memory_order_seq_cst);
+				return woken;
+			}
+
+			template<class Ready>
+			void lookedUp(size_t, bool, Ready&&) noexcept {}
+
+		private:
+			std::atomic<size_t> waiting_{ 0 };
+			std::mutex mtx_;
+			std::condition_variable cond_;
+		};
+
+		/// Never sleep: pause for ThreadPoolOptions::spin, then yield until
+		/// there is work or keep_alive expires. Submissions make no syscall and
+		/// pick-up latency is the lowest, at the price of every idle worker
+		/// burning a cpu; meant for dedicated cores and short keep_alive.
+		class SpinWait :public NonCopyable {
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			SpinWait(size_t, const sync::WaitOptions& spin)
+				:spin_(spin) {}
+
+			void enter(size_t) noexcept {}
+
+			void leave(size_t) noexcept {}
+
+			/* waiters poll, nobody needs a wakeup. */
+			size_t notify(size_t) noexcept {
+				return waiting_.load(std::memory_order_seq_cst);
+			}
+
+			void notifyAll() noexcept {}
+
+			template<class Ready>
+			bool wait(size_t, Clock::duration keep_alive, Ready&& ready) {
+				waiting_.fetch_add(1, std::memory_order_seq_cst);
+				auto deadline = Clock::now() + keep_alive;
+				auto result = sync::spin_pause_until(deadline, spin_, ready);
+				if (result == sync::spin_result::advance)
+					result = sync::spin_yield_until(deadline, ready);
+				waiting_.fetch_sub(1, std::memory_order_seq_cst);
+				return result == sync::spin_result::success;
+			}
+
+			template<class Ready>
+			void lookedUp(size_t, bool, Ready&&) noexcept {}
+
+		private:
+			const sync::WaitOptions spin_;
+			std::atomic<size_t> waiting_{ 0 };
+		};
+
+	} // namespace policy
+
+} // namespace booty
+
+#endif // !BOOTY_THREADPOOL_POLICIES_HPP
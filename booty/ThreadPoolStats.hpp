@@ -0,0 +1,273 @@
+/*
+ * ThreadPoolStats.hpp holds the optional instrumentation of booty::ThreadPool:
+ * cheap per-worker counters, and the snapshot they are aggregated into.
+ * Build with -DBOOTY_THREADPOOL_STATS=1 to compile the counters in.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_THREADPOOL_STATS_HPP
+#define BOOTY_THREADPOOL_STATS_HPP
+
+#include<array>
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<cstdio>
+#include<string>
+#include<thread>
+#include<vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include<intrin.h>
+#endif
+
+#include"Portability.h"
+
+#ifndef BOOTY_THREADPOOL_STATS
+#define BOOTY_THREADPOOL_STATS 0
+#endif
+
+namespace booty {
+
+	/// Log2 histogram taken out of a ThreadPool: bucket i counts samples in
+	/// [2^(i-1), 2^i) raw units (bucket 0 counts zeros), `unit` converts raw
+	/// units to the reported ones (ns for times, 1 for depths).
+	struct Histogram {
+		static constexpr size_t kBuckets = 64;
+
+		std::array<uint64_t, kBuckets> buckets{};
+		uint64_t count = 0;
+		double sum = 0;
+		double unit = 1;
+
+		double mean() const noexcept {
+			return count ? sum / count : 0.0;
+		}
+
+		/// p in [0, 1], interpolated linearly inside the bucket it falls in,
+		/// so it is exact up to a factor of 2.
+		double percentile(double p) const noexcept {
+			if (count == 0)
+				return 0;
+			double rank = p * count;
+			uint64_t seen = 0;
+			for (size_t i = 0; i < kBuckets; ++i) {
+				if (buckets[i] == 0)
+					continue;
+				if (seen + buckets[i] >= rank) {
+					if (i == 0)
+						return 0;
+					double low = double(uint64_t(1) << (i - 1));
+					double fraction = (rank - seen) / buckets[i];
+					return (low + low * fraction) * unit;
+				}
+				seen += buckets[i];
+			}
+			return double(uint64_t(1) << (kBuckets - 1)) * unit;
+		}
+
+		void merge(const Histogram& other) noexcept {
+			for (size_t i = 0; i < kBuckets; ++i)
+				buckets[i] += other.buckets[i];
+			count += other.count;
+			sum += other.sum;
+		}
+	};
+
+	/// Point-in-time aggregate of ThreadPool counters, see ThreadPool::stats().
+	/// All counts are totals since the pool was created.
+	struct ThreadPoolStats {
+		struct WorkerStats {
+			uint64_t tasks = 0;
+			uint64_t steals = 0;
+			std::chrono::nanoseconds busy{ 0 };
+			std::chrono::nanoseconds idle{ 0 };
+
+			/* share of the accounted time spent running tasks. */
+			double utilization() const noexcept {
+				auto total = busy + idle;
+				return total.count() ? double(busy.count()) / total.count() : 0.0;
+			}
+		};
+
+		// false when the pool was built without BOOTY_THREADPOOL_STATS.
+		bool enabled = false;
+		uint64_t tasks = 0;
+		uint64_t steals = 0;
+		uint64_t threads_launched = 0;
+		uint64_t threads_retired = 0;
+		// enqueue to start of execution, ns.
+		Histogram queue_wait;
+		// execution time, ns.
+		Histogram run_time;
+		// tasks still queued when one is picked up.
+		Histogram queue_depth;
+		// one per slot, the last entry collects threads outside of the pool.
+		std::vector<WorkerStats> workers;
+
+		std::string String() const {
+			if (!enabled)
+				return "ThreadPool statistics are disabled, build with BOOTY_THREADPOOL_STATS=1.";
+			char buf[512];
+			std::snprintf(buf, sizeof(buf),
+				"tasks %llu, steals %llu, threads launched %llu / retired %llu\n"
+				"queue wait ns  p50 %.0f p90 %.0f p99 %.0f mean %.0f\n"
+				"run time ns    p50 %.0f p90 %.0f p99 %.0f mean %.0f\n"
+				"queue depth    p50 %.0f p90 %.0f p99 %.0f mean %.1f\n",
+				(unsigned long long)tasks, (unsigned long long)steals,
+				(unsigned long long)threads_launched, (unsigned long long)threads_retired,
+				queue_wait.percentile(0.5), queue_wait.percentile(0.9), queue_wait.percentile(0.99), queue_wait.mean(),
+				run_time.percentile(0.5), run_time.percentile(0.9), run_time.percentile(0.99), run_time.mean(),
+				queue_depth.percentile(0.5), queue_depth.percentile(0.9), queue_depth.percentile(0.99), queue_depth.mean());
+			std::string text(buf);
+			for (size_t i = 0; i < workers.size(); ++i) {
+				const auto& worker = workers[i];
+				if (worker.tasks == 0 && worker.idle.count() == 0)
+					continue;
+				if (i + 1 == workers.size()) {
+					// helpers outside of the pool have no idle time to account.
+					std::snprintf(buf, sizeof(buf), "external   : tasks %llu, steals %llu\n",
+						(unsigned long long)worker.tasks, (unsigned long long)worker.steals);
+				}
+				else {
+					std::snprintf(buf, sizeof(buf), "worker %3zu : tasks %llu, steals %llu, utilization %.1f%%\n", i,
+						(unsigned long long)worker.tasks, (unsigned long long)worker.steals, 100 * worker.utilization());
+				}
+				text += buf;
+			}
+			return text;
+		}
+	};
+
+	namespace detail {
+
+		/// Cheapest monotonic tick available: the TSC on x86, steady_clock ns
+		/// elsewhere. Only differences are meaningful.
+		inline uint64_t cycleNow() noexcept {
+#if defined(__x86_64__) || defined(__i386__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+			return __rdtsc();
+#else
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+		}
+
+		/* ns per cycleNow() tick, measured once against steady_clock. */
+		inline double nsPerCycle() {
+			static const double ratio = [] {
+				auto start = std::chrono::steady_clock::now();
+				uint64_t first = cycleNow();
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				uint64_t last = cycleNow();
+				auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - start).count();
+				return last > first ? double(elapsed) / double(last - first) : 1.0;
+			}();
+			return ratio;
+		}
+
+		/// end - start, 0 if end is earlier: TSCs of different cores may be
+		/// apart, and a thread may move between the two readings.
+		inline uint64_t cyclesBetween(uint64_t start, uint64_t end) noexcept {
+			return end > start ? end - start : 0;
+		}
+
+		/* values of 2^63 and above share the last bucket. */
+		inline size_t log2Bucket(uint64_t value) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+			size_t bucket = value ? 64 - static_cast<size_t>(__builtin_clzll(value)) : 0;
+#else
+			size_t bucket = 0;
+			while (value) {
+				value >>= 1;
+				++bucket;
+			}
+#endif
+			return bucket < Histogram::kBuckets ? bucket : Histogram::kBuckets - 1;
+		}
+
+		/// Counters of one writer. Workers own their slot and update it with
+		/// plain load+store (no locked instruction); the shared slot of
+		/// external threads uses fetch_add. Readers only ever load, so a
+		/// snapshot may be a few samples behind but never torn.
+		template<bool Shared>
+		class alignas(kCacheLineSize) PoolCounters {
+			using Counter = std::atomic<uint64_t>;
+
+			static void bump(Counter& counter, uint64_t delta = 1) noexcept {
+				if constexpr (Shared)
+					counter.fetch_add(delta, std::memory_order_relaxed);
+				else
+					counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+			}
+
+			struct Buckets {
+				std::array<Counter, Histogram::kBuckets> counts{};
+				Counter sum{ 0 };
+
+				void add(uint64_t value) noexcept {
+					bump(counts[log2Bucket(value)]);
+					bump(sum, value);
+				}
+
+				void addTo(Histogram& out, double unit) const noexcept {
+					Histogram part;
+					for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+						part.buckets[i] = counts[i].load(std::memory_order_relaxed);
+						part.count += part.buckets[i];
+					}
+					part.sum = double(sum.load(std::memory_order_relaxed)) * unit;
+					out.unit = unit;
+					out.merge(part);
+				}
+			};
+
+		public:
+			void taskStarted(uint64_t wait_cycles, uint64_t depth) noexcept {
+				bump(tasks_);
+				wait_.add(wait_cycles);
+				depth_.add(depth);
+			}
+
+			void taskFinished(uint64_t run_cycles) noexcept {
+				run_.add(run_cycles);
+				bump(busy_, run_cycles);
+			}
+
+			void stolen() noexcept {
+				bump(steals_);
+			}
+
+			void idled(uint64_t cycles) noexcept {
+				bump(idle_, cycles);
+			}
+
+			/* add into `out`, `ns` converts cycles to nanoseconds. */
+			void collect(ThreadPoolStats& out, ThreadPoolStats::WorkerStats& worker, double ns) const {
+				worker.tasks = tasks_.load(std::memory_order_relaxed);
+				worker.steals = steals_.load(std::memory_order_relaxed);
+				worker.busy = std::chrono::nanoseconds(static_cast<int64_t>(busy_.load(std::memory_order_relaxed) * ns));
+				worker.idle = std::chrono::nanoseconds(static_cast<int64_t>(idle_.load(std::memory_order_relaxed) * ns));
+				out.tasks += worker.tasks;
+				out.steals += worker.steals;
+				wait_.addTo(out.queue_wait, ns);
+				run_.addTo(out.run_time, ns);
+				depth_.addTo(out.queue_depth, 1.0);
+			}
+
+		private:
+			Counter tasks_{ 0 };
+			Counter steals_{ 0 };
+			Counter busy_{ 0 };
+			Counter idle_{ 0 };
+			Buckets wait_;
+			Buckets run_;
+			Buckets depth_;
+		};
+
+	} // namespace detail
+
+} // namespace booty
+
+#endif // !BOOTY_THREADPOOL_STATS_HPP
@@ -14,9 +14,14 @@ namespace booty {
 
 	/* Defination of NonCopyable class */
 	class NonCopyable {
+	public:
 		// forbid copy ctor and copy assignment operator.
 		NonCopyable(const NonCopyable&) = delete;
 		NonCopyable& operator=(const NonCopyable&) = delete;
+
+	protected:
+		NonCopyable() = default;
+		~NonCopyable() = default;
 	};
 
 } // booty
@@ -0,0 +1,404 @@
+/*
+ * Topology detection, see Topology.h.
+ * @Simoncqk - 2019.03
+ */
+#include<algorithm>
+#include<cctype>
+#include<cmath>
+#include<fstream>
+#include<map>
+#include<set>
+#include<sstream>
+#include<thread>
+#include<tuple>
+#include<utility>
+
+#include"Topology.h"
+
+#ifdef __linux__
+#include<dirent.h>
+#include<pthread.h>
+#include<sched.h>
+#endif
+
+namespace booty {
+
+	namespace {
+
+		bool readLine(const std::string& path, std::string& line) {
+			std::ifstream in(path);
+			return static_cast<bool>(std::getline(in, line));
+		}
+
+		int readInt(const std::string& path, int fallback) {
+			std::string line;
+			if (!readLine(path, line))
+				return fallback;
+			try {
+				return std::stoi(line);
+			}
+			catch (...) {
+				return fallback;
+			}
+		}
+
+		// "32K", "8192K", "1M" -> bytes
+		size_t parseSize(const std::string& text) {
+			size_t pos = 0;
+			size_t value = 0;
+			try {
+				value = std::stoul(text, &pos);
+			}
+			catch (...) {
+				return 0;
+			}
+			if (pos < text.size()) {
+				switch (text[pos]) {
+				case 'K': return value << 10;
+				case 'M': return value << 20;
+				case 'G': return value << 30;
+				default: break;
+				}
+			}
+			return value;
+		}
+
+		std::vector<std::string> split(const std::string& text, char sep) {
+			std::vector<std::string> parts;
+			std::stringstream stream(text);
+			std::string part;
+			while (std::getline(stream, part, sep))
+				parts.push_back(part);
+			return parts;
+		}
+
+#ifdef __linux__
+		// names of the entries of `dir` starting with `prefix` followed by a number.
+		std::vector<int> numberedEntries(const std::string& dir, const std::string& prefix) {
+			std::vector<int> numbers;
+			DIR* handle = ::opendir(dir.c_str());
+			if (!handle)
+				return numbers;
+			while (dirent* entry = ::readdir(handle)) {
+				std::string name(entry->d_name);
+				if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+					std::all_of(name.begin() + prefix.size(), name.end(), ::isdigit)) {
+					numbers.push_back(std::stoi(name.substr(prefix.size())));
+				}
+			}
+			::closedir(handle);
+			std::sort(numbers.begin(), numbers.end());
+			return numbers;
+		}
+
+		std::vector<int> allowedCpus() {
+			std::vector<int> result;
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			if (::sched_getaffinity(0, sizeof(set), &set) == 0) {
+				for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+					if (CPU_ISSET(cpu, &set))
+						result.push_back(cpu);
+				}
+			}
+			return result;
+		}
+
+		struct MountEntry {
+			std::string root;
+			std::string mount_point;
+			std::string fs_type;
+			std::vector<std::string> super_options;
+		};
+
+		std::vector<MountEntry> cgroupMounts(const std::string& proc_root) {
+			std::vector<MountEntry> mounts;
+			std::ifstream in(proc_root + "/self/mountinfo");
+			std::string line;
+			while (std::getline(in, line)) {
+				// id parent dev root mount_point options [optional...] - type source super_options
+				std::istringstream fields(line);
+				std::string id, parent, dev, root, mount_point, field;
+				fields >> id >> parent >> dev >> root >> mount_point;
+				while (fields >> field && field != "-") {}
+				MountEntry entry;
+				std::string source, options;
+				fields >> entry.fs_type >> source >> options;
+				if (entry.fs_type != "cgroup" && entry.fs_type != "cgroup2")
+					continue;
+				entry.root = root;
+				entry.mount_point = mount_point;
+				entry.super_options = split(options, ',');
+				mounts.push_back(std::move(entry));
+			}
+			return mounts;
+		}
+
+		// cgroup path of this process relative to the root of its mount.
+		std::string relativeTo(const std::string& path, const std::string& root) {
+			if (root == "/" || path.compare(0, root.size(), root) != 0)
+				return path;
+			std::string rest = path.substr(root.size());
+			return rest.empty() ? "/" : rest;
+		}
+
+		// mount points are absolute paths of the live system, move /sys ones under sys_root.
+		std::string underSysRoot(const std::string& mount_point, const std::string& sys_root) {
+			if (mount_point.compare(0, 4, "/sys") == 0)
+				return sys_root + mount_point.substr(4);
+			return mount_point;
+		}
+
+		// the tightest quota from `dir` up to `top`, in CPUs; 0 if none.
+		template<class ReadQuota>
+		double tightestQuota(std::string dir, const std::string& top, ReadQuota&& read) {
+			double best = 0;
+			while (true) {
+				double quota = read(dir);
+				if (quota > 0 && (best == 0 || quota < best))
+					best = quota;
+				if (dir.size() <= top.size())
+					break;
+				size_t slash = dir.find_last_of('/');
+				if (slash == std::string::npos || slash < top.size())
+					dir = top;
+				else
+					dir.erase(slash);
+			}
+			return best;
+		}
+#endif // __linux__
+
+	} // namespace
+
+	const CpuTopology& CpuTopology::instance() {
+		static const CpuTopology topology = detect();
+		return topology;
+	}
+
+	std::vector<int> CpuTopology::parseCpuList(const std::string& list) {
+		std::vector<int> cpus;
+		for (const auto& range : split(list, ',')) {
+			if (range.empty())
+				continue;
+			try {
+				size_t dash = range.find('-');
+				int first = std::stoi(range.substr(0, dash));
+				int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+				for (int cpu = first; cpu <= last; ++cpu)
+					cpus.push_back(cpu);
+			}
+			catch (...) {
+				// ignore a malformed range, keep the rest.
+			}
+		}
+		return cpus;
+	}
+
+	size_t CpuTopology::usableCpus() const noexcept {
+		size_t usable = std::max<size_t>(1, cpus_.size());
+		if (cpu_quota_ > 0)
+			usable = std::min(usable, static_cast<size_t>(std::ceil(cpu_quota_)));
+		return std::max<size_t>(1, usable);
+	}
+
+	CpuTopology CpuTopology::detect(const std::string& sys_root, const std::string& proc_root) {
+#ifdef __linux__
+		return detect(sys_root, proc_root, allowedCpus());
+#else
+		return detect(sys_root, proc_root, std::vector<int>());
+#endif // __linux__
+	}
+
+	CpuTopology CpuTopology::detect(const std::string& sys_root, const std::string& proc_root,
+		const std::vector<int>& allowed_cpus) {
+		CpuTopology topology;
+#ifdef __linux__
+		const std::string cpu_root = sys_root + "/devices/system/cpu/cpu";
+		std::vector<int> allowed = allowed_cpus;
+		if (allowed.empty()) {
+			for (int cpu : numberedEntries(sys_root + "/devices/system/cpu", "cpu"))
+				allowed.push_back(cpu);
+		}
+
+		std::map<int, int> node_of;
+		for (int node : numberedEntries(sys_root + "/devices/system/node", "node")) {
+			std::string list;
+			if (readLine(sys_root + "/devices/system/node/node" + std::to_string(node) + "/cpulist", list)) {
+				for (int cpu : parseCpuList(list))
+					node_of[cpu] = node;
+			}
+		}
+
+		std::map<std::pair<int, int>, int> core_ids;
+		for (int id : allowed) {
+			const std::string dir = cpu_root + std::to_string(id);
+			CpuInfo cpu;
+			cpu.id = id;
+			cpu.package = std::max(0, readInt(dir + "/topology/physical_package_id", 0));
+			int core_id = readInt(dir + "/topology/core_id", id);
+			cpu.core = core_ids.emplace(std::make_pair(cpu.package, core_id),
+				static_cast<int>(core_ids.size())).first->second;
+			auto node = node_of.find(id);
+			cpu.numa_node = node == node_of.end() ? 0 : node->second;
+
+			std::string siblings;
+			if (readLine(dir + "/topology/thread_siblings_list", siblings)) {
+				auto list = parseCpuList(siblings);
+				cpu.smt_rank = static_cast<int>(std::find(list.begin(), list.end(), id) - list.begin());
+				if (cpu.smt_rank == static_cast<int>(list.size()))
+					cpu.smt_rank = 0;
+			}
+
+			// last level cache: the highest level listed, usually L3.
+			int llc_level = 0;
+			cpu.l3_domain = -1;
+			for (int index : numberedEntries(dir + "/cache", "index")) {
+				const std::string cache = dir + "/cache/index" + std::to_string(index);
+				int level = readInt(cache + "/level", 0);
+				std::string shared;
+				if (level < llc_level || !readLine(cache + "/shared_cpu_list", shared))
+					continue;
+				auto list = parseCpuList(shared);
+				if (list.empty())
+					continue;
+				llc_level = level;
+				cpu.l3_domain = *std::min_element(list.begin(), list.end());
+			}
+			topology.cpus_.push_back(cpu);
+		}
+
+		// no cache information: one domain per package.
+		for (auto& cpu : topology.cpus_) {
+			if (cpu.l3_domain < 0)
+				cpu.l3_domain = -1 - cpu.package;
+		}
+
+		if (!allowed.empty()) {
+			const std::string dir = cpu_root + std::to_string(allowed.front()) + "/cache";
+			for (int index : numberedEntries(dir, "index")) {
+				const std::string cache = dir + "/index" + std::to_string(index);
+				CacheInfo info;
+				info.level = readInt(cache + "/level", 0);
+				readLine(cache + "/type", info.type);
+				std::string text;
+				if (readLine(cache + "/size", text))
+					info.size = parseSize(text);
+				info.line_size = static_cast<size_t>(std::max(0, readInt(cache + "/coherency_line_size", 0)));
+				if (readLine(cache + "/shared_cpu_list", text))
+					info.shared_by = std::max<size_t>(1, parseCpuList(text).size());
+				topology.caches_.push_back(std::move(info));
+			}
+		}
+
+		topology.readCgroupQuota(sys_root, proc_root);
+#else
+		(void)sys_root;
+		(void)proc_root;
+		(void)allowed_cpus;
+		unsigned count = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned id = 0; id < count; ++id) {
+			CpuInfo cpu;
+			cpu.id = cpu.core = static_cast<int>(id);
+			topology.cpus_.push_back(cpu);
+		}
+#endif // __linux__
+
+		if (topology.cpus_.empty()) {
+			topology.cpus_.push_back(CpuInfo());
+		}
+		std::sort(topology.cpus_.begin(), topology.cpus_.end(), [](const CpuInfo& lhs, const CpuInfo& rhs) {
+			return std::tie(lhs.numa_node, lhs.l3_domain, lhs.smt_rank, lhs.core, lhs.id) <
+				std::tie(rhs.numa_node, rhs.l3_domain, rhs.smt_rank, rhs.core, rhs.id);
+		});
+		std::set<int> cores, nodes, domains;
+		for (const auto& cpu : topology.cpus_) {
+			cores.insert(cpu.core);
+			nodes.insert(cpu.numa_node);
+			domains.insert(cpu.l3_domain);
+		}
+		topology.physical_cores_ = cores.size();
+		topology.numa_nodes_ = nodes.size();
+		topology.l3_domains_ = domains.size();
+		return topology;
+	}
+
+	void CpuTopology::readCgroupQuota(const std::string& sys_root, const std::string& proc_root) {
+#ifdef __linux__
+		auto mounts = cgroupMounts(proc_root);
+		std::ifstream in(proc_root + "/self/cgroup");
+		std::string line;
+		while (std::getline(in, line)) {
+			// hierarchy-id:controllers:path, v2 has id 0 and no controllers.
+			size_t first = line.find(':');
+			size_t second = line.find(':', first + 1);
+			if (first == std::string::npos || second == std::string::npos)
+				continue;
+			auto controllers = split(line.substr(first + 1, second - first - 1), ',');
+			std::string path = line.substr(second + 1);
+			bool v2 = controllers.empty();
+			if (!v2 && std::find(controllers.begin(), controllers.end(), "cpu") == controllers.end())
+				continue;
+
+			for (const auto& mount : mounts) {
+				if (v2 != (mount.fs_type == "cgroup2"))
+					continue;
+				if (!v2 && std::find(mount.super_options.begin(), mount.super_options.end(), "cpu")
+					== mount.super_options.end())
+					continue;
+				std::string top = underSysRoot(mount.mount_point, sys_root);
+				std::string rel = relativeTo(path, mount.root);
+				std::string dir = rel == "/" ? top : top + rel;
+				double quota;
+				if (v2) {
+					quota = tightestQuota(dir, top, [](const std::string& d) {
+						// "max 100000" or "<quota> <period>"
+						std::string text;
+						if (!readLine(d + "/cpu.max", text))
+							return 0.0;
+						std::istringstream fields(text);
+						std::string limit;
+						double period = 0;
+						fields >> limit >> period;
+						if (limit == "max" || period <= 0)
+							return 0.0;
+						try {
+							return std::stod(limit) / period;
+						}
+						catch (...) {
+							return 0.0;
+						}
+					});
+				}
+				else {
+					quota = tightestQuota(dir, top, [](const std::string& d) {
+						int limit = readInt(d + "/cpu.cfs_quota_us", -1);
+						int period = readInt(d + "/cpu.cfs_period_us", 0);
+						return (limit > 0 && period > 0) ? double(limit) / period : 0.0;
+					});
+				}
+				if (quota > 0 && (cpu_quota_ == 0 || quota < cpu_quota_))
+					cpu_quota_ = quota;
+			}
+		}
+#else
+		(void)sys_root;
+		(void)proc_root;
+#endif // __linux__
+	}
+
+	bool CpuTopology::pinCurrentThread(int cpu) {
+#ifdef __linux__
+		if (cpu < 0 || cpu >= CPU_SETSIZE)
+			return false;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+#else
+		(void)cpu;
+		return false;
+#endif // __linux__
+	}
+
+} // namespace booty
@@ -0,0 +1,105 @@
+/*
+ * Topology describes the CPUs this process may actually run on: cores,
+ * SMT siblings, shared caches, NUMA nodes and the cgroup CPU quota.
+ * Linux only, other platforms get a flat topology of hardware threads.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_BASE_TOPOLOGY_H
+#define BOOTY_BASE_TOPOLOGY_H
+
+#include<cstddef>
+#include<cstdint>
+#include<string>
+#include<vector>
+
+namespace booty {
+
+	/// One logical CPU (hardware thread) in the affinity mask of the process.
+	struct CpuInfo {
+		int id = 0;             // kernel cpu number
+		int core = 0;           // physical core, unique across packages
+		int package = 0;        // socket
+		int numa_node = 0;
+		int l3_domain = 0;      // lowest cpu id sharing its last level cache
+		int smt_rank = 0;       // 0 for the first hardware thread of its core
+	};
+
+	/// One cache level as reported by the first allowed cpu.
+	struct CacheInfo {
+		int level = 0;
+		std::string type;       // "Data", "Instruction" or "Unified"
+		size_t size = 0;        // bytes
+		size_t line_size = 0;   // bytes
+		size_t shared_by = 1;   // logical cpus sharing one instance
+	};
+
+	/// CpuTopology is read once from /sys and /proc, then immutable.
+	/// Only CPUs in sched_getaffinity() are listed, and the cgroup v1
+	/// (cpu.cfs_quota_us) or v2 (cpu.max) quota caps usableCpus(), so a
+	/// container limited to 2 CPUs on a 64-core host reports 2.
+	class CpuTopology {
+	public:
+		/* topology of the running process, detected on first use. */
+		static const CpuTopology& instance();
+
+		/// Detect against other roots of sysfs/procfs/cgroupfs, for tests
+		/// or chroots. The affinity mask always comes from the live process.
+		static CpuTopology detect(const std::string& sys_root = "/sys",
+			const std::string& proc_root = "/proc");
+
+		/// Detect with the allowed cpus given instead of read from
+		/// sched_getaffinity(), e.g. a cpuset for a fixture tree. An empty
+		/// list allows every cpu found under sys_root.
+		static CpuTopology detect(const std::string& sys_root,
+			const std::string& proc_root, const std::vector<int>& allowed_cpus);
+
+		/* allowed cpus, sorted by numa node, l3 domain, smt rank and core. */
+		const std::vector<CpuInfo>& cpus() const noexcept {
+			return cpus_;
+		}
+
+		const std::vector<CacheInfo>& caches() const noexcept {
+			return caches_;
+		}
+
+		size_t physicalCores() const noexcept {
+			return physical_cores_;
+		}
+
+		size_t numaNodes() const noexcept {
+			return numa_nodes_;
+		}
+
+		size_t l3Domains() const noexcept {
+			return l3_domains_;
+		}
+
+		/* cgroup CPU quota in CPUs (e.g. 1.5), 0 when unlimited. */
+		double cpuQuota() const noexcept {
+			return cpu_quota_;
+		}
+
+		/// CPUs worth of threads to run: the allowed cpus, capped by the
+		/// quota rounded up. Never 0.
+		size_t usableCpus() const noexcept;
+
+		/* pin the calling thread to one cpu, false if the kernel refuses. */
+		static bool pinCurrentThread(int cpu);
+
+		/* "1-3,8,10-11" -> {1,2,3,8,10,11} */
+		static std::vector<int> parseCpuList(const std::string& list);
+
+	private:
+		void readCgroupQuota(const std::string& sys_root, const std::string& proc_root);
+
+		std::vector<CpuInfo> cpus_;
+		std::vector<CacheInfo> caches_;
+		size_t physical_cores_ = 1;
+		size_t numa_nodes_ = 1;
+		size_t l3_domains_ = 1;
+		double cpu_quota_ = 0;
+	};
+
+} // namespace booty
+
+#endif // !BOOTY_BASE_TOPOLOGY_H
@@ -0,0 +1,245 @@
+/*
+ * BlockingConcurrentQueue is a ConcurrentQueue whose consumers may wait
+ * for items, parked on an EventCount.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_CONCURRENCY_BLOCKINGCONCURRENTQUEUE_HPP
+#define BOOTY_CONCURRENCY_BLOCKINGCONCURRENTQUEUE_HPP
+
+#include<chrono>
+#include<cstddef>
+#include<cstdint>
+#include<thread>
+#include<utility>
+
+#include"../Asm.h"
+#include"../Portability.h"
+#include"../base/Base.h"
+#include"../sync/EventCount.hpp"
+#include"ConcurrentQueue.hpp"
+
+namespace booty {
+
+	namespace concurrency {
+
+		/// BlockingConcurrentQueue adds waiting dequeues to ConcurrentQueue,
+		/// with the names UnboundedQueue uses: dequeue() waits for an item,
+		/// try_dequeue_for()/until() wait up to a timeout, and the bulk
+		/// forms wait for at least one item.
+		///
+		/// A consumer which finds the queue empty retries for a while,
+		/// pausing and then yielding, announces itself on an EventCount,
+		/// tries once more and sleeps on its futex. A producer
+		/// checks for sleeping consumers after each enqueue, which costs a
+		/// fence and a load while nobody sleeps. Queues whose consumers never
+		/// wait should use ConcurrentQueue, which does not pay that.
+		///
+		/// Usage:
+		///   BlockingConcurrentQueue<int> q;
+		///   q.enqueue(1);
+		///   int v;
+		///   q.dequeue(v);                                  // waits for an item
+		///   bool got = q.try_dequeue_for(v, std::chrono::milliseconds(1));
+		///   BlockingConcurrentQueue<int>::ConsumerToken consumer(q);
+		///   size_t n = q.dequeue_bulk(consumer, out.begin(), out.size());  // >= 1
+		template<typename T>
+		class BlockingConcurrentQueue :public NonCopyable {
+			using Queue = ConcurrentQueue<T>;
+			using TimePoint = std::chrono::steady_clock::time_point;
+
+			static constexpr uint32_t kSpinsBeforeYield = 16;
+			static constexpr uint32_t kYieldsBeforeWait = 16;
+
+		public:
+			using value_type = T;
+
+			class ProducerToken :public Queue::ProducerToken {
+			public:
+				explicit ProducerToken(BlockingConcurrentQueue& queue)
+					:Queue::ProducerToken(queue.queue_) {}
+			};
+
+			class ConsumerToken :public Queue::ConsumerToken {
+			public:
+				explicit ConsumerToken(BlockingConcurrentQueue& queue)
+					:Queue::ConsumerToken(queue.queue_) {}
+			};
+
+			/* maxProducers as for ConcurrentQueue. */
+			explicit BlockingConcurrentQueue(size_t maxProducers = 64)
+				:queue_(maxProducers) {}
+
+			void enqueue(const T& item) {
+				queue_.enqueue(item);
+				waiters_.notify();
+			}
+
+			void enqueue(T&& item) {
+				queue_.enqueue(std::move(item));
+				waiters_.notify();
+			}
+
+			void enqueue(ProducerToken& token, const T& item) {
+				queue_.enqueue(token, item);
+				waiters_.notify();
+			}
+
+			void enqueue(ProducerToken& token, T&& item) {
+				queue_.enqueue(token, std::move(item));
+				waiters_.notify();
+			}
+
+			template<typename InputIt>
+			void enqueue_bulk(InputIt first, size_t count) {
+				queue_.enqueue_bulk(first, count);
+				notify(count);
+			}
+
+			template<typename InputIt>
+			void enqueue_bulk(ProducerToken& token, InputIt first, size_t count) {
+				queue_.enqueue_bulk(token, first, count);
+				notify(count);
+			}
+
+			/* take an item if there is one, never waits. */
+			bool try_dequeue(T& item) {
+				return queue_.try_dequeue(item);
+			}
+
+			bool try_dequeue(ConsumerToken& token, T& item) {
+				return queue_.try_dequeue(token, item);
+			}
+
+			template<typename OutputIt>
+			size_t try_dequeue_bulk(OutputIt out, size_t max) {
+				return queue_.try_dequeue_bulk(out, max);
+			}
+
+			template<typename OutputIt>
+			size_t try_dequeue_bulk(ConsumerToken& token, OutputIt out, size_t max) {
+				return queue_.try_dequeue_bulk(token, out, max);
+			}
+
+			/* wait for an item. */
+			void dequeue(T& item) {
+				waitUntil([&] { return queue_.try_dequeue(item); }, TimePoint::max());
+			}
+
+			void dequeue(ConsumerToken& token, T& item) {
+				waitUntil([&] { return queue_.try_dequeue(token, item); }, TimePoint::max());
+			}
+
+			template<typename Clock, typename Duration>
+			bool try_dequeue_until(T& item, const std::chrono::time_point<Clock, Duration>& deadline) {
+				return waitUntil([&] { return queue_.try_dequeue(item); }, deadline);
+			}
+
+			template<typename Clock, typename Duration>
+			bool try_dequeue_until(ConsumerToken& token, T& item,
+				const std::chrono::time_point<Clock, Duration>& deadline) {
+				return waitUntil([&] { return queue_.try_dequeue(token, item); }, deadline);
+			}
+
+			template<typename Rep, typename Period>
+			bool try_dequeue_for(T& item, const std::chrono::duration<Rep, Period>& duration) {
+				if (queue_.try_dequeue(item))
+					return true;
+				return try_dequeue_until(item, std::chrono::steady_clock::now() + duration);
+			}
+
+			template<typename Rep, typename Period>
+			bool try_dequeue_for(ConsumerToken& token, T& item, const std::chrono::duration<Rep, Period>& duration) {
+				if (queue_.try_dequeue(token, item))
+					return true;
+				return try_dequeue_until(token, item, std::chrono::steady_clock::now() + duration);
+			}
+
+			/// Waits for at least one item and moves up to max items to out,
+			/// returns how many.
+			template<typename OutputIt>
+			size_t dequeue_bulk(OutputIt out, size_t max) {
+				return waitUntil([&] { return queue_.try_dequeue_bulk(out, max); }, TimePoint::max());
+			}
+
+			template<typename OutputIt>
+			size_t dequeue_bulk(ConsumerToken& token, OutputIt out, size_t max) {
+				return waitUntil([&] { return queue_.try_dequeue_bulk(token, out, max); }, TimePoint::max());
+			}
+
+			/* dequeue_bulk(), up to a timeout. 0 if it timed out. */
+			template<typename OutputIt, typename Rep, typename Period>
+			size_t try_dequeue_bulk_for(OutputIt out, size_t max, const std::chrono::duration<Rep, Period>& duration) {
+				if (size_t got = queue_.try_dequeue_bulk(out, max))
+					return got;
+				return waitUntil([&] { return queue_.try_dequeue_bulk(out, max); },
+					std::chrono::steady_clock::now() + duration);
+			}
+
+			template<typename OutputIt, typename Rep, typename Period>
+			size_t try_dequeue_bulk_for(ConsumerToken& token, OutputIt out, size_t max,
+				const std::chrono::duration<Rep, Period>& duration) {
+				if (size_t got = queue_.try_dequeue_bulk(token, out, max))
+					return got;
+				return waitUntil([&] { return queue_.try_dequeue_bulk(token, out, max); },
+					std::chrono::steady_clock::now() + duration);
+			}
+
+			/* approximate: items enqueued and not dequeued yet. */
+			size_t size_approx() const noexcept {
+				return queue_.size_approx();
+			}
+
+			bool empty() const noexcept {
+				return queue_.empty();
+			}
+
+		private:
+			void notify(size_t count) noexcept {
+				if (count == 1)
+					waiters_.notify();
+				else if (count > 1)
+					waiters_.notifyAll();
+			}
+
+			/// Runs take() until it brings something or the deadline passes,
+			/// sleeping in between. take() returns a count or a bool. An
+			/// item is usually a moment away, and a producer which has to
+			/// wake a sleeper pays a system call, so sleep only after a
+			/// spin and a few yields found nothing.
+			template<typename Take, typename Clock, typename Duration>
+			auto waitUntil(Take&& take, const std::chrono::time_point<Clock, Duration>& deadline) -> decltype(take()) {
+				using Result = decltype(take());
+				for (uint32_t spins = 0; spins < kSpinsBeforeYield + kYieldsBeforeWait; ++spins) {
+					if (Result got = take())
+						return got;
+					if (spins < kSpinsBeforeYield)
+						asm_volatile_pause();
+					else
+						std::this_thread::yield();
+				}
+				for (;;) {
+					auto key = waiters_.prepareWait();
+					if (Result got = take()) {
+						waiters_.cancelWait();
+						return got;
+					}
+					if (deadline == Clock::time_point::max()) {
+						waiters_.wait(key);
+					}
+					else if (!waiters_.waitUntil(key, deadline)) {
+						return take();
+					}
+					if (Result got = take())
+						return got;
+				}
+			}
+
+			Queue queue_;
+			alignas(kCacheLineSize) sync::EventCount<> waiters_;
+		};
+
+	} // concurrency
+
+} // booty
+
+#endif // !BOOTY_CONCURRENCY_BLOCKINGCONCURRENTQUEUE_HPP
@@ -0,0 +1,32 @@
+/*
+ * ConcurrentQueue is a sharded, unbounded MPMC queue with producer and
+ * consumer tokens, see detail/ConcurrentQueue_impl.hpp.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_CONCURRENCY_CONCURRENTQUEUE_HPP
+#define BOOTY_CONCURRENCY_CONCURRENTQUEUE_HPP
+
+#include"../detail/ConcurrentQueue_impl.hpp"
+
+namespace booty {
+
+	namespace concurrency {
+
+		/// Usage:
+		///   ConcurrentQueue<int> q;
+		///   q.enqueue(1);                            // implicit sub-queue of this thread
+		///   ConcurrentQueue<int>::ProducerToken producer(q);
+		///   q.enqueue(producer, 2);                  // a sub-queue of its own
+		///   q.enqueue_bulk(producer, items.begin(), items.size());
+		///   ConcurrentQueue<int>::ConsumerToken consumer(q);
+		///   int v;
+		///   bool got = q.try_dequeue(consumer, v);
+		///   size_t n = q.try_dequeue_bulk(consumer, out.begin(), out.size());
+		template<typename T>
+		using ConcurrentQueue = detail::ConcurrentQueue_impl<T>;
+
+	} // concurrency
+
+} // booty
+
+#endif // !BOOTY_CONCURRENCY_CONCURRENTQUEUE_HPP
@@ -0,0 +1,401 @@
+/*
+ * This is a derivative snippet of Facebook::folly, under Apache Lisence.
+ * Indention:
+ * - Recurrent the design idea of seniors and rewrite some details to adapt
+ *   personal considerations as components of booty.
+ *
+ * @Simoncqk - 2018.05.03
+ *
+ */
+#ifndef BOOTY_CONCURRENCY_DYNAMICBOUNDEDQUEUE_H
+#define BOOTY_CONCURRENCY_DYNAMICBOUNDEDQUEUE_H
+
+#include<algorithm>
+#include<atomic>
+#include<cassert>
+#include<chrono>
+#include<cstdint>
+#include<memory>
+#include<thread>
+#include<utility>
+
+#include"../Portability.h"
+#include"../sync/Futex.h"
+#include"UnboundedQueue.hpp"
+
+namespace booty {
+
+	namespace concurrency {
+
+		/* Every item weighs 1, the capacity counts items. */
+		struct DefaultWeightFn {
+			template<typename T>
+			size_t operator()(const T&) const noexcept {
+				return 1;
+			}
+		};
+
+		namespace detail {
+			/* The budget shard of the calling thread, handed out round robin. */
+			inline size_t dynamicBoundedQueueHome() noexcept {
+				static std::atomic<size_t> next{ 0 };
+				thread_local size_t home = next.fetch_add(1, std::memory_order_relaxed);
+				return home;
+			}
+		}
+
+		/// DynamicBoundedQueue supports:
+		/// - Dynamic memory usage that grows and shrink in proportion to the
+		///   number of elements in the queue.
+		/// - A capacity that helps throttle pathological cases of growth.
+		/// - Weighted elements, the capacity bounds the total weight of the
+		///   elements in the queue rather than their number.
+		/// - Single vs. multiple producers, single vs. multiple consumers,
+		///   blocking vs. spin-waiting consumers, just as UnboundedQueue,
+		///   which holds the elements.
+		/// - Blocking, timed and non-waiting producers. A producer waits (or
+		///   fails) while the weight of its element does not fit in the
+		///   remaining capacity.
+		///
+		/// Template parameters:
+		/// - T, SingleProducer, SingleConsumer, MayBlock, LogSegmentSize,
+		///   LogAlign: as UnboundedQueue.
+		/// - WeightFn: size_t operator()(const T&), the weight of an
+		///   element. Defaults to 1 for every element. An element must weigh
+		///   the same when it is enqueued and when it is dequeued, and no
+		///   element may weigh more than the capacity.
+		///
+		/// Capacity accounting is sharded. The unused capacity is split into
+		///   cache line padded shards, and every thread debits and credits the
+		///   shard it was assigned on first use. A producer whose shard runs
+		///   short sweeps the other shards for the missing weight plus a
+		///   refill batch, which stays in its own shard, so in the steady
+		///   state capacity flows from the consumers' shards to the
+		///   producers' shards in batches and no single counter is written
+		///   by every operation. The price is that a producer may fail (or
+		///   wait) while the capacity it needs is in flight between two other
+		///   shards; the bound itself is never exceeded.
+		///
+		/// Producers that wait for capacity park on a Futex, and publish the
+		///   smallest weight any of them needs. Consumers read a shared
+		///   counter to find them, and wake them all at once when the free
+		///   capacity, over all shards, covers both that weight and a refill
+		///   batch, so a waiter wakes to room for a run of items. Room for
+		///   the waiter but short of a batch is found by the waiter itself,
+		///   which never sleeps longer than kMaxWakeDelay at a time.
+		///
+		/// Usage:
+		///   struct Bytes { size_t operator()(const std::string& s) const noexcept { return s.size(); } };
+		///   DMPMCQueue<std::string, true, 8, 7, Bytes> q(1 << 20);  // at most 1MiB of payload
+		///   q.enqueue(text);                                        // waits for capacity
+		///   bool ok = q.try_enqueue(text);                          // never waits
+		///   ok = q.try_enqueue_for(text, std::chrono::milliseconds(1));
+		///   std::string out;
+		///   q.dequeue(out);
+		///   ok = q.try_dequeue_for(out, std::chrono::milliseconds(1));
+		template<typename T, bool SingleProducer, bool SingleConsumer, bool MayBlock,
+			size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			typename WeightFn = DefaultWeightFn,
+			template<typename> class Atom = std::atomic>
+		class DynamicBoundedQueue {
+			using Queue = UnboundedQueue<T, SingleProducer, SingleConsumer, MayBlock, LogSegmentSize, LogAlign, Atom>;
+
+			static constexpr size_t kMaxShards = 64;
+			// the longest a waiting producer sleeps before it looks again.
+			static constexpr std::chrono::microseconds kMaxWakeDelay{ 1000 };
+
+			struct alignas(kCacheLineSize) Shard {
+				Atom<size_t> available{ 0 };
+			};
+
+		public:
+			/// shards = 0 picks one per hardware thread, up to kMaxShards; a
+			/// single producer queue uses one.
+			explicit DynamicBoundedQueue(size_t capacity, size_t shards = 0, WeightFn weight = WeightFn())
+				:capacity_(capacity),
+				shardCount_(roundUpShards(shards)),
+				shardMask_(shardCount_ - 1),
+				refill_(std::max<size_t>(1, capacity / (2 * shardCount_))),
+				shards_(new Shard[shardCount_]),
+				weight_(std::move(weight)) {
+				for (size_t i = 0; i < shardCount_; ++i)
+					shards_[i].available.store(capacity / shardCount_ + (i == 0 ? capacity % shardCount_ : 0),
+						std::memory_order_relaxed);
+			}
+
+			DynamicBoundedQueue(const DynamicBoundedQueue&) = delete;
+			DynamicBoundedQueue& operator=(const DynamicBoundedQueue&) = delete;
+
+			/* waits for capacity. */
+			void enqueue(const T& v) {
+				enqueueImpl(v, std::chrono::steady_clock::time_point::max());
+			}
+
+			void enqueue(T&& v) {
+				enqueueImpl(std::move(v), std::chrono::steady_clock::time_point::max());
+			}
+
+			/* fails without waiting if v does not fit, v is left untouched then. */
+			bool try_enqueue(const T& v) {
+				return enqueueImpl(v, std::chrono::steady_clock::time_point::min());
+			}
+
+			bool try_enqueue(T&& v) {
+				return enqueueImpl(std::move(v), std::chrono::steady_clock::time_point::min());
+			}
+
+			template<typename Clock, typename Duration>
+			bool try_enqueue_until(const T& v, const std::chrono::time_point<Clock, Duration>& deadline) {
+				return enqueueImpl(v, deadline);
+			}
+
+			template<typename Clock, typename Duration>
+			bool try_enqueue_until(T&& v, const std::chrono::time_point<Clock, Duration>& deadline) {
+				return enqueueImpl(std::move(v), deadline);
+			}
+
+			template<typename Rep, typename Period>
+			bool try_enqueue_for(const T& v, const std::chrono::duration<Rep, Period>& duration) {
+				return enqueueImpl(v, std::chrono::steady_clock::now() + duration);
+			}
+
+			template<typename Rep, typename Period>
+			bool try_enqueue_for(T&& v, const std::chrono::duration<Rep, Period>& duration) {
+				return enqueueImpl(std::move(v), std::chrono::steady_clock::now() + duration);
+			}
+
+			/* wait for an item. */
+			void dequeue(T& item) noexcept {
+				queue_.dequeue(item);
+				credit(weight_(item));
+			}
+
+			T dequeue() noexcept {
+				T item;
+				dequeue(item);
+				return item;
+			}
+
+			/* take an item if there is one, never waits. */
+			bool try_dequeue(T& item) noexcept {
+				if (!queue_.try_dequeue(item))
+					return false;
+				credit(weight_(item));
+				return true;
+			}
+
+			template<typename Clock, typename Duration>
+			bool try_dequeue_until(T& item, const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				if (!queue_.try_dequeue_until(item, deadline))
+					return false;
+				credit(weight_(item));
+				return true;
+			}
+
+			template<typename Rep, typename Period>
+			bool try_dequeue_for(T& item, const std::chrono::duration<Rep, Period>& duration) noexcept {
+				if (!queue_.try_dequeue_for(item, duration))
+					return false;
+				credit(weight_(item));
+				return true;
+			}
+
+			/* the bound on the total weight of the items. */
+			size_t capacity() const noexcept {
+				return capacity_;
+			}
+
+			/// Approximate total weight of the items in the queue, including
+			/// the items being enqueued and dequeued right now.
+			size_t weight() const noexcept {
+				size_t available = 0;
+				for (size_t i = 0; i < shardCount_; ++i)
+					available += shards_[i].available.load(std::memory_order_relaxed);
+				return available < capacity_ ? capacity_ - available : 0;
+			}
+
+			/* approximate: items enqueued and not dequeued yet. */
+			size_t size() const noexcept {
+				return queue_.size();
+			}
+
+			bool empty() const noexcept {
+				return queue_.empty();
+			}
+
+		private:
+			static size_t roundUpShards(size_t shards) noexcept {
+				if constexpr (SingleProducer)
+					return 1;
+				if (shards == 0)
+					shards = std::max(1u, std::thread::hardware_concurrency());
+				size_t rounded = 1;
+				while (rounded < shards && rounded < kMaxShards)
+					rounded <<= 1;
+				return rounded;
+			}
+
+			template<typename Arg, typename Clock, typename Duration>
+			bool enqueueImpl(Arg&& v, const std::chrono::time_point<Clock, Duration>& deadline) {
+				const size_t w = weight_(v);
+				assert(w <= capacity_);
+				if (!debitUntil(w, deadline))
+					return false;
+				try {
+					queue_.enqueue(std::forward<Arg>(v));
+				}
+				catch (...) {
+					credit(w);
+					throw;
+				}
+				return true;
+			}
+
+			/// Takes w out of the calling thread's shard, or sweeps all the
+			/// shards when it runs short. The sweep first adds the shards up
+			/// and fails without taking anything when they hold less than w;
+			/// only a race with other producers can leave it with a part of w,
+			/// which goes back with a wakeup, as it was there to be had.
+			bool tryDebit(size_t w) noexcept {
+				if (w == 0)
+					return true;
+				const size_t home = detail::dynamicBoundedQueueHome() & shardMask_;
+				Shard& own = shards_[home];
+				size_t available = own.available.load();
+				while (available >= w) {
+					if (own.available.compare_exchange_weak(available, available - w))
+						return true;
+				}
+				size_t total = 0;
+				for (size_t i = 0; i < shardCount_; ++i)
+					total += shards_[i].available.load();
+				if (total < w)
+					return false;
+				// the sweep also brings a refill batch home, so the next debits
+				// of this thread are local again.
+				size_t gathered = 0;
+				for (size_t i = 0; i < shardCount_ && gathered < w; ++i)
+					gathered += take(shards_[(home + i) & shardMask_], w - gathered + refill_);
+				if (gathered >= w) {
+					if (gathered > w)
+						own.available.fetch_add(gathered - w);
+					return true;
+				}
+				if (gathered) {
+					own.available.fetch_add(gathered);
+					wakeProducers();
+				}
+				return false;
+			}
+
+			/* Takes up to `most` out of a shard, returns how much it got. */
+			static size_t take(Shard& shard, size_t most) noexcept {
+				size_t available = shard.available.load();
+				while (available) {
+					size_t got = std::min(available, most);
+					if (shard.available.compare_exchange_weak(available, available - got))
+						return got;
+				}
+				return 0;
+			}
+
+			/// A waiting producer counts itself in waiting_, then lowers
+			/// needed_ to its weight, before its last look at the shards, and
+			/// parks on the epoch it read before all that. The consumer that
+			/// wakes the waiters zeroes the count, so a crowd of waiters costs
+			/// one wakeup; a waiter that is still short counts itself again.
+			template<typename Clock, typename Duration>
+			bool debitUntil(size_t w, const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				if (tryDebit(w))
+					return true;
+				if (deadline == std::chrono::time_point<Clock, Duration>::min())
+					return false;
+				while (true) {
+					const uint32_t epoch = wakeups_.load();
+					waiting_.fetch_add(1);
+					size_t needed = needed_.load();
+					while (w < needed && !needed_.compare_exchange_weak(needed, w)) {}
+					if (tryDebit(w))
+						return true;
+					if (Clock::now() >= deadline - std::chrono::duration_cast<Duration>(kMaxWakeDelay)) {
+						if (wakeups_.futexWaitUntil(epoch, deadline) == sync::FutexResult::TIMEDOUT)
+							return tryDebit(w);
+					}
+					else {
+						wakeups_.futexWaitUntil(epoch, std::chrono::steady_clock::now() + kMaxWakeDelay);
+					}
+				}
+			}
+
+			/// Returns w to the calling thread's shard, and wakes the waiting
+			/// producers once the free capacity, wherever it sits, covers the
+			/// smallest weight one of them needs and a refill batch. The
+			/// shards are only added up while somebody waits and the own
+			/// shard falls short.
+			void credit(size_t w) noexcept {
+				if (w == 0)
+					return;
+				const size_t home = detail::dynamicBoundedQueueHome() & shardMask_;
+				size_t available = shards_[home].available.fetch_add(w) + w;
+				if (waiting_.load() == 0)
+					return;
+				const size_t enough = std::max(needed_.load(), refill_);
+				for (size_t i = 1; i < shardCount_ && available < enough; ++i)
+					available += shards_[(home + i) & shardMask_].available.load();
+				if (available >= enough)
+					wakeProducers();
+			}
+
+			/// needed_ is reset before the count: a waiter counted after the
+			/// exchange, whom this wakeup misses, lowers needed_ after it.
+			void wakeProducers() noexcept {
+				needed_.store(SIZE_MAX);
+				if (waiting_.exchange(0) != 0) {
+					wakeups_.fetch_add(1);
+					wakeups_.futexWake();
+				}
+			}
+
+			const size_t capacity_;
+			const size_t shardCount_;
+			const size_t shardMask_;
+			const size_t refill_;
+			const std::unique_ptr<Shard[]> shards_;
+			WeightFn weight_;
+
+			/// Producers waiting for capacity, the smallest weight they wait
+			/// for, and the futex they park on.
+			alignas(kCacheLineSize) Atom<uint32_t> waiting_{ 0 };
+			Atom<size_t> needed_{ SIZE_MAX };
+			sync::Futex<Atom> wakeups_{ 0 };
+
+			Queue queue_;
+		};
+
+		/* Aliases */
+
+		/// SPSC
+		template<typename T, bool MayBlock, size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			typename WeightFn = DefaultWeightFn, template<typename> class Atom = std::atomic>
+		using DSPSCQueue = DynamicBoundedQueue<T, true, true, MayBlock, LogSegmentSize, LogAlign, WeightFn, Atom>;
+
+		/// MPSC
+		template<typename T, bool MayBlock, size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			typename WeightFn = DefaultWeightFn, template<typename> class Atom = std::atomic>
+		using DMPSCQueue = DynamicBoundedQueue<T, false, true, MayBlock, LogSegmentSize, LogAlign, WeightFn, Atom>;
+
+		/// SPMC
+		template<typename T, bool MayBlock, size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			typename WeightFn = DefaultWeightFn, template<typename> class Atom = std::atomic>
+		using DSPMCQueue = DynamicBoundedQueue<T, true, false, MayBlock, LogSegmentSize, LogAlign, WeightFn, Atom>;
+
+		/// MPMC
+		template<typename T, bool MayBlock, size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			typename WeightFn = DefaultWeightFn, template<typename> class Atom = std::atomic>
+		using DMPMCQueue = DynamicBoundedQueue<T, false, false, MayBlock, LogSegmentSize, LogAlign, WeightFn, Atom>;
+
+	} // concurrency
+
+} // booty
+
+#endif // !BOOTY_CONCURRENCY_DYNAMICBOUNDEDQUEUE_H
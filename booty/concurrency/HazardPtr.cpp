@@ -7,7 +7,11 @@
  * @Simoncqk - 2018.05.02
  *
  */
+#include<algorithm>
+#include<chrono>
 #include<memory>
+#include<new>
+#include<vector>
 
 #include"HazardPtr.h"
 
@@ -15,75 +19,148 @@ namespace booty {
 
 	namespace concurrency {
 
-
-
-
-		constexpr hazptr_domain::hazptr_domain(std::pmr::memory_resource * mr) noexcept
-			:mr_(mr) {}
+		hazptr_domain& default_hazptr_domain() noexcept {
+			static hazptr_domain domain;
+			return domain;
+		}
 
 		hazptr_domain::~hazptr_domain() {
+			// objects reclaimed here may retire others in turn.
+			hazptr_obj* obj;
+			while ((obj = retired_.exchange(nullptr, std::memory_order_acquire)) != nullptr) {
+				while (obj) {
+					hazptr_obj* next = obj->next_;
+					obj->reclaim_(obj);
+					obj = next;
+				}
+			}
+			hazptr_rec* rec = hazptrs_.load(std::memory_order_acquire);
+			while (rec) {
+				hazptr_rec* next = rec->next_;
+				rec->~hazptr_rec();
+				mr_->deallocate(rec, sizeof(hazptr_rec), alignof(hazptr_rec));
+				rec = next;
+			}
 		}
 
 		void hazptr_domain::cleanup() {
+			rcount_.exchange(0, std::memory_order_acq_rel);
+			bulkReclaim();
 		}
 
 		void hazptr_domain::tryTimedCleanup() {
+			uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+			uint64_t due = syncTime_.load(std::memory_order_relaxed);
+			if (now < due || !syncTime_.compare_exchange_strong(due, now + syncTimePeriod_,
+				std::memory_order_relaxed, std::memory_order_relaxed)) {
+				return;
+			}
+			cleanup();
 		}
 
-		void hazptr_domain::objRetire(hazptr_obj *) {
+		void hazptr_domain::objRetire(hazptr_obj* obj) {
+			int rcount = pushRetired(obj, obj, 1);
+			if (reachedThreshold(rcount))
+				tryBulkReclaim();
+			else
+				tryTimedCleanup();
 		}
 
 		hazptr_rec * hazptr_domain::hazptrAcquire() {
-			return nullptr;
+			for (hazptr_rec* rec = hazptrs_.load(std::memory_order_acquire); rec; rec = rec->next_) {
+				if (rec->tryAcquire())
+					return rec;
+			}
+			void* mem = mr_->allocate(sizeof(hazptr_rec), alignof(hazptr_rec));
+			hazptr_rec* rec = new (mem) hazptr_rec;
+			rec->active_.store(true, std::memory_order_relaxed);
+			rec->next_ = hazptrs_.load(std::memory_order_relaxed);
+			while (!hazptrs_.compare_exchange_weak(rec->next_, rec,
+				std::memory_order_release, std::memory_order_relaxed)) {}
+			hcount_.fetch_add(1, std::memory_order_relaxed);
+			return rec;
 		}
 
-		void hazptr_domain::hazptrRelease(hazptr_rec *) noexcept {
+		void hazptr_domain::hazptrRelease(hazptr_rec * rec) noexcept {
+			rec->clear();
+			rec->release();
 		}
 
 		int hazptr_domain::pushRetired(hazptr_obj * head, hazptr_obj * tail, int count) {
-			return 0;
+			tail->next_ = retired_.load(std::memory_order_relaxed);
+			while (!retired_.compare_exchange_weak(tail->next_, head,
+				std::memory_order_release, std::memory_order_relaxed)) {}
+			return rcount_.fetch_add(count, std::memory_order_acq_rel) + count;
 		}
 
 		bool hazptr_domain::reachedThreshold(int rcount) {
-			return false;
+			return rcount >= kThreshold && rcount >= 2 * hcount_.load(std::memory_order_acquire);
 		}
 
 		void hazptr_domain::tryBulkReclaim() {
+			while (true) {
+				int rcount = rcount_.load(std::memory_order_acquire);
+				if (!reachedThreshold(rcount))
+					return;
+				if (rcount_.compare_exchange_weak(rcount, 0,
+					std::memory_order_release, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			bulkReclaim();
 		}
 
+		/// Take the whole retired list, reclaim what no hazard pointer points
+		/// to, and push the rest back.
 		void hazptr_domain::bulkReclaim() {
-		}
-
-		inline void hazptr_rec::set(const void * p) noexcept {
-			hazptr_.store(p, std::memory_order_release);
-		}
-
-		inline const void * hazptr_rec::get() const noexcept {
-			return hazptr_.load(std::memory_order_acquire);
-		}
-
-		inline void hazptr_rec::clear() noexcept {
-			hazptr_.store(nullptr, std::memory_order_release);
-		}
-
-		inline bool hazptr_rec::isActive() noexcept {
-			return active_.load(std::memory_order_acquire);
-		}
-
-		inline bool hazptr_rec::tryAcquire() noexcept {
-			bool active = isActive();
-			if (!active&&
-				active_.compare_exchange_strong(
-					active, true, std::memory_order_release, std::memory_order_relaxed)) {
-				return true;
+			hazptr_obj* obj = retired_.exchange(nullptr, std::memory_order_acquire);
+			if (!obj)
+				return;
+			// pairs with the fence of hazptr_holder::try_protect().
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			// the snapshot lives on the stack unless there are more hazard
+			// pointers set than it holds, so a scan does not allocate.
+			const void* inline_ptrs[kInlineHazptrs];
+			size_t count = 0;
+			std::vector<const void*> more;
+			for (hazptr_rec* rec = hazptrs_.load(std::memory_order_acquire); rec; rec = rec->next_) {
+				const void* p = rec->get();
+				if (!p)
+					continue;
+				if (count < kInlineHazptrs) {
+					inline_ptrs[count++] = p;
+					continue;
+				}
+				if (more.empty())
+					more.assign(inline_ptrs, inline_ptrs + count);
+				more.push_back(p);
 			}
-			return false;
-		}
-
-		inline void hazptr_rec::release() noexcept {
-			active_.store(false, std::memory_order_release);
+			const void** first = more.empty() ? inline_ptrs : more.data();
+			const void** last = more.empty() ? inline_ptrs + count : more.data() + more.size();
+			std::sort(first, last);
+
+			hazptr_obj* kept_head = nullptr;
+			hazptr_obj* kept_tail = nullptr;
+			int kept = 0;
+			while (obj) {
+				hazptr_obj* next = obj->next_;
+				if (std::binary_search(first, last, obj->getObjPtr())) {
+					obj->next_ = kept_head;
+					kept_head = obj;
+					if (!kept_tail)
+						kept_tail = obj;
+					++kept;
+				}
+				else {
+					obj->reclaim_(obj);
+				}
+				obj = next;
+			}
+			if (kept_head)
+				pushRetired(kept_head, kept_tail, kept);
 		}
 
 	} // concurrency
 
-} // booty
\ No newline at end of file
+} // booty
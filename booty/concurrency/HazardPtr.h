@@ -13,6 +13,10 @@
 #include<memory_resource>
 #include<atomic>
 #include<cassert>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<utility>
 
 #include"../Portability.h"
 
@@ -21,14 +25,28 @@ namespace booty {
 	namespace concurrency {
 
 		/// Hazard Pointer: every reading-thread maintain a hazard pointer for
-		/// single-writing & multi-reading. 
-		/// Effection: By iterating every hazard pointer, we can judge whether the 
+		/// single-writing & multi-reading.
+		/// Effection: By iterating every hazard pointer, we can judge whether the
 		/// pointed content is being visited by reading threads or not, so to
 		/// determine is it safe to delete the memory hazard pointer points to.
+		///
+		/// Usage: a reader protects a pointer loaded from a shared location
+		/// with a hazptr_holder, a writer which unlinked an object retires it
+		/// to a hazptr_domain instead of deleting it. The domain reclaims
+		/// retired objects in bulk, once there are enough of them, skipping
+		/// those some holder still protects. Link HazardPtr.cpp.
+
+		class hazptr_domain;
+		class hazptr_holder;
+
+		/* the domain used when none is given. */
+		hazptr_domain& default_hazptr_domain() noexcept;
 
 		/** hazptr_rec: Private class that contains hazard pointers. */
-		class alignas(std::hardware_destructive_interference_size) hazptr_rec {
+		class alignas(kCacheLineSize) hazptr_rec {
 			friend class hazptr_domain;
+			friend class hazptr_holder;
+			friend class hazptr_tc;
 
 			std::atomic<const void*> hazptr_{ nullptr };
 			hazptr_rec* next_{ nullptr };
@@ -42,9 +60,91 @@ namespace booty {
 			void release() noexcept;
 		};
 
+		inline void hazptr_rec::set(const void * p) noexcept {
+			hazptr_.store(p, std::memory_order_release);
+		}
+
+		inline const void * hazptr_rec::get() const noexcept {
+			return hazptr_.load(std::memory_order_acquire);
+		}
+
+		inline void hazptr_rec::clear() noexcept {
+			hazptr_.store(nullptr, std::memory_order_release);
+		}
+
+		inline bool hazptr_rec::isActive() noexcept {
+			return active_.load(std::memory_order_acquire);
+		}
+
+		inline bool hazptr_rec::tryAcquire() noexcept {
+			bool active = isActive();
+			if (!active&&
+				active_.compare_exchange_strong(
+					active, true, std::memory_order_acquire, std::memory_order_relaxed)) {
+				return true;
+			}
+			return false;
+		}
+
+		inline void hazptr_rec::release() noexcept {
+			active_.store(false, std::memory_order_release);
+		}
+
+		/* hazptr_obj: Private class for objects protected by hazard pointers. */
+		class hazptr_obj {
+			friend class hazptr_domain;
+			template<typename, typename>
+			friend class hazptr_obj_base;
+			template<typename, typename>
+			friend class hazptr_obj_base_refcounted;
+
+			using reclaim_fn = void(*)(hazptr_obj*);
+
+			reclaim_fn reclaim_{ nullptr };
+			// the address readers protect, i.e. the retired object itself.
+			const void* obj_{ nullptr };
+			hazptr_obj* next_;
+		public:
+			// All constructors set next_ to this in order to catch misuse bugs like
+			// double retire.
+			hazptr_obj()noexcept
+				:next_(this) {}
+			hazptr_obj(const hazptr_obj&)noexcept
+				:next_(this) {}
+			hazptr_obj(hazptr_obj&&)noexcept
+				:next_(this) {}
+
+			hazptr_obj& operator=(const hazptr_obj&) {
+				return *this;
+			}
+
+			hazptr_obj& operator=(hazptr_obj&&) {
+				return *this;
+			}
+
+		private:
+			void set_next(hazptr_obj* next) {
+				next_ = next;
+			}
+
+			void retireCheckFail() {
+				assert(next_ == this);
+			}
+
+			void retireCheck() {
+				// Only for catching misusage bugs like double retire
+				if (next_ != this) {
+					retireCheckFail();
+				}
+			}
+
+			const void* getObjPtr() const {
+				return obj_;
+			}
+		};
+
 		/** hazptr_domain: Class of hazard pointer domains. Each domain manages a set
 		*  of hazard pointers and a set of retired objects. */
-		class hazptr_obj;
 		class hazptr_domain {
 			std::pmr::memory_resource* mr_;
 			std::atomic<hazptr_rec*> hazptrs_{ nullptr };
@@ -55,12 +155,18 @@ namespace booty {
 			std::atomic<int> hcount_{ 0 };
 			std::atomic<int> rcount_{ 0 };
 
+			// retired objects below which no reclamation is attempted.
+			static constexpr int kThreshold = 1000;
+			// hazard pointers a reclamation scan snapshots without allocating.
+			static constexpr size_t kInlineHazptrs = 256;
 			static constexpr uint64_t syncTimePeriod_{ 2000000000 }; // in ns
 			std::atomic<uint64_t> syncTime_{ 0 };
 
 		public:
-			constexpr explicit hazptr_domain(
-				std::pmr::memory_resource* = std::pmr::get_default_resource()) noexcept;
+			explicit hazptr_domain(
+				std::pmr::memory_resource* mr = std::pmr::get_default_resource()) noexcept
+				:mr_(mr) {}
+			/* reclaims whatever is still retired, no holder may be left. */
 			~hazptr_domain();
 
 			// forbid copy-construct tool functions.
@@ -72,16 +178,18 @@ namespace booty {
 			/** Free-function retire.  May allocate memory */
 			template <typename T, typename D = std::default_delete<T>>
 			void retire(T* obj, D reclaim = {});
+			/* reclaim every retired object no hazard pointer protects now. */
 			void cleanup();
+			/* cleanup(), at most once per syncTimePeriod_. */
 			void tryTimedCleanup();
 
 		private:
 			friend class hazptr_holder;
+			friend class hazptr_tc;
 			template <typename, typename>
 			friend class hazptr_obj_base;
 			template <typename, typename>
 			friend class hazptr_obj_base_refcounted;
-			friend class hazptr_priv;
 
 			void objRetire(hazptr_obj*);
 			hazptr_rec* hazptrAcquire();
@@ -92,58 +200,97 @@ namespace booty {
 			void bulkReclaim();
 		};
 
-		static hazptr_domain default_domain_;
+		/// hazptr_tc: per-thread cache of hazard pointer records of the default
+		/// domain, so that a holder costs no shared atomic operation.
+		class hazptr_tc {
+			friend class hazptr_holder;
+			static constexpr size_t kCapacity = 4;
 
-		hazptr_domain& default_hazptr_domain() {
-			return default_domain_;
-		}
+			hazptr_rec* recs_[kCapacity];
+			size_t count_ = 0;
 
-		/* hazptr_obj: Private class for objects protected by hazard pointers. */
-		class hazptr_obj {
-			template<typename, typename>
-			friend class hazptr_obj_base;
-			template<typename, typename>
-			friend class hazptr_obj_base_refcounted;
-
-			std::function<void(hazptr_obj *)> relaim_;
-			hazptr_obj* next_;
 		public:
-			// All constructors set next_ to this in order to catch misuse bugs like
-			// double retire.
-			hazptr_obj()noexcept
-				:next_(this) {}
-			hazptr_obj(const hazptr_obj&)noexcept
-				:next_(this) {}
-			hazptr_obj(hazptr_obj&&)noexcept
-				:next_(this) {}
+			~hazptr_tc() {
+				for (size_t i = 0; i < count_; ++i)
+					default_hazptr_domain().hazptrRelease(recs_[i]);
+			}
 
-			hazptr_obj& operator=(const hazptr_obj&) {
-				return *this;
+		private:
+			static hazptr_tc& local() noexcept {
+				static thread_local hazptr_tc tc;
+				return tc;
 			}
 
-			hazptr_obj& operator=(hazptr_obj&&) {
-				return *this;
+			hazptr_rec* tryGet() noexcept {
+				return count_ > 0 ? recs_[--count_] : nullptr;
 			}
 
-		private:
-			void set_next(hazptr_obj* next) {
-				next_ = next;
+			bool tryPut(hazptr_rec* rec) noexcept {
+				if (count_ == kCapacity)
+					return false;
+				recs_[count_++] = rec;
+				return true;
 			}
+		};
 
-			void retireCheckFail() {
-				assert(next_== this);
+		/// hazptr_holder owns one hazard pointer for its lifetime. The object
+		/// it protects is not reclaimed until the holder is reset or destroyed.
+		class hazptr_holder {
+		public:
+			explicit hazptr_holder(hazptr_domain& domain = default_hazptr_domain())
+				:domain_(&domain) {
+				if (&domain == &default_hazptr_domain())
+					rec_ = hazptr_tc::local().tryGet();
+				if (!rec_)
+					rec_ = domain.hazptrAcquire();
 			}
 
-			void retireCheck() {
-				// Only for catching misusage bugs like double retire
-				if (next_ != this) {
-					retireCheckFail();
+			~hazptr_holder() {
+				rec_->clear();
+				if (domain_ != &default_hazptr_domain() || !hazptr_tc::local().tryPut(rec_))
+					domain_->hazptrRelease(rec_);
+			}
+
+			hazptr_holder(const hazptr_holder&) = delete;
+			hazptr_holder& operator=(const hazptr_holder&) = delete;
+
+			/* load `src` and protect the value, retry until they agree. */
+			template<typename T, template<typename> class Atom = std::atomic>
+			T* get_protected(const Atom<T*>& src) noexcept {
+				T* ptr = src.load(std::memory_order_relaxed);
+				while (!try_protect(ptr, src)) {}
+				return ptr;
+			}
+
+			/// Protect `ptr`, loaded from `src` before. False, with `ptr`
+			/// reloaded, if `src` has changed meanwhile.
+			template<typename T, template<typename> class Atom = std::atomic>
+			bool try_protect(T*& ptr, const Atom<T*>& src) noexcept {
+				T* before = ptr;
+				reset(before);
+				// orders the publication above before the validation below, pairs
+				// with the fence of the reclaimer between unlinking and scanning.
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				ptr = src.load(std::memory_order_acquire);
+				if (ptr != before) {
+					reset();
+					return false;
 				}
+				return true;
 			}
 
-			const void* getObjPtr() const {
-				return this;
+			template<typename T>
+			void reset(const T* ptr) noexcept {
+				rec_->set(ptr);
 			}
+
+			void reset(std::nullptr_t = nullptr) noexcept {
+				rec_->clear();
+			}
+
+		private:
+			hazptr_domain* domain_;
+			hazptr_rec* rec_ = nullptr;
 		};
 
 		/* Defination of hazptr_obj_base */
@@ -163,9 +310,10 @@ namespace booty {
 		class hazptr_obj_base_refcounted :public hazptr_obj {
 		public:
 			/* Retire a removed object and pass the responsibility for
-			reclaiming it to the hazptr library
+			reclaiming it to the hazptr library. It is deleted once no hazard
+			pointer protects it and its reference count has dropped to zero.
 			*/
-			//void retire();
+			void retire(hazptr_domain& domain = default_hazptr_domain(), D deleter = {});
 
 			/* aquire_ref() increments the reference count
 			*
@@ -187,10 +335,27 @@ namespace booty {
 			D deleter_;
 		};
 
-
 		template<typename T, typename D>
 		inline void hazptr_domain::retire(T * obj, D reclaim) {
+			// a node carrying the object, readers protect the object itself.
+			struct hazptr_retire_node :public hazptr_obj_base<hazptr_retire_node> {
+				T* obj;
+				D reclaim;
 
+				hazptr_retire_node(T* o, D r)
+					:obj(o), reclaim(std::move(r)) {}
+
+				~hazptr_retire_node() {
+					reclaim(obj);
+				}
+			};
+			auto node = new hazptr_retire_node(obj, std::move(reclaim));
+			node->retireCheck();
+			node->obj_ = obj;
+			node->reclaim_ = [](hazptr_obj* p) {
+				delete static_cast<hazptr_retire_node*>(p);
+			};
+			objRetire(node);
 		}
 
 		template<typename T, typename D>
@@ -201,7 +366,6 @@ namespace booty {
 		template<typename T, typename D>
 		inline void hazptr_obj_base_refcounted<T, D>::acquire_ref_safe() {
 			auto old_val = refcount_.load(std::memory_order_acquire);
-			assert(old_val >= 0);
 			refcount_.store(old_val + 1, std::memory_order_release);
 		}
 
@@ -213,17 +377,23 @@ namespace booty {
 			}
 			else {
 				if (kIsDebug) {
-					refcount_.store(-1);
+					refcount_.store(static_cast<uint32_t>(-1));
 				}
 			}
-			assert(old_val >= 0);
 			return old_val == 0;
 		}
 
+		template<typename T, typename D>
+		inline void hazptr_obj_base_refcounted<T, D>::retire(hazptr_domain& domain, D deleter) {
+			preRetire(std::move(deleter));
+			domain.objRetire(this);
+		}
+
 		template<typename T, typename D>
 		inline void hazptr_obj_base_refcounted<T, D>::preRetire(D deleter) {
 			deleter_ = std::move(deleter);
 			retireCheck();
+			obj_ = static_cast<const T*>(this);
 			reclaim_ = [](hazptr_obj* p) {
 				auto hrobp = static_cast<hazptr_obj_base_refcounted*>(p);
 				if (hrobp->release_ref()) {
@@ -238,15 +408,12 @@ namespace booty {
 		inline void hazptr_obj_base<T, D>::retire(hazptr_domain & domain,D deleter){
 			retireCheck();
 			deleter_ = std::move(deleter);
+			obj_ = static_cast<const T*>(this);
 			reclaim_ = [](hazptr_obj* p) {
 				auto hobp = static_cast<hazptr_obj_base*>(p);
 				auto obj = static_cast<T*>(hobp);
 				hobp->deleter_(obj);
 			};
-
-			if (&domain == &default_hazptr_domain()) {
-				// TODO!!!
-			}
 			domain.objRetire(this);
 		}
 
@@ -0,0 +1,570 @@
+/*
+ * This is a derivative snippet of Facebook::folly, under Apache Lisence.
+ * Indention:
+ * - Recurrent the design idea of seniors and rewrite some details to adapt
+ *   personal considerations as components of booty.
+ *
+ * @Simoncqk - 2018.05.03
+ *
+ */
+#ifndef BOOTY_CONCURRENCY_MPMCQUEUE_H
+#define BOOTY_CONCURRENCY_MPMCQUEUE_H
+
+#include<atomic>
+#include<cassert>
+#include<chrono>
+#include<cstdint>
+#include<memory>
+#include<new>
+#include<stdexcept>
+#include<type_traits>
+#include<utility>
+
+#include"../Portability.h"
+#include"../base/Base.h"
+#include"../sync/TurnSequencer.hpp"
+
+namespace booty {
+
+	namespace concurrency {
+		/// MPMCQueue<T> is a high-performance bounded concurrent queue that
+		/// supports multiple producers, multiple consumers, and optional
+		/// blocking. The queue has a fixed capacity, for which all memory will
+		/// be allocated up front. The bulk of the work of enqueuing and
+		/// dequeuing can be performed in parallel.
+		///
+		/// The capacity is rounded up to a power of two, so a ticket maps to
+		/// its slot and turn with a mask and a shift. Each slot is padded to a
+		/// cache line and carries a TurnSequencer; the push and pop tickets
+		/// live on cache lines of their own.
+		///
+		/// MPMCQueue is linearizable. That means that if a call to write(A)
+		/// returns before a call to write(B) begins, then A will definitely
+		/// end up in the queue before B, and if a call to read(X) returns
+		/// before a call to read(Y) is started, that X will be something from
+		/// earlier in the queue than Y. This also means that if a read call
+		/// returns a value, you can be sure that all previous elements of the
+		/// queue have been assigned a reader (that reader might not yet have
+		/// returned, but it exists).
+		///
+		/// The underlying implementation uses a ticket dispenser for the head
+		/// and the tail, spreading accesses across N single-element queues to
+		/// produce a queue with capacity N. The ticket dispensers use atomic
+		/// increment, which is more robust to contention than a CAS loop. Each
+		/// of the single-element queues uses its own CAS to serialize access,
+		/// with an adaptive spin cutoff. When spinning fails on a
+		/// single-element queue it uses futex()'s _BITSET operations to reduce
+		/// unnecessary wakeups even if multiple waiters are present on an
+		/// individual queue (such as when the MPMCQueue's capacity is smaller
+		/// than the number of enqueuers or dequeuers).
+		///
+		/// tests/mpmc_queue_bench.cpp compares it with UMPMCQueue and
+		/// UnboundedLockQueue at 1 to 1, 1 to N, N to 1 and N to M thread
+		/// counts, and measures the round trip latency of a handoff.
+		///
+		/// write() and read() never wait and never allocate: they fail when
+		/// the queue is full or empty. blockingWrite() and blockingRead() take
+		/// a ticket unconditionally and wait for its turn, the timed variants
+		/// give up at a deadline. Nothing is allocated after construction.
+		///
+		/// The element constructor used by write() and blockingWrite() must not
+		/// throw: a ticket that was taken has to be completed, or the readers
+		/// of its slot wait forever.
+		///
+		/// Usage:
+		///   MPMCQueue<int> q(1000);   // capacity 1024
+		///   q.blockingWrite(1);       // waits while full
+		///   bool ok = q.write(2);     // never waits
+		///   int v;
+		///   q.blockingRead(v);        // waits while empty
+		///   ok = q.read(v);           // never waits
+		///   ok = q.tryReadFor(v, std::chrono::milliseconds(1));
+		template<typename T, template<typename> class Atom = std::atomic>
+		class MPMCQueue :public NonCopyable {
+			static_assert(std::is_nothrow_move_constructible_v<T>, "T must be nothrow_move_constructible.");
+			static_assert(std::is_nothrow_move_assignable_v<T>, "T must be nothrow_move_assignable.");
+			static_assert(std::is_nothrow_destructible_v<T>, "T must be nothrow_destructible.");
+
+			using Sequencer = sync::TurnSequencer<Atom>;
+
+			/// Once in kAdaptationFreq tickets a waiter spins up to the full
+			/// limit and feeds the result back into the spin cutoff.
+			static constexpr uint64_t kAdaptationFreq = 128;
+
+			/// A single-element queue. The sequencer runs two turns per ticket
+			/// that lands here: 2*t for the writer, 2*t+1 for the reader.
+			struct alignas(kCacheLineSize) Slot {
+				Sequencer sequencer;
+				typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+				T* ptr() noexcept {
+					return std::launder(reinterpret_cast<T*>(&storage));
+				}
+
+				bool mayEnqueue(uint32_t turn) const noexcept {
+					return sequencer.isTurn(turn * 2);
+				}
+
+				bool mayDequeue(uint32_t turn) const noexcept {
+					return sequencer.isTurn(turn * 2 + 1);
+				}
+
+				template<typename... Args>
+				void enqueue(uint32_t turn, Atom<uint32_t>& spinCutoff, bool updateSpinCutoff, Args&&... args) noexcept {
+					sequencer.waitForTurn(turn * 2, spinCutoff, updateSpinCutoff);
+					new (&storage) T(std::forward<Args>(args)...);
+					sequencer.completeTurn(turn * 2);
+				}
+
+				void dequeue(uint32_t turn, Atom<uint32_t>& spinCutoff, bool updateSpinCutoff, T& elem) noexcept {
+					sequencer.waitForTurn(turn * 2 + 1, spinCutoff, updateSpinCutoff);
+					T* p = ptr();
+					elem = std::move(*p);
+					p->~T();
+					sequencer.completeTurn(turn * 2 + 1);
+				}
+
+				/* Waits until the writer's turn of `turn` may start, or the deadline. */
+				template<class Clock, class Duration>
+				bool waitEnqueueUntil(uint32_t turn, Atom<uint32_t>& spinCutoff,
+					const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+					return sequencer.tryWaitForTurn(turn * 2, spinCutoff, false, &deadline)
+						!= Sequencer::TryWaitResult::TIMEDOUT;
+				}
+
+				template<class Clock, class Duration>
+				bool waitDequeueUntil(uint32_t turn, Atom<uint32_t>& spinCutoff,
+					const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+					return sequencer.tryWaitForTurn(turn * 2 + 1, spinCutoff, false, &deadline)
+						!= Sequencer::TryWaitResult::TIMEDOUT;
+				}
+			};
+
+		public:
+			using value_type = T;
+
+			explicit MPMCQueue(size_t queueCapacity)
+				:capacity_(roundUpCapacity(queueCapacity)),
+				mask_(capacity_ - 1),
+				shift_(log2(capacity_)),
+				slots_(new Slot[capacity_]) {}
+
+			/// A default-constructed queue is useful because a usable (non-zero
+			/// capacity) queue can be moved onto it or swapped with it.
+			MPMCQueue() noexcept
+				:capacity_(0), mask_(0), shift_(0) {}
+
+			/// IMPORTANT: The move constructor is here to make it easier to
+			/// perform the initialization phase, it is not safe to use when
+			/// there are any concurrent accesses (this is not checked).
+			MPMCQueue(MPMCQueue&& rhs) noexcept
+				:MPMCQueue() {
+				swap(rhs);
+			}
+
+			/// IMPORTANT: The move operator is here to make it easier to perform
+			/// the initialization phase, it is not safe to use when there are
+			/// any concurrent accesses (this is not checked).
+			MPMCQueue& operator=(MPMCQueue&& rhs) noexcept {
+				if (this != &rhs) {
+					MPMCQueue tmp(std::move(rhs));
+					swap(tmp);
+				}
+				return *this;
+			}
+
+			/// MPMCQueue can only be safely destroyed when there are no pending
+			/// enqueuers or dequeuers (this is not checked). Elements still in
+			/// the queue are destroyed.
+			~MPMCQueue() {
+				uint64_t pop = popTicket_.load(std::memory_order_relaxed);
+				uint64_t push = pushTicket_.load(std::memory_order_relaxed);
+				for (uint64_t ticket = pop; ticket < push; ++ticket)
+					slots_[idx(ticket)].ptr()->~T();
+			}
+
+			/* Not thread safe, see the move constructor. */
+			void swap(MPMCQueue& rhs) noexcept {
+				using std::swap;
+				swap(capacity_, rhs.capacity_);
+				swap(mask_, rhs.mask_);
+				swap(shift_, rhs.shift_);
+				swap(slots_, rhs.slots_);
+				// the tickets cannot be swapped as a whole, they are atomics.
+				swapAtomic(pushTicket_, rhs.pushTicket_);
+				swapAtomic(popTicket_, rhs.popTicket_);
+				swapAtomic(pushSpinCutoff_, rhs.pushSpinCutoff_);
+				swapAtomic(popSpinCutoff_, rhs.popSpinCutoff_);
+			}
+
+			/// Returns the number of writes (including threads that are
+			/// blocked waiting to write) minus the number of reads (including
+			/// threads that are blocked waiting to read). So effectively, it
+			/// becomes:
+			///   elements in queue + pending(calls to write) - pending(calls to read).
+			/// If nothing is pending, then the method returns the actual number
+			/// of elements in the queue.
+			/// The returned value can be negative if there are no writers and
+			/// the queue is empty, but there is one reader that is blocked
+			/// waiting to read (in which case, the returned size will be -1).
+			int64_t size() const noexcept {
+				// since both pushes and pops increase monotonically, we can get a
+				// consistent snapshot either by bracketing a read of popTicket_
+				// with two reads of pushTicket_ that return the same value, or
+				// the other way around. We maximize our chances by alternately
+				// attempting both bracketings.
+				uint64_t pushes = pushTicket_.load(std::memory_order_acquire); // A
+				uint64_t pops = popTicket_.load(std::memory_order_acquire); // B
+				while (true) {
+					uint64_t nextPushes = pushTicket_.load(std::memory_order_acquire); // C
+					if (pushes == nextPushes) {
+						// pushTicket_ didn't change from A (or the previous C) to C,
+						// so we can linearize at B (or D)
+						return static_cast<int64_t>(pushes - pops);
+					}
+					pushes = nextPushes;
+					uint64_t nextPops = popTicket_.load(std::memory_order_acquire); // D
+					if (pops == nextPops) {
+						// popTicket_ didn't change from B (or the previous D), so we
+						// can linearize at C
+						return static_cast<int64_t>(pushes - pops);
+					}
+					pops = nextPops;
+				}
+			}
+
+			/* Returns true if there are no items available for dequeue. */
+			bool isEmpty() const noexcept {
+				return size() <= 0;
+			}
+
+			/* Returns true if there is currently no empty space to enqueue. */
+			bool isFull() const noexcept {
+				// careful with signed -> unsigned promotion, since size can be negative
+				return size() >= static_cast<int64_t>(capacity_);
+			}
+
+			/// Returns is a guess at size() for contexts that don't need a
+			/// precise value, such as stats. More specifically, it returns the
+			/// number of writes minus the number of reads, but after reading
+			/// the number of writes, more writers could have came before the
+			/// number of reads was sampled, and this method doesn't protect
+			/// against such case. The returned value can be negative.
+			int64_t sizeGuess() const noexcept {
+				return static_cast<int64_t>(writeCount() - readCount());
+			}
+
+			/* Doesn't change. */
+			size_t capacity() const noexcept {
+				return capacity_;
+			}
+
+			/* Returns the total number of calls to blockingWrite or successful calls to write. */
+			uint64_t writeCount() const noexcept {
+				return pushTicket_.load(std::memory_order_acquire);
+			}
+
+			/* Returns the total number of calls to blockingRead or successful calls to read. */
+			uint64_t readCount() const noexcept {
+				return popTicket_.load(std::memory_order_acquire);
+			}
+
+			/// Enqueues a T constructed from args, blocking until space is
+			/// available. Note that this method signature allows enqueue via
+			/// move, if args is a T rvalue, via copy, if args is a T lvalue, or
+			/// via emplacement if args is an initializer list that can be passed
+			/// to a T constructor.
+			template<typename... Args>
+			void blockingWrite(Args&&... args) noexcept {
+				enqueueWithTicket(pushTicket_.fetch_add(1), std::forward<Args>(args)...);
+			}
+
+			/// If an item can be enqueued with no blocking, does so and returns
+			/// true, otherwise returns false. This method is similar to
+			/// writeIfNotFull, but if you don't have a specific need for that
+			/// method you should use this one.
+			///
+			/// One of the common usages of this method is to enqueue via the
+			/// move constructor, something like q.write(std::move(x)). If write
+			/// returns false because the queue is full then x has not actually
+			/// been consumed, which looks strange. To understand why it is
+			/// actually okay to use x afterward, remember that std::move is just
+			/// a typecast that provides an rvalue reference that enables use of
+			/// a move constructor or operator. std::move doesn't actually move
+			/// anything. It could more accurately be called std::rvalue_cast or
+			/// std::move_permission.
+			template<typename... Args>
+			bool write(Args&&... args) noexcept {
+				uint64_t ticket;
+				if (tryObtainReadyPushTicket(ticket)) {
+					enqueueWithTicket(ticket, std::forward<Args>(args)...);
+					return true;
+				}
+				return false;
+			}
+
+			/// If the queue is not full, enqueues and returns true, otherwise
+			/// returns false. Unlike write this method can be blocked by another
+			/// thread, specifically a read that has linearized (been assigned a
+			/// ticket) but not yet completed. If you don't really need this
+			/// function you should probably use write.
+			///
+			/// MPMCQueue isn't lock-free, so just because a read operation has
+			/// linearized (and isFull is false) doesn't mean that space has been
+			/// made available for another write. In this situation write will
+			/// return false, but writeIfNotFull will wait for the dequeue to
+			/// finish. This method is required if you are composing queues and
+			/// managing your own wakeup, because it guarantees that after every
+			/// successful write a readIfNotEmpty will succeed.
+			template<typename... Args>
+			bool writeIfNotFull(Args&&... args) noexcept {
+				uint64_t ticket;
+				if (tryObtainPromisedPushTicket(ticket)) {
+					enqueueWithTicket(ticket, std::forward<Args>(args)...);
+					return true;
+				}
+				return false;
+			}
+
+			/// Like write, but waits until the deadline for space to become
+			/// available. Returns false at the deadline.
+			template<class Clock, class Duration, typename... Args>
+			bool tryWriteUntil(const std::chrono::time_point<Clock, Duration>& deadline, Args&&... args) noexcept {
+				uint64_t ticket;
+				if (tryObtainPromisedPushTicketUntil(ticket, deadline)) {
+					enqueueWithTicket(ticket, std::forward<Args>(args)...);
+					return true;
+				}
+				return false;
+			}
+
+			template<class Rep, class Period, typename... Args>
+			bool tryWriteFor(const std::chrono::duration<Rep, Period>& duration, Args&&... args) noexcept {
+				return tryWriteUntil(std::chrono::steady_clock::now() + duration, std::forward<Args>(args)...);
+			}
+
+			/* Moves a dequeued element onto elem, blocking until an element is available. */
+			void blockingRead(T& elem) noexcept {
+				dequeueWithTicket(popTicket_.fetch_add(1), elem);
+			}
+
+			/* If an item can be dequeued with no blocking, does so and returns true, otherwise returns false. */
+			bool read(T& elem) noexcept {
+				uint64_t ticket;
+				if (tryObtainReadyPopTicket(ticket)) {
+					dequeueWithTicket(ticket, elem);
+					return true;
+				}
+				return false;
+			}
+
+			/// If the queue is not empty, dequeues and returns true, otherwise
+			/// returns false. If the matching write is still in progress then
+			/// this method may block waiting for it. If you don't rely on being
+			/// able to dequeue (such as by counting completed write) then you
+			/// should prefer read.
+			bool readIfNotEmpty(T& elem) noexcept {
+				uint64_t ticket;
+				if (tryObtainPromisedPopTicket(ticket)) {
+					dequeueWithTicket(ticket, elem);
+					return true;
+				}
+				return false;
+			}
+
+			/// Like read, but waits until the deadline for an element to become
+			/// available. Returns false at the deadline.
+			template<class Clock, class Duration>
+			bool tryReadUntil(const std::chrono::time_point<Clock, Duration>& deadline, T& elem) noexcept {
+				uint64_t ticket;
+				if (tryObtainPromisedPopTicketUntil(ticket, deadline)) {
+					dequeueWithTicket(ticket, elem);
+					return true;
+				}
+				return false;
+			}
+
+			template<class Rep, class Period>
+			bool tryReadFor(const std::chrono::duration<Rep, Period>& duration, T& elem) noexcept {
+				return tryReadUntil(std::chrono::steady_clock::now() + duration, elem);
+			}
+
+		private:
+			static size_t roundUpCapacity(size_t capacity) {
+				if (capacity == 0)
+					throw std::invalid_argument("MPMCQueue with explicit capacity 0 is impossible");
+				size_t rounded = 1;
+				while (rounded < capacity)
+					rounded <<= 1;
+				return rounded;
+			}
+
+			static uint32_t log2(size_t pow2) noexcept {
+				uint32_t shift = 0;
+				while ((size_t(1) << shift) < pow2)
+					++shift;
+				return shift;
+			}
+
+			template<typename U>
+			static void swapAtomic(Atom<U>& a, Atom<U>& b) noexcept {
+				U tmp = a.load(std::memory_order_relaxed);
+				a.store(b.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				b.store(tmp, std::memory_order_relaxed);
+			}
+
+			size_t idx(uint64_t ticket) const noexcept {
+				return static_cast<size_t>(ticket & mask_);
+			}
+
+			/* The number of times the slot of `ticket` has been reused, truncated to the sequencer's turn space. */
+			uint32_t turn(uint64_t ticket) const noexcept {
+				return static_cast<uint32_t>(ticket >> shift_);
+			}
+
+			/// Tries to obtain a push ticket for which enqueue won't block.
+			/// Returns true on immediate success, false on immediate failure.
+			bool tryObtainReadyPushTicket(uint64_t& ticket) noexcept {
+				ticket = pushTicket_.load(std::memory_order_acquire); // A
+				while (true) {
+					if (!slots_[idx(ticket)].mayEnqueue(turn(ticket))) {
+						// if we call enqueue(ticket, ...) on the slot we might
+						// block. Either this is because it is a stale ticket that
+						// another producer already took, or the queue is full.
+						// If pushTicket_ didn't change, it is the latter.
+						uint64_t prev = ticket;
+						ticket = pushTicket_.load(std::memory_order_acquire); // B
+						if (prev == ticket)
+							return false;
+					}
+					else if (pushTicket_.compare_exchange_strong(ticket, ticket + 1)) {
+						return true;
+					}
+				}
+			}
+
+			/// Tries to obtain a push ticket which can be satisfied if all
+			/// in-progress pops complete. This function does not block, but
+			/// blocking may be required when using the returned ticket if some
+			/// other thread's pop is still in progress (ticket has been granted
+			/// but pop has not yet completed).
+			bool tryObtainPromisedPushTicket(uint64_t& ticket) noexcept {
+				uint64_t numPushes = pushTicket_.load(std::memory_order_acquire); // A
+				while (true) {
+					ticket = numPushes;
+					const uint64_t numPops = popTicket_.load(std::memory_order_acquire); // B
+					// n will be negative if pops are pending
+					const int64_t n = static_cast<int64_t>(numPushes - numPops);
+					if (n >= static_cast<int64_t>(capacity_)) {
+						// full, linearize at B. We don't need to recheck the read
+						// we performed at A, because if numPushes was stale at B
+						// then the real numPushes value is even worse
+						return false;
+					}
+					if (pushTicket_.compare_exchange_strong(numPushes, numPushes + 1))
+						return true;
+				}
+			}
+
+			/// Tries until the deadline to obtain a push ticket for which
+			/// enqueue won't block. Waits on the slot of the oldest unfinished
+			/// pop while the queue is full.
+			template<class Clock, class Duration>
+			bool tryObtainPromisedPushTicketUntil(uint64_t& ticket,
+				const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				while (true) {
+					if (tryObtainPromisedPushTicket(ticket))
+						return true;
+					// ticket is a blocking ticket until the preceding ticket has
+					// been processed: wait until this ticket's turn arrives. We
+					// have not reserved this ticket so we will have to re-attempt
+					// to get a non-blocking ticket if we wake up before we time
+					// out.
+					if (!slots_[idx(ticket)].waitEnqueueUntil(turn(ticket), pushSpinCutoff_, deadline))
+						return false;
+				}
+			}
+
+			/// Similar to tryObtainReadyPushTicket, but returns a pop ticket
+			/// whose corresponding push ticket has already been handed out,
+			/// rather than returning one whose corresponding push ticket has
+			/// already been completed.
+			bool tryObtainReadyPopTicket(uint64_t& ticket) noexcept {
+				ticket = popTicket_.load(std::memory_order_acquire);
+				while (true) {
+					if (!slots_[idx(ticket)].mayDequeue(turn(ticket))) {
+						uint64_t prev = ticket;
+						ticket = popTicket_.load(std::memory_order_acquire);
+						if (prev == ticket)
+							return false;
+					}
+					else if (popTicket_.compare_exchange_strong(ticket, ticket + 1)) {
+						return true;
+					}
+				}
+			}
+
+			/// Similar to tryObtainPromisedPushTicket, but returns a pop ticket
+			/// whose corresponding push ticket has already been handed out.
+			bool tryObtainPromisedPopTicket(uint64_t& ticket) noexcept {
+				uint64_t numPops = popTicket_.load(std::memory_order_acquire); // A
+				while (true) {
+					ticket = numPops;
+					const uint64_t numPushes = pushTicket_.load(std::memory_order_acquire); // B
+					if (numPops >= numPushes) {
+						// empty, or empty with pending pops. Linearize at B. We
+						// don't need to recheck the read we performed at A,
+						// because if numPops is stale then the fresh value is
+						// larger and the >= is still true
+						return false;
+					}
+					if (popTicket_.compare_exchange_strong(numPops, numPops + 1))
+						return true;
+				}
+			}
+
+			template<class Clock, class Duration>
+			bool tryObtainPromisedPopTicketUntil(uint64_t& ticket,
+				const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				while (true) {
+					if (tryObtainPromisedPopTicket(ticket))
+						return true;
+					// ticket has no writer yet: wait until its element arrives,
+					// then compete for it again.
+					if (!slots_[idx(ticket)].waitDequeueUntil(turn(ticket), popSpinCutoff_, deadline))
+						return false;
+				}
+			}
+
+			template<typename... Args>
+			void enqueueWithTicket(uint64_t ticket, Args&&... args) noexcept {
+				slots_[idx(ticket)].enqueue(turn(ticket), pushSpinCutoff_,
+					(ticket % kAdaptationFreq) == 0, std::forward<Args>(args)...);
+			}
+
+			void dequeueWithTicket(uint64_t ticket, T& elem) noexcept {
+				slots_[idx(ticket)].dequeue(turn(ticket), popSpinCutoff_,
+					(ticket % kAdaptationFreq) == 0, elem);
+			}
+
+			size_t capacity_;
+			size_t mask_;
+			uint32_t shift_;
+			std::unique_ptr<Slot[]> slots_;
+
+			/* Enqueuers get tickets from here. */
+			alignas(kCacheLineSize) Atom<uint64_t> pushTicket_{ 0 };
+			/* The adaptive spin cutoff when the queue is full on enqueue. */
+			Atom<uint32_t> pushSpinCutoff_{ 0 };
+
+			/* Dequeuers get tickets from here. */
+			alignas(kCacheLineSize) Atom<uint64_t> popTicket_{ 0 };
+			/* The adaptive spin cutoff when the queue is empty on dequeue. */
+			Atom<uint32_t> popSpinCutoff_{ 0 };
+		};
+
+	} // concurrency
+
+} // booty
+
+#endif // !BOOTY_CONCURRENCY_MPMCQUEUE_H
@@ -0,0 +1,289 @@
+/*
+ * MultiQueue is a relaxed concurrent priority queue made of many small
+ * heaps, after Rihani, Sanders & Dementiev, "MultiQueues: Simple Relaxed
+ * Concurrent Priority Queues", 2015.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_CONCURRENCY_MULTIQUEUE_HPP
+#define BOOTY_CONCURRENCY_MULTIQUEUE_HPP
+
+#include<algorithm>
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<memory>
+#include<thread>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"../Asm.h"
+#include"../Portability.h"
+#include"../base/Base.h"
+#include"SkipListPriorityQueue.hpp"
+
+namespace booty {
+
+	namespace concurrency {
+
+		/// MultiQueue is a concurrent priority queue for many threads which
+		/// can live with an approximate order, e.g. jobs scheduled by
+		/// deadline. Unlike std::priority_queue, the element whose priority
+		/// comes first under Compare comes out first: the smallest with
+		/// std::less, the earliest deadline.
+		///
+		/// The elements are spread over c * P heaps, P the number of
+		/// threads, each behind its own try-lock:
+		/// - push() puts the element into a random heap, and moves on to
+		///   another one when the lock is taken.
+		/// - try_pop() picks two random heaps, compares their first
+		///   priorities, which each heap publishes in an atomic, and pops the
+		///   better one. Another pair is picked when the lock is taken.
+		/// No thread ever waits for a lock while another heap is free.
+		///
+		/// The order is relaxed: a pop takes one of the first O(c * P)
+		/// elements on average, not the first. Elements of equal priority
+		/// come out in no particular order. try_pop() returns false only
+		/// after it found every heap empty.
+		///
+		/// MultiQueue<T, Priority, Compare, true> is strict: a lock-free
+		/// SkipListPriorityQueue, which pops the first element every time,
+		/// at the price of all poppers meeting on it.
+		///
+		/// Usage:
+		///   MultiQueue<Job> q;                     // uint64_t priorities, smallest first
+		///   q.push(deadline, std::move(job));
+		///   Job job;
+		///   uint64_t when;
+		///   bool got = q.try_pop(job, when);
+		///   MultiQueue<Job, uint64_t, std::less<uint64_t>, true> strict;
+		template<typename T, typename Priority = uint64_t, typename Compare = std::less<Priority>, bool Strict = false>
+		class MultiQueue :public NonCopyable {
+			static_assert(std::is_nothrow_destructible_v<T>, "T must be nothrow_destructible.");
+			static_assert(std::is_trivially_copyable_v<Priority>, "Priority must be trivially copyable, it is published in an atomic.");
+
+			static constexpr size_t kPopAttempts = 8;
+			static constexpr uint32_t kSpinsBeforeYield = 128;
+
+			struct Entry {
+				Priority priority;
+				T item;
+			};
+
+			/* A test-and-test-and-set lock, pausing and then yielding. */
+			struct SpinLock {
+				std::atomic<bool> locked{ false };
+
+				bool try_lock() noexcept {
+					return !locked.load(std::memory_order_relaxed) &&
+						!locked.exchange(true, std::memory_order_acquire);
+				}
+
+				void lock() noexcept {
+					for (uint32_t spins = 0; !try_lock(); ++spins) {
+						if (spins < kSpinsBeforeYield)
+							asm_volatile_pause();
+						else
+							std::this_thread::yield();
+					}
+				}
+
+				void unlock() noexcept {
+					locked.store(false, std::memory_order_release);
+				}
+			};
+
+			/// A binary heap with its first priority and its size published
+			/// for the poppers, which read them without the lock.
+			struct alignas(kCacheLineSize) Shard {
+				SpinLock lock;
+				std::atomic<size_t> size{ 0 };
+				std::atomic<Priority> top{ Priority{} };
+				std::vector<Entry> heap;
+			};
+
+			/* orders the heap so that heap.front() comes first under Compare. */
+			struct HeapOrder {
+				Compare compare;
+
+				bool operator()(const Entry& a, const Entry& b) const {
+					return compare(b.priority, a.priority);
+				}
+			};
+
+		public:
+			using value_type = T;
+			using priority_type = Priority;
+
+			/// factor * concurrency heaps, at least two. More heaps mean
+			/// less contention and a weaker order.
+			explicit MultiQueue(size_t concurrency = std::max(1u, std::thread::hardware_concurrency()), size_t factor = 2)
+				:shardCount_(std::max<size_t>(2, concurrency * factor)),
+				shards_(new Shard[shardCount_]) {}
+
+			void push(const Priority& priority, const T& item) {
+				pushImpl(priority, item);
+			}
+
+			void push(const Priority& priority, T&& item) {
+				pushImpl(priority, std::move(item));
+			}
+
+			/// Moves an element among the first ones to item and returns
+			/// true, or returns false if every heap was empty.
+			bool try_pop(T& item) {
+				Priority priority;
+				return try_pop(item, priority);
+			}
+
+			/* also hands out the priority of the element. */
+			bool try_pop(T& item, Priority& priority) {
+				for (size_t attempt = 0; attempt < kPopAttempts; ++attempt) {
+					Shard* a = &shards_[nextRandom() % shardCount_];
+					Shard* b = &shards_[nextRandom() % shardCount_];
+					bool hasA = a->size.load(std::memory_order_acquire) != 0;
+					bool hasB = b->size.load(std::memory_order_acquire) != 0;
+					if (!hasA && !hasB)
+						continue;
+					Shard* best = !hasB ? a : !hasA ? b :
+						compare_(b->top.load(std::memory_order_relaxed), a->top.load(std::memory_order_relaxed)) ? b : a;
+					if (!best->lock.try_lock())
+						continue;
+					bool got = take(*best, item, priority);
+					best->lock.unlock();
+					if (got)
+						return true;
+				}
+				// looks empty or busy: visit every heap, waiting for its lock.
+				size_t start = nextRandom() % shardCount_;
+				for (size_t i = 0; i < shardCount_; ++i) {
+					Shard& shard = shards_[(start + i) % shardCount_];
+					if (shard.size.load(std::memory_order_acquire) == 0)
+						continue;
+					shard.lock.lock();
+					bool got = take(shard, item, priority);
+					shard.lock.unlock();
+					if (got)
+						return true;
+				}
+				return false;
+			}
+
+			/* approximate: elements pushed and not popped yet. */
+			size_t size_approx() const noexcept {
+				size_t size = 0;
+				for (size_t i = 0; i < shardCount_; ++i)
+					size += shards_[i].size.load(std::memory_order_relaxed);
+				return size;
+			}
+
+			bool empty() const noexcept {
+				for (size_t i = 0; i < shardCount_; ++i) {
+					if (shards_[i].size.load(std::memory_order_acquire) != 0)
+						return false;
+				}
+				return true;
+			}
+
+		private:
+			/* xorshift, seeded apart per thread. */
+			static uint32_t nextRandom() noexcept {
+				static std::atomic<uint32_t> seeds{ 0 };
+				thread_local uint32_t seed = (seeds.fetch_add(1, std::memory_order_relaxed) + 1) * 2654435761u;
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+				return seed;
+			}
+
+			template<typename Arg>
+			void pushImpl(const Priority& priority, Arg&& arg) {
+				Shard* shard;
+				for (uint32_t spins = 0;; ++spins) {
+					shard = &shards_[nextRandom() % shardCount_];
+					if (shard->lock.try_lock())
+						break;
+					if (spins >= shardCount_)
+						std::this_thread::yield();
+				}
+				try {
+					shard->heap.push_back(Entry{ priority, std::forward<Arg>(arg) });
+				}
+				catch (...) {
+					shard->lock.unlock();
+					throw;
+				}
+				std::push_heap(shard->heap.begin(), shard->heap.end(), HeapOrder{ compare_ });
+				publish(*shard);
+				shard->lock.unlock();
+			}
+
+			/* pops the first entry of a locked shard, if it has one. */
+			bool take(Shard& shard, T& item, Priority& priority) {
+				if (shard.heap.empty())
+					return false;
+				std::pop_heap(shard.heap.begin(), shard.heap.end(), HeapOrder{ compare_ });
+				Entry& entry = shard.heap.back();
+				priority = entry.priority;
+				item = std::move(entry.item);
+				shard.heap.pop_back();
+				publish(shard);
+				return true;
+			}
+
+			void publish(Shard& shard) noexcept {
+				if (!shard.heap.empty())
+					shard.top.store(shard.heap.front().priority, std::memory_order_relaxed);
+				shard.size.store(shard.heap.size(), std::memory_order_release);
+			}
+
+			const size_t shardCount_;
+			const std::unique_ptr<Shard[]> shards_;
+			const Compare compare_{};
+		};
+
+		/// The strict MultiQueue: every pop takes the first element. The
+		/// constructor arguments are accepted and ignored, so that the two
+		/// modes swap with the template argument alone.
+		template<typename T, typename Priority, typename Compare>
+		class MultiQueue<T, Priority, Compare, true> :public NonCopyable {
+		public:
+			using value_type = T;
+			using priority_type = Priority;
+
+			explicit MultiQueue(size_t = 0, size_t = 0) {}
+
+			void push(const Priority& priority, const T& item) {
+				queue_.push(priority, item);
+			}
+
+			void push(const Priority& priority, T&& item) {
+				queue_.push(priority, std::move(item));
+			}
+
+			bool try_pop(T& item) {
+				return queue_.try_pop(item);
+			}
+
+			bool try_pop(T& item, Priority& priority) {
+				return queue_.try_pop(item, priority);
+			}
+
+			size_t size_approx() const noexcept {
+				return queue_.size_approx();
+			}
+
+			bool empty() const noexcept {
+				return queue_.empty();
+			}
+
+		private:
+			SkipListPriorityQueue<T, Priority, Compare> queue_;
+		};
+
+	} // concurrency
+
+} // booty
+
+#endif // !BOOTY_CONCURRENCY_MULTIQUEUE_HPP
@@ -0,0 +1,257 @@
+/*
+ * This is a derivative snippet of Facebook::folly, under Apache Lisence.
+ * Indention:
+ * - Recurrent the design idea of seniors and rewrite some details to adapt
+ *   personal considerations as components of booty.
+ *
+ * @Simoncqk - 2018.05.03
+ *
+ */
+#ifndef BOOTY_CONCURRENCY_PRODUCERCONSUMERQUEUE_H
+#define BOOTY_CONCURRENCY_PRODUCERCONSUMERQUEUE_H
+
+#include<algorithm>
+#include<atomic>
+#include<cassert>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<new>
+#include<stdexcept>
+#include<type_traits>
+#include<utility>
+
+#include"../Portability.h"
+#include"../base/Base.h"
+
+namespace booty {
+
+	namespace concurrency {
+		/// ProducerConsumerQueue is a one producer and one consumer queue
+		/// without locks. Both sides are wait-free: write() fails when the
+		/// queue is full and read() fails when it is empty, nothing spins,
+		/// blocks or allocates after construction.
+		///
+		/// The capacity is rounded up to a power of two. The indices grow
+		/// monotonically and are masked into the ring, so every slot is
+		/// usable and a full queue is told from an empty one by the distance
+		/// of the indices.
+		///
+		/// The write index and the producer's cached copy of the read index
+		/// share a cache line, the read index and the consumer's cached copy
+		/// of the write index share another. A side only reads the other
+		/// side's index when its cached copy says the queue is full (or
+		/// empty), so in the steady state each side touches its own line and
+		/// the slots, and the index lines bounce once per lap instead of once
+		/// per item. The ring is padded on both ends, so the first and last
+		/// slots share no line with other allocations.
+		///
+		/// write_n() and read_n() move a run of items through the ring, as at
+		/// most two contiguous spans, and publish it with a single index
+		/// store.
+		///
+		/// Usage:
+		///   ProducerConsumerQueue<int> q(1000);   // capacity 1024
+		///   // producer thread
+		///   bool ok = q.write(1);
+		///   size_t written = q.write_n(items, count);
+		///   // consumer thread
+		///   int v;
+		///   ok = q.read(v);
+		///   size_t got = q.read_n(out, max);
+		///   if (int* front = q.frontPtr()) { use(*front); q.popFront(); }
+		template<typename T>
+		class ProducerConsumerQueue :public NonCopyable {
+			static_assert(std::is_nothrow_destructible_v<T>, "T must be nothrow_destructible.");
+
+			using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+			/* Unused slots in front of and behind the ring, a cache line worth of each. */
+			static constexpr size_t kPadding = (kCacheLineSize - 1) / sizeof(Storage) + 1;
+
+		public:
+			using value_type = T;
+
+			explicit ProducerConsumerQueue(size_t queueCapacity)
+				:capacity_(roundUpCapacity(queueCapacity)),
+				mask_(capacity_ - 1),
+				storage_(new Storage[capacity_ + 2 * kPadding]),
+				records_(storage_.get() + kPadding) {}
+
+			/// The queue can only be destroyed when neither side is using it.
+			/// Elements still in the queue are destroyed.
+			~ProducerConsumerQueue() {
+				if constexpr (!std::is_trivially_destructible_v<T>) {
+					size_t read = readIndex_.load(std::memory_order_relaxed);
+					size_t write = writeIndex_.load(std::memory_order_relaxed);
+					for (; read != write; ++read)
+						slot(read)->~T();
+				}
+			}
+
+			/// Producer only. Constructs a T from args at the tail and returns
+			/// true, or returns false without touching args if the queue is
+			/// full.
+			template<typename... Args>
+			bool write(Args&&... args) {
+				const size_t write = writeIndex_.load(std::memory_order_relaxed);
+				if (write - readCache_ == capacity_) {
+					readCache_ = readIndex_.load(std::memory_order_acquire);
+					if (write - readCache_ == capacity_)
+						return false;
+				}
+				new (slot(write)) T(std::forward<Args>(args)...);
+				writeIndex_.store(write + 1, std::memory_order_release);
+				return true;
+			}
+
+			/// Producer only. Moves up to n items from items into the queue and
+			/// returns how many were moved; the rest is left untouched. The
+			/// whole run becomes visible to the consumer at once.
+			template<typename InputIt>
+			size_t write_n(InputIt items, size_t n) {
+				const size_t write = writeIndex_.load(std::memory_order_relaxed);
+				size_t space = capacity_ - (write - readCache_);
+				if (space < n) {
+					readCache_ = readIndex_.load(std::memory_order_acquire);
+					space = capacity_ - (write - readCache_);
+				}
+				n = std::min(n, space);
+				if (n == 0)
+					return 0;
+				// the run is [write, write + n), split where the ring wraps.
+				const size_t first = std::min(n, capacity_ - (write & mask_));
+				T* dst = slot(write);
+				for (size_t i = 0; i < first; ++i, ++items)
+					new (dst + i) T(std::move(*items));
+				dst = slot(0);
+				for (size_t i = first; i < n; ++i, ++items)
+					new (dst + i - first) T(std::move(*items));
+				writeIndex_.store(write + n, std::memory_order_release);
+				return n;
+			}
+
+			/// Consumer only. Moves the head onto record and returns true, or
+			/// returns false if the queue is empty.
+			bool read(T& record) {
+				const size_t read = readIndex_.load(std::memory_order_relaxed);
+				if (read == writeCache_) {
+					writeCache_ = writeIndex_.load(std::memory_order_acquire);
+					if (read == writeCache_)
+						return false;
+				}
+				T* p = slot(read);
+				record = std::move(*p);
+				p->~T();
+				readIndex_.store(read + 1, std::memory_order_release);
+				return true;
+			}
+
+			/// Consumer only. Moves up to n items into out and returns how many
+			/// were moved. The freed slots are handed back to the producer at
+			/// once.
+			template<typename OutputIt>
+			size_t read_n(OutputIt out, size_t n) {
+				const size_t read = readIndex_.load(std::memory_order_relaxed);
+				size_t available = writeCache_ - read;
+				if (available < n) {
+					writeCache_ = writeIndex_.load(std::memory_order_acquire);
+					available = writeCache_ - read;
+				}
+				n = std::min(n, available);
+				if (n == 0)
+					return 0;
+				const size_t first = std::min(n, capacity_ - (read & mask_));
+				T* src = slot(read);
+				for (size_t i = 0; i < first; ++i, ++out) {
+					*out = std::move(src[i]);
+					src[i].~T();
+				}
+				src = slot(0);
+				for (size_t i = first; i < n; ++i, ++out) {
+					*out = std::move(src[i - first]);
+					src[i - first].~T();
+				}
+				readIndex_.store(read + n, std::memory_order_release);
+				return n;
+			}
+
+			/// Consumer only. Returns a pointer to the head, or nullptr if the
+			/// queue is empty. The element stays in the queue until popFront().
+			T* frontPtr() {
+				const size_t read = readIndex_.load(std::memory_order_relaxed);
+				if (read == writeCache_) {
+					writeCache_ = writeIndex_.load(std::memory_order_acquire);
+					if (read == writeCache_)
+						return nullptr;
+				}
+				return slot(read);
+			}
+
+			/* Consumer only. Destroys the head, the queue must not be empty. */
+			void popFront() {
+				const size_t read = readIndex_.load(std::memory_order_relaxed);
+				assert(read != writeIndex_.load(std::memory_order_acquire));
+				slot(read)->~T();
+				readIndex_.store(read + 1, std::memory_order_release);
+			}
+
+			/* Exact from the consumer, a guess from anywhere else. */
+			bool isEmpty() const {
+				return readIndex_.load(std::memory_order_acquire) ==
+					writeIndex_.load(std::memory_order_acquire);
+			}
+
+			/* Exact from the producer, a guess from anywhere else. */
+			bool isFull() const {
+				return writeIndex_.load(std::memory_order_acquire) -
+					readIndex_.load(std::memory_order_acquire) >= capacity_;
+			}
+
+			/// The number of items in the queue, exact only when both sides
+			/// are idle. The read index is loaded first, so the result never
+			/// underflows.
+			size_t sizeGuess() const {
+				size_t read = readIndex_.load(std::memory_order_acquire);
+				size_t write = writeIndex_.load(std::memory_order_acquire);
+				return write - read;
+			}
+
+			/* Maximum number of items in the queue. */
+			size_t capacity() const {
+				return capacity_;
+			}
+
+		private:
+			static size_t roundUpCapacity(size_t capacity) {
+				if (capacity == 0)
+					throw std::invalid_argument("ProducerConsumerQueue with capacity 0 is impossible");
+				size_t rounded = 1;
+				while (rounded < capacity)
+					rounded <<= 1;
+				return rounded;
+			}
+
+			T* slot(size_t index) const noexcept {
+				return std::launder(reinterpret_cast<T*>(records_ + (index & mask_)));
+			}
+
+			const size_t capacity_;
+			const size_t mask_;
+			const std::unique_ptr<Storage[]> storage_;
+			Storage* const records_;
+
+			/* Producer side: the write index and the last read index the producer saw. */
+			alignas(kCacheLineSize) std::atomic<size_t> writeIndex_{ 0 };
+			size_t readCache_ = 0;
+
+			/* Consumer side: the read index and the last write index the consumer saw. */
+			alignas(kCacheLineSize) std::atomic<size_t> readIndex_{ 0 };
+			size_t writeCache_ = 0;
+		};
+
+	} // concurrency
+
+} // booty
+
+#endif // !BOOTY_CONCURRENCY_PRODUCERCONSUMERQUEUE_H
@@ -0,0 +1,411 @@
+/*
+ * SkipListPriorityQueue is a lock-free priority queue on a skip list, after
+ * Linden & Jonsson, "A Skiplist-Based Concurrent Priority Queue with
+ * Minimal Memory Contention", 2013.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_CONCURRENCY_SKIPLISTPRIORITYQUEUE_HPP
+#define BOOTY_CONCURRENCY_SKIPLISTPRIORITYQUEUE_HPP
+
+#include<atomic>
+#include<cassert>
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<mutex>
+#include<new>
+#include<type_traits>
+#include<utility>
+
+#include"../Portability.h"
+#include"../base/Base.h"
+
+namespace booty {
+
+	namespace concurrency {
+
+		/// SkipListPriorityQueue is a strict concurrent priority queue:
+		/// try_pop() takes the element whose priority comes first under
+		/// Compare, the smallest with std::less, e.g. the earliest deadline.
+		/// Elements of equal priority come out in no particular order.
+		/// push() and try_pop() are lock-free.
+		///
+		/// The elements sit on the bottom level of a skip list, in order.
+		/// A pop deletes the first element logically, by setting the lowest
+		/// bit of its predecessor's bottom-level pointer, so the deleted
+		/// elements always form a prefix of the list. Pops walk that prefix
+		/// and mark the first pointer not marked yet: a single fetch_or,
+		/// with no search and no unlinking. Once a pop walked more than
+		/// kBoundOffset deleted nodes, it moves the head past the prefix at
+		/// every level with a few CAS, and retires the nodes it cut off.
+		/// Pushes search the upper levels, skip the prefix, and link the new
+		/// node bottom-up; a new node never goes into the prefix.
+		///
+		/// The first element is contended by all poppers. For many threads
+		/// and a weaker order, see MultiQueue.
+		///
+		/// Retired nodes are freed after a grace period: every operation
+		/// counts itself in the current epoch, on one of kStripes counters
+		/// picked per thread. The epoch only moves on when nobody is left
+		/// in the one before, and nodes retired two epochs back are freed.
+		/// Hazard pointers would need a pair of them per level for a
+		/// push, which costs more than the search.
+		///
+		/// Usage:
+		///   SkipListPriorityQueue<Job> q;      // uint64_t priorities, smallest first
+		///   q.push(deadline, std::move(job));
+		///   Job job;
+		///   uint64_t when;
+		///   bool got = q.try_pop(job, when);
+		template<typename T, typename Priority = uint64_t, typename Compare = std::less<Priority>>
+		class SkipListPriorityQueue :public NonCopyable {
+			static_assert(std::is_nothrow_destructible_v<T>, "T must be nothrow_destructible.");
+			static_assert(std::is_default_constructible_v<Priority>, "Priority must be default constructible.");
+
+			static constexpr int kMaxLevel = 24;
+			static constexpr size_t kBoundOffset = 64;
+			static constexpr size_t kStripes = 32;
+
+			/// A node with `level` next pointers, the ones past next[0] are
+			/// allocated behind it. The lowest bit of next[0] marks the
+			/// successor as deleted.
+			struct Node {
+				Node(int height, const Priority& p)
+					:priority(p), level(height) {}
+
+				const Priority priority;
+				const int level;
+				std::atomic<bool> inserting{ false };
+				Node* retiredNext = nullptr;
+				typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+				std::atomic<uintptr_t> next[1];
+
+				T* item() noexcept {
+					return std::launder(reinterpret_cast<T*>(&storage));
+				}
+
+				static Node* create(int height, const Priority& p) {
+					size_t size = sizeof(Node) + (height - 1) * sizeof(std::atomic<uintptr_t>);
+					void* mem = ::operator new(size);
+					Node* node = new (mem) Node(height, p);
+					node->next[0].store(0, std::memory_order_relaxed);
+					for (int i = 1; i < height; ++i)
+						new (&node->next[i]) std::atomic<uintptr_t>(0);
+					return node;
+				}
+
+				/* the item must be destroyed already. */
+				static void destroy(Node* node) noexcept {
+					node->~Node();
+					::operator delete(node);
+				}
+			};
+
+			/// Counts the operations in flight, per epoch parity, and the
+			/// elements pushed minus popped by the threads on this stripe.
+			struct alignas(kCacheLineSize) Stripe {
+				std::atomic<size_t> active[2] = {};
+				std::atomic<int64_t> elements{ 0 };
+			};
+
+			/* An operation in progress: the nodes it reaches stay allocated. */
+			class Guard {
+			public:
+				explicit Guard(const SkipListPriorityQueue& queue) noexcept
+					:counter_(queue.enter()) {}
+
+				~Guard() {
+					counter_->fetch_sub(1, std::memory_order_release);
+				}
+
+			private:
+				std::atomic<size_t>* counter_;
+			};
+
+		public:
+			using value_type = T;
+			using priority_type = Priority;
+
+			SkipListPriorityQueue()
+				:head_(Node::create(kMaxLevel, Priority{})),
+				tail_(Node::create(1, Priority{})) {
+				for (int i = 0; i < kMaxLevel; ++i)
+					head_->next[i].store(word(tail_), std::memory_order_relaxed);
+			}
+
+			/* destroys the elements left, no other thread may use the queue. */
+			~SkipListPriorityQueue() {
+				for (Node*& list : limbo_)
+					freeList(list);
+				Node* x = head_;
+				while (true) {
+					uintptr_t next = x->next[0].load(std::memory_order_relaxed);
+					Node* n = node(next);
+					if (x != head_)
+						Node::destroy(x);
+					if (n == tail_)
+						break;
+					if (!isMarked(next))
+						n->item()->~T();
+					x = n;
+				}
+				Node::destroy(head_);
+				Node::destroy(tail_);
+			}
+
+			void push(const Priority& priority, const T& item) {
+				pushImpl(priority, item);
+			}
+
+			void push(const Priority& priority, T&& item) {
+				pushImpl(priority, std::move(item));
+			}
+
+			/// Moves the first element to item and returns true, or returns
+			/// false if the queue is empty.
+			bool try_pop(T& item) noexcept {
+				Priority priority;
+				return try_pop(item, priority);
+			}
+
+			/* also hands out the priority of the element. */
+			bool try_pop(T& item, Priority& priority) noexcept {
+				Guard guard(*this);
+				Node* x = head_;
+				Node* newHead = nullptr;
+				size_t offset = 0;
+				const uintptr_t observedHead = head_->next[0].load(std::memory_order_acquire);
+				uintptr_t next;
+				do {
+					next = x->next[0].load(std::memory_order_acquire);
+					if (node(next) == tail_)
+						return false;
+					// a node still being linked must stay in the list, the
+					// head may move up to it but not past it.
+					if (!newHead && x->inserting.load(std::memory_order_acquire))
+						newHead = x;
+					next = x->next[0].fetch_or(1, std::memory_order_acq_rel);
+					++offset;
+					x = node(next);
+				} while (isMarked(next));
+
+				// x was not deleted before the fetch_or, it is ours.
+				priority = x->priority;
+				item = std::move(*x->item());
+				x->item()->~T();
+				stripes_[stripeIndex()].elements.fetch_sub(1, std::memory_order_relaxed);
+				if (!newHead)
+					newHead = x;
+				if (offset <= kBoundOffset || head_->next[0].load(std::memory_order_relaxed) != observedHead)
+					return true;
+				uintptr_t expected = observedHead;
+				if (head_->next[0].compare_exchange_strong(expected, word(newHead) | 1,
+					std::memory_order_acq_rel, std::memory_order_relaxed)) {
+					restructure();
+					retire(node(observedHead), newHead);
+				}
+				return true;
+			}
+
+			/* approximate: elements pushed and not popped yet. */
+			size_t size_approx() const noexcept {
+				int64_t size = 0;
+				for (const Stripe& stripe : stripes_)
+					size += stripe.elements.load(std::memory_order_relaxed);
+				return size > 0 ? static_cast<size_t>(size) : 0;
+			}
+
+			/* approximate: no element was left at some point of the call. */
+			bool empty() const noexcept {
+				Guard guard(*this);
+				Node* x = head_;
+				uintptr_t next = x->next[0].load(std::memory_order_acquire);
+				while (isMarked(next)) {
+					x = node(next);
+					next = x->next[0].load(std::memory_order_acquire);
+				}
+				return node(next) == tail_;
+			}
+
+		private:
+			static bool isMarked(uintptr_t w) noexcept {
+				return (w & 1) != 0;
+			}
+
+			static Node* node(uintptr_t w) noexcept {
+				return reinterpret_cast<Node*>(w & ~uintptr_t(1));
+			}
+
+			static uintptr_t word(Node* n) noexcept {
+				return reinterpret_cast<uintptr_t>(n);
+			}
+
+			/* geometric, one level in two nodes, two in four, and so on. */
+			static int randomLevel() noexcept {
+				static std::atomic<uint32_t> seeds{ 0 };
+				thread_local uint32_t seed = (seeds.fetch_add(1, std::memory_order_relaxed) + 1) * 2654435761u;
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+				int level = 1;
+				for (uint32_t bits = seed; level < kMaxLevel && (bits & 1); bits >>= 1)
+					++level;
+				return level;
+			}
+
+			static size_t stripeIndex() noexcept {
+				static std::atomic<size_t> next{ 0 };
+				thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+				return index;
+			}
+
+			template<typename Arg>
+			void pushImpl(const Priority& priority, Arg&& arg) {
+				Guard guard(*this);
+				const int height = randomLevel();
+				Node* n = Node::create(height, priority);
+				try {
+					new (n->item()) T(std::forward<Arg>(arg));
+				}
+				catch (...) {
+					Node::destroy(n);
+					throw;
+				}
+				n->inserting.store(true, std::memory_order_relaxed);
+
+				Node* preds[kMaxLevel];
+				Node* succs[kMaxLevel];
+				Node* del;
+				while (true) {
+					del = locatePreds(priority, preds, succs);
+					n->next[0].store(word(succs[0]), std::memory_order_relaxed);
+					uintptr_t expected = word(succs[0]);
+					// fails on a marked pointer too: nothing goes into the prefix.
+					if (preds[0]->next[0].compare_exchange_strong(expected, word(n),
+						std::memory_order_release, std::memory_order_relaxed))
+						break;
+				}
+				// the upper levels are a hint, give up on them once n or its
+				// successor is deleted.
+				for (int i = 1; i < height;) {
+					n->next[i].store(word(succs[i]), std::memory_order_relaxed);
+					if (isMarked(n->next[0].load(std::memory_order_acquire)) ||
+						isMarked(succs[i]->next[0].load(std::memory_order_acquire)) || del == succs[i])
+						break;
+					uintptr_t expected = word(succs[i]);
+					if (preds[i]->next[i].compare_exchange_strong(expected, word(n),
+						std::memory_order_release, std::memory_order_relaxed)) {
+						++i;
+						continue;
+					}
+					del = locatePreds(priority, preds, succs);
+					if (succs[0] != n)
+						break;
+				}
+				n->inserting.store(false, std::memory_order_release);
+				stripes_[stripeIndex()].elements.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			/// For every level, the last node before `priority` and the one
+			/// after it, past the deleted prefix. Returns the last deleted
+			/// node met on the bottom level.
+			Node* locatePreds(const Priority& priority, Node** preds, Node** succs) const noexcept {
+				Node* pred = head_;
+				Node* del = nullptr;
+				for (int i = kMaxLevel - 1; i >= 0; --i) {
+					uintptr_t next = pred->next[i].load(std::memory_order_acquire);
+					bool deleted = isMarked(next);
+					Node* cur = node(next);
+					while ((cur != tail_ && compare_(cur->priority, priority)) ||
+						isMarked(cur->next[0].load(std::memory_order_acquire)) || (i == 0 && deleted)) {
+						if (deleted && i == 0)
+							del = cur;
+						pred = cur;
+						next = pred->next[i].load(std::memory_order_acquire);
+						deleted = isMarked(next);
+						cur = node(next);
+					}
+					preds[i] = pred;
+					succs[i] = cur;
+				}
+				return del;
+			}
+
+			/* Moves the head past the deleted prefix on the upper levels. */
+			void restructure() noexcept {
+				Node* pred = head_;
+				for (int i = kMaxLevel - 1; i > 0;) {
+					uintptr_t h = head_->next[i].load(std::memory_order_acquire);
+					if (!isMarked(node(h)->next[0].load(std::memory_order_acquire))) {
+						--i;
+						continue;
+					}
+					Node* cur = node(pred->next[i].load(std::memory_order_acquire));
+					while (isMarked(cur->next[0].load(std::memory_order_acquire))) {
+						pred = cur;
+						cur = node(pred->next[i].load(std::memory_order_acquire));
+					}
+					if (head_->next[i].compare_exchange_strong(h, pred->next[i].load(std::memory_order_acquire),
+						std::memory_order_acq_rel, std::memory_order_relaxed))
+						--i;
+				}
+			}
+
+			std::atomic<size_t>* enter() const noexcept {
+				Stripe& stripe = stripes_[stripeIndex()];
+				while (true) {
+					uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+					std::atomic<size_t>& counter = stripe.active[epoch & 1];
+					counter.fetch_add(1, std::memory_order_seq_cst);
+					if (epoch_.load(std::memory_order_seq_cst) == epoch)
+						return &counter;
+					counter.fetch_sub(1, std::memory_order_release);
+				}
+			}
+
+			/// Queues the nodes [first, last) for freeing, and frees the ones
+			/// retired two epochs ago once nobody is left in the previous
+			/// epoch.
+			void retire(Node* first, Node* last) noexcept {
+				std::lock_guard<std::mutex> lock(reclaimLock_);
+				const uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+				Node*& list = limbo_[epoch & 1];
+				for (Node* n = first; n != last; ) {
+					Node* next = node(n->next[0].load(std::memory_order_relaxed));
+					n->retiredNext = list;
+					list = n;
+					n = next;
+				}
+				const size_t previous = (epoch + 1) & 1;
+				for (Stripe& stripe : stripes_) {
+					if (stripe.active[previous].load(std::memory_order_seq_cst) != 0)
+						return;
+				}
+				epoch_.store(epoch + 1, std::memory_order_seq_cst);
+				freeList(limbo_[previous]);
+			}
+
+			static void freeList(Node*& list) noexcept {
+				while (list) {
+					Node* next = list->retiredNext;
+					Node::destroy(list);
+					list = next;
+				}
+			}
+
+			Node* const head_;
+			Node* const tail_;
+			const Compare compare_{};
+
+			alignas(kCacheLineSize) std::atomic<uint64_t> epoch_{ 0 };
+			// const readers such as empty() count themselves in too.
+			mutable Stripe stripes_[kStripes];
+			std::mutex reclaimLock_;
+			Node* limbo_[2] = {};
+		};
+
+	} // concurrency
+
+} // booty
+
+#endif // !BOOTY_CONCURRENCY_SKIPLISTPRIORITYQUEUE_HPP
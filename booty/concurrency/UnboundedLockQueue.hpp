@@ -5,6 +5,7 @@
 #include<queue>
 #include<mutex>
 #include<atomic>
+#include<chrono>
 #include<condition_variable>
 
 #include"../base/Base.h"
@@ -14,8 +15,13 @@ namespace booty {
 	namespace concurrency {
 
 		/// UnboundedLockQueue provides thread-safe operations with STL lock.
-		/// enqueue/dequeue never blocks. If neccessary, block measures should
-		/// be adopted by caller/invoker.
+		/// enqueue never blocks, dequeue waits for an element, tryDequeue
+		/// never waits and dequeueFor waits up to a timeout.
+		///
+		/// The bulk operations take the lock once per batch: enqueueBulk
+		/// pushes a range, dequeueBulk takes up to max elements and, when the
+		/// queue holds no more than that, swaps the whole container out and
+		/// moves the elements to the caller after unlocking.
 
 		template<typename T>
 		class UnboundedLockQueue :public NonCopyable {
@@ -26,27 +32,40 @@ namespace booty {
 			void enqueue(const T& ele) {
 				std::lock_guard<std::mutex> lock(queue_mtx_);
 				queue_.push(ele);
-				if (size() == 1) // queue is empty before push().
-					cond_.notify_one();
+				// every push, not only the first into an empty queue: with several
+				// consumers waiting, each item must wake one of them.
+				cond_.notify_one();
 			}
 
 			/* enqueue one element(rvalue). */
 			void enqueue(T&& ele) {
 				std::lock_guard<std::mutex> lock(queue_mtx_);
 				queue_.emplace(std::move(ele));
-				if (size() == 1) // queue is empty before push().
+				cond_.notify_one();
+			}
+
+			/* enqueue [first, last) under one lock, a move_iterator range is moved in. */
+			template<typename Iter>
+			void enqueueBulk(Iter first, Iter last) {
+				size_t count = 0;
+				{
+					std::lock_guard<std::mutex> lock(queue_mtx_);
+					for (; first != last; ++first, ++count)
+						queue_.emplace(*first);
+				}
+				if (count == 1)
 					cond_.notify_one();
+				else if (count > 1)
+					cond_.notify_all();
 			}
 
 			/*
-			  dequeue one element, pass by reference.
-			  return by a local value is not exception-safe, and when queue is empty,
-			  it just throw an error by std::queue, but never block to wait for producer,
-			  as it mentioned above: block measures should be adopted by caller/invoker.
+			  dequeue one element, pass by reference, waits until there is one.
+			  return by a local value is not exception-safe.
 			*/
 			void dequeue(T& recv) {
 				std::unique_lock<std::mutex> lock(queue_mtx_);
-				if (empty()) {
+				if (queue_.empty()) {
 					cond_.wait(lock, [this] {
 						return !queue_.empty();
 					});
@@ -55,19 +74,85 @@ namespace booty {
 				queue_.pop();
 			}
 
+			/* dequeue one element if there is any, never blocks. */
+			bool tryDequeue(T& recv) {
+				std::lock_guard<std::mutex> lock(queue_mtx_);
+				if (queue_.empty())
+					return false;
+				recv = std::move(queue_.front());
+				queue_.pop();
+				return true;
+			}
+
+			/* dequeue one element, waits up to timeout, returns false if there was none. */
+			template<typename Rep, typename Period>
+			bool dequeueFor(T& recv, const std::chrono::duration<Rep, Period>& timeout) {
+				std::unique_lock<std::mutex> lock(queue_mtx_);
+				if (!cond_.wait_for(lock, timeout, [this] { return !queue_.empty(); }))
+					return false;
+				recv = std::move(queue_.front());
+				queue_.pop();
+				return true;
+			}
+
+			/*
+			  move up to max elements to out in FIFO order, returns how many, never blocks.
+			  if all the elements fit, the container is swapped out under the lock and
+			  drained after unlocking, so producers wait for a pointer swap only.
+			*/
+			template<typename OutputIt>
+			size_t dequeueBulk(OutputIt out, size_t max) {
+				if (max == 0)
+					return 0;
+				std::queue<T> taken;
+				std::unique_lock<std::mutex> lock(queue_mtx_);
+				return takeBulk(lock, taken, out, max);
+			}
+
+			/* as dequeueBulk, but waits up to timeout for the first element. */
+			template<typename OutputIt, typename Rep, typename Period>
+			size_t dequeueBulkFor(OutputIt out, size_t max, const std::chrono::duration<Rep, Period>& timeout) {
+				if (max == 0)
+					return 0;
+				std::queue<T> taken;
+				std::unique_lock<std::mutex> lock(queue_mtx_);
+				if (!cond_.wait_for(lock, timeout, [this] { return !queue_.empty(); }))
+					return 0;
+				return takeBulk(lock, taken, out, max);
+			}
+
 			/* get size of queue */
 			size_t size() const {
+				std::lock_guard<std::mutex> lock(queue_mtx_);
 				return queue_.size();
 			}
 
 			/* judge if queue is empty */
 			bool empty() const {
+				std::lock_guard<std::mutex> lock(queue_mtx_);
 				return queue_.empty();
 			}
 
 		private:
+			template<typename OutputIt>
+			size_t takeBulk(std::unique_lock<std::mutex>& lock, std::queue<T>& taken, OutputIt out, size_t max) {
+				size_t count = queue_.size();
+				if (count <= max) {
+					queue_.swap(taken);
+					lock.unlock();
+					for (; !taken.empty(); taken.pop(), ++out)
+						*out = std::move(taken.front());
+					return count;
+				}
+				for (size_t i = 0; i < max; ++i, ++out) {
+					*out = std::move(queue_.front());
+					queue_.pop();
+				}
+				return max;
+			}
+
 			std::queue<T> queue_;
-			std::mutex queue_mtx_;
+			mutable std::mutex queue_mtx_;
 			std::condition_variable cond_;
 		};
 	}
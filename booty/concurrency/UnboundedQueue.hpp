@@ -11,10 +11,17 @@
 #define BOOTY_CONCURRENCY_UNBOUNDEDQUEUE_H
 
 #include<atomic>
+#include<cassert>
 #include<chrono>
+#include<cstdint>
+#include<mutex>
 #include<new>
 #include<optional>
+#include<thread>
+#include<type_traits>
+#include<utility>
 
+#include"../Asm.h"
 #include"../sync/SaturatingSemaphore.hpp"
 #include"HazardPtr.h"
 
@@ -62,6 +69,13 @@ namespace booty {
 		///   producers or consumers, have references to them or their
 		///   predecessors. That is, a lagging thread may delay the reclamation
 		///   of a chain of removed segments.
+		/// - Reclaimed segments go back to a pool of the queue, which keeps
+		///   up to kMaxCachedSegments of them for the next allocations and
+		///   frees the rest. A producer which finds the pool empty while
+		///   segments of the queue wait for reclamation first asks the hazard
+		///   pointer domain to reclaim what no thread protects, so a queue
+		///   whose consumers keep up passes a few segments around and does
+		///   not allocate.
 		/// - The template parameter LgAlign can be used to reduce memory usage
 		///   at the cost of increased chance of false sharing.
 		///
@@ -101,20 +115,38 @@ namespace booty {
 		///   producer-consumer balance or favorable timing for avoiding
 		///   costly blocking.
 
+		///
+		/// Usage:
+		///   UMPMCQueue<int, false> q;  // may block = false
+		///   q.enqueue(1);
+		///   int v;
+		///   q.dequeue(v);                           // waits for an item
+		///   bool got = q.try_dequeue(v);            // never waits
+		///   got = q.try_dequeue_for(v, std::chrono::milliseconds(1));
+		///   std::optional<int> w = q.try_dequeue(); // same, by value
+		///
+		/// Producers and consumers protect the segment they start from with
+		/// a hazard pointer; each segment holds a reference to its successor,
+		/// so the segments a lagging thread walks into stay alive as long as
+		/// the one it protects. Link HazardPtr.cpp.
 		template<typename T, bool SingleProducer, bool SingleConsumer, bool MayBlock,
-			size_t LogSegmentSize = 8, size_t LogAlign = std::log2(std::hardware_constructive_interference_size),
+			size_t LogSegmentSize = 8, size_t LogAlign = 7,
 			template<typename> class Atom = std::atomic>
 		class UnboundedQueue {
 			using Ticket = uint64_t;
 
 			class Entry;
 			class Segment;
+			class SegmentPool;
 
 			static constexpr bool SPSC = SingleProducer && SingleConsumer;
 			static constexpr size_t Stride = SPSC || (LogSegmentSize <= 1) ? 1 : 27;
 			static constexpr size_t SegmentSize = 1u << LogSegmentSize;
 			static constexpr size_t Align = 1u << LogAlign;
 
+			static constexpr uint32_t kSpinsBeforeYield = 128;
+			static constexpr size_t kMaxCachedSegments = 16;
+
 			static_assert(std::is_nothrow_destructible_v<T>, "T must be nothrow_destructible.");
 			static_assert((Stride & 1) == 1, "Stride must be odd.");
 			static_assert(LogSegmentSize < 32, "LogSegmentSize must be < 32.");
@@ -131,10 +163,304 @@ namespace booty {
 
 			alignas(Align) Consumer consumer_;
 			alignas(Align) Producer producer_;
+			SegmentPool* const pool_;
 
 		public:
+			UnboundedQueue()
+				:pool_(new SegmentPool) {
+				setProducerTicket(0);
+				setConsumerTicket(0);
+				Segment* s = pool_->get(0);
+				setTail(s);
+				setHead(s);
+			}
+
+			/// destroys the items left, no other thread may use the queue.
+			/// The pool outlives the queue until the segments retired last
+			/// are reclaimed.
+			~UnboundedQueue() {
+				while (try_dequeue()) {}
+				Segment* next;
+				for (Segment* s = head(); s; s = next) {
+					next = s->nextSegment();
+					reclaimSegment(s);
+				}
+				pool_->close();
+			}
+
+			UnboundedQueue(const UnboundedQueue&) = delete;
+			UnboundedQueue& operator=(const UnboundedQueue&) = delete;
+
+			/* never waits, allocates a segment every SegmentSize items. */
+			void enqueue(const T& arg) {
+				enqueueImpl(arg);
+			}
+
+			void enqueue(T&& arg) {
+				enqueueImpl(std::move(arg));
+			}
+
+			/* wait for an item. */
+			void dequeue(T& item) noexcept {
+				dequeueImpl(item);
+			}
+
+			T dequeue() noexcept {
+				T item;
+				dequeueImpl(item);
+				return item;
+			}
+
+			/* take an item if there is one, never waits. */
+			bool try_dequeue(T& item) noexcept {
+				return tryDequeueUntil(item, std::chrono::steady_clock::time_point::min());
+			}
+
+			std::optional<T> try_dequeue() noexcept {
+				return try_dequeue_until(std::chrono::steady_clock::time_point::min());
+			}
+
+			template<typename Clock, typename Duration>
+			bool try_dequeue_until(T& item,
+				const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				return tryDequeueUntil(item, deadline);
+			}
+
+			template<typename Clock, typename Duration>
+			std::optional<T> try_dequeue_until(
+				const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				std::optional<T> item;
+				tryDequeueUntil(item, deadline);
+				return item;
+			}
+
+			template<typename Rep, typename Period>
+			bool try_dequeue_for(T& item,
+				const std::chrono::duration<Rep, Period>& duration) noexcept {
+				if (try_dequeue(item))
+					return true;
+				return tryDequeueUntil(item, std::chrono::steady_clock::now() + duration);
+			}
+
+			template<typename Rep, typename Period>
+			std::optional<T> try_dequeue_for(
+				const std::chrono::duration<Rep, Period>& duration) noexcept {
+				std::optional<T> item = try_dequeue();
+				if (!item)
+					tryDequeueUntil(item, std::chrono::steady_clock::now() + duration);
+				return item;
+			}
+
+			/* approximate: items enqueued and not dequeued yet. */
+			size_t size() const noexcept {
+				auto p = producerTicket();
+				auto c = consumerTicket();
+				return p > c ? static_cast<size_t>(p - c) : 0;
+			}
+
+			bool empty() const noexcept {
+				return consumerTicket() >= producerTicket();
+			}
 
 		private:
+			template<typename Arg>
+			void enqueueImpl(Arg&& arg) {
+				if (SPSC) {
+					Segment* s = tail();
+					enqueueCommon(s, std::forward<Arg>(arg));
+				}
+				else {
+					// a holder rather than a cached hazard pointer: T's
+					// constructor may use hazard pointers too.
+					hazptr_holder hptr;
+					Segment* s = hptr.get_protected(producer_.tail);
+					enqueueCommon(s, std::forward<Arg>(arg));
+				}
+			}
+
+			template<typename Arg>
+			void enqueueCommon(Segment* s, Arg&& arg) {
+				Ticket t = fetchIncrementProducerTicket();
+				if (!SingleProducer)
+					s = findSegment(s, t);
+				assert(t >= s->minTicket() && t < s->minTicket() + SegmentSize);
+				Entry& e = s->entry(index(t));
+				e.putItem(std::forward<Arg>(arg));
+				if (responsibleForAlloc(t))
+					allocNextSegment(s);
+				if (responsibleForAdvance(t))
+					advanceTail(s);
+			}
+
+			/// `Item` is T or std::optional<T>.
+			template<typename Item>
+			void dequeueImpl(Item& item) noexcept {
+				if (SPSC) {
+					Segment* s = head();
+					dequeueCommon(s, item);
+				}
+				else {
+					hazptr_holder hptr;
+					Segment* s = hptr.get_protected(consumer_.head);
+					dequeueCommon(s, item);
+				}
+			}
+
+			template<typename Item>
+			void dequeueCommon(Segment* s, Item& item) noexcept {
+				Ticket t = fetchIncrementConsumerTicket();
+				if (!SingleConsumer)
+					s = findSegment(s, t);
+				Entry& e = s->entry(index(t));
+				e.takeItem(item);
+				if (responsibleForAdvance(t))
+					advanceHead(s);
+			}
+
+			template<typename Item, typename Clock, typename Duration>
+			bool tryDequeueUntil(Item& item,
+				const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				if (SingleConsumer) {
+					Segment* s = head();
+					return tryDequeueUntilSC(s, item, deadline);
+				}
+				hazptr_holder hptr;
+				Segment* s = hptr.get_protected(consumer_.head);
+				return tryDequeueUntilMC(s, item, deadline);
+			}
+
+			template<typename Item, typename Clock, typename Duration>
+			bool tryDequeueUntilSC(Segment* s, Item& item,
+				const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				Ticket t = consumerTicket();
+				assert(t >= s->minTicket() && t < s->minTicket() + SegmentSize);
+				Entry& e = s->entry(index(t));
+				if (!e.tryWaitUntil(deadline))
+					return false;
+				setConsumerTicket(t + 1);
+				e.takeItem(item);
+				if (responsibleForAdvance(t))
+					advanceHead(s);
+				return true;
+			}
+
+			/// Claim a ticket only once its item is there, so a consumer that
+			/// times out leaves no hole behind.
+			template<typename Item, typename Clock, typename Duration>
+			bool tryDequeueUntilMC(Segment* s, Item& item,
+				const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				while (true) {
+					Ticket t = consumerTicket();
+					if (t >= s->minTicket() + SegmentSize) {
+						s = tryGetNextSegmentUntil(s, deadline);
+						if (s == nullptr)
+							return false;  // timed out
+						continue;
+					}
+					Entry& e = s->entry(index(t));
+					if (!e.tryWaitUntil(deadline))
+						return false;
+					if (!consumer_.ticket.compare_exchange_weak(t, t + 1,
+						std::memory_order_acq_rel, std::memory_order_acquire)) {
+						continue;
+					}
+					e.takeItem(item);
+					if (responsibleForAdvance(t))
+						advanceHead(s);
+					return true;
+				}
+			}
+
+			/// The segment holding ticket `t`, at or after `s`. Not
+			/// protected on its own: `s` is, and keeps its successors alive.
+			Segment* findSegment(Segment* s, const Ticket t) const noexcept {
+				while (t >= s->minTicket() + SegmentSize) {
+					s = tryGetNextSegmentUntil(s, std::chrono::steady_clock::time_point::max());
+					assert(s != nullptr);
+				}
+				return s;
+			}
+
+			/// The successor of `s`, once the tail has moved past `s`. This
+			/// does not spin for long: the producer responsible for advancing
+			/// the tail already holds its ticket.
+			template<typename Clock, typename Duration>
+			Segment* tryGetNextSegmentUntil(Segment* s,
+				const std::chrono::time_point<Clock, Duration>& deadline) const noexcept {
+				for (uint32_t spins = 0; tail() == s; ) {
+					if (deadline < Clock::time_point::max() && Clock::now() >= deadline)
+						return nullptr;
+					backoff(spins);
+				}
+				Segment* next = s->nextSegment();
+				assert(next != nullptr);
+				return next;
+			}
+
+			/* by the producer of the first ticket of `s`. */
+			void allocNextSegment(Segment* s) {
+				Segment* next = pool_->get(s->minTicket() + SegmentSize);
+				if (!SPSC)
+					next->acquire_ref_safe();  // the reference held by `s`.
+				assert(s->nextSegment() == nullptr);
+				s->setNextSegment(next);
+			}
+
+			/* by the producer of the last ticket of `s`. */
+			void advanceTail(Segment* s) noexcept {
+				Segment* next = s->nextSegment();
+				if (!SingleProducer) {
+					// the producer of the first ticket has its ticket already.
+					for (uint32_t spins = 0; next == nullptr; ) {
+						backoff(spins);
+						next = s->nextSegment();
+					}
+				}
+				assert(next != nullptr);
+				setTail(next);
+			}
+
+			/* by the consumer of the last ticket of `s`. */
+			void advanceHead(Segment* s) noexcept {
+				Segment* next = tryGetNextSegmentUntil(s, std::chrono::steady_clock::time_point::max());
+				for (uint32_t spins = 0; head() != s; ) {
+					// a lagging consumer of an earlier segment must go first,
+					// or it would set the head back.
+					backoff(spins);
+				}
+				setHead(next);
+				reclaimSegment(s);
+			}
+
+			void reclaimSegment(Segment* s) noexcept {
+				if (SPSC)
+					pool_->put(s);  // no other thread can reach it.
+				else
+					pool_->retire(s);
+			}
+
+			/// Wait for another thread's step of a segment hand-off. It is
+			/// normally a few instructions away, but it may be preempted, so
+			/// stop burning the cpu it may be waiting for after a while.
+			static void backoff(uint32_t& spins) noexcept {
+				if (++spins < kSpinsBeforeYield)
+					asm_volatile_pause();
+				else
+					std::this_thread::yield();
+			}
+
+			inline size_t index(Ticket t) const noexcept {
+				return static_cast<size_t>((t * Stride) & (SegmentSize - 1));
+			}
+
+			inline bool responsibleForAlloc(Ticket t) const noexcept {
+				return (t & (SegmentSize - 1)) == 0;
+			}
+
+			inline bool responsibleForAdvance(Ticket t) const noexcept {
+				return (t & (SegmentSize - 1)) == (SegmentSize - 1);
+			}
+
 			inline Segment* head() const noexcept {
 				return consumer_.head.load(std::memory_order_acquire);
 			}
@@ -200,7 +526,7 @@ namespace booty {
 				inline void putItem(Arg&& arg) {
 					// interesting usage of placement new. MARKABLE!
 					// construct a obj of type T at postion of &item_.
-					new (&item) T(std::forward<Arg>(arg));
+					new (&item_) T(std::forward<Arg>(arg));
 					flag_.post();
 				}
 
@@ -209,6 +535,12 @@ namespace booty {
 					getItem(item);
 				}
 
+				inline void takeItem(std::optional<T>& item) noexcept {
+					flag_.wait();
+					item.emplace(std::move(*itemPtr()));
+					destoryItem();
+				}
+
 				inline std::optional<T> takeItem() noexcept {
 					flag_.wait();
 					return getItem();
@@ -219,7 +551,7 @@ namespace booty {
 					const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
 					// wait-options from benchmarks on contended queues:
 					auto const opt =
-						flag_.wait_options().spin_max(std::chrono::microseconds(10));
+						flag_.wait_options().setSpinMax(std::chrono::microseconds(10));
 					return flag_.try_wait_until(deadline, opt);
 				}
 
@@ -234,7 +566,7 @@ namespace booty {
 					itemPtr()->~T();
 				}
 
-				inline void getItem(T& itme) noexcept {
+				inline void getItem(T& item) noexcept {
 					item = std::move(*(itemPtr()));
 					destoryItem();
 				}
@@ -246,14 +578,22 @@ namespace booty {
 				}
 			};  // Entry
 
-			class Segment :public booty::concurrency::hazptr_obj_base_refcounted<T> {
+			/* hands a segment the hazard pointers let go of back to its pool. */
+			struct Recycler {
+				SegmentPool* pool = nullptr;
+
+				void operator()(Segment* s) const noexcept {
+					pool->reclaimChain(s);
+				}
+			};
+
+			class Segment :public booty::concurrency::hazptr_obj_base_refcounted<Segment, Recycler> {
 				Atom<Segment*> next_;
 				const Ticket min_;
-				Atom<bool> marked_;  // used for iterative deletion
 				alignas(Align) Entry b_[SegmentSize];
 			public:
 				explicit Segment(const Ticket& t)
-					:next_(nullptr), min_(t), marked_(false) {}
+					:next_(nullptr), min_(t) {}
 
 				Segment* nextSegment() const noexcept {
 					return next_.load(std::memory_order_acquire);
@@ -264,31 +604,165 @@ namespace booty {
 				}
 
 				inline Ticket minTicket() const noexcept {
-					assert(min_&(SegmentSize - 1) == 0);
+					assert((min_ & (SegmentSize - 1)) == 0);
 					return min_;
 				}
 
 				inline Entry& entry(const size_t& index) noexcept {
 					return b_[index];
 				}
+			};  // Segment
 
-				~Segment() {
-					if (!SPSC && !marked_.load(std::memory_order_relaxed)) {
-						Segment* next = nextSegment();
-						while (next) {
-							if (!next->release_ref())  // hazptr
-								return;
-							Segment* s = next;
-							next = s->nextSegment();
-							s->marked_.store(true);
-							delete s; s = nullptr;
+			/// The segments of one queue. A segment is destroyed when it is
+			/// unreachable and its memory is kept, up to kMaxCachedSegments,
+			/// for the next segment the queue needs; get() constructs a fresh
+			/// one in place, so the hazard pointer state and the entries start
+			/// over. Retired segments may come back after the queue is gone,
+			/// so the pool counts the queue and every segment it allocated,
+			/// and deletes itself with the last of them.
+			class SegmentPool {
+				std::mutex lock_;
+				void* free_ = nullptr;  // cached memory, linked through its first word.
+				size_t cached_ = 0;
+				bool closed_ = false;
+				uint32_t skip_ = 0;     // allocations to go before the next cleanup.
+				uint32_t backoff_ = 0;
+				Atom<size_t> refs_{ 1 };
+				Atom<size_t> retired_{ 0 };  // retired, not back yet.
+
+			public:
+				Segment* get(Ticket t) {
+					void* mem = pop();
+					if (!mem && reclaimRetired())
+						mem = pop();
+					if (!mem) {
+						mem = ::operator new(sizeof(Segment), std::align_val_t(alignof(Segment)));
+						refs_.fetch_add(1, std::memory_order_relaxed);
+					}
+					return new (mem) Segment(t);
+				}
+
+				void retire(Segment* s) noexcept {
+					retired_.fetch_add(1, std::memory_order_relaxed);
+					s->retire(default_hazptr_domain(), Recycler{ this });  // hazptr
+				}
+
+				/* `s` is unreachable. */
+				void put(Segment* s) noexcept {
+					s->~Segment();
+					void* mem = s;
+					{
+						std::lock_guard<std::mutex> guard(lock_);
+						if (!closed_ && cached_ < kMaxCachedSegments) {
+							*static_cast<void**>(mem) = free_;
+							free_ = mem;
+							++cached_;
+							return;
 						}
 					}
+					::operator delete(mem, std::align_val_t(alignof(Segment)));
+					release();
 				}
-			};  // Segment
+
+				/// `s` is retired and no hazard pointer protects it. Drop its
+				/// reference to the successor: a successor whose count drops
+				/// to zero and which is retired already goes too, and so on
+				/// down the chain, iteratively rather than recursively.
+				void reclaimChain(Segment* s) noexcept {
+					while (s) {
+						Segment* next = s->nextSegment();
+						retired_.fetch_sub(1, std::memory_order_relaxed);
+						put(s);
+						if (next == nullptr || !next->release_ref())
+							return;
+						s = next;
+					}
+				}
+
+				/* by the queue's destructor, the pool must not be used after. */
+				void close() noexcept {
+					void* mem;
+					{
+						std::lock_guard<std::mutex> guard(lock_);
+						closed_ = true;
+						mem = free_;
+						free_ = nullptr;
+						cached_ = 0;
+					}
+					while (mem) {
+						void* next = *static_cast<void**>(mem);
+						::operator delete(mem, std::align_val_t(alignof(Segment)));
+						release();
+						mem = next;
+					}
+					release();
+				}
+
+			private:
+				void* pop() noexcept {
+					std::lock_guard<std::mutex> guard(lock_);
+					void* mem = free_;
+					if (mem) {
+						free_ = *static_cast<void**>(mem);
+						--cached_;
+					}
+					return mem;
+				}
+
+				/// Reclaim the retired segments no hazard pointer protects, if
+				/// there are any of this queue's. A lagging thread can hold a
+				/// chain of them back, so after a cleanup that brings nothing
+				/// back the next ones are spaced out, up to one in 64
+				/// allocations.
+				bool reclaimRetired() {
+					if (retired_.load(std::memory_order_relaxed) == 0)
+						return false;
+					{
+						std::lock_guard<std::mutex> guard(lock_);
+						if (skip_ > 0) {
+							--skip_;
+							return false;
+						}
+					}
+					default_hazptr_domain().cleanup();
+					std::lock_guard<std::mutex> guard(lock_);
+					if (free_) {
+						backoff_ = 0;
+						return true;
+					}
+					backoff_ = backoff_ >= 32 ? 64 : 2 * backoff_ + 1;
+					skip_ = backoff_;
+					return false;
+				}
+
+				void release() noexcept {
+					if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+						delete this;
+				}
+			};  // SegmentPool
 		};
 
+		/* Aliases */
 
+		/// SPSC
+		template<typename T, bool MayBlock, size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			template<typename> class Atom = std::atomic>
+		using USPSCQueue = UnboundedQueue<T, true, true, MayBlock, LogSegmentSize, LogAlign, Atom>;
+
+		/// MPSC
+		template<typename T, bool MayBlock, size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			template<typename> class Atom = std::atomic>
+		using UMPSCQueue = UnboundedQueue<T, false, true, MayBlock, LogSegmentSize, LogAlign, Atom>;
+
+		/// SPMC
+		template<typename T, bool MayBlock, size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			template<typename> class Atom = std::atomic>
+		using USPMCQueue = UnboundedQueue<T, true, false, MayBlock, LogSegmentSize, LogAlign, Atom>;
+
+		/// MPMC
+		template<typename T, bool MayBlock, size_t LogSegmentSize = 8, size_t LogAlign = 7,
+			template<typename> class Atom = std::atomic>
+		using UMPMCQueue = UnboundedQueue<T, false, false, MayBlock, LogSegmentSize, LogAlign, Atom>;
 
 	}
 
@@ -0,0 +1,126 @@
+/*
+ * WorkStealingDeque is the per-worker task container of booty::ThreadPool.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_CONCURRENCY_WORKSTEALINGDEQUE_HPP
+#define BOOTY_CONCURRENCY_WORKSTEALINGDEQUE_HPP
+
+#include<atomic>
+#include<mutex>
+#include<vector>
+#include<utility>
+#include<cassert>
+
+#include"../base/Base.h"
+
+namespace booty {
+
+	namespace concurrency {
+
+		/// WorkStealingDeque is a double-ended queue with two kinds of users:
+		/// - the owner pushes and pops at the back (LIFO), which keeps the
+		///   most recently spawned, cache-hot task on the same core.
+		/// - thieves steal from the front (FIFO), which hands out the oldest
+		///   and usually the biggest pieces of work.
+		///
+		/// The storage is a power-of-two ring buffer which only ever grows, so
+		/// a deque in steady state never allocates. Every operation takes a
+		/// per-deque mutex, but since each worker owns its own deque that lock
+		/// is almost always uncontended. size() is lock-free, thieves use it to
+		/// skip empty victims without touching their lock at all.
+		template<typename T>
+		class WorkStealingDeque :public NonCopyable {
+			static constexpr size_t kInitCapacity = 64;
+
+		public:
+			explicit WorkStealingDeque(size_t capacity = kInitCapacity)
+				:buffer_(roundUpPowerOfTwo(capacity)), mask_(buffer_.size() - 1) {}
+
+			/* owner: push one element at the back. */
+			void push(T&& item) {
+				std::lock_guard<std::mutex> lock(mtx_);
+				if (tail_ - head_ == buffer_.size())
+					grow();
+				buffer_[tail_++ & mask_] = std::move(item);
+				size_.store(tail_ - head_, std::memory_order_release);
+			}
+
+			/* owner: push [first, last) at the back under one lock. */
+			template<typename Iter>
+			void pushBulk(Iter first, Iter last) {
+				std::lock_guard<std::mutex> lock(mtx_);
+				for (; first != last; ++first) {
+					if (tail_ - head_ == buffer_.size())
+						grow();
+					buffer_[tail_++ & mask_] = std::move(*first);
+				}
+				size_.store(tail_ - head_, std::memory_order_release);
+			}
+
+			/* owner: pop the newest element from the back, false if empty. */
+			bool pop(T& out) {
+				if (empty())
+					return false;
+				std::lock_guard<std::mutex> lock(mtx_);
+				if (tail_ == head_)
+					return false;
+				out = std::move(buffer_[--tail_ & mask_]);
+				size_.store(tail_ - head_, std::memory_order_release);
+				return true;
+			}
+
+			/* thief: take the oldest element from the front, false if empty. */
+			bool steal(T& out) {
+				if (empty())
+					return false;
+				std::lock_guard<std::mutex> lock(mtx_);
+				if (tail_ == head_)
+					return false;
+				out = std::move(buffer_[head_++ & mask_]);
+				size_.store(tail_ - head_, std::memory_order_release);
+				return true;
+			}
+
+			/* approximate size, never blocks. */
+			size_t size() const noexcept {
+				return size_.load(std::memory_order_acquire);
+			}
+
+			bool empty() const noexcept {
+				return size() == 0;
+			}
+
+		private:
+			static size_t roundUpPowerOfTwo(size_t n) noexcept {
+				size_t cap = 1;
+				while (cap < n)
+					cap <<= 1;
+				return cap;
+			}
+
+			// double the ring, elements are re-laid from index 0.
+			void grow() {
+				std::vector<T> bigger(buffer_.size() * 2);
+				size_t count = tail_ - head_;
+				for (size_t i = 0; i < count; ++i)
+					bigger[i] = std::move(buffer_[(head_ + i) & mask_]);
+				buffer_.swap(bigger);
+				mask_ = buffer_.size() - 1;
+				head_ = 0;
+				tail_ = count;
+			}
+
+			std::vector<T> buffer_;
+			size_t mask_;
+			// monotonic indices, slot = index & mask_.
+			size_t head_{ 0 };
+			size_t tail_{ 0 };
+			std::atomic<size_t> size_{ 0 };
+			std::mutex mtx_;
+		};
+
+	} // namespace concurrency
+
+} // namespace booty
+
+#endif // !BOOTY_CONCURRENCY_WORKSTEALINGDEQUE_HPP
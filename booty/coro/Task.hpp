@@ -0,0 +1,210 @@
+/*
+ * Task.hpp provides booty::Task<T>, a lazily started C++20 coroutine whose
+ * result is taken by co_await-ing it.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_CORO_TASK_HPP
+#define BOOTY_CORO_TASK_HPP
+
+#include"../Portability.h"
+
+#if !BOOTY_HAS_COROUTINES
+#error "booty/coro needs C++20 coroutines, compile with -std=c++20."
+#endif
+
+#include<coroutine>
+#include<exception>
+#include<optional>
+#include<type_traits>
+#include<utility>
+
+#include"../Future.hpp"
+
+namespace booty {
+
+	template<typename T = void>
+	class Task;
+
+	namespace detail {
+
+		/// Part of a Task promise that does not depend on the result type:
+		/// where to go when the body finishes, and what it threw.
+		class TaskPromiseBase {
+			// resume whoever awaits us by symmetric transfer, so a long chain
+			// of finishing tasks does not grow the stack.
+			struct FinalAwaiter {
+				bool await_ready() const noexcept {
+					return false;
+				}
+
+				template<typename Promise>
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) noexcept {
+					std::coroutine_handle<> next = self.promise().continuation_;
+					return next ? next : std::noop_coroutine();
+				}
+
+				void await_resume() noexcept {}
+			};
+
+		public:
+			std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+
+			FinalAwaiter final_suspend() noexcept {
+				return {};
+			}
+
+			void unhandled_exception() noexcept {
+				error_ = std::current_exception();
+			}
+
+			void setContinuation(std::coroutine_handle<> continuation) noexcept {
+				continuation_ = continuation;
+			}
+
+		protected:
+			std::coroutine_handle<> continuation_;
+			std::exception_ptr error_;
+		};
+
+		template<typename T>
+		class TaskPromise :public TaskPromiseBase {
+		public:
+			Task<T> get_return_object() noexcept;
+
+			template<typename U>
+			void return_value(U&& value) {
+				value_.emplace(std::forward<U>(value));
+			}
+
+			/* move the result out, rethrow what the body threw if any. */
+			T result() {
+				if (error_)
+					std::rethrow_exception(error_);
+				return std::move(*value_);
+			}
+
+		private:
+			std::optional<T> value_;
+		};
+
+		template<>
+		class TaskPromise<void> :public TaskPromiseBase {
+		public:
+			Task<void> get_return_object() noexcept;
+
+			void return_void() noexcept {}
+
+			void result() {
+				if (error_)
+					std::rethrow_exception(error_);
+			}
+		};
+
+	} // namespace detail
+
+	/// Task<T> is a coroutine that does nothing until it is co_await-ed: the
+	/// awaiting coroutine suspends, the task runs on the same thread until its
+	/// own first suspension (e.g. `co_await pool.schedule()`), and when it
+	/// finishes it resumes the awaiting coroutine on whatever thread it ends
+	/// on. No thread ever blocks in between.
+	///
+	/// Task is move-only and owns its frame; its result (or exception) can be
+	/// taken once. Use sync_wait() to get a result from plain code.
+	template<typename T>
+	class [[nodiscard]] Task {
+		static_assert(!std::is_reference_v<T>, "Task<T&> is not supported, use a pointer.");
+
+	public:
+		using promise_type = detail::TaskPromise<T>;
+		using value_type = T;
+
+	private:
+		using Handle = std::coroutine_handle<promise_type>;
+
+		struct Awaiter {
+			Handle handle;
+
+			bool await_ready() const noexcept {
+				return !handle || handle.done();
+			}
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+				handle.promise().setContinuation(awaiting);
+				return handle;
+			}
+
+			T await_resume() {
+				if (!handle)
+					throw NoState();
+				return handle.promise().result();
+			}
+		};
+
+	public:
+		Task() noexcept = default;
+
+		explicit Task(Handle handle) noexcept
+			:handle_(handle) {}
+
+		Task(Task&& other) noexcept
+			:handle_(std::exchange(other.handle_, nullptr)) {}
+
+		Task& operator=(Task&& other) noexcept {
+			if (this != &other) {
+				reset();
+				handle_ = std::exchange(other.handle_, nullptr);
+			}
+			return *this;
+		}
+
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+
+		~Task() {
+			reset();
+		}
+
+		bool valid() const noexcept {
+			return static_cast<bool>(handle_);
+		}
+
+		/* true once the body has run to completion. */
+		bool isReady() const noexcept {
+			return handle_ && handle_.done();
+		}
+
+		Awaiter operator co_await() & noexcept {
+			return Awaiter{ handle_ };
+		}
+
+		Awaiter operator co_await() && noexcept {
+			return Awaiter{ handle_ };
+		}
+
+	private:
+		void reset() noexcept {
+			if (handle_)
+				std::exchange(handle_, nullptr).destroy();
+		}
+
+		Handle handle_;
+	};
+
+	namespace detail {
+
+		template<typename T>
+		inline Task<T> TaskPromise<T>::get_return_object() noexcept {
+			return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+		}
+
+		inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+			return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+		}
+
+	} // namespace detail
+
+} // namespace booty
+
+#endif // !BOOTY_CORO_TASK_HPP
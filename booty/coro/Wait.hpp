@@ -0,0 +1,244 @@
+/*
+ * Wait.hpp provides sync_wait() to run a Task from plain code, and
+ * when_all() to await several Tasks at once.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_CORO_WAIT_HPP
+#define BOOTY_CORO_WAIT_HPP
+
+#include<atomic>
+#include<condition_variable>
+#include<coroutine>
+#include<exception>
+#include<mutex>
+#include<optional>
+#include<tuple>
+#include<utility>
+#include<vector>
+
+#include"Task.hpp"
+#include"../Unit.h"
+
+namespace booty {
+
+	namespace detail {
+
+		/// A coroutine started by hand which runs its body, then reports to
+		/// `Notifier` from inside final_suspend, i.e. after its frame is
+		/// suspended, so whoever is notified may destroy the frame right away.
+		template<class Notifier>
+		class NotifyingTask {
+		public:
+			struct promise_type {
+				Notifier* notifier = nullptr;
+
+				NotifyingTask get_return_object() noexcept {
+					return NotifyingTask(std::coroutine_handle<promise_type>::from_promise(*this));
+				}
+
+				std::suspend_always initial_suspend() noexcept {
+					return {};
+				}
+
+				auto final_suspend() noexcept {
+					struct Awaiter {
+						bool await_ready() const noexcept {
+							return false;
+						}
+
+						std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> self) noexcept {
+							return self.promise().notifier->notify();
+						}
+
+						void await_resume() noexcept {}
+					};
+					return Awaiter{};
+				}
+
+				void return_void() noexcept {}
+
+				// bodies catch everything themselves.
+				void unhandled_exception() noexcept {
+					std::terminate();
+				}
+			};
+
+			explicit NotifyingTask(std::coroutine_handle<promise_type> handle) noexcept
+				:handle_(handle) {}
+
+			NotifyingTask(NotifyingTask&& other) noexcept
+				:handle_(std::exchange(other.handle_, nullptr)) {}
+
+			NotifyingTask(const NotifyingTask&) = delete;
+			NotifyingTask& operator=(const NotifyingTask&) = delete;
+			NotifyingTask& operator=(NotifyingTask&&) = delete;
+
+			~NotifyingTask() {
+				if (handle_)
+					handle_.destroy();
+			}
+
+			void start(Notifier& notifier) noexcept {
+				handle_.promise().notifier = &notifier;
+				handle_.resume();
+			}
+
+		private:
+			std::coroutine_handle<promise_type> handle_;
+		};
+
+		// what a finished awaitee left behind: value or exception.
+		template<typename T>
+		struct Outcome {
+			std::optional<Unit::LiftT<T>> value;
+			std::exception_ptr error;
+
+			Unit::LiftT<T> take() {
+				if (error)
+					std::rethrow_exception(error);
+				return std::move(*value);
+			}
+		};
+
+		template<class Notifier, typename T>
+		NotifyingTask<Notifier> awaitInto(Task<T>& task, Outcome<T>& outcome) {
+			try {
+				if constexpr (std::is_void_v<T>) {
+					co_await task;
+					outcome.value.emplace();
+				}
+				else {
+					outcome.value.emplace(co_await task);
+				}
+			}
+			catch (...) {
+				outcome.error = std::current_exception();
+			}
+		}
+
+		/// Blocks a plain thread until its NotifyingTask finished.
+		class SyncWaitEvent {
+		public:
+			// notify under the lock: the waiter owns us and may destroy us
+			// as soon as it sees done_.
+			std::coroutine_handle<> notify() noexcept {
+				std::lock_guard<std::mutex> lock(mtx_);
+				done_ = true;
+				cond_.notify_all();
+				return std::noop_coroutine();
+			}
+
+			void wait() {
+				std::unique_lock<std::mutex> lock(mtx_);
+				cond_.wait(lock, [this] { return done_; });
+			}
+
+		private:
+			std::mutex mtx_;
+			std::condition_variable cond_;
+			bool done_ = false;
+		};
+
+		/// Counts down the awaited children plus the awaiting coroutine
+		/// itself; whoever reaches zero resumes the awaiting coroutine (or
+		/// keeps it running, if that is the awaiter itself).
+		class WhenAllLatch {
+		public:
+			explicit WhenAllLatch(size_t children) noexcept
+				:count_(children + 1) {}
+
+			std::coroutine_handle<> notify() noexcept {
+				if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					return awaiting_;
+				return std::noop_coroutine();
+			}
+
+			template<class Children>
+			auto await(Children& children) noexcept {
+				struct Awaiter {
+					WhenAllLatch& latch;
+					Children& children;
+
+					bool await_ready() const noexcept {
+						return false;
+					}
+
+					bool await_suspend(std::coroutine_handle<> awaiting) noexcept {
+						latch.awaiting_ = awaiting;
+						for (auto& child : children)
+							child.start(latch);
+						// false: every child already finished, keep running.
+						return latch.count_.fetch_sub(1, std::memory_order_acq_rel) > 1;
+					}
+
+					void await_resume() noexcept {}
+				};
+				return Awaiter{ *this, children };
+			}
+
+		private:
+			std::atomic<size_t> count_;
+			std::coroutine_handle<> awaiting_;
+		};
+
+		template<typename... Ts, size_t... Is>
+		Task<std::tuple<Unit::LiftT<Ts>...>> whenAllTuple(std::index_sequence<Is...>, Task<Ts>... tasks) {
+			std::tuple<Outcome<Ts>...> outcomes;
+			WhenAllLatch latch(sizeof...(Ts));
+			std::vector<NotifyingTask<WhenAllLatch>> children;
+			children.reserve(sizeof...(Ts));
+			(children.push_back(awaitInto<WhenAllLatch>(tasks, std::get<Is>(outcomes))), ...);
+			co_await latch.await(children);
+			// braced init: take() runs in argument order, so the first failure wins.
+			co_return std::tuple<Unit::LiftT<Ts>...>{ std::get<Is>(outcomes).take()... };
+		}
+
+	} // namespace detail
+
+	/// Run `task` to completion from a plain thread and return its result
+	/// (rethrow its exception). The calling thread blocks, so never call it
+	/// from a pool worker, nor from inside a coroutine.
+	template<typename T>
+	T sync_wait(Task<T> task) {
+		detail::Outcome<T> outcome;
+		detail::SyncWaitEvent event;
+		auto runner = detail::awaitInto<detail::SyncWaitEvent>(task, outcome);
+		runner.start(event);
+		event.wait();
+		if constexpr (std::is_void_v<T>)
+			outcome.take();
+		else
+			return outcome.take();
+	}
+
+	/// Await all `tasks` concurrently: each runs until its first suspension
+	/// on the awaiting thread, the awaiting coroutine resumes on the thread
+	/// finishing last. Results come back in argument order, void ones as
+	/// Unit; if any task threw, the first such exception (in argument order)
+	/// is rethrown once all have finished.
+	template<typename... Ts>
+	Task<std::tuple<Unit::LiftT<Ts>...>> when_all(Task<Ts>... tasks) {
+		return detail::whenAllTuple(std::index_sequence_for<Ts...>(), std::move(tasks)...);
+	}
+
+	/// when_all() for a runtime number of tasks of one type.
+	template<typename T>
+	Task<std::vector<Unit::LiftT<T>>> when_all(std::vector<Task<T>> tasks) {
+		std::vector<detail::Outcome<T>> outcomes(tasks.size());
+		detail::WhenAllLatch latch(tasks.size());
+		std::vector<detail::NotifyingTask<detail::WhenAllLatch>> children;
+		children.reserve(tasks.size());
+		for (size_t i = 0; i < tasks.size(); ++i)
+			children.push_back(detail::awaitInto<detail::WhenAllLatch>(tasks[i], outcomes[i]));
+		co_await latch.await(children);
+
+		std::vector<Unit::LiftT<T>> results;
+		results.reserve(outcomes.size());
+		for (auto& outcome : outcomes)
+			results.push_back(outcome.take());
+		co_return results;
+	}
+
+} // namespace booty
+
+#endif // !BOOTY_CORO_WAIT_HPP
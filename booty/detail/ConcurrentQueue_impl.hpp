@@ -1,292 +1,460 @@
-#ifndef _CONCURRENT_QUEUE_IMPL_HPP
-#define _CONCURRENT_QUEUE_IMPL_HPP
+/*
+ * ConcurrentQueue_impl is the sharded MPMC queue behind
+ * booty::concurrency::ConcurrentQueue.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_DETAIL_CONCURRENTQUEUE_IMPL_HPP
+#define BOOTY_DETAIL_CONCURRENTQUEUE_IMPL_HPP
 
-#include<iostream>
-#include<array>
-#include<chrono>
-#include<thread>
+#include<algorithm>
 #include<atomic>
-#include<condition_variable>
-#include<mutex>
 #include<cassert>
-static std::mutex mtx;
-namespace concurrentlib {
-
-	template<typename T>
-	class ConcurrentQueue_impl {
-		struct ListNode;
-		struct ContLinkedList;
-
-		//define some type traits and constants.
-		using index_t = std::size_t;
-		using asize_t = std::atomic_size_t;
-		using abool = std::atomic_bool;
-		using aListNode_p = std::atomic<ListNode*>;
-
-		static constexpr size_t kSubQueueNum = 8;
-		static constexpr size_t kPreAllocNodeNum = 1024;
-		static constexpr size_t kNextAllocNodeNum = 64;
-		static constexpr size_t kMaxContendTryTime = 16;
-
-		// define free-list structure.
-		struct ListNode
-		{
-			T data;
-			aListNode_p next;
-			abool hold;
-			ListNode() {
-				next.store(nullptr, std::memory_order_relaxed);
-				hold.store(false, std::memory_order_relaxed);
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<mutex>
+#include<new>
+#include<thread>
+#include<type_traits>
+#include<utility>
+
+#include"../Asm.h"
+#include"../Portability.h"
+#include"../base/Base.h"
+
+namespace booty {
+
+	namespace detail {
+
+		/// ConcurrentQueue_impl is an unbounded MPMC queue made of sub-queues,
+		/// each filled by a single producer at a time:
+		/// - A ProducerToken owns a sub-queue of its own. Its enqueues touch
+		///   no shared state but the sub-queue's tail index.
+		/// - Enqueues without a token go to one of the implicit sub-queues,
+		///   one per hardware thread, picked once per thread and guarded by
+		///   a producer spin lock.
+		/// - Consumers take a sub-queue's consumer lock with try_lock and
+		///   move on to the next sub-queue when it is taken or empty. A
+		///   ConsumerToken keeps the sub-queue it last took from, rotating
+		///   every kTokenRotation items, so consumers spread over the
+		///   sub-queues instead of meeting on the same one.
+		///
+		/// Items are stored in blocks of kBlockSize slots. A block the
+		/// consumers are done with goes to its sub-queue's free list and
+		/// the producer reuses it, so a queue in a steady state allocates
+		/// nothing. enqueue_bulk and try_dequeue_bulk move a run of items
+		/// under one lock and publish it with a single index store.
+		///
+		/// Ordering: items of one producer (a token, or a thread without
+		/// one) are dequeued in the order they were enqueued. There is no
+		/// order between producers. A try_dequeue may fail while another
+		/// consumer holds the only non-empty sub-queue, it never fails on
+		/// a queue that stays non-empty during the whole call.
+		template<typename T>
+		class ConcurrentQueue_impl :public NonCopyable {
+			static_assert(std::is_nothrow_destructible_v<T>, "T must be nothrow_destructible.");
+
+			static constexpr size_t kBlockSize = 32;
+			static constexpr size_t kMaxImplicit = 64;
+			static constexpr size_t kTokenRotation = 256;
+
+			struct Block {
+				typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[kBlockSize];
+				std::atomic<Block*> next{ nullptr };
+
+				T* at(size_t index) noexcept {
+					return std::launder(reinterpret_cast<T*>(&slots[index % kBlockSize]));
+				}
+			};
+
+			/* A test-and-test-and-set lock, pausing and then yielding. */
+			struct SpinLock {
+				std::atomic<bool> locked{ false };
+
+				bool try_lock() noexcept {
+					return !locked.load(std::memory_order_relaxed) &&
+						!locked.exchange(true, std::memory_order_acquire);
+				}
+
+				void lock() noexcept {
+					for (uint32_t spins = 0; !try_lock(); ++spins) {
+						if (spins < 128)
+							asm_volatile_pause();
+						else
+							std::this_thread::yield();
+					}
+				}
+
+				void unlock() noexcept {
+					locked.store(false, std::memory_order_release);
+				}
+			};
+
+			/// Producer and consumer state live on separate cache lines. The
+			/// tail index is the only field both sides touch.
+			struct SubQueue {
+				SubQueue() {
+					Block* block = new Block;
+					tailBlock = block;
+					headBlock = block;
+				}
+
+				~SubQueue() {
+					size_t head = headIndex.load(std::memory_order_relaxed);
+					size_t tail = tailIndex.load(std::memory_order_relaxed);
+					// the same walk as take(): a block boundary moves to the next block.
+					Block* block = headBlock;
+					for (; head != tail; ++head) {
+						if (head % kBlockSize == 0 && head != 0)
+							block = block->next.load(std::memory_order_relaxed);
+						block->at(head)->~T();
+					}
+					deleteChain(headBlock);
+					deleteChain(freeBlocks.load(std::memory_order_relaxed));
+					deleteChain(spareBlocks);
+				}
+
+				static void deleteChain(Block* block) noexcept {
+					while (block) {
+						Block* next = block->next.load(std::memory_order_relaxed);
+						delete block;
+						block = next;
+					}
+				}
+
+				/* Producer side: a recycled block if there is one, a new one otherwise. */
+				Block* nextBlock() {
+					if (!spareBlocks)
+						spareBlocks = freeBlocks.exchange(nullptr, std::memory_order_acquire);
+					Block* block = spareBlocks;
+					if (block)
+						spareBlocks = block->next.load(std::memory_order_relaxed);
+					else
+						block = new Block;
+					block->next.store(nullptr, std::memory_order_relaxed);
+					return block;
+				}
+
+				// producer
+				alignas(kCacheLineSize) SpinLock producerLock;
+				std::atomic<bool> owned{ false };
+				Block* tailBlock;
+				Block* spareBlocks = nullptr;
+				std::atomic<size_t> tailIndex{ 0 };
+
+				// consumer
+				alignas(kCacheLineSize) SpinLock consumerLock;
+				Block* headBlock;
+				std::atomic<size_t> headIndex{ 0 };
+				/* Blocks the consumers are done with, pushed under consumerLock, taken whole by the producer. */
+				std::atomic<Block*> freeBlocks{ nullptr };
+			};
+
+		public:
+			using value_type = T;
+
+			/// A ProducerToken gives its holder a sub-queue of its own. The
+			/// sub-queue outlives the token: its items stay in the queue and
+			/// the next token created may take it over. A token must not
+			/// outlive its queue, and is used by one thread at a time.
+			class ProducerToken :public NonCopyable {
+			public:
+				explicit ProducerToken(ConcurrentQueue_impl& queue)
+					:sub_(queue.acquireSubQueue()) {}
+
+				~ProducerToken() {
+					if (sub_)
+						sub_->owned.store(false, std::memory_order_release);
+				}
+
+				/* false if the queue ran out of sub-queues and the token falls back on the implicit ones. */
+				bool valid() const noexcept {
+					return sub_ != nullptr;
+				}
+
+			private:
+				friend class ConcurrentQueue_impl;
+				SubQueue* sub_;
+			};
+
+			/// A ConsumerToken remembers which sub-queue its holder took from
+			/// last. Consumers with tokens start from different sub-queues.
+			class ConsumerToken :public NonCopyable {
+			public:
+				explicit ConsumerToken(ConcurrentQueue_impl& queue)
+					:next_(queue.nextConsumer_.fetch_add(1, std::memory_order_relaxed)) {}
+
+			private:
+				friend class ConcurrentQueue_impl;
+				size_t next_;
+				size_t taken_ = 0;
+			};
+
+			/// maxProducers bounds the number of ProducerToken sub-queues
+			/// alive at once, tokens beyond it share the implicit sub-queues.
+			explicit ConcurrentQueue_impl(size_t maxProducers = 64)
+				:implicitCount_(implicitSubQueues()),
+				capacity_(implicitCount_ + maxProducers),
+				subQueues_(new std::atomic<SubQueue*>[capacity_]) {
+				for (size_t i = 0; i < capacity_; ++i)
+					subQueues_[i].store(i < implicitCount_ ? new SubQueue : nullptr, std::memory_order_relaxed);
+				count_.store(implicitCount_, std::memory_order_release);
 			}
 
-			template<typename Ty>
-			ListNode(Ty&& val)
-				:data(std::forward<Ty>(val)) {
-				next.store(nullptr, std::memory_order_relaxed);
-				hold.store(false, std::memory_order_relaxed);
+			/* destroys the items left, no other thread may use the queue. */
+			~ConcurrentQueue_impl() {
+				for (size_t i = 0; i < capacity_; ++i)
+					delete subQueues_[i].load(std::memory_order_relaxed);
 			}
-		};
 
-		// define concurrent linked-list.
-		struct ContLinkedList
-		{
-			aListNode_p head;
-			aListNode_p tail;
-			abool lock;
-
-			ContLinkedList() {
-				head.store(nullptr, std::memory_order_relaxed);
-				tail.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);  // init: tail = head
-				lock.store(false, std::memory_order_relaxed);
+			void enqueue(const T& item) {
+				enqueueImplicit([&](SubQueue& sub) { emplace(sub, item); });
 			}
-			bool isEmpty() {
-				return head.load() == tail.load();
+
+			void enqueue(T&& item) {
+				enqueueImplicit([&](SubQueue& sub) { emplace(sub, std::move(item)); });
 			}
 
-			void allocNewNodes() {
-				this->lock.store(true);
-				ListNode* _tail = this->tail.load();
-				// preallocate a linked list.
-				if (!_tail)
-					_tail = new ListNode(T());
-				ListNode** head_copy = &_tail;
-				for (int i = 0; i < kNextAllocNodeNum; ++i) {
-					(*head_copy)->next.store(new ListNode(T()), std::memory_order_relaxed);
-					auto _next = (*head_copy)->next.load(std::memory_order_relaxed);
-					head_copy = &_next;
-				}
-				// connect new linked list to subqueue.
-				this->tail.store(_tail);
-				this->lock.store(false);
+			void enqueue(ProducerToken& token, const T& item) {
+				if (!token.sub_)
+					return enqueue(item);
+				emplace(*token.sub_, item);
 			}
-		};
 
-	public:
-		/*
-		  it is a unbounded queue.
-		*/
-		ConcurrentQueue_impl();
-
-		/*
-		  enqueue one element.
-		*/
-		void enqueue(const T& data) {
-			if (this->empty()) {
-				while (!tryEnqueue(data));  // try until succeed.
-				cond_empty.notify_one();
+			void enqueue(ProducerToken& token, T&& item) {
+				if (!token.sub_)
+					return enqueue(std::move(item));
+				emplace(*token.sub_, std::move(item));
 			}
-			else
-				while (!tryEnqueue(data));
-		}
-
-		/*
-		  enqueue one element(rvalue).
-		*/
-		void enqueue(T&& data) {
-			if (this->empty()) {
-				while (!tryEnqueue(std::forward<T>(data)));  // try until succeed.
-				cond_empty.notify_one();
+
+			/* enqueues count items from first, a move_iterator moves them in. */
+			template<typename InputIt>
+			void enqueue_bulk(InputIt first, size_t count) {
+				enqueueImplicit([&](SubQueue& sub) { emplaceBulk(sub, first, count); });
 			}
-			else
-				while (!tryEnqueue(std::forward<T>(data)));
-
-		}
-
-		/*
-		  dequeue one element,  block when it is empty.
-		*/
-		void dequeue(T& data) {
-			{
-				std::lock_guard<std::mutex> lock(mtx);
-				for (auto&& queue : sub_queues) {
-					auto head = queue.head.load();
-					int cnt = 0;
-					while (head) {
-						++cnt;
-						head = head->next.load();
-					}
-					std::printf("%d\n", cnt);
-				}
+
+			template<typename InputIt>
+			void enqueue_bulk(ProducerToken& token, InputIt first, size_t count) {
+				if (!token.sub_)
+					return enqueue_bulk(first, count);
+				emplaceBulk(*token.sub_, first, count);
 			}
-			if (this->empty()) {
-				std::unique_lock<std::mutex> lock(mtx_empty);
-				cond_empty.wait(lock, [this] {
-					return !this->empty();
-				});
+
+			/* take an item if there is one, never waits. */
+			bool try_dequeue(T& item) {
+				return try_dequeue_bulk(&item, 1) == 1;
 			}
-			while (!tryDequeue(data));  // try until succeed.
-		}
-
-		size_t size() const {
-			return _size.load();
-		}
-		bool empty() const {
-			return _size.load() == 0;
-		}
-
-		~ConcurrentQueue_impl() {
-			for (auto& queue : sub_queues) {
-				ListNode* head = queue.head.load(std::memory_order_relaxed);
-				ListNode* next = head->next.load(std::memory_order_relaxed);
-				delete head; head = nullptr;
-				while (next) {
-					head = next;
-					next = next->next.load(std::memory_order_relaxed);
-					delete head; head = nullptr;
-				}
+
+			bool try_dequeue(ConsumerToken& token, T& item) {
+				return try_dequeue_bulk(token, &item, 1) == 1;
 			}
-		}
 
-		// forbid copy ctor & copy operator.
-		ConcurrentQueue_impl(const ConcurrentQueue_impl& queue) = delete;
-		ConcurrentQueue_impl& operator=(const ConcurrentQueue_impl& queue) = delete;
+			/// Moves up to max items to out and returns how many. The items
+			/// all come from one sub-queue, in order.
+			template<typename OutputIt>
+			size_t try_dequeue_bulk(OutputIt out, size_t max) {
+				thread_local size_t next = 0;
+				size_t got = dequeueFrom(next, out, max);
+				next += got == 0;
+				return got;
+			}
 
-	private:
+			template<typename OutputIt>
+			size_t try_dequeue_bulk(ConsumerToken& token, OutputIt out, size_t max) {
+				size_t got = dequeueFrom(token.next_, out, max);
+				token.taken_ += got;
+				if (got == 0 || token.taken_ >= kTokenRotation) {
+					++token.next_;
+					token.taken_ = 0;
+				}
+				return got;
+			}
 
-		size_t _getEnqueueIndex() {
-			return _enqueue_idx.load() % kSubQueueNum;
-		}
+			/* approximate: items enqueued and not dequeued yet. */
+			size_t size_approx() const noexcept {
+				size_t size = 0;
+				size_t count = std::min(count_.load(std::memory_order_acquire), capacity_);
+				for (size_t i = 0; i < count; ++i) {
+					if (SubQueue* sub = subQueues_[i].load(std::memory_order_acquire)) {
+						size_t head = sub->headIndex.load(std::memory_order_acquire);
+						size_t tail = sub->tailIndex.load(std::memory_order_acquire);
+						size += tail > head ? tail - head : 0;
+					}
+				}
+				return size;
+			}
 
-		size_t _getDequeueIndex() {
-			return _dequeue_idx.load() % kSubQueueNum;
-		}
+			bool empty() const noexcept {
+				return size_approx() == 0;
+			}
 
-		// return the tail of linked list.
-		// if nodes are running out, allocate some new nodes.
-		ListNode* acquireOrAllocTail(ContLinkedList& list) {
-			if (list.isEmpty() || list.lock.load()) {
-				std::this_thread::yield();
-				return nullptr;
+		private:
+			static size_t implicitSubQueues() noexcept {
+				size_t threads = std::max(1u, std::thread::hardware_concurrency());
+				return std::min(threads, kMaxImplicit);
 			}
-			ListNode* _tail = list.tail.load(std::memory_order_acquire);
-			// queue-capacity is running out.
-			if (!_tail || !_tail->next.load()) {
-				std::lock_guard<std::mutex> lock(this->mtx_alloc);
-				if (list.lock.load())
-					return nullptr;
-				list.allocNewNodes();
-				return nullptr;
+
+			/* The implicit sub-queue of the calling thread, picked round robin on first use. */
+			static size_t implicitIndex() noexcept {
+				static std::atomic<size_t> next{ 0 };
+				thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+				return index;
 			}
-			for (size_t try_time = 0; !_tail || _tail->hold.load(std::memory_order_acquire); ++try_time) {
-				std::this_thread::yield();
-				_tail = list.tail.load(std::memory_order_acquire);
-				if (try_time >= kMaxContendTryTime)
+
+			/// A sub-queue for a new ProducerToken: one a dead token left, or
+			/// a new one. nullptr when all capacity_ slots are taken.
+			SubQueue* acquireSubQueue() {
+				size_t count = std::min(count_.load(std::memory_order_acquire), capacity_);
+				for (size_t i = implicitCount_; i < count; ++i) {
+					SubQueue* sub = subQueues_[i].load(std::memory_order_acquire);
+					bool owned = false;
+					if (sub && !sub->owned.load(std::memory_order_relaxed) &&
+						sub->owned.compare_exchange_strong(owned, true, std::memory_order_acquire))
+						return sub;
+				}
+				size_t slot = count_.fetch_add(1, std::memory_order_acq_rel);
+				if (slot >= capacity_) {
+					count_.fetch_sub(1, std::memory_order_relaxed);
 					return nullptr;
+				}
+				SubQueue* sub = new SubQueue;
+				sub->owned.store(true, std::memory_order_relaxed);
+				subQueues_[slot].store(sub, std::memory_order_release);
+				return sub;
 			}
-			assert(_tail != nullptr);
-			_tail->hold.store(true, std::memory_order_release);
-			return _tail;
-		}
-
-		/*
-		  try to enqueue, return true if succeed.
-		*/
-		template<typename Ty>
-		bool tryEnqueue(Ty&& data) {
-			auto& cur_queue = sub_queues[_getEnqueueIndex()];
-			ListNode* tail = acquireOrAllocTail(cur_queue);  // now tail->hold should be true.
-			if (!tail || !tail->hold.load(std::memory_order_acquire))
-				return false;
-			++_enqueue_idx;
-			tail->data = std::forward<Ty>(data);
-			tail->hold.store(false, std::memory_order_release);
-			// use CAS to update tail node.
-			auto _next = tail->next.load(std::memory_order_seq_cst);
-			while (!cur_queue.tail.compare_exchange_weak(tail, _next));
-			++_size;
-			return true;
-		}
-
-		/*
-		  try to get the head element.
-		*/
-		ListNode* tryGetFront(ContLinkedList& list) {
-			if (list.isEmpty()) {
-				std::this_thread::yield();
-				return nullptr;
+
+			template<typename Fn>
+			void enqueueImplicit(Fn&& fn) {
+				SubQueue& sub = *subQueues_[implicitIndex() % implicitCount_].load(std::memory_order_relaxed);
+				std::lock_guard<SpinLock> lock(sub.producerLock);
+				fn(sub);
 			}
-			ListNode* _next = list.head.load()->next.load();
-			for (size_t try_time = 0; !_next || _next->hold.load(std::memory_order_acquire); ++try_time) {
-				std::this_thread::yield();
-				_next = list.head.load()->next.load(std::memory_order_acquire); std::cout << "====" << std::endl; // TODO: dead-loop when _next is nullptr.
-				if (try_time >= kMaxContendTryTime)
-					return nullptr;
+
+			/* Producer side: the block for slot `tail`, linking a new one at a block boundary. */
+			static Block* blockFor(SubQueue& sub, size_t tail) {
+				if (tail % kBlockSize == 0 && tail != 0) {
+					Block* block = sub.nextBlock();
+					// consumers reach the new block only after the tail index
+					// store that publishes its first item.
+					sub.tailBlock->next.store(block, std::memory_order_relaxed);
+					sub.tailBlock = block;
+				}
+				return sub.tailBlock;
 			}
-			assert(_next != nullptr);
-			_next->hold.store(true, std::memory_order_release);
-			return _next;
-		}
-
-		/*
-		  try to dequeue one element (pass to data) and destory it from heap.
-		  REMARK: return by value is not provided since it's not exception safe.
-		*/
-		bool tryDequeue(T& data) {
-			auto& cur_queue = sub_queues[_getDequeueIndex()];
-			ListNode* _next = tryGetFront(cur_queue);
-			if (!_next || !_next->hold.load(std::memory_order_acquire)) {
-				return false;
+
+			template<typename Arg>
+			static void emplace(SubQueue& sub, Arg&& item) {
+				const size_t tail = sub.tailIndex.load(std::memory_order_relaxed);
+				new (blockFor(sub, tail)->at(tail)) T(std::forward<Arg>(item));
+				sub.tailIndex.store(tail + 1, std::memory_order_release);
+			}
+
+			/// A throwing constructor publishes the items before it and
+			/// rethrows.
+			template<typename InputIt>
+			static void emplaceBulk(SubQueue& sub, InputIt first, size_t count) {
+				const size_t tail = sub.tailIndex.load(std::memory_order_relaxed);
+				size_t done = 0;
+				try {
+					for (; done < count; ++done, ++first)
+						new (blockFor(sub, tail + done)->at(tail + done)) T(*first);
+				}
+				catch (...) {
+					sub.tailIndex.store(tail + done, std::memory_order_release);
+					throw;
+				}
+				sub.tailIndex.store(tail + count, std::memory_order_release);
+			}
+
+			/// Sweeps the sub-queues once from `start`, skipping the ones
+			/// another consumer holds. If it skipped any and found nothing,
+			/// it sweeps again waiting for the locks, so that it does not fail
+			/// on a queue that holds items. `start` is left at the sub-queue
+			/// the items came from.
+			template<typename OutputIt>
+			size_t dequeueFrom(size_t& start, OutputIt& out, size_t max) {
+				if (max == 0)
+					return 0;
+				const size_t count = std::min(count_.load(std::memory_order_acquire), capacity_);
+				bool skipped = false;
+				for (size_t i = 0; i < count; ++i) {
+					size_t index = (start + i) % count;
+					SubQueue* sub = subQueues_[index].load(std::memory_order_acquire);
+					if (!sub || !hasItems(*sub))
+						continue;
+					if (!sub->consumerLock.try_lock()) {
+						skipped = true;
+						continue;
+					}
+					size_t got = take(*sub, out, max);
+					sub->consumerLock.unlock();
+					if (got) {
+						start = index;
+						return got;
+					}
+				}
+				if (!skipped)
+					return 0;
+				for (size_t i = 0; i < count; ++i) {
+					size_t index = (start + i) % count;
+					SubQueue* sub = subQueues_[index].load(std::memory_order_acquire);
+					if (!sub || !hasItems(*sub))
+						continue;
+					std::lock_guard<SpinLock> lock(sub->consumerLock);
+					if (size_t got = take(*sub, out, max)) {
+						start = index;
+						return got;
+					}
+				}
+				return 0;
+			}
+
+			static bool hasItems(const SubQueue& sub) noexcept {
+				return sub.headIndex.load(std::memory_order_relaxed) != sub.tailIndex.load(std::memory_order_acquire);
 			}
-			++_dequeue_idx;
-			data = std::move(_next->data);
-			//update head and return old head.
-			auto old_head = cur_queue.head.exchange(_next, std::memory_order_seq_cst);
-			//delete old_head; old_head = nullptr;
-			_next->hold.store(false, std::memory_order_release);
-			--_size;
-			return true;
-		}
-
-		// only for blocking when queue is empty.
-		std::condition_variable cond_empty;
-		std::mutex mtx_empty;
-		std::mutex mtx_alloc;
-		
-		// std::array perform better than std::vector.
-		std::array<ContLinkedList, kSubQueueNum> sub_queues;
-		asize_t _size;
-		asize_t _enqueue_idx;
-		asize_t _dequeue_idx;
-	};
-
-	template<typename T>
-	inline ConcurrentQueue_impl<T>::ConcurrentQueue_impl() {
-		_size.store(0, std::memory_order_relaxed);
-		_enqueue_idx.store(0, std::memory_order_relaxed);
-		_dequeue_idx.store(0, std::memory_order_relaxed);
-		// pre-allocate kPreAllocNodeNum nodes.
-		for (auto& queue : sub_queues) {
-			queue.head.store(new ListNode(T()), std::memory_order_relaxed);
-			queue.tail.store(new ListNode(T()), std::memory_order_relaxed);
-			auto _tail = queue.tail.load(std::memory_order_relaxed);
-			for (int i = 0; i < kPreAllocNodeNum / kSubQueueNum; ++i) {
-				_tail->next.store(new ListNode(T()), std::memory_order_relaxed);
-				_tail = _tail->next.load(std::memory_order_relaxed);
+
+			/// Consumer side, under consumerLock. A block is recycled when the
+			/// consumer steps past its last slot; the producer has moved on to
+			/// a later block by then, as that slot is not the tail.
+			template<typename OutputIt>
+			static size_t take(SubQueue& sub, OutputIt& out, size_t max) {
+				const size_t head = sub.headIndex.load(std::memory_order_relaxed);
+				const size_t tail = sub.tailIndex.load(std::memory_order_acquire);
+				const size_t n = std::min(max, tail - head);
+				for (size_t i = 0; i < n; ++i, ++out) {
+					size_t index = head + i;
+					if (index % kBlockSize == 0 && index != 0) {
+						Block* done = sub.headBlock;
+						sub.headBlock = done->next.load(std::memory_order_relaxed);
+						recycle(sub, done);
+					}
+					T* item = sub.headBlock->at(index);
+					*out = std::move(*item);
+					item->~T();
+				}
+				if (n)
+					sub.headIndex.store(head + n, std::memory_order_release);
+				return n;
 			}
-			queue.head.load(std::memory_order_relaxed)->next.store(queue.tail.load(std::memory_order_relaxed), std::memory_order_relaxed);
-		}
-	}
 
-} // namespace concurrentlib
+			static void recycle(SubQueue& sub, Block* block) noexcept {
+				Block* top = sub.freeBlocks.load(std::memory_order_relaxed);
+				do {
+					block->next.store(top, std::memory_order_relaxed);
+				} while (!sub.freeBlocks.compare_exchange_weak(top, block,
+					std::memory_order_release, std::memory_order_relaxed));
+			}
+
+			const size_t implicitCount_;
+			const size_t capacity_;
+			const std::unique_ptr<std::atomic<SubQueue*>[]> subQueues_;
+			/* Slots of subQueues_ handed out, a ProducerToken sub-queue may still be on its way into its slot. */
+			std::atomic<size_t> count_{ 0 };
+			std::atomic<size_t> nextConsumer_{ 0 };
+		};
+
+	} // detail
+
+} // booty
 
-#endif // !_CONCURRENT_QUEUE_IMPL_HPP
\ No newline at end of file
+#endif // !BOOTY_DETAIL_CONCURRENTQUEUE_IMPL_HPP
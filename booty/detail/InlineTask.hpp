@@ -0,0 +1,175 @@
+/*
+ * InlineTask is the move-only `void()` callable queued by booty::ThreadPool.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_DETAIL_INLINETASK_HPP
+#define BOOTY_DETAIL_INLINETASK_HPP
+
+#include<cstddef>
+#include<cstdint>
+#include<new>
+#include<type_traits>
+#include<utility>
+
+namespace booty {
+
+	namespace detail {
+
+		/// InlineTask type-erases any `void()` callable like std::function, but:
+		/// - it is move-only, so it can hold move-only captures (promises,
+		///   unique_ptr...) and never needs a copy constructor of the callable.
+		/// - callables up to kInlineSize bytes that are nothrow-movable live in
+		///   an inline buffer, so the common small lambda costs no allocation.
+		///   Bigger ones fall back to one heap block.
+		/// The whole object is exactly one cache line.
+		class alignas(16) InlineTask {
+		public:
+			static constexpr size_t kInlineSize = 48;
+
+		private:
+			/// per-callable-type operations, one static table per type.
+			struct Ops {
+				void(*invoke)(void* storage);
+				// move-construct into dst and destroy src.
+				void(*relocate)(void* dst, void* src) noexcept;
+				void(*destroy)(void* storage) noexcept;
+			};
+
+			template<typename F>
+			static constexpr bool fitsInline =
+				sizeof(F) <= kInlineSize && alignof(F) <= 16 &&
+				std::is_nothrow_move_constructible_v<F>;
+
+			template<typename F>
+			struct InlineOps {
+				static void invoke(void* storage) {
+					(*static_cast<F*>(storage))();
+				}
+				static void relocate(void* dst, void* src) noexcept {
+					F* from = static_cast<F*>(src);
+					new (dst) F(std::move(*from));
+					from->~F();
+				}
+				static void destroy(void* storage) noexcept {
+					static_cast<F*>(storage)->~F();
+				}
+				static constexpr Ops table{ &invoke, &relocate, &destroy };
+			};
+
+			template<typename F>
+			struct HeapOps {
+				static F*& ptr(void* storage) noexcept {
+					return *static_cast<F**>(storage);
+				}
+				static void invoke(void* storage) {
+					(*ptr(storage))();
+				}
+				static void relocate(void* dst, void* src) noexcept {
+					new (dst) F*(ptr(src));
+				}
+				static void destroy(void* storage) noexcept {
+					delete ptr(storage);
+				}
+				static constexpr Ops table{ &invoke, &relocate, &destroy };
+			};
+
+		public:
+			InlineTask() noexcept = default;
+
+			template<typename F, typename Fn = std::decay_t<F>,
+				typename = std::enable_if_t<!std::is_same_v<Fn, InlineTask>>>
+			InlineTask(F&& func) {
+				static_assert(std::is_invocable_v<Fn&>, "InlineTask needs a void() callable.");
+				if constexpr (fitsInline<Fn>) {
+					new (&storage_) Fn(std::forward<F>(func));
+					ops_ = &InlineOps<Fn>::table;
+				}
+				else {
+					new (&storage_) Fn*(new Fn(std::forward<F>(func)));
+					ops_ = &HeapOps<Fn>::table;
+				}
+			}
+
+			InlineTask(InlineTask&& other) noexcept {
+				moveFrom(other);
+			}
+
+			InlineTask& operator=(InlineTask&& other) noexcept {
+				if (this != &other) {
+					reset();
+					moveFrom(other);
+				}
+				return *this;
+			}
+
+			InlineTask(const InlineTask&) = delete;
+			InlineTask& operator=(const InlineTask&) = delete;
+
+			~InlineTask() {
+				reset();
+			}
+
+			/* run the callable, the task must not be empty. */
+			void operator()() {
+				ops_->invoke(&storage_);
+			}
+
+			explicit operator bool() const noexcept {
+				return ops_ != nullptr;
+			}
+
+			/// An 8-byte tag that travels with the task through moves; it lives
+			/// in what would otherwise be padding. ThreadPool stores the
+			/// enqueue timestamp there when statistics are compiled in, and
+			/// keeps the top bit for the continuation mark.
+			uint64_t stamp() const noexcept {
+				return stamp_ & ~kContinuationBit;
+			}
+
+			void setStamp(uint64_t stamp) noexcept {
+				stamp_ = (stamp & ~kContinuationBit) | (stamp_ & kContinuationBit);
+			}
+
+			/// A continuation carries on work the pool has already admitted
+			/// (a split-off range, a ready graph node, a strand's drain); the
+			/// pool never refuses nor drops it.
+			bool continuation() const noexcept {
+				return (stamp_ & kContinuationBit) != 0;
+			}
+
+			void markContinuation() noexcept {
+				stamp_ |= kContinuationBit;
+			}
+
+			/* destroy the held callable without running it. */
+			void reset() noexcept {
+				if (ops_) {
+					ops_->destroy(&storage_);
+					ops_ = nullptr;
+				}
+			}
+
+		private:
+			void moveFrom(InlineTask& other) noexcept {
+				if (other.ops_) {
+					other.ops_->relocate(&storage_, &other.storage_);
+					ops_ = other.ops_;
+					other.ops_ = nullptr;
+				}
+				stamp_ = other.stamp_;
+			}
+
+			static constexpr uint64_t kContinuationBit = uint64_t(1) << 63;
+
+			std::aligned_storage_t<kInlineSize, 16> storage_;
+			const Ops* ops_ = nullptr;
+			uint64_t stamp_ = 0;
+		};
+
+		static_assert(sizeof(InlineTask) == 64, "InlineTask should fill exactly one cache line.");
+
+	} // namespace detail
+
+} // namespace booty
+
+#endif // !BOOTY_DETAIL_INLINETASK_HPP
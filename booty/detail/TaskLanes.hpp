@@ -0,0 +1,163 @@
+/*
+ * TaskLanes contains the extra queues behind ThreadPool's priority and
+ * deadline submissions.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_DETAIL_TASKLANES_HPP
+#define BOOTY_DETAIL_TASKLANES_HPP
+
+#include<algorithm>
+#include<atomic>
+#include<cstdint>
+#include<limits>
+#include<memory>
+#include<mutex>
+#include<utility>
+#include<vector>
+
+#include"../Portability.h"
+#include"../base/Base.h"
+#include"../concurrency/WorkStealingDeque.hpp"
+
+namespace booty {
+
+	namespace detail {
+
+		/// ShardedLane is a FIFO lane split into several independently locked
+		/// shards. Producers push to the shard picked by their hint (worker
+		/// index or a per-thread hash), consumers take from their own shard
+		/// first and sweep the others. Emptiness is read from each shard's own
+		/// size, so an idle lane is a few shared, read-only cache lines and
+		/// no counter is written by every submission.
+		template<typename T>
+		class ShardedLane :public NonCopyable {
+			struct alignas(kCacheLineSize) Shard {
+				concurrency::WorkStealingDeque<T> queue;
+			};
+
+		public:
+			explicit ShardedLane(size_t shards)
+				:shards_(std::max<size_t>(1, shards)),
+				slots_(std::make_unique<Shard[]>(shards_)) {}
+
+			void push(size_t hint, T&& item) {
+				slots_[hint % shards_].queue.push(std::move(item));
+			}
+
+			template<typename Iter>
+			void pushBulk(size_t hint, Iter first, Iter last) {
+				slots_[hint % shards_].queue.pushBulk(first, last);
+			}
+
+			/* take the oldest item, own shard first. */
+			bool tryTake(size_t hint, T& out) {
+				for (size_t i = 0; i < shards_; ++i) {
+					if (slots_[(hint + i) % shards_].queue.steal(out))
+						return true;
+				}
+				return false;
+			}
+
+			bool empty() const noexcept {
+				for (size_t i = 0; i < shards_; ++i) {
+					if (!slots_[i].queue.empty())
+						return false;
+				}
+				return true;
+			}
+
+		private:
+			const size_t shards_;
+			std::unique_ptr<Shard[]> slots_;
+		};
+
+		/// DeadlineLane orders items by absolute deadline (earliest first,
+		/// FIFO among equal deadlines pushed to the same shard). Each shard
+		/// is a binary heap under its own lock and publishes its earliest
+		/// deadline in an atomic, so a consumer picks the globally earliest
+		/// shard without taking any lock and only locks that one shard to pop.
+		/// Ties are broken by a sequence counted per shard, under its lock.
+		template<typename T>
+		class DeadlineLane :public NonCopyable {
+			// marks an empty shard, pushed deadlines are clamped below it.
+			static constexpr int64_t kNoDeadline = std::numeric_limits<int64_t>::max();
+
+			struct Entry {
+				int64_t deadline;
+				uint64_t sequence;
+				T item;
+			};
+
+			// std heap is a max-heap: "less" means "later".
+			struct Later {
+				bool operator()(const Entry& lhs, const Entry& rhs) const noexcept {
+					return lhs.deadline != rhs.deadline
+						? lhs.deadline > rhs.deadline : lhs.sequence > rhs.sequence;
+				}
+			};
+
+			struct alignas(kCacheLineSize) Shard {
+				std::atomic<int64_t> earliest{ kNoDeadline };
+				std::mutex mtx;
+				uint64_t sequence = 0;
+				std::vector<Entry> heap;
+			};
+
+		public:
+			explicit DeadlineLane(size_t shards)
+				:shards_(std::max<size_t>(1, shards)),
+				slots_(std::make_unique<Shard[]>(shards_)) {}
+
+			void push(size_t hint, int64_t deadline, T&& item) {
+				Shard& shard = slots_[hint % shards_];
+				std::lock_guard<std::mutex> lock(shard.mtx);
+				shard.heap.push_back(Entry{ std::min(deadline, kNoDeadline - 1),
+					shard.sequence++, std::move(item) });
+				std::push_heap(shard.heap.begin(), shard.heap.end(), Later());
+				shard.earliest.store(shard.heap.front().deadline, std::memory_order_release);
+			}
+
+			/* pop the item with the earliest deadline across all shards. */
+			bool tryTake(T& out) {
+				while (true) {
+					Shard* best = nullptr;
+					int64_t best_deadline = kNoDeadline;
+					for (size_t i = 0; i < shards_; ++i) {
+						int64_t deadline = slots_[i].earliest.load(std::memory_order_acquire);
+						if (deadline < best_deadline) {
+							best_deadline = deadline;
+							best = &slots_[i];
+						}
+					}
+					if (!best)
+						return false;
+					std::lock_guard<std::mutex> lock(best->mtx);
+					if (best->heap.empty())
+						continue;  // raced with another consumer, look again.
+					std::pop_heap(best->heap.begin(), best->heap.end(), Later());
+					out = std::move(best->heap.back().item);
+					best->heap.pop_back();
+					best->earliest.store(best->heap.empty() ? kNoDeadline : best->heap.front().deadline,
+						std::memory_order_release);
+					return true;
+				}
+			}
+
+			bool empty() const noexcept {
+				for (size_t i = 0; i < shards_; ++i) {
+					if (slots_[i].earliest.load(std::memory_order_acquire) != kNoDeadline)
+						return false;
+				}
+				return true;
+			}
+
+		private:
+			const size_t shards_;
+			std::unique_ptr<Shard[]> slots_;
+		};
+
+	} // namespace detail
+
+} // namespace booty
+
+#endif // !BOOTY_DETAIL_TASKLANES_HPP
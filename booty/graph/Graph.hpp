@@ -4,8 +4,13 @@
  * @Simoncqk - 2019.02
  */
 
+#include<cstdio>
+#include<functional>
+#include<memory>
+#include<queue>
 #include<string>
 #include<unordered_map>
+#include<vector>
 
 namespace booty {
 
@@ -22,12 +27,17 @@ namespace booty {
 		template<typename IdType = int>
 		class NodeInterface {
 		public:
+			virtual ~NodeInterface() = default;
 			// return id of current node(vertex).
-			IdType ID() = 0;
+			virtual IdType ID() const = 0;
 			// return a string-typed description of current node(vertex).
-			std::string String() = 0;
+			virtual std::string String() const = 0;
 		};
 
+		// nodes are polymorphic, graphs share them by pointer.
+		template<typename IdType = int>
+		using NodePtr = std::shared_ptr<NodeInterface<IdType>>;
+
 		// Edge interface defination.
 		template<typename IdType = int>
 		class EdgeInterface {
@@ -35,10 +45,11 @@ namespace booty {
 			using WeightType = double;
 
 		public:
-			NodeInterface<IdType> Source() = 0;
-			NodeInterface<IdType> Target() = 0;
-			double Weight() = 0;
-			std::string String() = 0;
+			virtual ~EdgeInterface() = default;
+			virtual NodePtr<IdType> Source() const = 0;
+			virtual NodePtr<IdType> Target() const = 0;
+			virtual double Weight() const = 0;
+			virtual std::string String() const = 0;
 		};
 
 		// Graph interface defination, including all basic but significant operations
@@ -46,72 +57,201 @@ namespace booty {
 		template<typename IdType = int>
 		class GraphInterface {
 		public:
-			using NodeMap = std::unordered_map<IdType, NodeInterface<IdType>>;
+			using NodeMap = std::unordered_map<IdType, NodePtr<IdType>>;
 
+			virtual ~GraphInterface() = default;
 			// total number of nodes.
-			int NodeCounts() = 0;
-			// get node by the given id.
-			NodeInterface<IdType> GetNode(IdType id) = 0;
+			virtual int NodeCounts() const = 0;
+			// get node by the given id, nullptr if there is no such node.
+			virtual NodePtr<IdType> GetNode(IdType id) const = 0;
 			// return nodes with its ids.
-			NodeMap GetNodes() = 0;
+			virtual NodeMap GetNodes() const = 0;
 			// add new node, return true if add succeed, else false if add fails
 			// or node has existed.
-			bool AddNode(const NodeInterface<IdType>& node) = 0;
+			virtual bool AddNode(NodePtr<IdType> node) = 0;
 			// delete node, return true if deletion succeed, else false if deletion fails
 			// or node has been deleted.
-			bool DeleteNode(IdType id) = 0;
+			virtual bool DeleteNode(IdType id) = 0;
 			// add new edge, return true if add succeed, else false if add fails
 			// or edge has existed.
-			bool AddEdge(IdType srcId, IdType tgtId, double weight) = 0;
+			virtual bool AddEdge(IdType srcId, IdType tgtId, double weight) = 0;
 			// update edge, return true if update succeed, else false if update fails
 			// or edge does not exist.
-			bool UpdateEdge(IdType srcId, IdType tgtId, double weight) = 0;
+			virtual bool UpdateEdge(IdType srcId, IdType tgtId, double weight) = 0;
 			// delete edge, return true if deletion succeed, else false if deletion fails
 			// or edge has been deleted.
-			bool DeleteEdge(IdType srcId, IdType tgtId) = 0;
+			virtual bool DeleteEdge(IdType srcId, IdType tgtId) = 0;
 			// get weight of edge from node(srcId) to node(tgtId).
-			double GetWeight(IdType srcId, IdType tgtId) = 0;
+			virtual double GetWeight(IdType srcId, IdType tgtId) const = 0;
 			// get all previous nodes of the given id node.
-			NodeMap GetSources(IdType id) = 0;
+			virtual NodeMap GetSources(IdType id) const = 0;
 			// get all target nodes of the given id node.
-			NodeMap GetTargets(IdType id) = 0;
+			virtual NodeMap GetTargets(IdType id) const = 0;
 		};
 
 		// Default graph edge implementation.
 		template<typename IdType = int>
-		class Edge {
+		class Edge :public EdgeInterface<IdType> {
 		public:
-			explicit Edge(const NodeInterface<IdType>& src, const NodeInterface<IdType>& tgt, double weight)
-				:src(src), tgt(tgt), weight(weight) {}
-			NodeInterface<IdType> Source() {
+			explicit Edge(NodePtr<IdType> src, NodePtr<IdType> tgt, double weight)
+				:src(std::move(src)), tgt(std::move(tgt)), weight(weight) {}
+			NodePtr<IdType> Source() const override {
 				return src;
 			}
-			NodeInterface<IdType> Target() {
+			NodePtr<IdType> Target() const override {
 				return tgt;
 			}
-			double Weight() {
+			double Weight() const override {
 				return weight;
 			}
-			std::string String() {
+			std::string String() const override {
 				char buf[256];
-				// TODO: add weight info
-				std::fprintf(buf, "%s -> %s, weight: %lf\n", src.String(), tgt.String(), weight);
+				std::snprintf(buf, sizeof(buf), "%s -> %s, weight: %lf",
+					src->String().c_str(), tgt->String().c_str(), weight);
 				return buf;
 			}
 			// override < operator for sorting.
-			bool operator < (const Edge& e) {
+			bool operator < (const Edge& e) const {
 				return this->weight < e.weight;
 			}
 		private:
-			NodeInterface<IdType> src;
-			NodeInterface<IdType> tgt;
+			NodePtr<IdType> src;
+			NodePtr<IdType> tgt;
 			double weight;
 		};
 
-		// Default graph edge implementation.
-		template<typename IdType=int>
-		class Graph {
+		// Default graph implementation: a directed graph kept as adjacency maps
+		// in both directions, so sources and targets are equally cheap.
+		template<typename IdType = int>
+		class Graph :public GraphInterface<IdType> {
+			using typename GraphInterface<IdType>::NodeMap;
+
+			struct Vertex {
+				NodePtr<IdType> node;
+				std::unordered_map<IdType, double> out;  // target id -> weight
+				std::unordered_map<IdType, double> in;   // source id -> weight
+			};
+
+		public:
+			int NodeCounts() const override {
+				return static_cast<int>(vertices.size());
+			}
+
+			NodePtr<IdType> GetNode(IdType id) const override {
+				auto it = vertices.find(id);
+				return it == vertices.end() ? nullptr : it->second.node;
+			}
+
+			NodeMap GetNodes() const override {
+				NodeMap nodes;
+				for (const auto& entry : vertices)
+					nodes.emplace(entry.first, entry.second.node);
+				return nodes;
+			}
+
+			bool AddNode(NodePtr<IdType> node) override {
+				if (!node)
+					return false;
+				IdType id = node->ID();
+				return vertices.emplace(id, Vertex{ std::move(node), {}, {} }).second;
+			}
+
+			bool DeleteNode(IdType id) override {
+				auto it = vertices.find(id);
+				if (it == vertices.end())
+					return false;
+				for (const auto& target : it->second.out)
+					vertices[target.first].in.erase(id);
+				for (const auto& source : it->second.in)
+					vertices[source.first].out.erase(id);
+				vertices.erase(it);
+				return true;
+			}
+
+			bool AddEdge(IdType srcId, IdType tgtId, double weight) override {
+				auto src = vertices.find(srcId);
+				auto tgt = vertices.find(tgtId);
+				if (src == vertices.end() || tgt == vertices.end())
+					return false;
+				if (!src->second.out.emplace(tgtId, weight).second)
+					return false;
+				tgt->second.in.emplace(srcId, weight);
+				return true;
+			}
+
+			bool UpdateEdge(IdType srcId, IdType tgtId, double weight) override {
+				auto src = vertices.find(srcId);
+				if (src == vertices.end())
+					return false;
+				auto edge = src->second.out.find(tgtId);
+				if (edge == src->second.out.end())
+					return false;
+				edge->second = weight;
+				vertices[tgtId].in[srcId] = weight;
+				return true;
+			}
+
+			bool DeleteEdge(IdType srcId, IdType tgtId) override {
+				auto src = vertices.find(srcId);
+				if (src == vertices.end() || src->second.out.erase(tgtId) == 0)
+					return false;
+				vertices[tgtId].in.erase(srcId);
+				return true;
+			}
+
+			// 0 if there is no such edge.
+			double GetWeight(IdType srcId, IdType tgtId) const override {
+				auto src = vertices.find(srcId);
+				if (src == vertices.end())
+					return 0;
+				auto edge = src->second.out.find(tgtId);
+				return edge == src->second.out.end() ? 0 : edge->second;
+			}
+
+			NodeMap GetSources(IdType id) const override {
+				return neighbours(id, &Vertex::in);
+			}
+
+			NodeMap GetTargets(IdType id) const override {
+				return neighbours(id, &Vertex::out);
+			}
+
+			// ids of every node in dependency order (Kahn's algorithm), ties
+			// broken by id. Return false if the graph has a cycle.
+			bool TopologicalOrder(std::vector<IdType>& order) const {
+				order.clear();
+				order.reserve(vertices.size());
+				std::unordered_map<IdType, size_t> indegree;
+				std::priority_queue<IdType, std::vector<IdType>, std::greater<IdType>> ready;
+				for (const auto& entry : vertices) {
+					indegree[entry.first] = entry.second.in.size();
+					if (entry.second.in.empty())
+						ready.push(entry.first);
+				}
+				while (!ready.empty()) {
+					IdType id = ready.top();
+					ready.pop();
+					order.push_back(id);
+					for (const auto& target : vertices.at(id).out) {
+						if (--indegree[target.first] == 0)
+							ready.push(target.first);
+					}
+				}
+				return order.size() == vertices.size();
+			}
+
+		private:
+			NodeMap neighbours(IdType id, std::unordered_map<IdType, double> Vertex::* side) const {
+				NodeMap nodes;
+				auto it = vertices.find(id);
+				if (it == vertices.end())
+					return nodes;
+				for (const auto& entry : it->second.*side)
+					nodes.emplace(entry.first, vertices.at(entry.first).node);
+				return nodes;
+			}
 
+			std::unordered_map<IdType, Vertex> vertices;
 		};
 
 	} // namespace graph
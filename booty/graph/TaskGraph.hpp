@@ -0,0 +1,301 @@
+/*
+ * TaskGraph runs a DAG of callables on booty::ThreadPool: build it once,
+ * run it many times.
+ * @Simoncqk - 2019.03
+ */
+#ifndef BOOTY_GRAPH_TASKGRAPH_HPP
+#define BOOTY_GRAPH_TASKGRAPH_HPP
+
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cstdio>
+#include<functional>
+#include<memory>
+#include<stdexcept>
+#include<string>
+#include<vector>
+
+#include"Graph.hpp"
+#include"../Parallel.hpp"
+#include"../ThreadPool.hpp"
+#include"../base/Base.h"
+
+namespace booty {
+
+	namespace graph {
+
+		/// Timing of one TaskGraph::run().
+		struct TaskGraphReport {
+			// wall time of the whole run.
+			std::chrono::nanoseconds elapsed{ 0 };
+			// sum of the time spent in every node.
+			std::chrono::nanoseconds total_work{ 0 };
+			// longest dependency chain, weighted by measured node times.
+			std::chrono::nanoseconds critical_path{ 0 };
+			// names of the nodes along it, first to last.
+			std::vector<std::string> critical_nodes;
+
+			/* upper bound of the speedup any number of workers could give. */
+			double parallelism() const {
+				return critical_path.count() > 0
+					? double(total_work.count()) / critical_path.count() : 0.0;
+			}
+
+			std::string String() const {
+				char buf[160];
+				std::snprintf(buf, sizeof(buf),
+					"elapsed %.3fms, work %.3fms, critical path %.3fms (parallelism %.2f):",
+					elapsed.count() / 1e6, total_work.count() / 1e6, critical_path.count() / 1e6, parallelism());
+				std::string text(buf);
+				for (size_t i = 0; i < critical_nodes.size(); ++i)
+					text += (i ? " -> " : " ") + critical_nodes[i];
+				return text;
+			}
+		};
+
+		/// TaskGraph is a DAG whose nodes are callables and whose edges are
+		/// dependencies. Construction goes through graph::Graph; the first
+		/// run after a change compiles it into flat arrays (successor lists,
+		/// dependency counts, roots), which later runs reuse as they are.
+		///
+		/// At run time each node has an atomic count of unfinished
+		/// dependencies. The thread finishing a node decrements its
+		/// successors, runs the last one that became ready itself and pushes
+		/// the others with ThreadPool::executeContinuation(), which from a
+		/// worker lands on that worker's own deque and is never refused nor
+		/// dropped by a bounded pool. No thread ever blocks on a dependency,
+		/// the caller of run() helps the pool until the graph is done.
+		///
+		/// A graph runs once at a time, on a ThreadPool or any other
+		/// BasicThreadPool. The first exception thrown by a node skips the
+		/// bodies of the nodes not started yet and is rethrown by run().
+		class TaskGraph :public NonCopyable {
+		public:
+			using NodeId = size_t;
+
+			/* add a node, return the id to use in precede(). */
+			NodeId emplace(std::string name, std::function<void()> work) {
+				NodeId id = next_id_++;
+				graph_.AddNode(std::make_shared<TaskNode>(id, std::move(name), std::move(work)));
+				compiled_ = false;
+				return id;
+			}
+
+			/* `before` must finish before `after` starts. */
+			void precede(NodeId before, NodeId after) {
+				if (before == after || !graph_.GetNode(before) || !graph_.GetNode(after))
+					throw std::invalid_argument("TaskGraph::precede() needs two distinct existing nodes.");
+				graph_.AddEdge(before, after, 1.0);
+				compiled_ = false;
+			}
+
+			size_t size() const {
+				return static_cast<size_t>(graph_.NodeCounts());
+			}
+
+			/// the graph as built, e.g. for inspection or export.
+			const Graph<NodeId>& graph() const noexcept {
+				return graph_;
+			}
+
+			/// Run every node once, respecting dependencies, and block until all
+			/// are done (helping the pool meanwhile). Throws std::logic_error
+			/// for a cycle or a concurrent run, and rethrows a node's exception.
+			template<class Pool>
+			const TaskGraphReport& run(Pool& pool) {
+				if (running_.exchange(true, std::memory_order_acquire))
+					throw std::logic_error("TaskGraph is already running.");
+				struct Running {
+					std::atomic<bool>& flag;
+					~Running() { flag.store(false, std::memory_order_release); }
+				} running{ running_ };
+
+				compile();
+				auto start = std::chrono::steady_clock::now();
+				detail::ParallelGroup group(1);
+				group_ = &group;
+				for (auto& node : nodes_)
+					node.pending.store(node.dependencies, std::memory_order_relaxed);
+				try {
+					for (size_t root : roots_)
+						dispatch(pool, root);
+				}
+				catch (...) {
+					group.fail(std::current_exception());
+				}
+				group.join(pool);  // rethrows the first failure.
+				report(std::chrono::steady_clock::now() - start);
+				return report_;
+			}
+
+			/* report of the last successful run. */
+			const TaskGraphReport& lastReport() const noexcept {
+				return report_;
+			}
+
+		private:
+			class TaskNode :public NodeInterface<NodeId> {
+			public:
+				TaskNode(NodeId id, std::string name, std::function<void()> work)
+					:id_(id), name_(std::move(name)), work_(std::move(work)) {}
+
+				NodeId ID() const override {
+					return id_;
+				}
+
+				std::string String() const override {
+					return name_;
+				}
+
+				void operator()() const {
+					if (work_)
+						work_();
+				}
+
+			private:
+				NodeId id_;
+				std::string name_;
+				std::function<void()> work_;
+			};
+
+			// flattened node, indexed by position in topological order.
+			struct RunNode {
+				const TaskNode* task = nullptr;
+				std::vector<size_t> successors;
+				uint32_t dependencies = 0;
+				std::atomic<uint32_t> pending{ 0 };
+				int64_t started = 0;
+				int64_t finished = 0;
+			};
+
+			void compile() {
+				if (compiled_)
+					return;
+				std::vector<NodeId> order;
+				if (!graph_.TopologicalOrder(order))
+					throw std::logic_error("TaskGraph has a cycle.");
+				std::unordered_map<NodeId, size_t> index;
+				for (size_t i = 0; i < order.size(); ++i)
+					index.emplace(order[i], i);
+
+				nodes_ = std::vector<RunNode>(order.size());
+				roots_.clear();
+				for (size_t i = 0; i < order.size(); ++i) {
+					RunNode& node = nodes_[i];
+					node.task = static_cast<const TaskNode*>(graph_.GetNode(order[i]).get());
+					for (const auto& target : graph_.GetTargets(order[i]))
+						node.successors.push_back(index.at(target.first));
+					std::sort(node.successors.begin(), node.successors.end());
+					node.dependencies = static_cast<uint32_t>(graph_.GetSources(order[i]).size());
+					if (node.dependencies == 0)
+						roots_.push_back(i);
+				}
+				compiled_ = true;
+			}
+
+			// account for `index` in the group, then queue it.
+			template<class Pool>
+			void dispatch(Pool& pool, size_t index) {
+				group_->add();
+				try {
+					pool.executeContinuation([this, &pool, index] { runFrom(pool, index); });
+				}
+				catch (...) {
+					group_->done();
+					throw;
+				}
+			}
+
+			/// Run `index`, then keep going with the last successor it made
+			/// ready; the other ready successors are queued for other workers.
+			template<class Pool>
+			void runFrom(Pool& pool, size_t index) {
+				while (true) {
+					RunNode& node = nodes_[index];
+					if (!group_->cancelled()) {
+						node.started = nowNs();
+						try {
+							(*node.task)();
+						}
+						catch (...) {
+							group_->fail(std::current_exception());
+						}
+						node.finished = nowNs();
+					}
+					else {
+						node.started = node.finished = 0;
+					}
+
+					size_t next = nodes_.size();
+					for (size_t successor : node.successors) {
+						if (nodes_[successor].pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+							continue;
+						if (next != nodes_.size()) {
+							try {
+								dispatch(pool, next);
+							}
+							catch (...) {
+								group_->fail(std::current_exception());
+							}
+						}
+						next = successor;
+					}
+					if (next == nodes_.size())
+						break;
+					index = next;  // `next` inherits the group slot of `index`.
+				}
+				group_->done();
+			}
+
+			/* longest path by measured time, nodes_ are in topological order. */
+			void report(std::chrono::steady_clock::duration elapsed) {
+				const size_t count = nodes_.size();
+				std::vector<int64_t> path(count, 0);
+				std::vector<int64_t> best_in(count, 0);
+				std::vector<size_t> parent(count, count);
+				int64_t total = 0;
+				size_t last = count;
+				for (size_t i = 0; i < count; ++i) {
+					int64_t cost = nodes_[i].finished - nodes_[i].started;
+					total += cost;
+					path[i] = best_in[i] + cost;
+					for (size_t successor : nodes_[i].successors) {
+						if (path[i] >= best_in[successor]) {
+							best_in[successor] = path[i];
+							parent[successor] = i;
+						}
+					}
+					if (last == count || path[i] > path[last])
+						last = i;
+				}
+
+				report_.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+				report_.total_work = std::chrono::nanoseconds(total);
+				report_.critical_path = std::chrono::nanoseconds(last == count ? 0 : path[last]);
+				report_.critical_nodes.clear();
+				for (size_t i = last; i != count; i = parent[i])
+					report_.critical_nodes.push_back(nodes_[i].task->String());
+				std::reverse(report_.critical_nodes.begin(), report_.critical_nodes.end());
+			}
+
+			static int64_t nowNs() {
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			Graph<NodeId> graph_;
+			NodeId next_id_ = 0;
+			bool compiled_ = false;
+			std::vector<RunNode> nodes_;
+			std::vector<size_t> roots_;
+			detail::ParallelGroup* group_ = nullptr;
+			std::atomic<bool> running_{ false };
+			TaskGraphReport report_;
+		};
+
+	} // namespace graph
+
+} // namespace booty
+
+#endif // !BOOTY_GRAPH_TASKGRAPH_HPP
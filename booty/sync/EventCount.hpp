@@ -0,0 +1,155 @@
+/*
+ * This is a derivative snippet of Facebook::folly, under Apache Lisence.
+ * Indention:
+ * - Recurrent the design idea of seniors and rewrite some details to adapt
+ *   personal considerations as components of booty.
+ *
+ * @Simoncqk - 2019.03
+ *
+ */
+#ifndef BOOTY_SYNC_EVENTCOUNT_HPP
+#define BOOTY_SYNC_EVENTCOUNT_HPP
+
+#include<atomic>
+#include<cassert>
+#include<chrono>
+#include<cstdint>
+#include<limits>
+
+#include"./Futex.h"
+
+namespace booty {
+
+	namespace sync {
+		/// EventCount is a condition variable for lock-free data structures:
+		/// it lets a thread wait for a condition on other shared state
+		/// without a mutex around that state.
+		///
+		/// Waiter:
+		///   if (!condition()) {
+		///     for (;;) {
+		///       auto key = ec.prepareWait();
+		///       if (condition()) {
+		///         ec.cancelWait();
+		///         break;
+		///       }
+		///       ec.wait(key);
+		///       if (condition())
+		///         break;
+		///     }
+		///   }
+		///   (or simply: ec.await(condition);)
+		///
+		/// Notifier:
+		///   make condition() true;
+		///   ec.notify();   // or notifyAll()
+		///
+		/// A waiter announces itself in prepareWait() before it checks the
+		/// condition the last time, and a notifier checks for waiters after
+		/// it made the condition true, with a full fence in between on both
+		/// sides: either the waiter sees the condition, or the notifier sees
+		/// the waiter and moves the epoch on, so the wait of a key taken
+		/// before the notify returns at once. When nobody waits, notify()
+		/// is the fence and one load of the waiter count.
+		///
+		/// The waiter count and the epoch live in separate words, the epoch
+		/// is the Futex. Wakeups may be spurious: wait() returns once the
+		/// epoch moved on, which a notify() meant for another waiter does
+		/// too, so the caller checks the condition again.
+		template<template<typename> class Atom = std::atomic>
+		class EventCount {
+		public:
+			class Key {
+				friend class EventCount;
+				explicit Key(uint32_t epoch) noexcept
+					:epoch_(epoch) {}
+				uint32_t epoch_;
+			};
+
+			EventCount() noexcept = default;
+			EventCount(const EventCount&) = delete;
+			EventCount& operator=(const EventCount&) = delete;
+
+			/* wakes a waiter, if there is one. */
+			void notify() noexcept {
+				doNotify(1);
+			}
+
+			/* wakes every waiter. */
+			void notifyAll() noexcept {
+				doNotify(std::numeric_limits<int>::max());
+			}
+
+			/// Announces a waiter, the condition must be checked after it.
+			/// Must be followed by cancelWait() or a wait of the key.
+			Key prepareWait() noexcept {
+				waiters_.fetch_add(1, std::memory_order_seq_cst);
+				return Key(epoch_.load(std::memory_order_acquire));
+			}
+
+			/* the condition came true after prepareWait(), no wait. */
+			void cancelWait() noexcept {
+				uint32_t prev = waiters_.fetch_sub(1, std::memory_order_seq_cst);
+				assert(prev > 0);
+				(void)prev;
+			}
+
+			/* blocks until a notify() after the prepareWait() of key. */
+			void wait(Key key) noexcept {
+				while (epoch_.load(std::memory_order_acquire) == key.epoch_)
+					epoch_.futexWait(key.epoch_);
+				cancelWait();
+			}
+
+			/// wait(), up to deadline. Returns false if it timed out with no
+			/// notify() in between.
+			template<typename Clock, typename Duration>
+			bool waitUntil(Key key, const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+				bool notified = true;
+				while (epoch_.load(std::memory_order_acquire) == key.epoch_) {
+					if (epoch_.futexWaitUntil(key.epoch_, deadline) == FutexResult::TIMEDOUT) {
+						notified = epoch_.load(std::memory_order_acquire) != key.epoch_;
+						break;
+					}
+				}
+				cancelWait();
+				return notified;
+			}
+
+			/* blocks until condition() holds, condition() must not throw. */
+			template<typename Condition>
+			void await(Condition condition) {
+				if (condition())
+					return;
+				for (;;) {
+					Key key = prepareWait();
+					if (condition()) {
+						cancelWait();
+						return;
+					}
+					wait(key);
+					if (condition())
+						return;
+				}
+			}
+
+		private:
+			void doNotify(int count) noexcept {
+				// pairs with the seq_cst increment in prepareWait(): the
+				// condition was made true before, and is checked after.
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (waiters_.load(std::memory_order_relaxed) != 0) {
+					epoch_.fetch_add(1, std::memory_order_acq_rel);
+					epoch_.futexWake(count);
+				}
+			}
+
+			Atom<uint32_t> waiters_{ 0 };
+			Futex<Atom> epoch_{ 0 };
+		};
+
+	} // sync
+
+} // booty
+
+#endif // !BOOTY_SYNC_EVENTCOUNT_HPP
@@ -12,8 +12,14 @@
 
 using namespace std::chrono;
 
+#include<cassert>
+#include<cerrno>
+#include<ctime>
+
 #if __linux__
 #include<linux/futex.h>
+#include<sys/syscall.h>
+#include<unistd.h>
 #endif // __linux__
 
 
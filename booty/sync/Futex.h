@@ -11,7 +11,11 @@
 #define BOOTY_SYNC_FUTEX_H
 
 #include<atomic>
+#include<cassert>
 #include<chrono>
+#include<cstdint>
+#include<limits>
+#include<type_traits>
 
 namespace booty {
 
@@ -40,9 +44,11 @@ namespace booty {
 		template<template<typename> class Atom = std::atomic>
 		struct Futex :Atom<uint32_t> {
 			Futex()
-				:Atom<uint32_t>{}
-				explicit constexpr Futex(uint32_t init)
+				:Atom<uint32_t>{} {}
+
+			explicit constexpr Futex(uint32_t init)
 				: Atom<uint32_t>(init) {}
+
 			/** Puts the thread to sleep if this->load() == expected.  Returns true when
 			*  it is returning because it has consumed a wake() event, false for any
 			*  other return (signal, this->load() != expected, or spurious wakeup). */
@@ -14,6 +14,8 @@
 #include<condition_variable>
 #include<mutex>
 #include<array>
+#include<chrono>
+#include<functional>
 #include<cassert>
 
 #include"../Unit.h"
@@ -64,7 +66,7 @@ namespace booty {
 				}
 			};
 
-			extern std::atomic<uint64_t> id_allocator{ 0 };
+			inline std::atomic<uint64_t> id_allocator{ 0 };
 
 			// Our emulated futex uses 4096 lists of wait nodes.  There are two levels
 			// of locking: a per-list mutex that controls access to the list and a
@@ -175,7 +177,7 @@ namespace booty {
 
 				template <typename D>
 				WaitNode(uint64_t key, uint64_t lotid, D&& data)
-					: WaitNodeBase(key, lotid), data_(std::forward<Data>(data)) {}
+					: WaitNodeBase(key, lotid), data_(std::forward<D>(data)) {}
 			};
 
 		public:
@@ -206,7 +208,7 @@ namespace booty {
 			template <typename Key, typename D, typename ToPark, typename PreWait,
 				typename Rep, typename Period>
 				ParkResult park_for(const Key key, D&& data, ToPark&& toPark, PreWait&& preWait,
-					std::chrono::duration<Rep, Period>& timeout) {
+					const std::chrono::duration<Rep, Period>& timeout) {
 				return park_until(
 					key,
 					std::forward<D>(data),
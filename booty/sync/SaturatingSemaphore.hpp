@@ -219,13 +219,13 @@ namespace booty {
 					 *  obscure, so I have to give it up.
 					 */
 					auto rv = state_.futexWaitUntil(BLOCKED, ddl);
+					if (ready())
+						return true;
 					if (rv == FutexResult::TIMEDOUT) {
 						assert(ddl != (std::chrono::time_point<Clock, Duration>::max()));
 						return false;
 					}
 				}
-				if (ready())
-					return true;
 			}
 
 			// wrapped by Futex make it performs better than pure std::mutex.
@@ -0,0 +1,248 @@
+/*
+ * This is a derivative snippet of Facebook::folly, under Apache Lisence.
+ * Indention:
+ * - Recurrent the design idea of seniors and rewrite some details to adapt
+ *   personal considerations as components of booty.
+ *
+ * @Simoncqk - 2018.05.03
+ *
+ */
+#ifndef BOOTY_SYNC_TURNSEQUENCER_HPP
+#define BOOTY_SYNC_TURNSEQUENCER_HPP
+
+#include<algorithm>
+#include<atomic>
+#include<cassert>
+#include<chrono>
+#include<cstdint>
+#include<limits>
+#include<thread>
+
+#include"../Asm.h"
+#include"./Futex.h"
+
+namespace booty {
+
+	namespace sync {
+		/// A TurnSequencer allows threads to order their execution according to
+		/// a monotonically increasing (with wraparound) "turn" value. The two
+		/// operations provided are to wait for turn T, and to move to the next
+		/// turn. Every thread that is waiting for T must have arrived before
+		/// that turn is marked completed (for MPMCQueue only one thread waits
+		/// for any particular turn, so this is trivially true).
+		///
+		/// TurnSequencer's state_ holds 26 bits of the current turn (shifted
+		/// left by 6), along with a 6 bit saturating value that records the
+		/// maximum waiter minus the current turn. Wraparound of the turn space
+		/// is expected and handled. This allows us to atomically adjust the
+		/// number of outstanding waiters when we perform a futexWake. Wakers
+		/// can detect if there are no waiters by checking the low 6 bits.
+		///
+		/// Waiters use the low 5 bits of their turn as their futex wait mask,
+		/// so completeTurn() only wakes the thread whose turn comes next and
+		/// not every thread parked on the same slot.
+		///
+		/// Waiting threads spin before they block. The spin limit adapts to
+		/// how long waits actually take: the caller keeps it in spinCutoff
+		/// and asks for a recalibration now and then with updateSpinCutoff.
+		/// Spinning pauses for a short while and then yields, so a waiter on
+		/// a single CPU lets the thread it waits for run instead of burning
+		/// its timeslice.
+		template<template<typename> class Atom = std::atomic>
+		struct TurnSequencer {
+			explicit TurnSequencer(const uint32_t firstTurn = 0) noexcept
+				:state_(encode(firstTurn << kTurnShift, 0)) {}
+
+			/* Returns true iff a call to waitForTurn(turn, ...) won't block. */
+			bool isTurn(const uint32_t turn) const noexcept {
+				auto state = state_.load(std::memory_order_acquire);
+				return decodeCurrentSturn(state) == (turn << kTurnShift);
+			}
+
+			enum class TryWaitResult { SUCCESS, PAST, TIMEDOUT };
+
+			/// See tryWaitForTurn. Requires that `turn` is not a turn in the
+			/// past.
+			void waitForTurn(const uint32_t turn, Atom<uint32_t>& spinCutoff,
+				const bool updateSpinCutoff) noexcept {
+				const auto ret = tryWaitForTurn(turn, spinCutoff, updateSpinCutoff);
+				(void)ret;
+				assert(ret == TryWaitResult::SUCCESS);
+			}
+
+			/// Internally we always work with shifted turn values, which makes
+			/// the truncation and wraparound work correctly. This leaves us
+			/// bits at the bottom to store the number of waiters. We call
+			/// shifted turns "sturns" inside this class.
+
+			/// Blocks the current thread until turn has arrived.
+			/// If updateSpinCutoff is true then this will spin for up to
+			/// kMaxSpinLimit tries before blocking and will adjust spinCutoff
+			/// based on the results, otherwise it will spin for at most
+			/// spinCutoff spins.
+			/// Returns SUCCESS if the wait succeeded, PAST if the turn is in the
+			/// past or TIMEDOUT if the absTime time value is not nullptr and is
+			/// reached before the turn arrives.
+			template<class Clock = std::chrono::steady_clock, class Duration = typename Clock::duration>
+			TryWaitResult tryWaitForTurn(const uint32_t turn, Atom<uint32_t>& spinCutoff,
+				const bool updateSpinCutoff,
+				const std::chrono::time_point<Clock, Duration>* absTime = nullptr) noexcept {
+				uint32_t prevThresh = spinCutoff.load(std::memory_order_relaxed);
+				const uint32_t effectiveSpinCutoff =
+					updateSpinCutoff || prevThresh == 0 ? kMaxSpinLimit : prevThresh;
+
+				uint32_t tries;
+				const uint32_t sturn = turn << kTurnShift;
+				for (tries = 0;; ++tries) {
+					uint32_t state = state_.load(std::memory_order_acquire);
+					uint32_t current_sturn = decodeCurrentSturn(state);
+					if (current_sturn == sturn)
+						break;
+
+					// wrap-safe version of (current_sturn >= sturn)
+					if (sturn - current_sturn >= std::numeric_limits<uint32_t>::max() / 2) {
+						// turn is in the past
+						return TryWaitResult::PAST;
+					}
+
+					// the first effectiveSpinCutoff tries are spins, after that we
+					// will record ourself as a waiter and block with futexWait
+					if (tries < effectiveSpinCutoff) {
+						if (tries < kSpinsBeforeYield)
+							asm_volatile_pause();
+						else
+							std::this_thread::yield();
+						continue;
+					}
+
+					uint32_t current_max_waiter_delta = decodeMaxWaitersDelta(state);
+					uint32_t our_waiter_delta = (sturn - current_sturn) >> kTurnShift;
+					uint32_t new_state;
+					if (our_waiter_delta <= current_max_waiter_delta) {
+						// state already records us as waiters, probably because this
+						// isn't our first time around this loop
+						new_state = state;
+					}
+					else {
+						new_state = encode(current_sturn, our_waiter_delta);
+						if (state != new_state && !state_.compare_exchange_strong(state, new_state))
+							continue;
+					}
+					if (absTime) {
+						auto futexResult = state_.futexWaitUntil(new_state, *absTime, futexChannel(turn));
+						if (futexResult == FutexResult::TIMEDOUT)
+							return TryWaitResult::TIMEDOUT;
+					}
+					else {
+						state_.futexWait(new_state, futexChannel(turn));
+					}
+				}
+
+				if (updateSpinCutoff || prevThresh == 0) {
+					// if we hit kMaxSpinLimit then spinning was pointless, so the
+					// right spinCutoff is kMinSpinLimit
+					uint32_t target;
+					if (tries >= kMaxSpinLimit) {
+						target = kMinSpinLimit;
+					}
+					else {
+						// to account for variations, we allow ourself to spin 2*N
+						// when we think that N is actually required in order to
+						// succeed
+						target = std::min<uint32_t>(kMaxSpinLimit,
+							std::max<uint32_t>(kMinSpinLimit, tries * 2));
+					}
+
+					if (prevThresh == 0) {
+						// bootstrap
+						spinCutoff.store(target);
+					}
+					else {
+						// try once, keep moving if CAS fails. Exponential moving
+						// average with alpha of 7/8. Be careful that the quantity we
+						// add to prevThresh is signed.
+						spinCutoff.compare_exchange_weak(prevThresh,
+							prevThresh + static_cast<int>(target - prevThresh) / 8);
+					}
+				}
+
+				return TryWaitResult::SUCCESS;
+			}
+
+			/* Unblocks a thread running waitForTurn(turn + 1). */
+			void completeTurn(const uint32_t turn) noexcept {
+				uint32_t state = state_.load(std::memory_order_acquire);
+				while (true) {
+					assert(state == encode(turn << kTurnShift, decodeMaxWaitersDelta(state)));
+					uint32_t max_waiter_delta = decodeMaxWaitersDelta(state);
+					uint32_t new_state = encode((turn + 1) << kTurnShift,
+						max_waiter_delta == 0 ? 0 : max_waiter_delta - 1);
+					if (state_.compare_exchange_strong(state, new_state)) {
+						if (max_waiter_delta != 0)
+							state_.futexWake(std::numeric_limits<int>::max(), futexChannel(turn + 1));
+						break;
+					}
+					// failing compare_exchange_strong updates first arg to the
+					// value that caused the failure, so no need to reread state_
+				}
+			}
+
+			/* Returns the least-most significant byte of the current uncompleted turn. */
+			uint8_t uncompletedTurnLSB() const noexcept {
+				return static_cast<uint8_t>(state_.load(std::memory_order_acquire) >> kTurnShift);
+			}
+
+		private:
+			enum : uint32_t {
+				/// kTurnShift counts the bits that are stolen to record the delta
+				/// between the current turn and the maximum waiter. It needs to be
+				/// big enough to record wait deltas of 0 to 32 inclusive. Waiters
+				/// more than 32 in the future will be woken up 32*n turns early
+				/// (since their BITSET will hit) and will adjust the waiter count
+				/// again. We go a bit beyond and let the waiter count go up to 63,
+				/// which is free and might save us a few CAS.
+				kTurnShift = 6,
+				kWaitersMask = (1 << kTurnShift) - 1,
+
+				/// The minimum spin duration that we will adaptively select. The
+				/// value here is cycles, adjusted to the way in which the limit
+				/// will actually be applied.
+				kMinSpinLimit = 1 << 1,
+
+				/// The maximum spin duration that we will adaptively select, and
+				/// the spin duration that will be used when probing to get a new
+				/// data point for the adaptation. Past kSpinsBeforeYield every
+				/// try is a yield, so the limit is kept well below folly's 2^18.
+				kMaxSpinLimit = 1 << 12,
+
+				/// Tries that pause before the spin turns into yields.
+				kSpinsBeforeYield = 128,
+			};
+
+			/// This holds both the current turn, and the highest waiting turn,
+			/// stored as (current_turn << 6) | min(63, max(waited_turn - current_turn))
+			Futex<Atom> state_;
+
+			/* Returns the bitmask to pass futexWait or futexWake when communicating about the specified turn. */
+			uint32_t futexChannel(uint32_t turn) const noexcept {
+				return 1u << (turn & 31);
+			}
+
+			uint32_t decodeCurrentSturn(uint32_t state) const noexcept {
+				return state & ~kWaitersMask;
+			}
+
+			uint32_t decodeMaxWaitersDelta(uint32_t state) const noexcept {
+				return state & kWaitersMask;
+			}
+
+			uint32_t encode(uint32_t currentSturn, uint32_t maxWaiterD) const noexcept {
+				return currentSturn + std::min(uint32_t(kWaitersMask), maxWaiterD);
+			}
+		};
+
+	} // sync
+
+} // booty
+
+#endif // !BOOTY_SYNC_TURNSEQUENCER_HPP
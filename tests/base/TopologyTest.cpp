@@ -0,0 +1,193 @@
+#include<filesystem>
+#include<fstream>
+#include<iostream>
+#include<string>
+#include<vector>
+
+#include<unistd.h>
+
+#include"../../booty/base/Topology.h"
+
+using namespace std;
+using namespace booty;
+namespace fs = std::filesystem;
+
+bool failed = false;
+
+void Check(bool ok, const string& what) {
+	cout << what << ": " << (ok ? "ok" : "FAILED") << endl;
+	failed = failed || !ok;
+}
+
+void WriteFile(const fs::path& path, const string& text) {
+	fs::create_directories(path.parent_path());
+	ofstream(path) << text << "\n";
+}
+
+vector<int> Ids(const CpuTopology& topology) {
+	vector<int> ids;
+	for (const auto& cpu : topology.cpus())
+		ids.push_back(cpu.id);
+	return ids;
+}
+
+const CpuInfo* Find(const CpuTopology& topology, int id) {
+	for (const auto& cpu : topology.cpus()) {
+		if (cpu.id == id)
+			return &cpu;
+	}
+	return nullptr;
+}
+
+// 2 packages, one numa node and one L3 each, of 2 cores with 2 hardware
+// threads: cpus 0-3 on package 0 (siblings 0,2 and 1,3), 4-7 on package 1.
+void MakeSys(const fs::path& sys) {
+	for (int node = 0; node < 2; ++node)
+		WriteFile(sys / "devices/system/node" / ("node" + to_string(node)) / "cpulist", node == 0 ? "0-3" : "4-7");
+	for (int id = 0; id < 8; ++id) {
+		const fs::path dir = sys / "devices/system/cpu" / ("cpu" + to_string(id));
+		const int package = id / 4;
+		const int first = package * 4 + id % 2;
+		const string siblings = to_string(first) + "," + to_string(first + 2);
+		WriteFile(dir / "topology/physical_package_id", to_string(package));
+		WriteFile(dir / "topology/core_id", to_string(id % 2));
+		WriteFile(dir / "topology/thread_siblings_list", siblings);
+		const struct { int level; const char* type; const char* size; string shared; } caches[] = {
+			{ 1, "Data", "32K", siblings },
+			{ 2, "Unified", "1024K", siblings },
+			{ 3, "Unified", "16M", package == 0 ? "0-3" : "4-7" },
+		};
+		for (int index = 0; index < 3; ++index) {
+			const fs::path cache = dir / "cache" / ("index" + to_string(index));
+			WriteFile(cache / "level", to_string(caches[index].level));
+			WriteFile(cache / "type", caches[index].type);
+			WriteFile(cache / "size", caches[index].size);
+			WriteFile(cache / "coherency_line_size", "64");
+			WriteFile(cache / "shared_cpu_list", caches[index].shared);
+		}
+	}
+
+	// cgroup v2: /app unlimited, /kube/pod unlimited under a 1.5 cpu parent,
+	// /small 4 cpus.
+	const fs::path v2 = sys / "fs/cgroup";
+	WriteFile(v2 / "app/cpu.max", "max 100000");
+	WriteFile(v2 / "kube/cpu.max", "150000 100000");
+	WriteFile(v2 / "kube/pod/cpu.max", "max 100000");
+	WriteFile(v2 / "small/cpu.max", "400000 100000");
+	// cgroup v1: /docker/c1 unlimited (-1), /docker/c2 2.5 cpus.
+	const fs::path v1 = sys / "fs/cgroup/cpu,cpuacct";
+	WriteFile(v1 / "docker/cpu.cfs_quota_us", "-1");
+	WriteFile(v1 / "docker/cpu.cfs_period_us", "100000");
+	WriteFile(v1 / "docker/c1/cpu.cfs_quota_us", "-1");
+	WriteFile(v1 / "docker/c1/cpu.cfs_period_us", "100000");
+	WriteFile(v1 / "docker/c2/cpu.cfs_quota_us", "250000");
+	WriteFile(v1 / "docker/c2/cpu.cfs_period_us", "100000");
+}
+
+// a proc root whose process lives in cgroup `path` of a v2 or v1 hierarchy.
+fs::path MakeProc(const fs::path& root, const string& name, bool v2, const string& path) {
+	const fs::path proc = root / name;
+	if (v2) {
+		WriteFile(proc / "self/mountinfo",
+			"30 23 0:26 / /sys/fs/cgroup rw,nosuid,nodev,noexec,relatime shared:4 - cgroup2 cgroup2 rw,nsdelegate");
+		WriteFile(proc / "self/cgroup", "0::" + path);
+	}
+	else {
+		WriteFile(proc / "self/mountinfo",
+			"33 25 0:28 / /sys/fs/cgroup/memory rw,nosuid,nodev,noexec,relatime shared:15 - cgroup cgroup rw,memory\n"
+			"34 25 0:29 / /sys/fs/cgroup/cpu,cpuacct rw,nosuid,nodev,noexec,relatime shared:16 - cgroup cgroup rw,cpu,cpuacct");
+		WriteFile(proc / "self/cgroup", "5:memory:" + path + "\n4:cpu,cpuacct:" + path);
+	}
+	return proc;
+}
+
+void TestFixtureTopology(const fs::path& sys, const fs::path& proc) {
+	auto topology = CpuTopology::detect(sys.string(), proc.string(), {});
+	Check(Ids(topology) == vector<int>({ 0, 1, 2, 3, 4, 5, 6, 7 }), "8 cpus sorted by node, l3 domain and smt rank");
+	Check(topology.physicalCores() == 4 && topology.l3Domains() == 2 && topology.numaNodes() == 2,
+		"4 cores, 2 l3 domains, 2 numa nodes");
+	const CpuInfo* cpu6 = Find(topology, 6);
+	const CpuInfo* cpu4 = Find(topology, 4);
+	Check(cpu6 && cpu4 && cpu6->l3_domain == 4 && cpu6->numa_node == 1 && cpu6->package == 1 &&
+		cpu6->smt_rank == 1 && cpu6->core == cpu4->core && cpu4->core != Find(topology, 0)->core,
+		"cpu 6 is the second thread of cpu 4's core, l3 domain 4, node 1");
+	const auto& caches = topology.caches();
+	Check(caches.size() == 3 && caches[0].level == 1 && caches[0].type == "Data" && caches[0].size == 32 * 1024 &&
+		caches[2].level == 3 && caches[2].size == 16u << 20 && caches[2].shared_by == 4 && caches[2].line_size == 64,
+		"caches of the first cpu: L1d 32K, L3 16M shared by 4");
+	Check(topology.cpuQuota() == 0 && topology.usableCpus() == 8, "no cgroup files: no quota, 8 usable");
+}
+
+void TestQuota(const fs::path& sys, const fs::path& proc, const string& what, double quota, size_t usable,
+	const vector<int>& allowed = {}) {
+	auto topology = CpuTopology::detect(sys.string(), proc.string(), allowed);
+	Check(topology.cpuQuota() == quota && topology.usableCpus() == usable, what);
+}
+
+void TestCpuset(const fs::path& sys, const fs::path& proc) {
+	// cpus 0, 2, 5 and 7 are outside the cpuset.
+	auto topology = CpuTopology::detect(sys.string(), proc.string(), { 1, 3, 4, 6 });
+	Check(Ids(topology) == vector<int>({ 1, 3, 4, 6 }), "cpuset 1,3,4,6 lists only those cpus");
+	Check(topology.physicalCores() == 2 && topology.l3Domains() == 2 && topology.numaNodes() == 2 &&
+		Find(topology, 3)->smt_rank == 1 && Find(topology, 3)->l3_domain == 0,
+		"cpuset keeps 2 cores over 2 l3 domains and numa nodes");
+	Check(topology.usableCpus() == 4, "cpuset of 4 cpus: 4 usable");
+	// only cpu 6 allowed: the caches are read from it.
+	topology = CpuTopology::detect(sys.string(), proc.string(), { 6 });
+	Check(topology.cpus().size() == 1 && topology.physicalCores() == 1 && topology.usableCpus() == 1 &&
+		topology.caches().size() == 3 && topology.caches()[2].shared_by == 4, "cpuset of cpu 6 alone");
+}
+
+void TestFixtures() {
+	const fs::path root = fs::temp_directory_path() / ("booty_topology_" + to_string(::getpid()));
+	fs::remove_all(root);
+	const fs::path sys = root / "sys";
+	MakeSys(sys);
+
+	TestFixtureTopology(sys, root / "proc_none");
+	TestQuota(sys, MakeProc(root, "proc_v2max", true, "/app"), "cgroup v2 cpu.max \"max\": no quota, 8 usable", 0, 8);
+	TestQuota(sys, MakeProc(root, "proc_v2quota", true, "/kube/pod"),
+		"cgroup v2 parent \"150000 100000\": quota 1.5, 2 usable", 1.5, 2);
+	TestQuota(sys, MakeProc(root, "proc_v1none", false, "/docker/c1"),
+		"cgroup v1 cfs_quota_us -1: no quota, 8 usable", 0, 8);
+	TestQuota(sys, MakeProc(root, "proc_v1quota", false, "/docker/c2"),
+		"cgroup v1 250000/100000: quota 2.5, 3 usable", 2.5, 3);
+	TestCpuset(sys, root / "proc_none");
+	TestQuota(sys, MakeProc(root, "proc_v2small", true, "/small"),
+		"cpuset of 2 under a 4 cpu quota: 2 usable", 4, 2, { 0, 4 });
+
+	fs::remove_all(root);
+}
+
+void TestDetect() {
+	const auto& topology = CpuTopology::instance();
+	cout << "allowed cpus:" << topology.cpus().size()
+		<< " physical cores:" << topology.physicalCores()
+		<< " l3 domains:" << topology.l3Domains()
+		<< " numa nodes:" << topology.numaNodes() << endl;
+	cout << "cgroup quota:" << topology.cpuQuota()
+		<< " usable cpus:" << topology.usableCpus() << endl;
+	for (const auto& cpu : topology.cpus()) {
+		cout << "  cpu " << cpu.id << " core " << cpu.core << " smt " << cpu.smt_rank
+			<< " l3 " << cpu.l3_domain << " node " << cpu.numa_node << endl;
+	}
+	for (const auto& cache : topology.caches()) {
+		cout << "  L" << cache.level << " " << cache.type << " " << cache.size / 1024
+			<< "KiB shared by " << cache.shared_by << endl;
+	}
+	Check(!topology.cpus().empty() && topology.usableCpus() >= 1 && topology.usableCpus() <= topology.cpus().size(),
+		"live topology: 1 <= usable cpus <= allowed cpus");
+}
+
+void TestParseCpuList() {
+	Check(CpuTopology::parseCpuList("0-2,5,8-9") == vector<int>({ 0, 1, 2, 5, 8, 9 }), "0-2,5,8-9");
+	Check(CpuTopology::parseCpuList("3,x-1,,7\n") == vector<int>({ 3, 7 }), "malformed ranges are skipped");
+}
+
+int main() {
+	TestFixtures();
+	TestDetect();
+	TestParseCpuList();
+	Check(CpuTopology::pinCurrentThread(CpuTopology::instance().cpus().front().id), "pin to first cpu");
+	return failed ? 1 : 0;
+}
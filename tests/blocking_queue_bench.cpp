@@ -0,0 +1,241 @@
+// Blocking consumers: BlockingConcurrentQueue, parked on an EventCount,
+// against UMPMCQueue (futex per entry), MPMCQueue (futex per turn) and
+// UnboundedLockQueue (mutex and condition variable). Consumers wait in
+// dequeue for an even share of the items. Every item carries its
+// producer and sequence number; consumers check that each producer's
+// items reach them in order, and that no item is lost or duplicated.
+// Then the price of the wakeup check on the producer side while nobody
+// waits, a ping-pong over two queues where every item wakes a sleeper,
+// and the timed, bulk and EventCount edge cases.
+//
+// Build with booty/concurrency/HazardPtr.cpp for UMPMCQueue.
+//
+//   usage: blocking_queue_bench [items per producer = 1000000] [threads per side = 4] [round trips = 20000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<string>
+#include<iterator>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/sync/EventCount.hpp"
+#include"../booty/concurrency/BlockingConcurrentQueue.hpp"
+#include"../booty/concurrency/ConcurrentQueue.hpp"
+#include"../booty/concurrency/MPMCQueue.hpp"
+#include"../booty/concurrency/UnboundedQueue.hpp"
+#include"../booty/concurrency/UnboundedLockQueue.hpp"
+
+using namespace booty;
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+
+// the interface run() expects: push() and a waiting pop().
+struct Sharded :BlockingConcurrentQueue<uint64_t> {
+	void push(uint64_t item) { enqueue(item); }
+	void pop(uint64_t& item) { dequeue(item); }
+	bool drained() const { return empty(); }
+};
+
+struct Unbounded :UMPMCQueue<uint64_t, true> {
+	void push(uint64_t item) { enqueue(item); }
+	void pop(uint64_t& item) { dequeue(item); }
+	bool drained() const { return empty(); }
+};
+
+struct Bounded :MPMCQueue<uint64_t> {
+	Bounded() :MPMCQueue<uint64_t>(1 << 14) {}
+	void push(uint64_t item) { blockingWrite(item); }
+	void pop(uint64_t& item) { blockingRead(item); }
+	bool drained() const { return isEmpty(); }
+};
+
+struct Locked :UnboundedLockQueue<uint64_t> {
+	void push(uint64_t item) { enqueue(item); }
+	void pop(uint64_t& item) { dequeue(item); }
+	bool drained() const { return empty(); }
+};
+
+template<class Queue>
+void run(const char* name, size_t producers, size_t consumers, size_t per_producer) {
+	Queue queue;
+	const size_t total = producers * per_producer;
+	std::atomic<size_t> taken{ 0 };
+	std::atomic<uint64_t> sum{ 0 };
+	std::atomic<size_t> reordered{ 0 };
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < consumers; ++c) {
+		threads.emplace_back([&, c] {
+			// an even share, the first consumer takes the remainder.
+			size_t count = total / consumers + (c == 0 ? total % consumers : 0);
+			std::vector<uint64_t> last(producers, 0);
+			uint64_t local = 0;
+			size_t bad = 0;
+			for (size_t i = 0; i < count; ++i) {
+				uint64_t item;
+				queue.pop(item);
+				uint64_t producer = item >> 32, seq = item & 0xffffffffu;
+				if (seq <= last[producer])
+					++bad;
+				last[producer] = seq;
+				local += seq;
+			}
+			taken.fetch_add(count);
+			sum.fetch_add(local);
+			reordered.fetch_add(bad);
+		});
+	}
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p] {
+			for (uint64_t seq = 1; seq <= per_producer; ++seq)
+				queue.push((uint64_t(p) << 32) | seq);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	uint64_t expected = producers * (uint64_t(per_producer) * (per_producer + 1) / 2);
+	bool ok = taken.load() == total && sum.load() == expected && reordered.load() == 0 && queue.drained();
+	failed = failed || !ok;
+	std::printf("%-26s %zup/%zuc %8.1f ns/item %12.0f items/s  %s\n", name, producers, consumers,
+		seconds * 1e9 / total, total / seconds, ok ? "ok" : "FAILED");
+}
+
+template<class Queue>
+void runAll(const char* name, size_t threads, size_t per_producer) {
+	run<Queue>(name, 1, 1, per_producer * threads);
+	run<Queue>(name, threads, 1, per_producer);
+	run<Queue>(name, threads, threads, per_producer);
+}
+
+// one thread, nobody waits: what the wakeup check adds to an enqueue.
+template<class Queue>
+double enqueueCost(size_t items) {
+	Queue queue;
+	auto start = steady_clock::now();
+	for (uint64_t i = 0; i < items; ++i)
+		queue.enqueue(i);
+	double seconds = duration<double>(steady_clock::now() - start).count();
+	uint64_t item;
+	while (queue.try_dequeue(item)) {}
+	return seconds * 1e9 / items;
+}
+
+void producerCost(size_t items) {
+	double plain = 1e9, blocking = 1e9;
+	for (int i = 0; i < 3; ++i) {
+		plain = std::min(plain, enqueueCost<ConcurrentQueue<uint64_t>>(items));
+		blocking = std::min(blocking, enqueueCost<BlockingConcurrentQueue<uint64_t>>(items));
+	}
+	std::printf("enqueue with nobody waiting: ConcurrentQueue %.1f ns, BlockingConcurrentQueue %.1f ns\n",
+		plain, blocking);
+}
+
+// the main thread and an echo thread bounce an item over two queues, each
+// side sleeps in dequeue until the other one answers.
+template<class Queue>
+void pingPong(const char* name, size_t round_trips) {
+	Queue ping, pong;
+	std::thread echo([&] {
+		for (size_t i = 0; i < round_trips; ++i) {
+			uint64_t item;
+			ping.pop(item);
+			pong.push(item + 1);
+		}
+	});
+	bool ok = true;
+	auto start = steady_clock::now();
+	for (uint64_t i = 0; i < round_trips; ++i) {
+		ping.push(i);
+		uint64_t item;
+		pong.pop(item);
+		ok = ok && item == i + 1;
+	}
+	double seconds = duration<double>(steady_clock::now() - start).count();
+	echo.join();
+	failed = failed || !ok;
+	std::printf("%-26s ping-pong %8.2f us/round trip  %s\n", name, seconds * 1e6 / round_trips, ok ? "ok" : "FAILED");
+}
+
+void edgeCases() {
+	BlockingConcurrentQueue<std::string> queue;
+	std::string text;
+	auto start = steady_clock::now();
+	bool got = queue.try_dequeue_for(text, milliseconds(20));
+	double waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	std::printf("try_dequeue_for(20ms) on an empty queue: %s after %.1f ms\n", got ? "GOT AN ITEM" : "timed out", waited);
+	failed = failed || got || waited < 19;
+
+	// a consumer sleeps in dequeue_bulk while a producer fills the queue.
+	std::thread producer([&queue] {
+		std::this_thread::sleep_for(milliseconds(5));
+		std::vector<std::string> items(3, std::string(64, 'x'));
+		BlockingConcurrentQueue<std::string>::ProducerToken token(queue);
+		queue.enqueue_bulk(token, std::make_move_iterator(items.begin()), items.size());
+	});
+	BlockingConcurrentQueue<std::string>::ConsumerToken consumer(queue);
+	std::vector<std::string> out;
+	size_t n = queue.dequeue_bulk(consumer, std::back_inserter(out), 100);
+	producer.join();
+	bool ok = n == 3 && out[2] == std::string(64, 'x');
+	ok = ok && queue.try_dequeue_bulk_for(std::back_inserter(out), 100, milliseconds(1)) == 0;
+	std::printf("dequeue_bulk while a producer fills: %s\n", ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	// notifyAll() wakes every thread waiting on the flag.
+	sync::EventCount<> event;
+	std::atomic<bool> flag{ false };
+	std::atomic<int> woken{ 0 };
+	std::vector<std::thread> waiters;
+	for (int i = 0; i < 4; ++i) {
+		waiters.emplace_back([&] {
+			event.await([&] { return flag.load(); });
+			woken.fetch_add(1);
+		});
+	}
+	std::this_thread::sleep_for(milliseconds(5));
+	flag.store(true);
+	event.notifyAll();
+	for (auto& waiter : waiters)
+		waiter.join();
+	std::printf("EventCount::notifyAll wakes %d of 4 waiters: %s\n", woken.load(), woken.load() == 4 ? "ok" : "FAILED");
+	failed = failed || woken.load() != 4;
+
+	// a timed wait whose epoch did not move reports the timeout.
+	auto key = event.prepareWait();
+	ok = !event.waitUntil(key, steady_clock::now() + milliseconds(5));
+	key = event.prepareWait();
+	event.notify();
+	ok = ok && event.waitUntil(key, steady_clock::now() + seconds(5));
+	std::printf("EventCount::waitUntil timeout and notify: %s\n", ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	queue.enqueue("left over");
+	std::printf("%zu item left to the destructor\n", queue.size_approx());
+}
+
+int main(int argc, char** argv) {
+	size_t per_producer = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t threads = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4;
+	size_t round_trips = argc > 3 ? std::max<size_t>(1, std::strtoul(argv[3], nullptr, 10)) : 20000;
+
+	runAll<Sharded>("BlockingConcurrentQueue", threads, per_producer);
+	runAll<Unbounded>("UMPMCQueue block", threads, per_producer);
+	runAll<Bounded>("MPMCQueue blockingRead", threads, per_producer);
+	runAll<Locked>("UnboundedLockQueue", threads, per_producer);
+	producerCost(per_producer * threads);
+	pingPong<Sharded>("BlockingConcurrentQueue", round_trips);
+	pingPong<Unbounded>("UMPMCQueue block", round_trips);
+	pingPong<Bounded>("MPMCQueue blockingRead", round_trips);
+	pingPong<Locked>("UnboundedLockQueue", round_trips);
+	edgeCases();
+	return failed ? 1 : 0;
+}
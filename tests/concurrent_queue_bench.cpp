@@ -0,0 +1,248 @@
+// ConcurrentQueue without tokens, with producer and consumer tokens, and
+// with bulk operations, against UMPMCQueue, MPMCQueue and
+// UnboundedLockQueue. Consumers poll with try-dequeues, backing off while
+// they find nothing, until all items are taken. Every item carries its
+// producer and sequence number; consumers check that each producer's
+// items reach them in order, and that no item is lost or duplicated.
+// Then token reuse and leftovers.
+//
+// Build with booty/concurrency/HazardPtr.cpp for UMPMCQueue.
+//
+//   usage: concurrent_queue_bench [items per producer = 1000000] [threads per side = 4] [batch = 64]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<string>
+#include<iterator>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/Asm.h"
+#include"../booty/concurrency/ConcurrentQueue.hpp"
+#include"../booty/concurrency/MPMCQueue.hpp"
+#include"../booty/concurrency/UnboundedQueue.hpp"
+#include"../booty/concurrency/UnboundedLockQueue.hpp"
+
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+static size_t batch = 64;
+
+struct Backoff {
+	void operator()() {
+		if (++spins_ < 128)
+			asm_volatile_pause();
+		else
+			std::this_thread::yield();
+	}
+	void reset() { spins_ = 0; }
+
+private:
+	unsigned spins_ = 0;
+};
+
+// each adapter: a Producer and a Consumer per thread, push() takes a run
+// of items, pop() returns how many it took, up to max.
+struct Implicit {
+	ConcurrentQueue<uint64_t> queue;
+	struct Producer {
+		Producer(Implicit&) {}
+	};
+	struct Consumer {
+		Consumer(Implicit&) {}
+	};
+	void push(Producer&, const uint64_t* items, size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			queue.enqueue(items[i]);
+	}
+	size_t pop(Consumer&, uint64_t* out, size_t) { return queue.try_dequeue(*out) ? 1 : 0; }
+	bool drained() const { return queue.empty(); }
+};
+
+struct Tokens {
+	ConcurrentQueue<uint64_t> queue;
+	struct Producer {
+		Producer(Tokens& q) :token(q.queue) {}
+		ConcurrentQueue<uint64_t>::ProducerToken token;
+	};
+	struct Consumer {
+		Consumer(Tokens& q) :token(q.queue) {}
+		ConcurrentQueue<uint64_t>::ConsumerToken token;
+	};
+	void push(Producer& p, const uint64_t* items, size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			queue.enqueue(p.token, items[i]);
+	}
+	size_t pop(Consumer& c, uint64_t* out, size_t) { return queue.try_dequeue(c.token, *out) ? 1 : 0; }
+	bool drained() const { return queue.empty(); }
+};
+
+struct Bulk :Tokens {
+	void push(Producer& p, const uint64_t* items, size_t n) { queue.enqueue_bulk(p.token, items, n); }
+	size_t pop(Consumer& c, uint64_t* out, size_t max) { return queue.try_dequeue_bulk(c.token, out, max); }
+};
+
+struct Unbounded {
+	UMPMCQueue<uint64_t, false> queue;
+	struct Producer {
+		Producer(Unbounded&) {}
+	};
+	struct Consumer {
+		Consumer(Unbounded&) {}
+	};
+	void push(Producer&, const uint64_t* items, size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			queue.enqueue(items[i]);
+	}
+	size_t pop(Consumer&, uint64_t* out, size_t) { return queue.try_dequeue(*out) ? 1 : 0; }
+	bool drained() const { return queue.empty(); }
+};
+
+struct Bounded {
+	MPMCQueue<uint64_t> queue{ 1 << 14 };
+	struct Producer {
+		Producer(Bounded&) {}
+	};
+	struct Consumer {
+		Consumer(Bounded&) {}
+	};
+	void push(Producer&, const uint64_t* items, size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			queue.blockingWrite(items[i]);
+	}
+	size_t pop(Consumer&, uint64_t* out, size_t) { return queue.read(*out) ? 1 : 0; }
+	bool drained() const { return queue.isEmpty(); }
+};
+
+struct Locked {
+	UnboundedLockQueue<uint64_t> queue;
+	struct Producer {
+		Producer(Locked&) {}
+	};
+	struct Consumer {
+		Consumer(Locked&) {}
+	};
+	void push(Producer&, const uint64_t* items, size_t n) { queue.enqueueBulk(items, items + n); }
+	size_t pop(Consumer&, uint64_t* out, size_t max) { return queue.dequeueBulk(out, max); }
+	bool drained() const { return queue.empty(); }
+};
+
+template<class Queue>
+void run(const char* name, size_t producers, size_t consumers, size_t per_producer) {
+	Queue queue;
+	const size_t total = producers * per_producer;
+	std::atomic<size_t> taken{ 0 };
+	std::atomic<uint64_t> sum{ 0 };
+	std::atomic<size_t> reordered{ 0 };
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < consumers; ++c) {
+		threads.emplace_back([&] {
+			typename Queue::Consumer consumer(queue);
+			std::vector<uint64_t> last(producers, 0), items(batch);
+			uint64_t local = 0;
+			size_t bad = 0;
+			Backoff backoff;
+			while (taken.load(std::memory_order_relaxed) < total) {
+				size_t got = queue.pop(consumer, items.data(), batch);
+				if (got == 0) {
+					backoff();
+					continue;
+				}
+				backoff.reset();
+				for (size_t i = 0; i < got; ++i) {
+					uint64_t producer = items[i] >> 32, seq = items[i] & 0xffffffffu;
+					if (seq <= last[producer])
+						++bad;
+					last[producer] = seq;
+					local += seq;
+				}
+				taken.fetch_add(got, std::memory_order_relaxed);
+			}
+			sum.fetch_add(local);
+			reordered.fetch_add(bad);
+		});
+	}
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p] {
+			typename Queue::Producer producer(queue);
+			std::vector<uint64_t> items(batch);
+			for (uint64_t seq = 1; seq <= per_producer;) {
+				size_t n = std::min<uint64_t>(batch, per_producer - seq + 1);
+				for (size_t i = 0; i < n; ++i)
+					items[i] = (uint64_t(p) << 32) | (seq + i);
+				queue.push(producer, items.data(), n);
+				seq += n;
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	uint64_t expected = producers * (uint64_t(per_producer) * (per_producer + 1) / 2);
+	bool ok = taken.load() == total && sum.load() == expected && reordered.load() == 0 && queue.drained();
+	failed = failed || !ok;
+	std::printf("%-26s %zup/%zuc %8.1f ns/item %12.0f items/s  %s\n", name, producers, consumers,
+		seconds * 1e9 / total, total / seconds, ok ? "ok" : "FAILED");
+}
+
+template<class Queue>
+void runAll(const char* name, size_t threads, size_t per_producer) {
+	run<Queue>(name, 1, 1, per_producer * threads);
+	run<Queue>(name, threads, 1, per_producer);
+	run<Queue>(name, 1, threads, per_producer * threads);
+	run<Queue>(name, threads, threads, per_producer);
+}
+
+void edgeCases() {
+	ConcurrentQueue<std::string> queue(2);
+	std::string text;
+	bool ok = !queue.try_dequeue(text) && queue.empty();
+	{
+		ConcurrentQueue<std::string>::ProducerToken first(queue), second(queue), third(queue);
+		ok = ok && first.valid() && second.valid() && !third.valid();
+		// 100 items span several blocks.
+		for (int i = 0; i < 100; ++i)
+			queue.enqueue(first, std::string(64, 'x') + std::to_string(i));
+		queue.enqueue(third, "implicit");
+	}
+	// a new token takes over a sub-queue left by a dead one.
+	ConcurrentQueue<std::string>::ProducerToken again(queue);
+	std::vector<std::string> in(3, std::string(64, 'y'));
+	queue.enqueue_bulk(again, std::make_move_iterator(in.begin()), in.size());
+	ok = ok && again.valid() && in[0].empty() && queue.size_approx() == 104;
+
+	ConcurrentQueue<std::string>::ConsumerToken consumer(queue);
+	std::vector<std::string> out;
+	size_t got = 0, n;
+	while ((n = queue.try_dequeue_bulk(consumer, std::back_inserter(out), 30)) != 0)
+		got += n;
+	ok = ok && got == 104 && queue.empty();
+	std::printf("token limit, token reuse, bulk across blocks: %s\n", ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	for (int i = 0; i < 50; ++i)
+		queue.enqueue(again, std::string(64, 'z') + std::to_string(i));
+	std::printf("%zu items left to the destructor\n", queue.size_approx());
+}
+
+int main(int argc, char** argv) {
+	size_t per_producer = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t threads = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4;
+	batch = argc > 3 ? std::max<size_t>(1, std::strtoul(argv[3], nullptr, 10)) : 64;
+
+	runAll<Implicit>("ConcurrentQueue", threads, per_producer);
+	runAll<Tokens>("ConcurrentQueue tokens", threads, per_producer);
+	runAll<Bulk>("ConcurrentQueue bulk", threads, per_producer);
+	runAll<Unbounded>("UMPMCQueue", threads, per_producer);
+	runAll<Bounded>("MPMCQueue", threads, per_producer);
+	runAll<Locked>("UnboundedLockQueue bulk", threads, per_producer);
+	edgeCases();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+// Thousands of in-flight coroutines on a small ThreadPool: every operation
+// hops onto the pool a few times and awaits child Tasks, no worker blocks
+// and no thread is created per operation. Needs -std=c++20.
+//
+//   usage: coroutine_bench [operations = 10000] [hops = 8]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<cstdio>
+
+#include"../booty/ThreadPool.hpp"
+#include"../booty/coro/Task.hpp"
+#include"../booty/coro/Wait.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+static std::atomic<size_t> in_flight{ 0 };
+static std::atomic<size_t> peak{ 0 };
+
+Task<unsigned> leaf(ThreadPool& pool, unsigned seed) {
+	co_await pool.schedule();
+	for (int i = 0; i < 100; ++i)
+		seed = seed * 1664525u + 1013904223u;
+	co_return seed;
+}
+
+// one "request": a few sequential hops, then two children awaited together.
+Task<unsigned> operation(ThreadPool& pool, unsigned id, int hops) {
+	size_t now = in_flight.fetch_add(1) + 1;
+	size_t seen = peak.load();
+	while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+
+	unsigned acc = id;
+	for (int i = 0; i < hops; ++i)
+		acc ^= co_await leaf(pool, acc + i);
+	auto[a, b] = co_await when_all(leaf(pool, acc), leaf(pool, ~acc));
+	in_flight.fetch_sub(1);
+	co_return a ^ b;
+}
+
+Task<unsigned> all(ThreadPool& pool, size_t operations, int hops) {
+	std::vector<Task<unsigned>> tasks;
+	tasks.reserve(operations);
+	for (size_t i = 0; i < operations; ++i)
+		tasks.push_back(operation(pool, static_cast<unsigned>(i), hops));
+	unsigned acc = 0;
+	for (unsigned result : co_await when_all(std::move(tasks)))
+		acc ^= result;
+	co_return acc;
+}
+
+Task<void> failing(ThreadPool& pool) {
+	co_await pool.schedule(Priority::HIGH);
+	throw std::runtime_error("expected failure");
+}
+
+int main(int argc, char** argv) {
+	size_t operations = argc > 1 ? std::stoul(argv[1]) : 10000;
+	int hops = argc > 2 ? std::stoi(argv[2]) : 8;
+	ThreadPool pool;
+
+	auto start = steady_clock::now();
+	unsigned result = sync_wait(all(pool, operations, hops));
+	double secs = duration_cast<duration<double>>(steady_clock::now() - start).count();
+	size_t resumes = operations * (hops + 2);
+	std::printf("%zu operations, %zu resumes on %zu workers: %.3fs, %.0f resumes/s, peak in flight %zu\n",
+		operations, resumes, pool.threadCount(), secs, resumes / secs, peak.load());
+
+	try {
+		sync_wait(failing(pool));
+		std::printf("exception was lost\n");
+		return 1;
+	}
+	catch (const std::runtime_error& e) {
+		std::printf("rethrown: %s\n", e.what());
+	}
+	return result == 42 ? 1 : 0;
+}
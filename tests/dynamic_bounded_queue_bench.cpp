@@ -0,0 +1,204 @@
+// DynamicBoundedQueue variants against UMPMCQueue (no bound) and
+// MPMCQueue (a fixed ring of the same capacity). Items are weighed by a
+// payload size taken from their sequence number; consumers check that
+// each producer's items reach them in order, that none is lost or
+// duplicated, and that the whole capacity is available again once the
+// queue is drained. A single shard runs next to the sharded default to
+// show the cost of one shared budget counter.
+// Then the edge cases: over budget, timeouts, a producer blocked until a
+// consumer frees capacity, leftovers.
+//
+// Build with booty/concurrency/HazardPtr.cpp.
+//
+//   usage: dynamic_bounded_queue_bench [items per producer = 1000000] [threads per side = 4] [capacity = 4096]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<string>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/concurrency/DynamicBoundedQueue.hpp"
+#include"../booty/concurrency/MPMCQueue.hpp"
+
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+static size_t queue_capacity = 4096;
+
+// 1 to 16 units for each item, the sequence number is in the low bits.
+struct Weight {
+	size_t operator()(uint64_t item) const noexcept { return (item & 15) + 1; }
+};
+
+struct Bytes {
+	size_t operator()(const std::string& s) const noexcept { return s.size(); }
+};
+
+// the interface run() expects, on top of each queue.
+template<size_t Shards>
+struct Dynamic :DMPMCQueue<uint64_t, true, 8, 7, Weight> {
+	Dynamic() :DMPMCQueue<uint64_t, true, 8, 7, Weight>(queue_capacity * 8, Shards) {}
+	void push(uint64_t item) { enqueue(item); }
+	void pop(uint64_t& item) { dequeue(item); }
+	bool drained() const { return empty() && weight() == 0; }
+};
+
+struct Unbounded :UMPMCQueue<uint64_t, true> {
+	void push(uint64_t item) { enqueue(item); }
+	void pop(uint64_t& item) { dequeue(item); }
+	bool drained() const { return empty(); }
+};
+
+struct Bounded :MPMCQueue<uint64_t> {
+	Bounded() :MPMCQueue<uint64_t>(queue_capacity) {}
+	void push(uint64_t item) { blockingWrite(item); }
+	void pop(uint64_t& item) { blockingRead(item); }
+	bool drained() const { return isEmpty(); }
+};
+
+template<class Queue>
+void run(const char* name, size_t producers, size_t consumers, size_t per_producer) {
+	Queue queue;
+	const size_t total = producers * per_producer;
+	std::atomic<size_t> taken{ 0 };
+	std::atomic<uint64_t> sum{ 0 };
+	std::atomic<size_t> reordered{ 0 };
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < consumers; ++c) {
+		threads.emplace_back([&, c] {
+			// an even share, the first consumer takes the remainder.
+			size_t count = total / consumers + (c == 0 ? total % consumers : 0);
+			std::vector<uint64_t> last(producers, 0);
+			uint64_t local = 0;
+			size_t bad = 0;
+			for (size_t i = 0; i < count; ++i) {
+				uint64_t item;
+				queue.pop(item);
+				uint64_t producer = item >> 32, seq = item & 0xffffffffu;
+				if (seq <= last[producer])
+					++bad;
+				last[producer] = seq;
+				local += seq;
+			}
+			taken.fetch_add(count);
+			sum.fetch_add(local);
+			reordered.fetch_add(bad);
+		});
+	}
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p] {
+			for (uint64_t seq = 1; seq <= per_producer; ++seq)
+				queue.push((uint64_t(p) << 32) | seq);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	uint64_t expected = producers * (uint64_t(per_producer) * (per_producer + 1) / 2);
+	bool ok = taken.load() == total && sum.load() == expected && reordered.load() == 0 && queue.drained();
+	failed = failed || !ok;
+	std::printf("%-24s %zup/%zuc %8.1f ns/item %12.0f items/s  %s\n", name, producers, consumers,
+		seconds * 1e9 / total, total / seconds, ok ? "ok" : "FAILED");
+}
+
+template<class Queue>
+void runAll(const char* name, size_t threads, size_t per_producer) {
+	run<Queue>(name, 1, 1, per_producer * threads);
+	run<Queue>(name, threads, 1, per_producer);
+	run<Queue>(name, 1, threads, per_producer * threads);
+	run<Queue>(name, threads, threads, per_producer);
+}
+
+void edgeCases() {
+	DMPMCQueue<std::string, true, 8, 7, Bytes> queue(1000, 4);
+	bool ok = queue.try_enqueue(std::string(600, 'a')) && queue.weight() == 600;
+	std::string big(500, 'b');
+	ok = ok && !queue.try_enqueue(std::move(big)) && big.size() == 500;
+	ok = ok && queue.try_enqueue(std::string(400, 'c')) && queue.weight() == 1000 && !queue.try_enqueue(std::string(1, 'd'));
+	ok = ok && queue.try_enqueue(std::string()) && queue.size() == 3;
+	std::printf("weighted budget, full and zero weight: %s\n", ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	auto start = steady_clock::now();
+	bool wrote = queue.try_enqueue_for(std::string(1, 'e'), milliseconds(20));
+	double waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	std::printf("try_enqueue_for(20ms) over budget: %s after %.1f ms\n", wrote ? "ENQUEUED" : "timed out", waited);
+	failed = failed || wrote || waited < 19;
+
+	// a consumer on another thread, and so on another shard, frees the
+	// capacity a blocked producer waits for.
+	std::thread consumer([&queue] {
+		std::this_thread::sleep_for(milliseconds(5));
+		std::string first;
+		queue.dequeue(first);
+	});
+	start = steady_clock::now();
+	queue.enqueue(std::string(550, 'f'));
+	waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	consumer.join();
+	ok = queue.weight() == 950 && queue.size() == 3 && waited >= 4;
+	std::printf("enqueue blocked until a dequeue, %.1f ms: %s\n", waited, ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	// a little room, spread over the shards of the consumer threads and short
+	// of a refill batch, reaches a producer waiting for one unit within
+	// kMaxWakeDelay; 100ms leaves the scheduler plenty of slack.
+	DMPMCQueue<int, true> units(1000, 64);
+	for (int i = 0; i < 1000; ++i)
+		units.enqueue(i);
+	std::atomic<bool> enqueued{ false };
+	std::thread producer([&] {
+		units.enqueue(1000);
+		enqueued.store(true);
+	});
+	std::this_thread::sleep_for(milliseconds(10));
+	std::vector<std::thread> consumers;
+	for (int i = 0; i < 5; ++i)
+		consumers.emplace_back([&units] { units.dequeue(); });
+	for (auto& thread : consumers)
+		thread.join();
+	start = steady_clock::now();
+	while (!enqueued.load() && steady_clock::now() - start < milliseconds(100))
+		std::this_thread::yield();
+	waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	ok = enqueued.load();
+	for (int item; !enqueued.load();)
+		units.try_dequeue(item);  // frees the producer if it missed its wakeup.
+	producer.join();
+	std::printf("blocked producer woken by 5 dequeues on 5 shards, %.1f ms: %s\n", waited, ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	std::string text;
+	ok = queue.try_dequeue(text) && text.size() == 400 && queue.try_dequeue(text) && text.empty();
+	start = steady_clock::now();
+	ok = ok && queue.try_dequeue_for(text, milliseconds(20)) && text.size() == 550;
+	ok = ok && !queue.try_dequeue_for(text, milliseconds(20)) && queue.weight() == 0;
+	waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	std::printf("drain and try_dequeue_for(20ms) on empty, %.1f ms: %s\n", waited, ok && waited >= 19 ? "ok" : "FAILED");
+	failed = failed || !ok || waited < 19;
+
+	for (int i = 0; i < 10; ++i)
+		queue.enqueue(std::string(64, 'x') + std::to_string(i));
+	std::printf("%zu items left to the destructor, weight %zu\n", queue.size(), queue.weight());
+}
+
+int main(int argc, char** argv) {
+	size_t per_producer = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t threads = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4;
+	queue_capacity = argc > 3 ? std::max<size_t>(16, std::strtoul(argv[3], nullptr, 10)) : 4096;
+
+	runAll<Dynamic<0>>("DMPMCQueue sharded", threads, per_producer);
+	runAll<Dynamic<1>>("DMPMCQueue one shard", threads, per_producer);
+	runAll<Unbounded>("UMPMCQueue (no bound)", threads, per_producer);
+	runAll<Bounded>("MPMCQueue (ring)", threads, per_producer);
+	edgeCases();
+	return failed ? 1 : 0;
+}
@@ -33,7 +33,7 @@ int main() {
 	auto end1 = system_clock::now();
 	auto start2 = system_clock::now();
 	ThreadPool pool(8);
-	std::vector<std::future<void>> results;
+	std::vector<Future<void>> results;
 	for (int i = 0; i < 1000; ++i) {
 		results.push_back(pool.submitTask([i, &mtx] {
 			{
@@ -0,0 +1,153 @@
+// UnboundedLockQueue per item against its bulk operations: producers push
+// one item or a batch under one lock, consumers pop one item at a time or
+// take batches with dequeueBulkFor. Every item carries its producer and
+// sequence number; consumers check that each producer's items reach them
+// in order, and that no item is lost or duplicated. Then the timed and
+// partial cases.
+//
+//   usage: lock_queue_bulk_bench [items per producer = 1000000] [threads per side = 4] [batch = 1000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<string>
+#include<iterator>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/concurrency/UnboundedLockQueue.hpp"
+
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+
+void run(const char* name, size_t producers, size_t consumers, size_t per_producer, size_t batch,
+	bool bulk_in, bool bulk_out) {
+	UnboundedLockQueue<uint64_t> queue;
+	const size_t total = producers * per_producer;
+	std::atomic<size_t> taken{ 0 };
+	std::atomic<uint64_t> sum{ 0 };
+	std::atomic<size_t> reordered{ 0 };
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < consumers; ++c) {
+		threads.emplace_back([&] {
+			std::vector<uint64_t> last(producers, 0);
+			std::vector<uint64_t> items(batch);
+			uint64_t local = 0;
+			size_t bad = 0;
+			auto check = [&](uint64_t item) {
+				uint64_t producer = item >> 32, seq = item & 0xffffffffu;
+				if (seq <= last[producer])
+					++bad;
+				last[producer] = seq;
+				local += seq;
+			};
+			// consumers share the items as they come, and stop once all of
+			// them are taken.
+			while (taken.load(std::memory_order_relaxed) < total) {
+				size_t got = 0;
+				if (bulk_out) {
+					got = queue.dequeueBulkFor(items.begin(), batch, milliseconds(1));
+				}
+				else {
+					for (; got < batch && queue.dequeueFor(items[got], milliseconds(1)); ++got) {}
+				}
+				for (size_t i = 0; i < got; ++i)
+					check(items[i]);
+				taken.fetch_add(got, std::memory_order_relaxed);
+			}
+			sum.fetch_add(local);
+			reordered.fetch_add(bad);
+		});
+	}
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p] {
+			std::vector<uint64_t> items;
+			items.reserve(batch);
+			for (uint64_t seq = 1; seq <= per_producer; ++seq) {
+				uint64_t item = (uint64_t(p) << 32) | seq;
+				if (!bulk_in) {
+					queue.enqueue(item);
+					continue;
+				}
+				items.push_back(item);
+				if (items.size() == batch || seq == per_producer) {
+					queue.enqueueBulk(items.begin(), items.end());
+					items.clear();
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	uint64_t expected = producers * (uint64_t(per_producer) * (per_producer + 1) / 2);
+	bool ok = taken.load() == total && sum.load() == expected && reordered.load() == 0 && queue.empty();
+	failed = failed || !ok;
+	std::printf("%-26s %zup/%zuc %8.1f ns/item %12.0f items/s  %s\n", name, producers, consumers,
+		seconds * 1e9 / total, total / seconds, ok ? "ok" : "FAILED");
+}
+
+void runAll(const char* name, size_t threads, size_t per_producer, size_t batch, bool bulk_in, bool bulk_out) {
+	run(name, 1, 1, per_producer * threads, batch, bulk_in, bulk_out);
+	run(name, threads, 1, per_producer, batch, bulk_in, bulk_out);
+	run(name, threads, threads, per_producer, batch, bulk_in, bulk_out);
+}
+
+void edgeCases() {
+	UnboundedLockQueue<std::string> queue;
+	std::string text;
+	auto start = steady_clock::now();
+	bool got = queue.dequeueFor(text, milliseconds(20));
+	double waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	std::printf("dequeueFor(20ms) on an empty queue: %s after %.1f ms\n", got ? "GOT AN ITEM" : "timed out", waited);
+	failed = failed || got || waited < 19;
+
+	std::vector<std::string> in;
+	for (int i = 0; i < 10; ++i)
+		in.push_back(std::string(64, 'x') + std::to_string(i));
+	queue.enqueueBulk(std::make_move_iterator(in.begin()), std::make_move_iterator(in.end()));
+	std::vector<std::string> out;
+	bool ok = in[0].empty() && queue.size() == 10;
+	ok = ok && queue.dequeueBulk(std::back_inserter(out), 4) == 4 && out[3] == std::string(64, 'x') + "3";
+	ok = ok && queue.dequeueBulk(std::back_inserter(out), 100) == 6 && out[9] == std::string(64, 'x') + "9";
+	ok = ok && queue.empty() && queue.dequeueBulk(std::back_inserter(out), 100) == 0;
+	std::printf("partial and whole-container dequeueBulk: %s\n", ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	// a producer fills the queue while a consumer waits for the batch.
+	std::thread producer([&queue] {
+		std::this_thread::sleep_for(milliseconds(5));
+		std::vector<std::string> items(3, "late");
+		queue.enqueueBulk(items.begin(), items.end());
+	});
+	out.clear();
+	size_t n = queue.dequeueBulkFor(std::back_inserter(out), 100, seconds(5));
+	producer.join();
+	// the batch may arrive in one piece or, with an unlucky wakeup, in part.
+	n += queue.dequeueBulk(std::back_inserter(out), 100);
+	std::printf("dequeueBulkFor(5s) while a producer fills: %s\n", n == 3 ? "ok" : "FAILED");
+	failed = failed || n != 3;
+
+	queue.enqueue("left over");
+	std::printf("%zu item left to the destructor\n", queue.size());
+}
+
+int main(int argc, char** argv) {
+	size_t per_producer = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t threads = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4;
+	size_t batch = argc > 3 ? std::max<size_t>(1, std::strtoul(argv[3], nullptr, 10)) : 1000;
+
+	runAll("per item", threads, per_producer, batch, false, false);
+	runAll("enqueueBulk", threads, per_producer, batch, true, false);
+	runAll("dequeueBulkFor", threads, per_producer, batch, false, true);
+	runAll("enqueueBulk+dequeueBulkFor", threads, per_producer, batch, true, true);
+	edgeCases();
+	return failed ? 1 : 0;
+}
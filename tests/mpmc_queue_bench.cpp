@@ -0,0 +1,217 @@
+// MPMCQueue against UMPMCQueue and UnboundedLockQueue:
+// - throughput: 1 to 1, 1 to N, N to 1 and N to M threads. Every item
+//   carries its producer and sequence number; consumers check that each
+//   producer's items reach them in order, and that no item is lost or
+//   duplicated. MPMCQueue runs with blocking and with non-blocking
+//   (write/read, yield on failure) calls.
+// - ping-pong: one item bounces between two threads over two queues, the
+//   round trip percentiles show the tail latency of the handoff.
+// - edge cases: capacity rounding, full and empty, timeouts, leftovers.
+//
+// Build with booty/concurrency/HazardPtr.cpp for UMPMCQueue.
+//
+//   usage: mpmc_queue_bench [items per producer = 1000000] [threads per side = 4] [capacity = 1024] [rounds = 100000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<string>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/concurrency/MPMCQueue.hpp"
+#include"../booty/concurrency/UnboundedQueue.hpp"
+#include"../booty/concurrency/UnboundedLockQueue.hpp"
+
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+static size_t bounded_capacity = 1024;
+
+static double percentile(std::vector<double>& samples, double p) {
+	size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+// the interface run() and pingPong() expect, on top of each queue.
+struct BlockingBounded :MPMCQueue<uint64_t> {
+	BlockingBounded() :MPMCQueue<uint64_t>(bounded_capacity) {}
+	void push(uint64_t item) { blockingWrite(item); }
+	void pop(uint64_t& item) { blockingRead(item); }
+	bool drained() const { return isEmpty(); }
+};
+
+struct SpinningBounded :MPMCQueue<uint64_t> {
+	SpinningBounded() :MPMCQueue<uint64_t>(bounded_capacity) {}
+	void push(uint64_t item) {
+		while (!write(item))
+			std::this_thread::yield();
+	}
+	void pop(uint64_t& item) {
+		while (!read(item))
+			std::this_thread::yield();
+	}
+	bool drained() const { return isEmpty(); }
+};
+
+struct Unbounded :UMPMCQueue<uint64_t, true> {
+	void push(uint64_t item) { enqueue(item); }
+	void pop(uint64_t& item) { dequeue(item); }
+	bool drained() const { return empty(); }
+};
+
+struct Locked :UnboundedLockQueue<uint64_t> {
+	void push(uint64_t item) { enqueue(item); }
+	void pop(uint64_t& item) { dequeue(item); }
+	bool drained() const { return empty(); }
+};
+
+template<class Queue>
+void run(const char* name, size_t producers, size_t consumers, size_t per_producer) {
+	Queue queue;
+	const size_t total = producers * per_producer;
+	std::atomic<size_t> taken{ 0 };
+	std::atomic<uint64_t> sum{ 0 };
+	std::atomic<size_t> reordered{ 0 };
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < consumers; ++c) {
+		threads.emplace_back([&, c] {
+			// an even share, the first consumer takes the remainder.
+			size_t count = total / consumers + (c == 0 ? total % consumers : 0);
+			std::vector<uint64_t> last(producers, 0);
+			uint64_t local = 0;
+			size_t bad = 0;
+			for (size_t i = 0; i < count; ++i) {
+				uint64_t item;
+				queue.pop(item);
+				uint64_t producer = item >> 32, seq = item & 0xffffffffu;
+				if (seq <= last[producer])
+					++bad;
+				last[producer] = seq;
+				local += seq;
+			}
+			taken.fetch_add(count);
+			sum.fetch_add(local);
+			reordered.fetch_add(bad);
+		});
+	}
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p] {
+			for (uint64_t seq = 1; seq <= per_producer; ++seq)
+				queue.push((uint64_t(p) << 32) | seq);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	uint64_t expected = producers * (uint64_t(per_producer) * (per_producer + 1) / 2);
+	bool ok = taken.load() == total && sum.load() == expected && reordered.load() == 0 && queue.drained();
+	failed = failed || !ok;
+	std::printf("%-22s %zup/%zuc %8.1f ns/item %12.0f items/s  %s\n", name, producers, consumers,
+		seconds * 1e9 / total, total / seconds, ok ? "ok" : "FAILED");
+}
+
+template<class Queue>
+void pingPong(const char* name, size_t rounds) {
+	Queue ping, pong;
+	std::vector<double> samples(rounds);
+	std::thread echo([&] {
+		for (size_t i = 0; i < rounds; ++i) {
+			uint64_t item;
+			ping.pop(item);
+			pong.push(item);
+		}
+	});
+	bool ok = true;
+	for (size_t i = 0; i < rounds; ++i) {
+		auto start = steady_clock::now();
+		uint64_t item;
+		ping.push(i);
+		pong.pop(item);
+		samples[i] = duration<double, std::micro>(steady_clock::now() - start).count();
+		ok = ok && item == i;
+	}
+	echo.join();
+	failed = failed || !ok;
+	double p50 = percentile(samples, 0.5), p99 = percentile(samples, 0.99), p999 = percentile(samples, 0.999);
+	std::printf("%-22s round trip p50 %7.2f us  p99 %7.2f us  p99.9 %7.2f us  %s\n",
+		name, p50, p99, p999, ok ? "ok" : "FAILED");
+}
+
+template<class Queue>
+void runAll(const char* name, size_t threads, size_t per_producer) {
+	run<Queue>(name, 1, 1, per_producer * threads);
+	run<Queue>(name, 1, threads, per_producer * threads);
+	run<Queue>(name, threads, 1, per_producer);
+	run<Queue>(name, threads, threads, per_producer);
+}
+
+void edgeCases() {
+	MPMCQueue<std::string> queue(3);
+	bool ok = queue.capacity() == 4 && queue.isEmpty() && !queue.isFull();
+	std::string text;
+	ok = ok && !queue.read(text) && !queue.readIfNotEmpty(text);
+	for (int i = 0; i < 4; ++i)
+		ok = ok && queue.write(std::string(64, 'x') + std::to_string(i));
+	ok = ok && queue.isFull() && !queue.write("overflow") && !queue.writeIfNotFull("overflow") && queue.size() == 4;
+	ok = ok && queue.read(text) && text == std::string(64, 'x') + "0";
+	queue.blockingWrite(std::string(64, 'x') + "4");
+	std::printf("capacity, full and empty: %s\n", ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	auto start = steady_clock::now();
+	bool wrote = queue.tryWriteFor(milliseconds(20), "late");
+	double waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	std::printf("tryWriteFor(20ms) on a full queue: %s after %.1f ms\n", wrote ? "WROTE" : "timed out", waited);
+	failed = failed || wrote || waited < 19;
+
+	// a reader frees a slot while a timed writer waits for it.
+	std::thread reader([&queue] {
+		std::this_thread::sleep_for(milliseconds(5));
+		std::string first;
+		queue.blockingRead(first);
+	});
+	wrote = queue.tryWriteFor(seconds(5), "in time");
+	reader.join();
+	std::printf("tryWriteFor(5s) while a reader drains: %s\n", wrote ? "ok" : "FAILED");
+	failed = failed || !wrote;
+
+	MPMCQueue<std::string> empty(8);
+	start = steady_clock::now();
+	bool got = empty.tryReadFor(milliseconds(20), text);
+	waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	std::printf("tryReadFor(20ms) on an empty queue: %s after %.1f ms\n", got ? "GOT AN ITEM" : "timed out", waited);
+	failed = failed || got || waited < 19;
+
+	// moved-from queues are empty, the target owns the items and destroys
+	// the ones left over.
+	MPMCQueue<std::string> moved(std::move(queue));
+	ok = queue.capacity() == 0 && moved.size() == 4 && moved.read(text) && text == std::string(64, 'x') + "2";
+	std::printf("move, %lld items left to the destructor: %s\n", static_cast<long long>(moved.size()), ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+}
+
+int main(int argc, char** argv) {
+	size_t per_producer = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t threads = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4;
+	bounded_capacity = argc > 3 ? std::max<size_t>(1, std::strtoul(argv[3], nullptr, 10)) : 1024;
+	size_t rounds = argc > 4 ? std::max<size_t>(1, std::strtoul(argv[4], nullptr, 10)) : 100000;
+
+	runAll<BlockingBounded>("MPMCQueue blocking", threads, per_producer);
+	runAll<SpinningBounded>("MPMCQueue write/read", threads, per_producer);
+	runAll<Unbounded>("UMPMCQueue block", threads, per_producer);
+	runAll<Locked>("UnboundedLockQueue", threads, per_producer);
+	pingPong<BlockingBounded>("MPMCQueue blocking", rounds);
+	pingPong<SpinningBounded>("MPMCQueue write/read", rounds);
+	pingPong<Unbounded>("UMPMCQueue block", rounds);
+	pingPong<Locked>("UnboundedLockQueue", rounds);
+	edgeCases();
+	return failed ? 1 : 0;
+}
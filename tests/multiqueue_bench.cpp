@@ -0,0 +1,245 @@
+// Concurrent priority queues: MultiQueue (relaxed, heaps behind try-locks),
+// MultiQueue strict (lock-free skip list) and a std::priority_queue behind
+// a mutex. First the throughput of a mixed load, each thread pushing and
+// popping in turn; every pushed priority must come out exactly once. Then
+// the rank error: the queue is filled with distinct priorities, threads
+// pop them all and log each pop with a global sequence number, and the
+// log is replayed to find how many smaller priorities were still queued
+// when each one was popped. The sequence number is taken right after the
+// pop, so even the strict queues show a small error under contention.
+// The relaxed queue is also drained by one thread, with as many heaps as
+// for all of them: with fewer cores than threads, a thread preempted while
+// holding a heap lock freezes that heap for a time slice, which the
+// concurrent figure then includes.
+// Last, the strict order on one thread and leftovers to the destructors.
+//
+//   usage: multiqueue_bench [operations per thread = 1000000] [threads = 4] [rank error elements = 1000000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<mutex>
+#include<queue>
+#include<string>
+#include<random>
+#include<algorithm>
+#include<functional>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/concurrency/MultiQueue.hpp"
+
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+
+// the interface the runs expect, on top of std::priority_queue.
+class LockedHeap {
+	struct Later {
+		bool operator()(const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) const {
+			return a.first > b.first;
+		}
+	};
+
+public:
+	explicit LockedHeap(size_t = 0, size_t = 0) {}
+
+	void push(uint64_t priority, uint64_t item) {
+		std::lock_guard<std::mutex> lock(lock_);
+		heap_.emplace(priority, item);
+	}
+
+	bool try_pop(uint64_t& item, uint64_t& priority) {
+		std::lock_guard<std::mutex> lock(lock_);
+		if (heap_.empty())
+			return false;
+		priority = heap_.top().first;
+		item = heap_.top().second;
+		heap_.pop();
+		return true;
+	}
+
+	bool empty() {
+		std::lock_guard<std::mutex> lock(lock_);
+		return heap_.empty();
+	}
+
+private:
+	std::mutex lock_;
+	std::priority_queue<std::pair<uint64_t, uint64_t>, std::vector<std::pair<uint64_t, uint64_t>>, Later> heap_;
+};
+
+using Relaxed = MultiQueue<uint64_t>;
+using Strict = MultiQueue<uint64_t, uint64_t, std::less<uint64_t>, true>;
+
+// each thread pushes a random priority and pops one, `ops` times, over a
+// prefilled queue. The item is its priority, the sums must match.
+template<class Queue>
+void throughput(const char* name, size_t threads, size_t ops) {
+	Queue queue(threads);
+	const size_t prefill = 1024 * threads;
+	std::atomic<uint64_t> pushed{ 0 }, popped{ 0 };
+	std::atomic<size_t> mismatched{ 0 };
+	for (uint64_t i = 0; i < prefill; ++i) {
+		uint64_t priority = i * 2654435761u % 1000003;
+		queue.push(priority, priority);
+		pushed.fetch_add(priority);
+	}
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t] {
+			std::mt19937_64 random(t + 1);
+			uint64_t in = 0, out = 0;
+			size_t bad = 0;
+			for (size_t i = 0; i < ops; ++i) {
+				uint64_t priority = random() % 1000003;
+				queue.push(priority, priority);
+				in += priority;
+				uint64_t item, got;
+				if (queue.try_pop(item, got)) {
+					out += item;
+					bad += item != got;
+				}
+			}
+			pushed.fetch_add(in);
+			popped.fetch_add(out);
+			mismatched.fetch_add(bad);
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	uint64_t item, priority, rest = 0;
+	while (queue.try_pop(item, priority))
+		rest += item;
+	bool ok = popped.load() + rest == pushed.load() && mismatched.load() == 0 && queue.empty();
+	failed = failed || !ok;
+	std::printf("%-24s %2zu threads %8.1f ns/op %12.0f ops/s  %s\n", name, threads,
+		seconds * 1e9 / (threads * ops * 2), threads * ops * 2 / seconds, ok ? "ok" : "FAILED");
+}
+
+// counts the priorities still queued, a Fenwick tree over 0..n-1.
+class Fenwick {
+public:
+	explicit Fenwick(size_t n) :tree_(n + 1, 0) {}
+
+	void add(size_t index, int64_t delta) {
+		for (++index; index < tree_.size(); index += index & (0 - index))
+			tree_[index] += delta;
+	}
+
+	/* how many below index. */
+	int64_t prefix(size_t index) const {
+		int64_t sum = 0;
+		for (; index > 0; index -= index & (0 - index))
+			sum += tree_[index];
+		return sum;
+	}
+
+private:
+	std::vector<int64_t> tree_;
+};
+
+template<class Queue>
+void rankError(const char* name, size_t threads, size_t poppers, size_t elements) {
+	Queue queue(threads);
+	std::vector<uint64_t> priorities(elements);
+	for (uint64_t i = 0; i < elements; ++i)
+		priorities[i] = i;
+	std::shuffle(priorities.begin(), priorities.end(), std::mt19937_64(42));
+	for (uint64_t priority : priorities)
+		queue.push(priority, priority);
+
+	// log[sequence] = the priority popped at that point.
+	std::vector<uint64_t> log(elements, ~uint64_t(0));
+	std::atomic<size_t> sequence{ 0 };
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < poppers; ++t) {
+		workers.emplace_back([&] {
+			uint64_t item, priority;
+			while (queue.try_pop(item, priority))
+				log[sequence.fetch_add(1, std::memory_order_relaxed)] = priority;
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+
+	bool ok = sequence.load() == elements;
+	Fenwick queued(elements);
+	std::vector<bool> seen(elements, false);
+	for (size_t i = 0; i < elements; ++i)
+		queued.add(i, 1);
+	double sum = 0;
+	int64_t worst = 0;
+	for (size_t i = 0; ok && i < elements; ++i) {
+		uint64_t priority = log[i];
+		if (priority >= elements || seen[priority]) {
+			ok = false;
+			break;
+		}
+		seen[priority] = true;
+		int64_t rank = queued.prefix(priority);
+		sum += rank;
+		worst = std::max(worst, rank);
+		queued.add(priority, -1);
+	}
+	failed = failed || !ok;
+	std::printf("%-24s %2zu threads %2zu poppers rank error mean %8.2f max %8lld  %s\n", name, threads, poppers,
+		sum / elements, static_cast<long long>(worst), ok ? "ok" : "FAILED");
+}
+
+void strictOrderAndLeftovers() {
+	// enough pops to move the skip list head several times.
+	MultiQueue<std::string, uint64_t, std::less<uint64_t>, true> strict;
+	std::mt19937_64 random(7);
+	std::vector<uint64_t> priorities;
+	for (int i = 0; i < 10000; ++i) {
+		priorities.push_back(random() % 5000);
+		strict.push(priorities.back(), std::string(32, 'x') + std::to_string(priorities.back()));
+	}
+	std::sort(priorities.begin(), priorities.end());
+	bool ok = true;
+	for (size_t i = 0; i < 9000; ++i) {
+		std::string item;
+		uint64_t priority;
+		ok = ok && strict.try_pop(item, priority) && priority == priorities[i] &&
+			item == std::string(32, 'x') + std::to_string(priority);
+	}
+	const auto& view = strict;  // the same const interface as the relaxed one.
+	ok = ok && view.size_approx() == 1000 && !view.empty();
+	std::printf("strict order over 9000 of 10000 pops, 1000 left: %s\n", ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	MultiQueue<std::string, double, std::greater<double>> relaxed(1, 1);
+	for (int i = 0; i < 100; ++i)
+		relaxed.push(i * 0.5, std::string(32, 'y'));
+	std::string item;
+	double priority = 0;
+	ok = relaxed.try_pop(item, priority) && priority >= 45.0 && relaxed.size_approx() == 99;
+	std::printf("std::greater relaxed pop near the largest (%.1f): %s\n", priority, ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+	// the remaining items are destroyed with the queues.
+}
+
+int main(int argc, char** argv) {
+	size_t ops = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t threads = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4;
+	size_t elements = argc > 3 ? std::max<size_t>(1, std::strtoul(argv[3], nullptr, 10)) : 1000000;
+
+	for (size_t n : { size_t(1), threads }) {
+		throughput<Relaxed>("MultiQueue relaxed", n, ops);
+		throughput<Strict>("MultiQueue strict", n, ops);
+		throughput<LockedHeap>("mutex priority_queue", n, ops);
+	}
+	rankError<Relaxed>("MultiQueue relaxed", threads, 1, elements);
+	rankError<Relaxed>("MultiQueue relaxed", threads, threads, elements);
+	rankError<Strict>("MultiQueue strict", threads, threads, elements);
+	rankError<LockedHeap>("mutex priority_queue", threads, threads, elements);
+	strictOrderAndLeftovers();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+// Compares booty::parallel_reduce / parallel_transform against a sequential
+// loop and, when built with -DBOOTY_WITH_STD_PAR (and -ltbb for libstdc++),
+// against std::execution::par.
+//
+//   usage: parallel_bench [max_log10_elements = 8]   (9 needs ~12GB of RAM)
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<numeric>
+#include<algorithm>
+#include<functional>
+#include<cstdio>
+#include<cmath>
+#ifdef BOOTY_WITH_STD_PAR
+#include<execution>
+#endif
+
+#include"../booty/Parallel.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+template<class F>
+double timeIt(F&& func) {
+	auto start = steady_clock::now();
+	func();
+	return duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count();
+}
+
+void benchSum(ThreadPool& pool, const std::vector<int>& data) {
+	long long seq = 0, par = 0;
+	double t_seq = timeIt([&] {
+		seq = std::accumulate(data.begin(), data.end(), 0LL);
+	});
+	double t_par = timeIt([&] {
+		par = parallel_reduce(pool, data.begin(), data.end(), 0LL, std::plus<>());
+	});
+	std::printf("  sum       seq %10.2fms   booty %10.2fms (x%.2f)", t_seq, t_par, t_seq / t_par);
+#ifdef BOOTY_WITH_STD_PAR
+	long long stdpar = 0;
+	double t_std = timeIt([&] {
+		stdpar = std::reduce(std::execution::par, data.begin(), data.end(), 0LL);
+	});
+	std::printf("   std::par %10.2fms (x%.2f)", t_std, t_seq / t_std);
+	if (stdpar != seq)
+		std::printf("   MISMATCH(std)");
+#endif
+	if (par != seq)
+		std::printf("   MISMATCH");
+	std::printf("\n");
+}
+
+void benchTransform(ThreadPool& pool, const std::vector<int>& data, std::vector<float>& out) {
+	auto op = [](int x) { return std::sqrt(static_cast<float>(x)) * 0.5f; };
+	double t_seq = timeIt([&] {
+		std::transform(data.begin(), data.end(), out.begin(), op);
+	});
+	float check = out[out.size() / 2];
+	std::fill(out.begin(), out.end(), 0.0f);
+	double t_par = timeIt([&] {
+		parallel_transform(pool, data.begin(), data.end(), out.begin(), op);
+	});
+	std::printf("  transform seq %10.2fms   booty %10.2fms (x%.2f)", t_seq, t_par, t_seq / t_par);
+#ifdef BOOTY_WITH_STD_PAR
+	double t_std = timeIt([&] {
+		std::transform(std::execution::par, data.begin(), data.end(), out.begin(), op);
+	});
+	std::printf("   std::par %10.2fms (x%.2f)", t_std, t_seq / t_std);
+#endif
+	if (out[out.size() / 2] != check)
+		std::printf("   MISMATCH");
+	std::printf("\n");
+}
+
+int main(int argc, char** argv) {
+	int max_exp = argc > 1 ? std::stoi(argv[1]) : 8;
+	ThreadPool pool;
+	std::printf("pool of up to %zu workers\n", pool.maxThreadCount());
+	for (int e = 4; e <= max_exp; ++e) {
+		size_t n = static_cast<size_t>(std::pow(10, e));
+		std::vector<int> data(n);
+		std::iota(data.begin(), data.end(), 0);
+		std::vector<float> out(n);
+		std::printf("n = 10^%d\n", e);
+		benchSum(pool, data);
+		benchTransform(pool, data, out);
+	}
+
+	// the same algorithms on a pool with other queue and wait policies.
+	BasicThreadPool<policy::LockQueue, policy::CondVarWait> other;
+	std::vector<int> data(1000000);
+	std::iota(data.begin(), data.end(), 0);
+	long long sum = parallel_reduce(other, data.begin(), data.end(), 0LL, std::plus<>());
+	bool ok = sum == 1000000LL * 999999 / 2;
+	std::printf("sum on BasicThreadPool<LockQueue, CondVarWait>: %lld  %s\n", sum, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+// Every booty FIFO queue, over 1 or N producers and 1 or N consumers, with
+// 8, 64 and 512 byte items, and consumers that spin (try-dequeue, pause,
+// yield) or block (a waiting dequeue). Each run reports the throughput
+// and the enqueue-to-dequeue latency: producers stamp every 16th item
+// just before its enqueue, and the consumer which takes it records the
+// time it waited. Producers run at full speed, so on the unbounded queues
+// the latency includes the backlog that builds up when consumers fall
+// behind; the bounded ones hold producers back instead. Every item
+// carries its producer and sequence number; consumers check that each
+// producer's items reach them in order, and that none is lost.
+//
+// Queues: UnboundedLockQueue, USPSC/UMPSC/USPMC/UMPMCQueue, ConcurrentQueue
+// (BlockingConcurrentQueue for blocking consumers), MPMCQueue,
+// ProducerConsumerQueue (spinning only) and DMPMCQueue; each in the
+// shapes it supports. The first column is the queue name, a filter picks
+// the runs of the queues whose name contains it.
+//
+// Build with booty/concurrency/HazardPtr.cpp, booty/sync/Futex.cpp.
+//
+//   usage: queue_matrix_bench [items per producer = 100000] [threads per side = 4] [name filter = ""]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<string>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+
+#include"../booty/Asm.h"
+#include"../booty/concurrency/BlockingConcurrentQueue.hpp"
+#include"../booty/concurrency/ConcurrentQueue.hpp"
+#include"../booty/concurrency/DynamicBoundedQueue.hpp"
+#include"../booty/concurrency/MPMCQueue.hpp"
+#include"../booty/concurrency/ProducerConsumerQueue.hpp"
+#include"../booty/concurrency/UnboundedQueue.hpp"
+#include"../booty/concurrency/UnboundedLockQueue.hpp"
+
+using namespace booty;
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+static const char* filter = "";
+
+constexpr size_t kBoundedCapacity = 4096;
+constexpr uint64_t kSampleEvery = 16;
+
+// an item of N bytes: producer << 40 | sequence, and padding.
+template<size_t N>
+struct Payload {
+	uint64_t id;
+	char bytes[N - sizeof(uint64_t)];
+};
+
+template<>
+struct Payload<8> {
+	uint64_t id;
+};
+
+static_assert(sizeof(Payload<8>) == 8 && sizeof(Payload<64>) == 64 && sizeof(Payload<512>) == 512);
+
+struct Backoff {
+	void operator()() {
+		if (++spins_ < 128)
+			asm_volatile_pause();
+		else
+			std::this_thread::yield();
+	}
+	void reset() { spins_ = 0; }
+
+private:
+	unsigned spins_ = 0;
+};
+
+// the interface run() expects: push(), tryPop() and, for blocking
+// consumers, a waiting pop().
+template<class Queue, typename P>
+struct Moody :Queue {
+	void push(const P& item) { this->enqueue(item); }
+	bool tryPop(P& item) { return this->try_dequeue(item); }
+	void pop(P& item) { this->dequeue(item); }
+};
+
+template<typename P>
+struct LockQueue :UnboundedLockQueue<P> {
+	void push(const P& item) { this->enqueue(item); }
+	bool tryPop(P& item) { return this->tryDequeue(item); }
+	void pop(P& item) { this->dequeue(item); }
+};
+
+template<typename P>
+struct Ring :MPMCQueue<P> {
+	Ring() :MPMCQueue<P>(kBoundedCapacity) {}
+	void push(const P& item) { this->blockingWrite(item); }
+	bool tryPop(P& item) { return this->read(item); }
+	void pop(P& item) { this->blockingRead(item); }
+};
+
+template<typename P>
+struct SpscRing :ProducerConsumerQueue<P> {
+	SpscRing() :ProducerConsumerQueue<P>(kBoundedCapacity) {}
+	void push(const P& item) {
+		Backoff backoff;
+		while (!this->write(item))
+			backoff();
+	}
+	bool tryPop(P& item) { return this->read(item); }
+};
+
+template<typename P, bool MayBlock>
+struct Dynamic :DMPMCQueue<P, MayBlock> {
+	Dynamic() :DMPMCQueue<P, MayBlock>(kBoundedCapacity) {}
+	void push(const P& item) { this->enqueue(item); }
+	bool tryPop(P& item) { return this->try_dequeue(item); }
+	void pop(P& item) { this->dequeue(item); }
+};
+
+template<typename P> using Lock = LockQueue<P>;
+template<typename P> using SpscSpin = Moody<USPSCQueue<P, false>, P>;
+template<typename P> using SpscBlock = Moody<USPSCQueue<P, true>, P>;
+template<typename P> using MpscSpin = Moody<UMPSCQueue<P, false>, P>;
+template<typename P> using MpscBlock = Moody<UMPSCQueue<P, true>, P>;
+template<typename P> using SpmcSpin = Moody<USPMCQueue<P, false>, P>;
+template<typename P> using SpmcBlock = Moody<USPMCQueue<P, true>, P>;
+template<typename P> using MpmcSpin = Moody<UMPMCQueue<P, false>, P>;
+template<typename P> using MpmcBlock = Moody<UMPMCQueue<P, true>, P>;
+template<typename P> using Sharded = Moody<ConcurrentQueue<P>, P>;
+template<typename P> using ShardedBlock = Moody<BlockingConcurrentQueue<P>, P>;
+template<typename P> using DynamicSpin = Dynamic<P, false>;
+template<typename P> using DynamicBlock = Dynamic<P, true>;
+
+static uint64_t nowNs() {
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+template<class Queue, typename P, bool Blocking>
+void run(const char* name, size_t producers, size_t consumers, size_t per_producer) {
+	Queue queue;
+	const size_t total = producers * per_producer;
+	// stamps[p][seq / kSampleEvery], written before the enqueue of the item.
+	std::vector<std::vector<uint64_t>> stamps(producers, std::vector<uint64_t>(per_producer / kSampleEvery + 1));
+	std::vector<std::vector<uint64_t>> latencies(consumers);
+	std::atomic<size_t> taken{ 0 };
+	std::atomic<size_t> reordered{ 0 };
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < consumers; ++c) {
+		threads.emplace_back([&, c] {
+			// an even share, the first consumer takes the remainder.
+			size_t count = total / consumers + (c == 0 ? total % consumers : 0);
+			std::vector<uint64_t> last(producers, 0);
+			std::vector<uint64_t>& latency = latencies[c];
+			latency.reserve(count / kSampleEvery + 1);
+			size_t bad = 0;
+			Backoff backoff;
+			for (size_t i = 0; i < count; ++i) {
+				P item;
+				if constexpr (Blocking) {
+					queue.pop(item);
+				}
+				else {
+					backoff.reset();
+					while (!queue.tryPop(item))
+						backoff();
+				}
+				uint64_t producer = item.id >> 40, seq = item.id & ((uint64_t(1) << 40) - 1);
+				if (seq <= last[producer])
+					++bad;
+				last[producer] = seq;
+				if (seq % kSampleEvery == 0)
+					latency.push_back(nowNs() - stamps[producer][seq / kSampleEvery]);
+			}
+			taken.fetch_add(count);
+			reordered.fetch_add(bad);
+		});
+	}
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p] {
+			P item;
+			std::memset(&item, 'x', sizeof(item));
+			for (uint64_t seq = 1; seq <= per_producer; ++seq) {
+				item.id = (uint64_t(p) << 40) | seq;
+				if (seq % kSampleEvery == 0)
+					stamps[p][seq / kSampleEvery] = nowNs();
+				queue.push(item);
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	std::vector<uint64_t> all;
+	for (auto& latency : latencies)
+		all.insert(all.end(), latency.begin(), latency.end());
+	std::sort(all.begin(), all.end());
+	auto percentile = [&all](double q) {
+		return all.empty() ? 0.0 : all[std::min(all.size() - 1, size_t(q * all.size()))] / 1e3;
+	};
+
+	bool ok = taken.load() == total && reordered.load() == 0;
+	failed = failed || !ok;
+	std::printf("%-21s %-5s %4zuB %2zup/%2zuc %8.1f ns/item %7.2f M/s  us p50 %9.1f p99 %9.1f p99.9 %9.1f max %9.1f  %s\n",
+		name, Blocking ? "block" : "spin", sizeof(P), producers, consumers, seconds * 1e9 / total, total / seconds / 1e6,
+		percentile(0.5), percentile(0.99), percentile(0.999), all.empty() ? 0.0 : all.back() / 1e3, ok ? "ok" : "FAILED");
+}
+
+// every shape the queue supports, for one payload.
+template<template<typename> class Queue, typename P, bool Blocking>
+void shapes(const char* name, bool sp, bool sc, size_t threads, size_t per_producer) {
+	for (size_t producers : { size_t(1), threads }) {
+		for (size_t consumers : { size_t(1), threads }) {
+			if ((sp && producers > 1) || (sc && consumers > 1))
+				continue;
+			// the same number of items for every shape.
+			size_t items = per_producer * threads / producers;
+			run<Queue<P>, P, Blocking>(name, producers, consumers, items);
+			if (threads == 1)
+				return;
+		}
+	}
+}
+
+template<template<typename> class Queue, bool Blocking>
+void matrix(const char* name, bool sp, bool sc, size_t threads, size_t per_producer) {
+	if (!std::strstr(name, filter))
+		return;
+	shapes<Queue, Payload<8>, Blocking>(name, sp, sc, threads, per_producer);
+	shapes<Queue, Payload<64>, Blocking>(name, sp, sc, threads, per_producer);
+	shapes<Queue, Payload<512>, Blocking>(name, sp, sc, threads, per_producer);
+}
+
+int main(int argc, char** argv) {
+	size_t per_producer = argc > 1 ? std::max<size_t>(kSampleEvery, std::strtoul(argv[1], nullptr, 10)) : 100000;
+	size_t threads = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4;
+	filter = argc > 3 ? argv[3] : "";
+
+	matrix<Lock, false>("UnboundedLockQueue", false, false, threads, per_producer);
+	matrix<Lock, true>("UnboundedLockQueue", false, false, threads, per_producer);
+	matrix<SpscSpin, false>("USPSCQueue", true, true, threads, per_producer);
+	matrix<SpscBlock, true>("USPSCQueue", true, true, threads, per_producer);
+	matrix<MpscSpin, false>("UMPSCQueue", false, true, threads, per_producer);
+	matrix<MpscBlock, true>("UMPSCQueue", false, true, threads, per_producer);
+	matrix<SpmcSpin, false>("USPMCQueue", true, false, threads, per_producer);
+	matrix<SpmcBlock, true>("USPMCQueue", true, false, threads, per_producer);
+	matrix<MpmcSpin, false>("UMPMCQueue", false, false, threads, per_producer);
+	matrix<MpmcBlock, true>("UMPMCQueue", false, false, threads, per_producer);
+	matrix<Sharded, false>("ConcurrentQueue", false, false, threads, per_producer);
+	matrix<ShardedBlock, true>("ConcurrentQueue", false, false, threads, per_producer);
+	matrix<Ring, false>("MPMCQueue", false, false, threads, per_producer);
+	matrix<Ring, true>("MPMCQueue", false, false, threads, per_producer);
+	matrix<SpscRing, false>("ProducerConsumerQueue", true, true, threads, per_producer);
+	matrix<DynamicSpin, false>("DMPMCQueue", false, false, threads, per_producer);
+	matrix<DynamicBlock, true>("DMPMCQueue", false, false, threads, per_producer);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+// Recursive parallel quicksort where every task waits with waitFor() on the
+// future of the half it spawned, so the blocked workers keep sorting. Then
+// a plain get() inside a task, which only helps with cooperative_wait set:
+// by default it blocks and runs nothing on the waiter's stack.
+//
+//   usage: quicksort_bench [elements = 10000000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<random>
+#include<algorithm>
+#include<atomic>
+#include<thread>
+#include<cstdio>
+
+#include"../booty/ThreadPool.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+static const size_t kCutoff = 4096;
+
+void quicksort(ThreadPool& pool, int* first, int* last) {
+	while (static_cast<size_t>(last - first) > kCutoff) {
+		int pivot = first[(last - first) / 2];
+		int* middle = std::partition(first, last, [pivot](int x) { return x < pivot; });
+		int* upper = std::partition(middle, last, [pivot](int x) { return !(pivot < x); });
+		auto left = pool.submitTask([&pool, first, middle] { quicksort(pool, first, middle); });
+		quicksort(pool, upper, last);
+		pool.waitFor(left);  // a worker runs other tasks meanwhile.
+		left.get();
+		return;
+	}
+	std::sort(first, last);
+}
+
+double timeSort(ThreadPool* pool, std::vector<int> data, bool use_wait_for) {
+	auto start = steady_clock::now();
+	if (!pool) {
+		std::sort(data.begin(), data.end());
+	}
+	else if (use_wait_for) {
+		// the caller is not a worker: waitFor() lets it help too.
+		auto root = pool->submitTask([pool, &data] { quicksort(*pool, data.data(), data.data() + data.size()); });
+		pool->waitFor(root);
+		root.get();
+	}
+	else {
+		quicksort(*pool, data.data(), data.data() + data.size());
+	}
+	double ms = duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count();
+	if (!std::is_sorted(data.begin(), data.end()))
+		std::printf("NOT SORTED\n");
+	return ms;
+}
+
+static thread_local bool in_get = false;
+
+// a task blocks in get() on a result an outside thread delivers, while
+// other tasks are queued; counts the queued tasks that ran on its stack.
+size_t reentered(const ThreadPoolOptions& options) {
+	ThreadPool pool(options);
+	std::atomic<size_t> nested{ 0 };
+	auto contract = Promise<void>::makeContract();
+	auto outer = pool.submitTask([&] {
+		std::vector<Future<void>> others;
+		for (int i = 0; i < 64; ++i)
+			others.push_back(pool.submitTask([&] { nested.fetch_add(in_get ? 1 : 0); }));
+		in_get = true;
+		contract.second.get();
+		in_get = false;
+		pool.waitFor(others);
+	});
+	std::this_thread::sleep_for(milliseconds(20));
+	contract.first.setValue();
+	outer.get();
+	return nested.load();
+}
+
+int main(int argc, char** argv) {
+	size_t n = argc > 1 ? std::stoul(argv[1]) : 10000000;
+	std::vector<int> data(n);
+	std::mt19937 rng(42);
+	for (auto& x : data)
+		x = static_cast<int>(rng());
+
+	ThreadPool pool;
+	std::printf("%zu ints, pool of up to %zu workers\n", n, pool.maxThreadCount());
+	std::printf("std::sort                  %9.2fms\n", timeSort(nullptr, data, false));
+	std::printf("quicksort from main thread %9.2fms\n", timeSort(&pool, data, false));
+	std::printf("quicksort via waitFor()    %9.2fms\n", timeSort(&pool, data, true));
+	std::printf("workers launched: %zu\n", pool.threadCount());
+
+	ThreadPoolOptions cooperative;
+	cooperative.cooperative_wait = true;
+	size_t plain = reentered(ThreadPoolOptions());
+	size_t helped = reentered(cooperative);
+	bool ok = plain == 0 && helped > 0;
+	std::printf("tasks run inside a plain get(): %zu by default, %zu with cooperative_wait  %s\n",
+		plain, helped, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+// Per-key ordered jobs on ThreadPool: every key sees its items in
+// submission order, keys run in parallel. Compares
+// - the old way: pool tasks locking a per-key mutex around the job,
+//   which holds ordering only by luck and blocks pool threads,
+// - KeyedSerialExecutor with one item per drain (batch 1),
+// - KeyedSerialExecutor with the default batch.
+// Reports throughput and the number of items that ran out of order, and
+// the allocations per item of a strand in a steady state.
+//
+//   usage: serial_executor_bench [keys = 64] [items per key = 20000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<mutex>
+#include<memory>
+#include<cstdio>
+#include<cstdlib>
+#include<new>
+
+#include"../booty/SerialExecutor.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+// count every global allocation made by the process.
+static std::atomic<size_t> g_allocs{ 0 };
+
+void* operator new(std::size_t size) {
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+// a short job, roughly what a session update costs.
+static unsigned work(unsigned seed) {
+	for (int i = 0; i < 200; ++i)
+		seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+struct Session {
+	std::mutex mtx;
+	size_t next = 0;        // sequence number expected next
+	size_t reordered = 0;
+	unsigned state = 0;
+
+	void apply(size_t seq) {
+		if (seq != next)
+			++reordered;
+		next = seq + 1;
+		state = work(state + static_cast<unsigned>(seq));
+	}
+};
+
+static void report(const char* name, double seconds, size_t items, std::vector<std::unique_ptr<Session>>& sessions) {
+	size_t reordered = 0;
+	for (auto& session : sessions)
+		reordered += session->reordered;
+	std::printf("%-26s %8.1f ns/item   %9.0f items/s   reordered %zu\n",
+		name, seconds * 1e9 / items, items / seconds, reordered);
+}
+
+static std::vector<std::unique_ptr<Session>> makeSessions(size_t keys) {
+	std::vector<std::unique_ptr<Session>> sessions;
+	for (size_t i = 0; i < keys; ++i)
+		sessions.emplace_back(std::make_unique<Session>());
+	return sessions;
+}
+
+void lockedTasks(ThreadPool& pool, size_t keys, size_t per_key) {
+	auto sessions = makeSessions(keys);
+	std::atomic<size_t> done{ 0 };
+	auto start = steady_clock::now();
+	for (size_t seq = 0; seq < per_key; ++seq) {
+		for (size_t key = 0; key < keys; ++key) {
+			Session* session = sessions[key].get();
+			pool.execute([session, seq, &done] {
+				{
+					std::lock_guard<std::mutex> lock(session->mtx);
+					session->apply(seq);
+				}
+				done.fetch_add(1, std::memory_order_release);
+			});
+		}
+	}
+	while (done.load(std::memory_order_acquire) != keys * per_key)
+		pool.tryRunTask();
+	report("mutex inside pool tasks", duration<double>(steady_clock::now() - start).count(), keys * per_key, sessions);
+}
+
+void strands(const char* name, ThreadPool& pool, size_t batch, size_t keys, size_t per_key) {
+	auto sessions = makeSessions(keys);
+	auto start = steady_clock::now();
+	{
+		KeyedSerialExecutor<size_t> executor(pool, 0, batch);
+		for (size_t seq = 0; seq < per_key; ++seq) {
+			for (size_t key = 0; key < keys; ++key) {
+				Session* session = sessions[key].get();
+				executor.execute(key, [session, seq] { session->apply(seq); });
+			}
+		}
+	}  // waits for every strand to drain.
+	report(name, duration<double>(steady_clock::now() - start).count(), keys * per_key, sessions);
+}
+
+// one worker, a hot strand with many items and a cold one with a single
+// item queued behind it: the hot drain must hand the worker over after a
+// batch, so returns how many hot items ran before the cold one.
+size_t hotItemsBeforeCold(size_t batch) {
+	ThreadPool pool(1);
+	auto gate = Promise<void>::makeContract();
+	pool.execute([&gate] { gate.second.wait(); });  // hold the worker until both strands are queued.
+	std::atomic<size_t> hot_done{ 0 };
+	SerialExecutor hot(pool, batch), cold(pool, batch);
+	for (size_t i = 0; i < 100 * batch; ++i)
+		hot.execute([&hot_done] { hot_done.fetch_add(1, std::memory_order_relaxed); });
+	auto before = cold.submitTask([&hot_done] { return hot_done.load(std::memory_order_relaxed); });
+	gate.first.setValue();
+	// a plain get(), so that only the worker runs the strands; the
+	// destructors then wait for the rest of the hot strand.
+	return before.get();
+}
+
+// bursts of `burst` items into one strand, each waited for: allocations
+// per item once the strand has warmed up.
+double allocsPerItem(ThreadPool& pool, size_t burst, size_t rounds) {
+	SerialExecutor strand(pool);
+	std::atomic<size_t> sum{ 0 };
+	auto run = [&](size_t count) {
+		for (size_t r = 0; r < count; ++r) {
+			for (size_t i = 0; i < burst; ++i)
+				strand.execute([&sum, i] { sum.fetch_add(i, std::memory_order_relaxed); });
+			while (strand.pending() > 0) {
+				if (!pool.tryRunTask())
+					std::this_thread::yield();
+			}
+		}
+	};
+	run(16);
+	size_t before = g_allocs.load();
+	run(rounds);
+	return double(g_allocs.load() - before) / double(burst * rounds);
+}
+
+int main(int argc, char** argv) {
+	size_t keys = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+	size_t per_key = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000;
+
+	ThreadPool pool;
+	std::printf("%zu keys x %zu items, pool of up to %zu workers\n", keys, per_key, pool.maxThreadCount());
+	lockedTasks(pool, keys, per_key);
+	strands("strands, batch 1", pool, 1, keys, per_key);
+	strands("strands, batch 64", pool, SerialExecutor::kDefaultBatch, keys, per_key);
+
+	// submitTask() of a strand, and ordering of a single hot key.
+	SerialExecutor strand(pool);
+	std::vector<Future<size_t>> results;
+	size_t last = 0;
+	bool ordered = true;
+	for (size_t i = 0; i < 1000; ++i)
+		results.push_back(strand.submitTask([&last, &ordered, i] {
+			ordered = ordered && last == i;
+			last = i + 1;
+			return i;
+		}));
+	pool.waitFor(results);
+	std::printf("hot key: %s, last result %zu\n", ordered ? "in order" : "OUT OF ORDER", results.back().get());
+
+	// strands on a pool with other queue and wait policies.
+	using OtherPool = BasicThreadPool<policy::LockQueue, policy::CondVarWait>;
+	OtherPool other;
+	auto sessions = makeSessions(4);
+	{
+		KeyedSerialExecutor<size_t, std::hash<size_t>, OtherPool> executor(other);
+		for (size_t seq = 0; seq < 1000; ++seq)
+			for (size_t key = 0; key < sessions.size(); ++key)
+				executor.execute(key, [session = sessions[key].get(), seq] { session->apply(seq); });
+	}
+	size_t reordered = 0;
+	for (auto& session : sessions)
+		reordered += session->reordered + (session->next != 1000);
+	std::printf("keyed strands on BasicThreadPool<LockQueue, CondVarWait>: %s\n", reordered == 0 ? "in order" : "OUT OF ORDER");
+	ordered = ordered && reordered == 0;
+
+	size_t before = hotItemsBeforeCold(SerialExecutor::kDefaultBatch);
+	bool fair = before <= 2 * SerialExecutor::kDefaultBatch;
+	std::printf("two strands on one worker: %zu hot items ran before the cold one  %s\n", before, fair ? "ok" : "FAILED");
+
+	// nodes are recycled while the backlog fits the strand's cache, past
+	// it the surplus is freed and allocated again.
+	double steady = allocsPerItem(pool, SerialExecutor::kDefaultBatch, 2000);
+	bool recycled = steady < 0.01;
+	std::printf("bursts of %zu items: %.4f allocs/item  %s\n", SerialExecutor::kDefaultBatch, steady, recycled ? "ok" : "FAILED");
+	std::printf("bursts of 4096 items: %.4f allocs/item\n", allocsPerItem(pool, 4096, 50));
+	return ordered && fair && recycled ? 0 : 1;
+}
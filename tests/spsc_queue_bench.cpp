@@ -0,0 +1,174 @@
+// ProducerConsumerQueue against USPSCQueue and MPMCQueue on a
+// single-producer single-consumer hand-off of 8-byte items:
+// - one at a time: write/read, retried with a pause and then a yield when
+//   the queue is full or empty.
+// - batched: write_n/read_n with runs of `batch` items.
+// The consumer checks that the items come out in order. Then the edge
+// cases: capacity rounding, full and empty, frontPtr/popFront, partial
+// and wrapping runs, leftovers.
+//
+// Build with booty/concurrency/HazardPtr.cpp for USPSCQueue.
+//
+//   usage: spsc_queue_bench [items = 50000000] [capacity = 4096] [batch = 64]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<thread>
+#include<string>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/Asm.h"
+#include"../booty/concurrency/ProducerConsumerQueue.hpp"
+#include"../booty/concurrency/MPMCQueue.hpp"
+#include"../booty/concurrency/UnboundedQueue.hpp"
+
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+static size_t queue_capacity = 4096;
+
+// spins are cheap between two cores, but on a single one the other side
+// has to be let in.
+struct Backoff {
+	void operator()() {
+		if (++spins_ < 128)
+			asm_volatile_pause();
+		else
+			std::this_thread::yield();
+	}
+	void reset() { spins_ = 0; }
+
+private:
+	unsigned spins_ = 0;
+};
+
+// the interface run() expects, on top of each queue.
+struct Ring :ProducerConsumerQueue<uint64_t> {
+	Ring() :ProducerConsumerQueue<uint64_t>(queue_capacity) {}
+	bool push(uint64_t item) { return write(item); }
+	bool pop(uint64_t& item) { return read(item); }
+};
+
+struct Bounded :MPMCQueue<uint64_t> {
+	Bounded() :MPMCQueue<uint64_t>(queue_capacity) {}
+	bool push(uint64_t item) { return write(item); }
+	bool pop(uint64_t& item) { return read(item); }
+};
+
+struct Unbounded :USPSCQueue<uint64_t, false> {
+	bool push(uint64_t item) { enqueue(item); return true; }
+	bool pop(uint64_t& item) { return try_dequeue(item); }
+};
+
+static void report(const char* name, size_t items, double seconds, bool ok) {
+	failed = failed || !ok;
+	std::printf("%-30s %8.2f ns/item %8.1f M items/s  %s\n", name, seconds * 1e9 / items, items / seconds / 1e6,
+		ok ? "ok" : "FAILED");
+}
+
+template<class Queue>
+void run(const char* name, size_t items) {
+	Queue queue;
+	bool ok = true;
+	auto start = steady_clock::now();
+	std::thread consumer([&] {
+		Backoff backoff;
+		for (uint64_t expected = 0; expected < items; ++expected) {
+			uint64_t item;
+			while (!queue.pop(item))
+				backoff();
+			backoff.reset();
+			ok = ok && item == expected;
+		}
+	});
+	Backoff backoff;
+	for (uint64_t item = 0; item < items; ++item) {
+		while (!queue.push(item))
+			backoff();
+		backoff.reset();
+	}
+	consumer.join();
+	report(name, items, duration<double>(steady_clock::now() - start).count(), ok);
+}
+
+void runBatched(size_t items, size_t batch) {
+	Ring queue;
+	bool ok = true;
+	auto start = steady_clock::now();
+	std::thread consumer([&] {
+		Backoff backoff;
+		std::vector<uint64_t> out(batch);
+		uint64_t expected = 0;
+		while (expected < items) {
+			size_t got = queue.read_n(out.begin(), batch);
+			if (got == 0) {
+				backoff();
+				continue;
+			}
+			backoff.reset();
+			for (size_t i = 0; i < got; ++i)
+				ok = ok && out[i] == expected++;
+		}
+	});
+	Backoff backoff;
+	std::vector<uint64_t> in(batch);
+	for (uint64_t next = 0; next < items;) {
+		size_t n = std::min<uint64_t>(batch, items - next);
+		for (size_t i = 0; i < n; ++i)
+			in[i] = next + i;
+		size_t written = 0;
+		while ((written += queue.write_n(in.begin() + written, n - written)) < n)
+			backoff();
+		backoff.reset();
+		next += n;
+	}
+	consumer.join();
+	char name[64];
+	std::snprintf(name, sizeof(name), "PCQueue write_n/read_n x%zu", batch);
+	report(name, items, duration<double>(steady_clock::now() - start).count(), ok);
+}
+
+void edgeCases() {
+	ProducerConsumerQueue<std::string> queue(5);
+	bool ok = queue.capacity() == 8 && queue.isEmpty() && !queue.isFull() && queue.frontPtr() == nullptr;
+	std::string text;
+	ok = ok && !queue.read(text);
+	for (int i = 0; i < 8; ++i)
+		ok = ok && queue.write(std::string(64, 'x') + std::to_string(i));
+	ok = ok && queue.isFull() && !queue.write("overflow") && queue.sizeGuess() == 8;
+	ok = ok && queue.frontPtr() && *queue.frontPtr() == std::string(64, 'x') + "0";
+	queue.popFront();
+	ok = ok && queue.read(text) && text == std::string(64, 'x') + "1";
+	std::printf("capacity, full, empty, frontPtr: %s\n", ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+
+	// 6 items at [2, 8), a run of 5 can only place 2 and wraps to slot 0.
+	std::vector<std::string> in;
+	for (int i = 8; i < 13; ++i)
+		in.push_back(std::string(64, 'x') + std::to_string(i));
+	ok = queue.write_n(in.begin(), in.size()) == 2 && in[0].empty() && in[2].size() == 66 && queue.isFull();
+	std::vector<std::string> out(5);
+	ok = ok && queue.read_n(out.begin(), 5) == 5 && out[0] == std::string(64, 'x') + "2" && out[4] == std::string(64, 'x') + "6";
+	ok = ok && queue.write_n(in.begin() + 2, 3) == 3 && queue.sizeGuess() == 6;
+	// the remaining run wraps from slot 7 to slot 0 on the way out.
+	std::vector<std::string> rest(10);
+	ok = ok && queue.read_n(rest.begin(), 4) == 4 && rest[0] == std::string(64, 'x') + "7" && rest[3] == std::string(64, 'x') + "10";
+	std::printf("partial and wrapping runs, %zu items left to the destructor: %s\n", queue.sizeGuess(), ok ? "ok" : "FAILED");
+	failed = failed || !ok;
+}
+
+int main(int argc, char** argv) {
+	size_t items = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50000000;
+	queue_capacity = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4096;
+	size_t batch = argc > 3 ? std::max<size_t>(1, std::strtoul(argv[3], nullptr, 10)) : 64;
+
+	run<Ring>("PCQueue write/read", items);
+	runBatched(items, batch);
+	run<Bounded>("MPMCQueue write/read", items);
+	run<Unbounded>("USPSCQueue enqueue/try_dequeue", items);
+	edgeCases();
+	return failed ? 1 : 0;
+}
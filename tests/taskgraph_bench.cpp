@@ -0,0 +1,107 @@
+// Runs a layered pipeline DAG with booty::graph::TaskGraph and compares it
+// with submitting layer by layer and waiting on futures in between.
+//
+//   usage: taskgraph_bench [layers = 50] [width = 8] [runs = 20]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<string>
+#include<cstdio>
+
+#include"../booty/graph/TaskGraph.hpp"
+
+using namespace booty;
+using namespace booty::graph;
+using namespace std::chrono;
+
+// a few microseconds of work per stage.
+static unsigned spin(unsigned seed, int rounds) {
+	for (int i = 0; i < rounds; ++i)
+		seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+static std::atomic<unsigned> sink{ 0 };
+
+// every stage depends on the stage above it and its right neighbour above;
+// one column is 10x heavier, so it forms the critical path.
+void build(TaskGraph& graph, size_t layers, size_t width) {
+	std::vector<TaskGraph::NodeId> above;
+	for (size_t l = 0; l < layers; ++l) {
+		std::vector<TaskGraph::NodeId> current;
+		for (size_t w = 0; w < width; ++w) {
+			int rounds = w == 0 ? 20000 : 2000;
+			current.push_back(graph.emplace("s" + std::to_string(l) + "." + std::to_string(w), [rounds, l, w] {
+				sink.fetch_add(spin(static_cast<unsigned>(l * 31 + w), rounds), std::memory_order_relaxed);
+			}));
+			if (!above.empty()) {
+				graph.precede(above[w], current.back());
+				graph.precede(above[(w + 1) % width], current.back());
+			}
+		}
+		above = std::move(current);
+	}
+}
+
+double layerByLayer(ThreadPool& pool, size_t layers, size_t width) {
+	auto start = steady_clock::now();
+	for (size_t l = 0; l < layers; ++l) {
+		std::vector<Future<void>> results;
+		for (size_t w = 0; w < width; ++w) {
+			int rounds = w == 0 ? 20000 : 2000;
+			results.push_back(pool.submitTask([rounds, l, w] {
+				sink.fetch_add(spin(static_cast<unsigned>(l * 31 + w), rounds), std::memory_order_relaxed);
+			}));
+		}
+		for (auto& result : results)
+			result.get();
+	}
+	return duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+	size_t layers = argc > 1 ? std::stoul(argv[1]) : 50;
+	size_t width = argc > 2 ? std::stoul(argv[2]) : 8;
+	int runs = argc > 3 ? std::stoi(argv[3]) : 20;
+	ThreadPool pool;
+
+	TaskGraph graph;
+	build(graph, layers, width);
+	double best = 1e300;
+	for (int r = 0; r < runs; ++r)
+		best = std::min(best, graph.run(pool).elapsed.count() / 1e6);
+	const auto& report = graph.lastReport();
+	std::printf("%zu stages on %zu workers\n", graph.size(), pool.threadCount());
+	std::printf("task graph     best %8.3fms\n", best);
+	double baseline = 1e300;
+	for (int r = 0; r < runs; ++r)
+		baseline = std::min(baseline, layerByLayer(pool, layers, width));
+	std::printf("layer by layer best %8.3fms\n", baseline);
+	std::printf("last run: elapsed %.3fms, work %.3fms, critical path %.3fms over %zu stages, parallelism %.2f\n",
+		report.elapsed.count() / 1e6, report.total_work.count() / 1e6, report.critical_path.count() / 1e6,
+		report.critical_nodes.size(), report.parallelism());
+
+	// any BasicThreadPool runs the graph.
+	BasicThreadPool<policy::LockQueue, policy::CondVarWait> other;
+	std::printf("on BasicThreadPool<LockQueue, CondVarWait>: %.3fms\n", graph.run(other).elapsed.count() / 1e6);
+
+	TaskGraph failing;
+	auto a = failing.emplace("a", [] {});
+	auto b = failing.emplace("b", [] { throw std::runtime_error("stage b failed"); });
+	failing.precede(a, b);
+	try {
+		failing.run(pool);
+	}
+	catch (const std::runtime_error& e) {
+		std::printf("rethrown: %s\n", e.what());
+	}
+	failing.precede(b, a);
+	try {
+		failing.run(pool);
+	}
+	catch (const std::logic_error& e) {
+		std::printf("rejected: %s\n", e.what());
+	}
+	return sink.load() == 42 ? 1 : 0;
+}
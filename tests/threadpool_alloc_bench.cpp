@@ -0,0 +1,69 @@
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<cstdio>
+#include<cstdlib>
+#include<new>
+
+#include"../booty/ThreadPool.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+// count every global allocation made by the process.
+static std::atomic<size_t> g_allocs{ 0 };
+
+void* operator new(std::size_t size) {
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+// submit `batch` small tasks, wait for them, repeat `rounds` times.
+void run(ThreadPool& pool, size_t rounds, size_t batch, const char* name) {
+	auto probe = [] { return 0; };
+	using Future = decltype(pool.submitTask(probe));
+	std::vector<Future> results;
+	results.reserve(batch);
+	long sum = 0;
+	// warm up: grow deques, launch workers, fill caches.
+	for (size_t i = 0; i < batch; ++i)
+		results.push_back(pool.submitTask([i] { return static_cast<int>(i); }));
+	for (auto& result : results)
+		sum += result.get();
+	results.clear();
+
+	size_t allocs_before = g_allocs.load();
+	auto start = steady_clock::now();
+	for (size_t r = 0; r < rounds; ++r) {
+		for (size_t i = 0; i < batch; ++i)
+			results.push_back(pool.submitTask([i, r](int k) { return static_cast<int>(i + r) + k; }, 1));
+		for (auto& result : results)
+			sum += result.get();
+		results.clear();
+	}
+	auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+	size_t allocs = g_allocs.load() - allocs_before;
+	double tasks = double(rounds * batch);
+	std::printf("%-24s %10.2f allocs/task %10.1f ns/task (checksum %ld)\n",
+		name, allocs / tasks, elapsed / tasks, sum);
+}
+
+int main(int argc, char** argv) {
+	size_t rounds = argc > 1 ? std::stoul(argv[1]) : 200;
+	ThreadPool pool(1);
+	run(pool, rounds, 1000, "submitTask, 1 worker");
+	ThreadPool wide;
+	run(wide, rounds, 1000, "submitTask, default pool");
+	return 0;
+}
@@ -0,0 +1,280 @@
+// A producer floods a pool with tasks far faster than it can run them.
+// Unbounded, the queue grows with the burst; with a capacity each
+// overflow policy turns the pool into a backpressure point instead.
+// Reports the deepest queue seen, the producer's rate, and where the
+// tasks ended up. Then the cases a bounded pool must get right: a
+// submission with nothing to drop, and continuations of admitted work
+// (parallel_for, TaskGraph, strands) on a full queue.
+//
+//   usage: threadpool_backpressure_bench [tasks = 200000] [capacity = 1000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<algorithm>
+#include<string>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/Parallel.hpp"
+#include"../booty/SerialExecutor.hpp"
+#include"../booty/ThreadPool.hpp"
+#include"../booty/graph/TaskGraph.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+// a couple of microseconds of work.
+static unsigned work(unsigned seed) {
+	for (int i = 0; i < 2000; ++i)
+		seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+static std::atomic<unsigned> sink{ 0 };
+
+struct Outcome {
+	size_t ran = 0;
+	size_t inline_runs = 0;
+	size_t refused = 0;
+	size_t peak = 0;
+	double seconds = 0;
+};
+
+template<class Submit>
+Outcome flood(ThreadPool& pool, size_t tasks, Submit&& submit) {
+	Outcome outcome;
+	std::atomic<size_t> ran{ 0 };
+	std::atomic<size_t> inline_runs{ 0 };
+	auto producer = std::this_thread::get_id();
+	auto start = steady_clock::now();
+	for (size_t i = 0; i < tasks; ++i) {
+		bool queued = submit([&ran, &inline_runs, producer, i] {
+			sink.fetch_add(work(static_cast<unsigned>(i)), std::memory_order_relaxed);
+			if (std::this_thread::get_id() == producer)
+				inline_runs.fetch_add(1, std::memory_order_relaxed);
+			ran.fetch_add(1, std::memory_order_release);
+		});
+		if (!queued)
+			++outcome.refused;
+		if (i % 64 == 0)
+			outcome.peak = std::max(outcome.peak, pool.pendingTasks());
+	}
+	outcome.seconds = duration<double>(steady_clock::now() - start).count();
+	outcome.inline_runs = inline_runs.load(std::memory_order_relaxed);
+	// whatever was neither refused nor dropped is still coming.
+	while (pool.pendingTasks() > 0)
+		pool.tryRunTask();
+	pool.close();
+	outcome.ran = ran.load(std::memory_order_acquire);
+	return outcome;
+}
+
+void report(const char* name, size_t tasks, const Outcome& outcome) {
+	size_t dropped = tasks - outcome.ran - outcome.refused;
+	std::printf("%-24s peak queue %7zu   producer %7.0f tasks/ms   ran %6zu (%6zu by the producer)   refused %6zu   dropped %6zu\n",
+		name, outcome.peak, tasks / outcome.seconds / 1e3, outcome.ran, outcome.inline_runs, outcome.refused, dropped);
+}
+
+ThreadPoolOptions bounded(size_t capacity, OverflowPolicy policy) {
+	ThreadPoolOptions options;
+	options.capacity = capacity;
+	options.overflow = policy;
+	return options;
+}
+
+void run(const char* name, const ThreadPoolOptions& options, size_t tasks) {
+	ThreadPool pool(options);
+	report(name, tasks, flood(pool, tasks, [&pool](auto&& task) {
+		try {
+			pool.execute(task);
+			return true;
+		}
+		catch (const QueueFull&) {
+			return false;
+		}
+	}));
+}
+
+// DISCARD_OLDEST with only a HIGH task queued, which is never dropped: a
+// submission gives up after kDiscardWait, or as soon as the pool pauses.
+bool nothingToDrop() {
+	auto gate = Promise<void>::makeContract();  // outlives the worker waiting on it.
+	ThreadPoolOptions options = bounded(1, OverflowPolicy::DISCARD_OLDEST);
+	options.max_threads = 1;
+	ThreadPool pool(options);
+	std::atomic<bool> started{ false };
+	pool.execute([&] {
+		started.store(true);
+		gate.second.wait();
+	});
+	while (!started.load())
+		std::this_thread::yield();  // the worker holds the gate, the queue is empty.
+	pool.execute(Priority::HIGH, [] {});
+
+	auto attempt = [&pool]()->const char* {
+		try {
+			pool.execute([] {});
+			return "admitted";
+		}
+		catch (const QueueFull&) {
+			return "QueueFull";
+		}
+		catch (const std::runtime_error&) {
+			return "refused";
+		}
+	};
+	auto start = steady_clock::now();
+	const char* full = attempt();
+	double full_ms = duration<double, std::milli>(steady_clock::now() - start).count();
+	std::thread pauser([&pool] {
+		std::this_thread::sleep_for(milliseconds(10));
+		pool.pause();
+	});
+	start = steady_clock::now();
+	const char* paused = attempt();
+	double paused_ms = duration<double, std::milli>(steady_clock::now() - start).count();
+	pauser.join();
+	pool.unpause();
+	gate.first.setValue();
+
+	bool ok = std::string(full) == "QueueFull" && std::string(paused) == "refused" && paused_ms < full_ms;
+	std::printf("nothing to drop: %s after %.1fms, paused meanwhile: %s after %.1fms  %s\n",
+		full, full_ms, paused, paused_ms, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static const char* policyName(OverflowPolicy policy) {
+	switch (policy) {
+	case OverflowPolicy::BLOCK: return "BLOCK";
+	case OverflowPolicy::REJECT: return "REJECT";
+	case OverflowPolicy::CALLER_RUNS: return "CALLER_RUNS";
+	default: return "DISCARD_OLDEST";
+	}
+}
+
+// The continuations of admitted work on a full queue, its only worker held:
+// parallel_for's split-offs, TaskGraph's nodes and a strand's drain must be
+// queued past the capacity, and never dropped by the user submissions that
+// follow them (DISCARD_OLDEST). Before, they were refused, blocked the
+// caller for good, or were dropped and hung their waiter.
+bool continuationsAdmitted(OverflowPolicy policy) {
+	auto gate = Promise<void>::makeContract();
+	ThreadPoolOptions options = bounded(4, policy);
+	options.max_threads = 1;
+	ThreadPool pool(options);
+	std::atomic<bool> started{ false };
+	pool.execute([&] {
+		started.store(true);
+		gate.second.wait();
+	});
+	while (!started.load())
+		std::this_thread::yield();
+	// LOW tasks fill the queue but leave the injection queue empty, so
+	// parallel_for still splits.
+	auto fill = [&pool] {
+		while (pool.pendingTasks() < 4)
+			pool.execute(Priority::LOW, [] {});
+	};
+	// the user submissions DISCARD_OLDEST makes room for.
+	auto flood = [&pool, policy] {
+		if (policy == OverflowPolicy::DISCARD_OLDEST)
+			for (int i = 0; i < 10; ++i)
+				pool.execute([] {});
+	};
+
+	bool ok = true, released = false;
+	try {
+		fill();
+		std::atomic<size_t> sum{ 0 };
+		parallel_for(pool, size_t(0), size_t(1000), [&](size_t i) {
+			if (i == 0)
+				flood();
+			sum.fetch_add(i, std::memory_order_relaxed);
+		}, 10);
+		ok = ok && sum.load() == 999 * 1000 / 2;
+
+		fill();
+		graph::TaskGraph graph;
+		std::atomic<int> nodes{ 0 };
+		auto first = graph.emplace("first", [&] { nodes.fetch_add(1); });
+		for (int i = 0; i < 3; ++i)
+			graph.precede(first, graph.emplace("next", [&] { nodes.fetch_add(1); }));
+		graph.emplace("root", [&] { flood(); nodes.fetch_add(1); });
+		graph.run(pool);
+		ok = ok && nodes.load() == 5;
+
+		fill();
+		std::atomic<bool> ran{ false };
+		{
+			SerialExecutor strand(pool);
+			strand.execute([&ran] { ran.store(true); });
+			flood();
+			released = true;
+			gate.first.setValue();
+		}  // waits for the strand.
+		ok = ok && ran.load();
+	}
+	catch (const std::exception& e) {
+		std::printf("  %s\n", e.what());
+		ok = false;
+	}
+	if (!released)
+		gate.first.setValue();
+	std::printf("continuations on a full %s queue: %s\n", policyName(policy), ok ? "ok" : "FAILED");
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	size_t tasks = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+	size_t capacity = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+
+	std::printf("%zu tasks, capacity %zu\n", tasks, capacity);
+	run("unbounded", ThreadPoolOptions(), tasks);
+	run("BLOCK", bounded(capacity, OverflowPolicy::BLOCK), tasks);
+	ThreadPoolOptions timed = bounded(capacity, OverflowPolicy::BLOCK);
+	timed.block_timeout = milliseconds(1);
+	run("BLOCK, 1ms timeout", timed, tasks);
+	run("REJECT", bounded(capacity, OverflowPolicy::REJECT), tasks);
+	run("CALLER_RUNS", bounded(capacity, OverflowPolicy::CALLER_RUNS), tasks);
+	run("DISCARD_OLDEST", bounded(capacity, OverflowPolicy::DISCARD_OLDEST), tasks);
+
+	{
+		ThreadPool pool(bounded(capacity, OverflowPolicy::BLOCK));
+		std::vector<Future<size_t>> futures;
+		report("trySubmit", tasks, flood(pool, tasks, [&pool, &futures](auto&& task) {
+			auto future = pool.trySubmit([task]() mutable { task(); return size_t(1); });
+			if (future)
+				futures.push_back(std::move(*future));
+			return future.has_value();
+		}));
+	}
+
+	// a future whose task was dropped is broken rather than left hanging.
+	ThreadPoolOptions options = bounded(1, OverflowPolicy::DISCARD_OLDEST);
+	options.min_threads = 0;
+	options.max_threads = 1;
+	ThreadPool pool(options);
+	pool.execute([] { std::this_thread::sleep_for(milliseconds(20)); });
+	auto first = pool.submitTask([] { return 1; });
+	auto second = pool.submitTask([] { return 2; });
+	try {
+		first.get();
+		std::printf("dropped future: ready?!\n");
+	}
+	catch (const BrokenPromise&) {
+		std::printf("dropped future: BrokenPromise, survivor returned %d\n", second.get());
+	}
+	// a continuation lost for good hangs its waiter: fail instead.
+	std::thread([] {
+		std::this_thread::sleep_for(seconds(60));
+		std::printf("hung\n");
+		std::fflush(stdout);
+		std::_Exit(1);
+	}).detach();
+	bool ok = nothingToDrop();
+	for (auto policy : { OverflowPolicy::BLOCK, OverflowPolicy::REJECT, OverflowPolicy::CALLER_RUNS, OverflowPolicy::DISCARD_OLDEST })
+		ok = continuationsAdmitted(policy) && ok;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<cstdio>
+
+#include"../booty/ThreadPool.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+// a few hundred nanoseconds of work, small enough to stress the queues.
+static unsigned spin(unsigned seed) {
+	for (int i = 0; i < 200; ++i)
+		seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+static std::atomic<unsigned> sink{ 0 };
+
+// every task is submitted from the main thread: stresses the injection queue.
+double flatSubmit(ThreadPool& pool, size_t tasks) {
+	auto start = steady_clock::now();
+	std::vector<Future<void>> results;
+	results.reserve(tasks);
+	for (size_t i = 0; i < tasks; ++i) {
+		results.push_back(pool.submitTask([i] {
+			sink.fetch_add(spin(static_cast<unsigned>(i)), std::memory_order_relaxed);
+		}));
+	}
+	for (auto& result : results)
+		result.get();
+	return duration_cast<duration<double>>(steady_clock::now() - start).count();
+}
+
+// a few roots fan out on the workers: stresses local push/pop and stealing.
+double nestedSubmit(ThreadPool& pool, size_t roots, size_t fanout) {
+	std::atomic<size_t> done{ 0 };
+	auto start = steady_clock::now();
+	for (size_t r = 0; r < roots; ++r) {
+		pool.submitTask([&pool, &done, fanout, r] {
+			for (size_t i = 0; i < fanout; ++i) {
+				pool.submitTask([&done, i, r] {
+					sink.fetch_add(spin(static_cast<unsigned>(i + r)), std::memory_order_relaxed);
+					done.fetch_add(1, std::memory_order_release);
+				});
+			}
+		});
+	}
+	while (done.load(std::memory_order_acquire) < roots * fanout)
+		std::this_thread::yield();
+	return duration_cast<duration<double>>(steady_clock::now() - start).count();
+}
+
+// enqueue `tasks` tiny tasks in one go, report enqueue cost and total time.
+void fanOut(ThreadPool& pool, size_t tasks) {
+	std::atomic<size_t> done{ 0 };
+	auto body = [&done] { done.fetch_add(1, std::memory_order_relaxed); };
+	auto wait = [&](size_t target) {
+		while (done.load(std::memory_order_relaxed) < target)
+			std::this_thread::yield();
+	};
+	auto report = [tasks](const char* name, steady_clock::time_point start,
+		steady_clock::time_point enqueued, steady_clock::time_point end) {
+		std::printf("%-22s enqueue %8.1f ns/task, total %8.1f ns/task\n", name,
+			double(duration_cast<nanoseconds>(enqueued - start).count()) / tasks,
+			double(duration_cast<nanoseconds>(end - start).count()) / tasks);
+	};
+
+	auto start = steady_clock::now();
+	std::vector<Future<void>> results;
+	results.reserve(tasks);
+	for (size_t i = 0; i < tasks; ++i)
+		results.push_back(pool.submitTask(body));
+	auto enqueued = steady_clock::now();
+	for (auto& result : results)
+		result.get();
+	report("submitTask loop", start, enqueued, steady_clock::now());
+
+	done.store(0);
+	start = steady_clock::now();
+	for (size_t i = 0; i < tasks; ++i)
+		pool.execute(body);
+	enqueued = steady_clock::now();
+	wait(tasks);
+	report("execute loop", start, enqueued, steady_clock::now());
+
+	std::vector<decltype(body)> batch(tasks, body);
+	done.store(0);
+	start = steady_clock::now();
+	auto futures = pool.submitBatch(batch);
+	enqueued = steady_clock::now();
+	for (auto& result : futures)
+		result.get();
+	report("submitBatch", start, enqueued, steady_clock::now());
+
+	done.store(0);
+	start = steady_clock::now();
+	pool.executeBatch(batch);
+	enqueued = steady_clock::now();
+	wait(tasks);
+	report("executeBatch", start, enqueued, steady_clock::now());
+}
+
+int main(int argc, char** argv) {
+	size_t tasks = argc > 1 ? std::stoul(argv[1]) : 200000;
+	size_t max_workers = static_cast<size_t>(1.5 * CpuTopology::instance().usableCpus());
+	if (max_workers == 0)
+		max_workers = 1;
+
+	std::printf("%8s %16s %10s %16s %10s\n", "workers", "flat(task/s)", "speedup", "nested(task/s)", "speedup");
+	double flat_base = 0, nested_base = 0;
+	for (size_t n = 1; n <= max_workers; n *= 2) {
+		ThreadPool pool(n);
+		// warm up so every worker slot gets launched.
+		flatSubmit(pool, tasks / 10);
+		double flat = tasks / flatSubmit(pool, tasks);
+		double nested = tasks / nestedSubmit(pool, 64, tasks / 64);
+		if (n == 1) {
+			flat_base = flat;
+			nested_base = nested;
+		}
+		std::printf("%8zu %16.0f %10.2f %16.0f %10.2f\n",
+			n, flat, flat / flat_base, nested, nested / nested_base);
+		if (n < max_workers && n * 2 > max_workers)
+			n = max_workers / 2;  // always finish with max_workers.
+	}
+
+	ThreadPoolOptions placed;
+	placed.max_threads = max_workers;
+	placed.pin_workers = true;
+	placed.local_steal = true;
+	{
+		ThreadPool pool(placed);
+		flatSubmit(pool, tasks / 10);
+		std::printf("%8s %16.0f %10s %16.0f %10s\n", "pinned", tasks / flatSubmit(pool, tasks), "",
+			tasks / nestedSubmit(pool, 64, tasks / 64), "");
+	}
+
+	std::printf("\nfan-out of %zu tiny tasks on a default pool:\n", tasks);
+	ThreadPool pool;
+	fanOut(pool, tasks);
+	return sink.load() == 42 ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+// Every queue policy x wait policy combination of BasicThreadPool on the
+// same workloads:
+// - fan-out: `producers` outside threads execute() tiny tasks as fast as
+//   they can, then wait for all of them. Stresses the external queue.
+// - ping-pong: submit one task, wait for it, repeat. Stresses the wakeup
+//   path of the wait policy.
+//
+// Build with booty/concurrency/HazardPtr.cpp for policy::LockFreeQueue.
+//
+//   usage: threadpool_policy_bench [tasks = 1000000] [producers = 2] [rounds = 20000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/ThreadPool.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+static double percentile(std::vector<double>& samples, double p) {
+	size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+static int64_t nowNs() {
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+template<class Pool>
+double fanOut(size_t tasks, size_t producers) {
+	Pool pool;
+	std::atomic<size_t> done{ 0 };
+	auto start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&pool, &done, count = tasks / producers] {
+			for (size_t i = 0; i < count; ++i)
+				pool.execute([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	size_t total = tasks / producers * producers;
+	while (done.load(std::memory_order_relaxed) != total)
+		if (!pool.tryRunTask())
+			std::this_thread::yield();
+	return duration<double>(steady_clock::now() - start).count() * 1e9 / total;
+}
+
+template<class Pool>
+void pingPong(size_t rounds, double& p50, double& p99) {
+	Pool pool;
+	std::atomic<size_t> done{ 0 };
+	std::vector<double> samples(rounds);
+	for (size_t i = 0; i < rounds; ++i) {
+		int64_t start = nowNs();
+		pool.execute([&done, i] { done.store(i + 1, std::memory_order_release); });
+		while (done.load(std::memory_order_acquire) != i + 1)
+			std::this_thread::yield();
+		samples[i] = (nowNs() - start) / 1e3;
+	}
+	p50 = percentile(samples, 0.5);
+	p99 = percentile(samples, 0.99);
+}
+
+template<class Queue, class Wait>
+void run(const char* queue, const char* wait, size_t tasks, size_t producers, size_t rounds) {
+	using Pool = BasicThreadPool<Queue, Wait>;
+	double fan = fanOut<Pool>(tasks, producers);
+	double p50, p99;
+	pingPong<Pool>(rounds, p50, p99);
+	std::printf("%-12s %-12s %10.1f ns/task %12.2f us %10.2f us\n", queue, wait, fan, p50, p99);
+}
+
+template<class Queue>
+void runWaits(const char* queue, size_t tasks, size_t producers, size_t rounds) {
+	run<Queue, policy::FutexWait>(queue, "futex", tasks, producers, rounds);
+	run<Queue, policy::CondVarWait>(queue, "condvar", tasks, producers, rounds);
+	run<Queue, policy::SpinWait>(queue, "spin", tasks, producers, rounds);
+}
+
+int main(int argc, char** argv) {
+	size_t tasks = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t producers = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 2;
+	size_t rounds = argc > 3 ? std::max<size_t>(1, std::strtoul(argv[3], nullptr, 10)) : 20000;
+
+	std::printf("fan-out: %zu tasks from %zu producers, ping-pong: %zu rounds\n", tasks, producers, rounds);
+	std::printf("%-12s %-12s %18s %15s %13s\n", "queue", "wait", "fan-out", "ping-pong p50", "p99");
+	runWaits<policy::DequeQueue>("deque", tasks, producers, rounds);
+	runWaits<policy::LockQueue>("lock queue", tasks, producers, rounds);
+	runWaits<policy::LockFreeQueue>("lock-free", tasks, producers, rounds);
+	runWaits<policy::ShardedQueue>("sharded", tasks, producers, rounds);
+	return 0;
+}
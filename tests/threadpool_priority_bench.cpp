@@ -0,0 +1,109 @@
+// Mixed workload on a saturated pool: a steady stream of bulk NORMAL/LOW
+// tasks keeps every worker busy while latency probes are submitted at
+// NORMAL, HIGH and with a near deadline. Reports enqueue-to-start latency.
+// Then deadlines at the ends of the clock's range still run.
+//
+//   usage: threadpool_priority_bench [probes = 2000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<algorithm>
+#include<cstdio>
+
+#include"../booty/ThreadPool.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+// tens of microseconds of work, a typical background job.
+static unsigned spin(unsigned seed) {
+	for (int i = 0; i < 20000; ++i)
+		seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+static std::atomic<unsigned> sink{ 0 };
+
+enum class Probe { NORMAL, HIGH, DEADLINE };
+
+static double percentile(std::vector<double>& samples, double p) {
+	size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+void measure(const char* name, Probe kind, size_t probes) {
+	ThreadPool pool;
+	const size_t backlog = pool.maxThreadCount() * 64;
+	std::atomic<bool> stop{ false };
+	std::atomic<size_t> queued{ 0 };
+
+	// keep about `backlog` bulk tasks queued, half of them LOW.
+	std::thread feeder([&] {
+		unsigned i = 0;
+		while (!stop.load(std::memory_order_relaxed)) {
+			if (queued.load(std::memory_order_relaxed) >= backlog) {
+				std::this_thread::yield();
+				continue;
+			}
+			queued.fetch_add(1, std::memory_order_relaxed);
+			pool.execute(++i % 2 ? Priority::LOW : Priority::NORMAL, [&queued, i] {
+				sink.fetch_add(spin(i), std::memory_order_relaxed);
+				queued.fetch_sub(1, std::memory_order_relaxed);
+			});
+		}
+	});
+	while (queued.load() < backlog)
+		std::this_thread::yield();
+
+	std::vector<double> latencies(probes);
+	for (size_t i = 0; i < probes; ++i) {
+		auto submitted = steady_clock::now();
+		auto probe = [submitted] {
+			return duration_cast<duration<double, std::micro>>(steady_clock::now() - submitted).count();
+		};
+		Future<double> result;
+		switch (kind) {
+		case Probe::NORMAL:
+			result = pool.submitTask(probe);
+			break;
+		case Probe::HIGH:
+			result = pool.submitTask(Priority::HIGH, probe);
+			break;
+		case Probe::DEADLINE:
+			result = pool.submitTask(submitted + milliseconds(1), probe);
+			break;
+		}
+		latencies[i] = result.get();
+	}
+	stop.store(true);
+	feeder.join();
+
+	double p50 = percentile(latencies, 0.50);
+	double p99 = percentile(latencies, 0.99);
+	double max = *std::max_element(latencies.begin(), latencies.end());
+	std::printf("%-10s p50 %10.1f us   p99 %10.1f us   max %10.1f us\n", name, p50, p99, max);
+}
+
+// time_point::max() is the latest deadline there is, not "no task".
+bool extremeDeadlines() {
+	ThreadPool pool;
+	auto latest = pool.submitTask(steady_clock::time_point::max(), [] { return 1; });
+	auto earliest = pool.submitTask(steady_clock::time_point::min(), [] { return 2; });
+	bool ok = latest.wait_for(seconds(5)) == std::future_status::ready && latest.get() == 1 &&
+		earliest.wait_for(seconds(5)) == std::future_status::ready && earliest.get() == 2;
+	std::printf("deadlines time_point::max() and min() run: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	size_t probes = argc > 1 ? std::stoul(argv[1]) : 2000;
+	std::printf("%zu probes behind a saturated pool:\n", probes);
+	measure("NORMAL", Probe::NORMAL, probes);
+	measure("HIGH", Probe::HIGH, probes);
+	measure("DEADLINE", Probe::DEADLINE, probes);
+	bool ok = extremeDeadlines();
+	return !ok || sink.load() == 42 ? 1 : 0;
+}
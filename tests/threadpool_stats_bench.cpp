@@ -0,0 +1,76 @@
+// Prints ThreadPool statistics for a mixed workload and the per-task cost
+// of collecting them. Build it twice to see the overhead:
+//
+//   g++ -O2 -std=c++17 -pthread threadpool_stats_bench.cpp ../booty/base/Topology.cpp ../booty/sync/Futex.cpp
+//   g++ -O2 -std=c++17 -pthread -DBOOTY_THREADPOOL_STATS=1 threadpool_stats_bench.cpp ../booty/base/Topology.cpp ../booty/sync/Futex.cpp
+//
+//   usage: threadpool_stats_bench [tasks = 1000000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<cstdio>
+
+#include"../booty/ThreadPool.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+static std::atomic<unsigned> sink{ 0 };
+
+static unsigned spin(unsigned seed, int rounds) {
+	for (int i = 0; i < rounds; ++i)
+		seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+// empty tasks from a batch, so the per-task cost is mostly pool overhead.
+double emptyTasks(ThreadPool& pool, size_t tasks) {
+	std::atomic<size_t> done{ 0 };
+	auto body = [&done] { done.fetch_add(1, std::memory_order_release); };
+	std::vector<decltype(body)> batch(tasks, body);
+	auto start = steady_clock::now();
+	pool.executeBatch(batch);
+	while (done.load(std::memory_order_acquire) < tasks)
+		pool.tryRunTask() || (std::this_thread::yield(), true);
+	return double(duration_cast<nanoseconds>(steady_clock::now() - start).count()) / tasks;
+}
+
+// short and long tasks mixed, some spawning children.
+void mixed(ThreadPool& pool, size_t tasks) {
+	std::vector<Future<void>> results;
+	results.reserve(tasks);
+	for (size_t i = 0; i < tasks; ++i) {
+		int rounds = i % 100 == 0 ? 100000 : 500;
+		results.push_back(pool.submitTask([&pool, i, rounds] {
+			sink.fetch_add(spin(static_cast<unsigned>(i), rounds), std::memory_order_relaxed);
+			if (i % 10 == 0)
+				pool.execute([i] { sink.fetch_add(spin(static_cast<unsigned>(i), 500), std::memory_order_relaxed); });
+		}));
+	}
+	for (auto& result : results)
+		result.get();
+}
+
+int main(int argc, char** argv) {
+	size_t tasks = argc > 1 ? std::stoul(argv[1]) : 1000000;
+	ThreadPool pool;
+	emptyTasks(pool, tasks / 10);  // warm up
+	double best = 1e300;
+	for (int i = 0; i < 5; ++i)
+		best = std::min(best, emptyTasks(pool, tasks));
+	std::printf("statistics %s: %.1f ns per empty task (best of 5)\n",
+		BOOTY_THREADPOOL_STATS ? "on" : "off", best);
+
+	mixed(pool, tasks / 100);
+	std::printf("%s\n", pool.stats().String().c_str());
+
+	// a skewed TSC makes end < start, the largest values go to the last bucket.
+	bool ok = detail::cyclesBetween(100, 40) == 0 &&
+		detail::log2Bucket(~uint64_t(0)) == Histogram::kBuckets - 1 &&
+		detail::log2Bucket(uint64_t(1) << 63) == Histogram::kBuckets - 1 &&
+		detail::log2Bucket((uint64_t(1) << 62) + 1) == 63 && detail::log2Bucket(1) == 1;
+	std::printf("histogram bucket bounds: %s\n", ok ? "ok" : "FAILED");
+	return !ok || sink.load() == 42 ? 1 : 0;
+}
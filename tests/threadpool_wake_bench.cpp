@@ -0,0 +1,97 @@
+// Wakeup costs of ThreadPool, with idle workers spinning first (default)
+// and with spinning disabled, i.e. parking right away:
+// - ping-pong: submit one task, wait for it, repeat. Workers never get
+//   to park, this is the latency of a pool kept warm by its submitter.
+// - idle submit: the pool sits idle long enough for every worker to
+//   park, then one task is submitted. Reports what execute() costs the
+//   submitter and how long the task waits for a worker to wake up.
+//
+//   usage: threadpool_wake_bench [rounds = 20000]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+
+#include"../booty/ThreadPool.hpp"
+
+using namespace booty;
+using namespace std::chrono;
+
+static double percentile(std::vector<double>& samples, double p) {
+	size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+static void print(const char* name, std::vector<double>& samples) {
+	std::printf("%-28s p50 %8.2f us   p99 %8.2f us   max %9.2f us\n", name,
+		percentile(samples, 0.5), percentile(samples, 0.99), percentile(samples, 1.0));
+}
+
+static int64_t nowNs() {
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// the submitter waits without a syscall of its own, yielding so that a
+// single cpu still gets to run the worker.
+static void waitFor(const std::atomic<size_t>& done, size_t value) {
+	while (done.load(std::memory_order_acquire) != value)
+		std::this_thread::yield();
+}
+
+void pingPong(const char* name, const ThreadPoolOptions& options, size_t rounds) {
+	ThreadPool pool(options);
+	std::atomic<size_t> done{ 0 };
+	std::vector<double> samples(rounds);
+	for (size_t i = 0; i < rounds; ++i) {
+		int64_t start = nowNs();
+		pool.execute([&done, i] { done.store(i + 1, std::memory_order_release); });
+		waitFor(done, i + 1);
+		samples[i] = (nowNs() - start) / 1e3;
+	}
+	print(name, samples);
+}
+
+void idleSubmit(const char* name, const ThreadPoolOptions& options, size_t rounds) {
+	ThreadPool pool(options);
+	std::atomic<size_t> done{ 0 };
+	std::atomic<int64_t> started{ 0 };
+	std::vector<double> submit(rounds), wake(rounds);
+	for (size_t i = 0; i < rounds; ++i) {
+		// well past the spin phase, every worker is parked.
+		std::this_thread::sleep_for(microseconds(200));
+		int64_t start = nowNs();
+		pool.execute([&done, &started, i] {
+			started.store(nowNs(), std::memory_order_relaxed);
+			done.store(i + 1, std::memory_order_release);
+		});
+		submit[i] = (nowNs() - start) / 1e3;
+		waitFor(done, i + 1);
+		wake[i] = (started.load(std::memory_order_relaxed) - start) / 1e3;
+	}
+	std::printf("%s\n", name);
+	print("  execute() on idle pool", submit);
+	print("  submit to task start", wake);
+}
+
+int main(int argc, char** argv) {
+	size_t rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+
+	ThreadPoolOptions spinning;
+	ThreadPoolOptions parking;
+	parking.spin.setSpinMax(nanoseconds::zero());
+
+	std::printf("ping-pong, %zu rounds, one task in flight:\n", rounds);
+	pingPong("spin then park", spinning, rounds);
+	pingPong("park only", parking, rounds);
+
+	size_t idle_rounds = std::max<size_t>(1, rounds / 10);
+	std::printf("\nsubmit to a parked pool, %zu rounds:\n", idle_rounds);
+	idleSubmit("spin then park", spinning, idle_rounds);
+	idleSubmit("park only", parking, idle_rounds);
+	return 0;
+}
@@ -0,0 +1,202 @@
+// UnboundedQueue variants (SPSC, MPSC, SPMC, MPMC, spinning and blocking
+// consumers) against UnboundedLockQueue. Every item carries its producer
+// and sequence number; consumers check that each producer's items reach
+// them in order, and that no item is lost or duplicated. Then the steady
+// state: with a bounded number of items in flight, the segments are
+// recycled and neither side allocates.
+//
+//   usage: unbounded_queue_bench [items per producer = 1000000] [threads per side = 4]
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<atomic>
+#include<thread>
+#include<string>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+#include<new>
+
+#include"../booty/concurrency/UnboundedQueue.hpp"
+#include"../booty/concurrency/UnboundedLockQueue.hpp"
+
+using namespace booty::concurrency;
+using namespace std::chrono;
+
+static bool failed = false;
+
+// count every global allocation made by the process.
+static std::atomic<size_t> g_allocs{ 0 };
+
+void* operator new(std::size_t size) {
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	size_t alignment = std::max(static_cast<size_t>(align), sizeof(void*));
+	if (void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+template<class Queue>
+void run(const char* name, size_t producers, size_t consumers, size_t per_producer) {
+	Queue queue;
+	const size_t total = producers * per_producer;
+	std::atomic<size_t> taken{ 0 };
+	std::atomic<uint64_t> sum{ 0 };
+	std::atomic<size_t> reordered{ 0 };
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < consumers; ++c) {
+		threads.emplace_back([&, c] {
+			// an even share, the first consumer takes the remainder.
+			size_t count = total / consumers + (c == 0 ? total % consumers : 0);
+			std::vector<uint64_t> last(producers, 0);
+			uint64_t local = 0;
+			size_t bad = 0;
+			for (size_t i = 0; i < count; ++i) {
+				uint64_t item;
+				queue.dequeue(item);
+				uint64_t producer = item >> 32, seq = item & 0xffffffffu;
+				if (seq <= last[producer])
+					++bad;
+				last[producer] = seq;
+				local += seq;
+			}
+			taken.fetch_add(count);
+			sum.fetch_add(local);
+			reordered.fetch_add(bad);
+		});
+	}
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&, p] {
+			for (uint64_t seq = 1; seq <= per_producer; ++seq)
+				queue.enqueue((uint64_t(p) << 32) | seq);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+
+	uint64_t expected = producers * (uint64_t(per_producer) * (per_producer + 1) / 2);
+	bool ok = taken.load() == total && sum.load() == expected && reordered.load() == 0 && queue.empty();
+	failed = failed || !ok;
+	std::printf("%-28s %zup/%zuc %8.1f ns/item %12.0f items/s  %s\n", name, producers, consumers,
+		seconds * 1e9 / total, total / seconds, ok ? "ok" : "FAILED");
+}
+
+template<class Queue>
+void runAll(const char* name, size_t threads, size_t per_producer, bool sp, bool sc) {
+	run<Queue>(name, sp ? 1 : threads, sc ? 1 : threads, sp ? per_producer * threads : per_producer);
+}
+
+// the interface run() expects, on top of UnboundedLockQueue.
+struct LockQueue :UnboundedLockQueue<uint64_t> {};
+
+// producers keep at most `in_flight` items in the queue, consumers take
+// them. The allocations are counted over the second half of the run, once
+// threads, hazard pointers and segments are warmed up.
+template<class Queue>
+void steadyState(const char* name, size_t producers, size_t consumers, size_t per_producer, size_t in_flight) {
+	Queue queue;
+	const size_t total = producers * per_producer;
+	std::atomic<size_t> produced{ 0 };
+	std::atomic<size_t> allocs_before{ 0 };
+	std::atomic<bool> counting{ false };
+	std::vector<std::thread> threads;
+	auto start = steady_clock::now();
+	for (size_t c = 0; c < consumers; ++c) {
+		threads.emplace_back([&, c] {
+			size_t count = total / consumers + (c == 0 ? total % consumers : 0);
+			for (size_t i = 0; i < count; ++i) {
+				uint64_t item;
+				queue.dequeue(item);
+			}
+		});
+	}
+	for (size_t p = 0; p < producers; ++p) {
+		threads.emplace_back([&] {
+			for (size_t i = 0; i < per_producer; ++i) {
+				while (queue.size() >= in_flight)
+					std::this_thread::yield();
+				if (produced.fetch_add(1, std::memory_order_relaxed) == total / 2) {
+					allocs_before.store(g_allocs.load());
+					counting.store(true);
+				}
+				queue.enqueue(i);
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = duration<double>(steady_clock::now() - start).count();
+	size_t allocs = g_allocs.load() - allocs_before.load();
+
+	bool ok = counting.load() && allocs == 0 && queue.empty();
+	failed = failed || !ok;
+	std::printf("%-28s %zup/%zuc %8.1f ns/item %6zu allocations in the 2nd half  %s\n", name, producers, consumers,
+		seconds * 1e9 / total, allocs, ok ? "ok" : "FAILED");
+}
+
+void timedAndLeftovers() {
+	UMPMCQueue<std::string, true> queue;
+	uint64_t item;
+	(void)item;
+	std::string text;
+	auto start = steady_clock::now();
+	bool got = queue.try_dequeue_for(text, milliseconds(20));
+	double waited = duration<double, std::milli>(steady_clock::now() - start).count();
+	std::printf("try_dequeue_for(20ms) on an empty queue: %s after %.1f ms\n", got ? "GOT AN ITEM" : "timed out", waited);
+	failed = failed || got || waited < 19;
+
+	for (int i = 0; i < 1000; ++i)
+		queue.enqueue(std::string(64, 'x') + std::to_string(i));
+	auto first = queue.try_dequeue();
+	std::printf("try_dequeue() after 1000 enqueues: %s, size %zu\n",
+		first && *first == std::string(64, 'x') + "0" ? "first item" : "WRONG ITEM", queue.size());
+	failed = failed || !first || queue.size() != 999;
+	// the remaining items are destroyed with the queue.
+}
+
+int main(int argc, char** argv) {
+	size_t per_producer = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t threads = argc > 2 ? std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10)) : 4;
+
+	runAll<USPSCQueue<uint64_t, false>>("USPSCQueue spin", threads, per_producer, true, true);
+	runAll<USPSCQueue<uint64_t, true>>("USPSCQueue block", threads, per_producer, true, true);
+	runAll<UMPSCQueue<uint64_t, false>>("UMPSCQueue spin", threads, per_producer, false, true);
+	runAll<UMPSCQueue<uint64_t, true>>("UMPSCQueue block", threads, per_producer, false, true);
+	runAll<USPMCQueue<uint64_t, false>>("USPMCQueue spin", threads, per_producer, true, false);
+	runAll<USPMCQueue<uint64_t, true>>("USPMCQueue block", threads, per_producer, true, false);
+	runAll<UMPMCQueue<uint64_t, false>>("UMPMCQueue spin", threads, per_producer, false, false);
+	runAll<UMPMCQueue<uint64_t, true>>("UMPMCQueue block", threads, per_producer, false, false);
+	runAll<LockQueue>("UnboundedLockQueue", threads, per_producer, false, false);
+	steadyState<USPSCQueue<uint64_t, false>>("USPSCQueue steady", 1, 1, per_producer * threads, 1024);
+	steadyState<UMPSCQueue<uint64_t, true>>("UMPSCQueue steady", threads, 1, per_producer, 1024);
+	steadyState<UMPMCQueue<uint64_t, false>>("UMPMCQueue steady", threads, threads, per_producer, 1024);
+	steadyState<UMPMCQueue<uint64_t, true>>("UMPMCQueue block steady", threads, threads, per_producer, 1024);
+	timedAndLeftovers();
+	return failed ? 1 : 0;
+}